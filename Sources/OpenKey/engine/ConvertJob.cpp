@@ -0,0 +1,87 @@
+//
+//  ConvertJob.cpp
+//  OpenKey
+//
+//  Conversion of big documents on a worker thread.
+//
+
+#include "ConvertJob.h"
+#include <algorithm>
+#include <system_error>
+#include <thread>
+
+shared_ptr<vConvertJob> createConvertJob() {
+    shared_ptr<vConvertJob> job = make_shared<vConvertJob>();
+    beginConvert(job->options);
+    return job;
+}
+
+void addConvertJobDocument(vConvertJob& job, string input, const int& format) {
+    job.documents.push_back(vConvertJobDocument());
+    vConvertJobDocument& document = job.documents.back();
+    document.format = format;
+    document.input.swap(input);
+    if (format == CONVERT_JOB_TEXT) {
+        document.state = job.options;
+    } else {
+        beginMarkupConvert(document.markupState, (Uint8)format);
+        document.markupState.text = job.options;
+    }
+    job.total += document.input.size();
+}
+
+static void runConvertJob(shared_ptr<vConvertJob> job) {
+    vConvertJob& _job = *job;
+    string converted;
+    size_t i, size;
+    bool last;
+    if (_job.load && !_job.cancelled)
+        _job.load(_job, _job.context);
+    for (vConvertJobDocument& document : _job.documents) {
+        const char* data = document.input.data();
+        document.output.reserve(document.input.size());
+        i = 0;
+        do {
+            if (_job.cancelled)
+                break;
+            size = min((size_t)CONVERT_JOB_CHUNK_SIZE, document.input.size() - i);
+            last = i + size == document.input.size();
+            if (document.format == CONVERT_JOB_TEXT)
+                convertChunk(document.state, data + i, size, converted, last);
+            else
+                convertMarkupChunk(document.markupState, data + i, size, converted, last);
+            document.output += converted;
+            i += size;
+            _job.processed += size;
+            if (_job.progress)
+                _job.progress(_job, _job.processed, _job.total, _job.context);
+        } while (!last);
+        if (_job.cancelled)
+            break;
+        if (document.format == vMarkupClipboardHtml && !document.output.empty())
+            updateMarkupHeader(document.markupState, &document.output[0], document.output.size());
+        string().swap(document.input);
+    }
+    _job.status = _job.cancelled ? vConvertJobCancelled : vConvertJobCompleted;
+    if (_job.completion)
+        _job.completion(_job, _job.context);
+}
+
+void startConvertJob(const shared_ptr<vConvertJob>& job, vConvertJobLoad load, vConvertJobProgress progress, vConvertJobCompletion completion, void* context) {
+    job->load = load;
+    job->progress = progress;
+    job->completion = completion;
+    job->context = context;
+    job->status = vConvertJobRunning;
+    try {
+        thread(runConvertJob, job).detach();
+    } catch (const system_error&) { //can't create thread: don't convert on the calling thread (the keyboard hook)
+        job->status = vConvertJobFailed;
+        if (job->completion)
+            job->completion(*job, job->context);
+    }
+}
+
+void cancelConvertJob(vConvertJob& job) {
+    job.cancelled = true;
+}
@@ -0,0 +1,89 @@
+//
+//  ConvertJob.h
+//  OpenKey
+//
+//  Conversion of big documents (quick convert of the clipboard) on a worker thread,
+//  so the thread of the keyboard hook never waits for it.
+//
+
+#ifndef ConvertJob_h
+#define ConvertJob_h
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ConvertTool.h"
+#include "MarkupConvert.h"
+
+using namespace std;
+
+#define CONVERT_JOB_CHUNK_SIZE  262144 //bytes converted between checks of cancel and progress callbacks
+#define CONVERT_JOB_TEXT        -1 //format of a plain UTF-8 text document
+
+enum vConvertJobStatus {
+    vConvertJobWaiting = 0,
+    vConvertJobRunning,
+    vConvertJobCompleted,
+    vConvertJobCancelled,
+    vConvertJobFailed //the worker thread can't be created, nothing is converted
+};
+
+struct vConvertJob;
+
+/**
+ * Callbacks are called on the worker thread. @load adds documents which are slow to read
+ * (a big clipboard), so the calling thread doesn't copy them
+ */
+typedef void (*vConvertJobLoad)(vConvertJob& job, void* context);
+typedef void (*vConvertJobProgress)(vConvertJob& job, const size_t& processed, const size_t& total, void* context);
+typedef void (*vConvertJobCompletion)(vConvertJob& job, void* context);
+
+struct vConvertJobDocument {
+    int format = CONVERT_JOB_TEXT; //or vMarkupFormat
+    string input; //released when the document is converted
+    string output;
+    vConvertState state; //starts with options of the job
+    vMarkupConvertState markupState;
+};
+
+struct vConvertJob {
+    vConvertState options; //convertTool options when the job is created
+    vector<vConvertJobDocument> documents; //only changed by @load after startConvertJob()
+    size_t total = 0; //input bytes of all documents
+    atomic<size_t> processed;
+    atomic<int> status;
+    atomic<bool> cancelled;
+    vConvertJobLoad load = NULL;
+    vConvertJobProgress progress = NULL;
+    vConvertJobCompletion completion = NULL;
+    void* context = NULL;
+
+    vConvertJob() : processed(0), status(vConvertJobWaiting), cancelled(false) {}
+};
+
+/**
+ * A job with current convertTool options, they don't change while documents are added
+ */
+shared_ptr<vConvertJob> createConvertJob();
+
+/**
+ * @input is moved to the job (std::move a big clipboard, it isn't copied again)
+ */
+void addConvertJobDocument(vConvertJob& job, string input, const int& format);
+
+/**
+ * Call @load (can be NULL) then convert all documents on a worker thread, it returns at once.
+ * The worker keeps the job alive until @completion returns, outputs are valid when status is
+ * vConvertJobCompleted. If the worker can't be created, @completion is called at once on the
+ * calling thread with vConvertJobFailed
+ */
+void startConvertJob(const shared_ptr<vConvertJob>& job, vConvertJobLoad load, vConvertJobProgress progress, vConvertJobCompletion completion, void* context);
+
+/**
+ * Stop at the next chunk, it never waits for the worker; @completion is still called
+ * with vConvertJobCancelled
+ */
+void cancelConvertJob(vConvertJob& job);
+
+#endif /* ConvertJob_h */
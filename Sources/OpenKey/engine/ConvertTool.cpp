@@ -6,11 +6,27 @@
 //  Copyright © 2019 Tuyen Mai. All rights reserved.
 //
 #include <locale>
-#include <codecvt>
 #include "ConvertTool.h"
 #include "Engine.h"
 #include <iostream>
 #include <memory.h>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+
+#if defined(__AVX2__)
+#define CONVERT_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CONVERT_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CONVERT_NEON
+#include <arm_neon.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 //option
 bool convertToolDontAlertWhenCompleted = false;
@@ -25,18 +41,30 @@ int convertToolHotKey = 0;
 
 static vector<Uint8> _breakCode = {'.', '?', '!'};
 
-static bool findKeyCode(const Uint32& charCode, const Uint8& code, int& j, int& k) {
-    //find character which has tone/mark
-    for (map<Uint32, vector<Uint16>>::iterator it = _codeTable[code].begin(); it != _codeTable[code].end(); ++it) {
-        for (int z = 0; z < it->second.size(); z++) {
-            if (charCode == it->second[z]) {
-                j = it->first;
-                k = z;
-                return true;
-            }//end if
-        }
-    }
-    return false;
+#define PARALLEL_MIN_PART_SIZE 262144 //bytes of the smallest part of a parallel conversion
+#define DETECT_SAMPLE_COUNT 16 //detectConvertCode() checks some samples of a big text
+#define DETECT_SAMPLE_SIZE 2048
+#define DETECT_UNIT_COUNT 0x2000 //units of all Vietnamese characters are lower than this
+
+//bits of vDetectUnitMask, with (1 << code) if the unit is a character of table code
+#define DETECT_VNI_HIGH 0x20 //high unit of a VNI pair
+#define DETECT_1258_HIGH 0x40 //high unit of a CP1258 pair
+#define DETECT_COMPOUND_MARK 0x80 //mark of Unicode Compound
+
+static inline bool findKeyCode(const Uint32& charCode, const Uint8& code, int& j, int& k) {
+    //find character which has tone/mark, j is the row in _codeTable
+    return charCode <= 0xFFFF && findCodeTableCharacter((Uint16)charCode, code, j, k);
+}
+
+/**
+ * Case of @character of table @code: getCharacterCase for ASCII and table characters, towupper/towlower
+ * for other letters when @code is Unicode (the units of other tables are bytes of their own encoding)
+ */
+static inline Uint16 getConvertCase(const Uint16& character, const Uint8& code, const bool& upperCase) {
+    const Uint16 result = getCharacterCase(character, code, upperCase);
+    if (result != character || character < 0x80 || (code != 0 && code != 3))
+        return result;
+    return (Uint16)(upperCase ? towupper(character) : towlower(character));
 }
 
 static Uint16 getUnicodeCompoundMarkIndex(const Uint16& mark) {
@@ -48,23 +76,181 @@ static Uint16 getUnicodeCompoundMarkIndex(const Uint16& mark) {
     return 0;
 }
 
-string convertUtil(const string& sourceString) {
-    wstring data = utf8ToWideString(sourceString);
+/**
+ * ASCII characters (except NUL, new line and sentence breaks) are normal characters of
+ * table @fromCode, and 2 of them are never one character (VNI, CP1258). True for all tables,
+ * it's checked in case a table is changed
+ */
+static bool canUseAsciiFastPath(const Uint8& fromCode) {
+    for (int j = 0; j < CODE_TABLE_ROW_COUNT; j++) {
+        for (int k = 0; k < _codeTableRowSize[j]; k++) {
+            const Uint16 character = _codeTable[fromCode][j][k];
+            if (character == 0)
+                continue;
+            if (character < 0x80)
+                return false;
+            if ((fromCode == 2 || fromCode == 4) && (character & 0xFF) < 0x80 && (character >> 8) < 0x80)
+                return false;
+        }
+    }
+    return true;
+}
+
+void beginConvert(vConvertState& state) {
+    state.fromCode = convertToolFromCode;
+    state.toCode = convertToolToCode;
+    state.toAllCaps = convertToolToAllCaps;
+    state.toAllNonCaps = convertToolToAllNonCaps;
+    state.toCapsFirstLetter = convertToolToCapsFirstLetter;
+    state.toCapsEachWord = convertToolToCapsEachWord;
+    state.removeMark = convertToolRemoveMark;
+    state.asciiFastPath = canUseAsciiFastPath(state.fromCode);
+    state.hasBreak = false;
+    state.shouldUpperCase = false;
+    if (state.toCapsFirstLetter || state.toCapsEachWord)
+        state.shouldUpperCase = true;
+    if (state.toAllNonCaps)
+        state.shouldUpperCase = false;
+    state.hasPendingUnit = false;
+    state.decoder = vUtf8Decoder();
+    state.encoder = vUtf16Encoder();
+}
+
+static inline int countTrailingZeros(const Uint32& mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static inline bool isAsciiRunUnit(const Uint16& unit, const bool& allowSpace) {
+    return unit > 0 && unit < 0x80 && unit != '\n' && unit != '.' && unit != '?' && unit != '!' && (allowSpace || unit != ' ');
+}
+
+/**
+ * Length of the ASCII run at @data: units which only need case mapping,
+ * vectors of units are checked at once
+ */
+static size_t findAsciiRun(const Uint16* data, const size_t& size, const bool& allowSpace) {
+    size_t i = 0;
+    const Uint16 space = allowSpace ? 0 : ' '; //NUL is never in a run, so it disables the space check
+#if defined(CONVERT_AVX2)
+    const __m256i high = _mm256_set1_epi16((short)0xFF80), zero = _mm256_setzero_si256();
+    const __m256i newLine = _mm256_set1_epi16('\n'), dot = _mm256_set1_epi16('.');
+    const __m256i question = _mm256_set1_epi16('?'), exclamation = _mm256_set1_epi16('!');
+    const __m256i spaceUnit = _mm256_set1_epi16((short)space);
+    for (; i + 16 <= size; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i stop = _mm256_or_si256(_mm256_cmpeq_epi16(v, zero), _mm256_xor_si256(_mm256_cmpeq_epi16(_mm256_and_si256(v, high), zero), _mm256_set1_epi16(-1)));
+        stop = _mm256_or_si256(stop, _mm256_or_si256(_mm256_cmpeq_epi16(v, newLine), _mm256_cmpeq_epi16(v, dot)));
+        stop = _mm256_or_si256(stop, _mm256_or_si256(_mm256_cmpeq_epi16(v, question), _mm256_cmpeq_epi16(v, exclamation)));
+        stop = _mm256_or_si256(stop, _mm256_cmpeq_epi16(v, spaceUnit));
+        Uint32 mask = (Uint32)_mm256_movemask_epi8(stop);
+        if (mask != 0)
+            return i + countTrailingZeros(mask) / 2;
+    }
+#elif defined(CONVERT_SSE2)
+    const __m128i high = _mm_set1_epi16((short)0xFF80), zero = _mm_setzero_si128();
+    const __m128i newLine = _mm_set1_epi16('\n'), dot = _mm_set1_epi16('.');
+    const __m128i question = _mm_set1_epi16('?'), exclamation = _mm_set1_epi16('!');
+    const __m128i spaceUnit = _mm_set1_epi16((short)space);
+    for (; i + 8 <= size; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i stop = _mm_or_si128(_mm_cmpeq_epi16(v, zero), _mm_xor_si128(_mm_cmpeq_epi16(_mm_and_si128(v, high), zero), _mm_set1_epi16(-1)));
+        stop = _mm_or_si128(stop, _mm_or_si128(_mm_cmpeq_epi16(v, newLine), _mm_cmpeq_epi16(v, dot)));
+        stop = _mm_or_si128(stop, _mm_or_si128(_mm_cmpeq_epi16(v, question), _mm_cmpeq_epi16(v, exclamation)));
+        stop = _mm_or_si128(stop, _mm_cmpeq_epi16(v, spaceUnit));
+        Uint32 mask = (Uint32)_mm_movemask_epi8(stop);
+        if (mask != 0)
+            return i + countTrailingZeros(mask) / 2;
+    }
+#elif defined(CONVERT_NEON)
+    const uint16x8_t high = vdupq_n_u16(0xFF80), zero = vdupq_n_u16(0);
+    for (; i + 8 <= size; i += 8) {
+        uint16x8_t v = vld1q_u16(data + i);
+        uint16x8_t stop = vorrq_u16(vceqq_u16(v, zero), vmvnq_u16(vceqq_u16(vandq_u16(v, high), zero)));
+        stop = vorrq_u16(stop, vorrq_u16(vceqq_u16(v, vdupq_n_u16('\n')), vceqq_u16(v, vdupq_n_u16('.'))));
+        stop = vorrq_u16(stop, vorrq_u16(vceqq_u16(v, vdupq_n_u16('?')), vceqq_u16(v, vdupq_n_u16('!'))));
+        stop = vorrq_u16(stop, vceqq_u16(v, vdupq_n_u16(space)));
+        if (vmaxvq_u16(stop) != 0)
+            break; //the scalar loop finds the unit
+    }
+#endif
+    for (; i < size && isAsciiRunUnit(data[i], allowSpace); i++);
+    return i;
+}
+
+/**
+ * Copy ASCII @data to @out with case mapping, like getConvertCase
+ */
+static void mapAsciiCase(const Uint16* data, const size_t& size, Uint16* out, const bool& toUpper) {
+    size_t i = 0;
+    const Uint16 first = toUpper ? 'a' : 'A', last = toUpper ? 'z' : 'Z';
+#if defined(CONVERT_AVX2)
+    const __m256i below = _mm256_set1_epi16((short)(first - 1)), above = _mm256_set1_epi16((short)(last + 1));
+    const __m256i delta = _mm256_set1_epi16(toUpper ? -0x20 : 0x20);
+    for (; i + 16 <= size; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi16(v, below), _mm256_cmpgt_epi16(above, v));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi16(v, _mm256_and_si256(letter, delta)));
+    }
+#elif defined(CONVERT_SSE2)
+    const __m128i below = _mm_set1_epi16((short)(first - 1)), above = _mm_set1_epi16((short)(last + 1));
+    const __m128i delta = _mm_set1_epi16(toUpper ? -0x20 : 0x20);
+    for (; i + 8 <= size; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i letter = _mm_and_si128(_mm_cmpgt_epi16(v, below), _mm_cmplt_epi16(v, above));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi16(v, _mm_and_si128(letter, delta)));
+    }
+#elif defined(CONVERT_NEON)
+    const uint16x8_t below = vdupq_n_u16(first), above = vdupq_n_u16(last);
+    const uint16x8_t delta = vdupq_n_u16(toUpper ? (Uint16)-0x20 : 0x20);
+    for (; i + 8 <= size; i += 8) {
+        uint16x8_t v = vld1q_u16(data + i);
+        uint16x8_t letter = vandq_u16(vcgeq_u16(v, below), vcleq_u16(v, above));
+        vst1q_u16(out + i, vaddq_u16(v, vandq_u16(letter, delta)));
+    }
+#endif
+    for (; i < size; i++)
+        out[i] = data[i] >= first && data[i] <= last ? (Uint16)(toUpper ? data[i] - 0x20 : data[i] + 0x20) : data[i];
+}
+
+/**
+ * Convert @data to @_temp, the last unit is kept for the next chunk if it isn't @last,
+ * because a character of VNI, CP1258 and Unicode Compound can be 2 units.
+ * Return the number of converted units
+ */
+static size_t convertUnits(vConvertState& state, const Uint16* data, const size_t& size, const bool& last, vector<Uint16>& _temp) {
     Uint16 t = 0, target;
     int j, k, p;
-    vector<wchar_t> _temp;
-    bool hasBreak = false;
-    bool shouldUpperCase = false;
-    if (convertToolToCapsFirstLetter || convertToolToCapsEachWord)
-        shouldUpperCase = true;
-    if (convertToolToAllNonCaps)
-        shouldUpperCase = false;
-    
-    for (int i = 0; i < data.size(); i++) {
+    size_t i;
+    const bool allowSpace = !state.toCapsEachWord;
+    size_t run;
+    for (i = 0; i < size; i++) {
+        if (i == size - 1 && !last)
+            break;
+        
+        //fast path: a run of ASCII normal characters is only case mapped, they don't change the caps state
+        //if it's already false. The last unit of a run is checked normally, it can start a 2 units character
+        if (state.asciiFastPath && !state.shouldUpperCase && !state.hasBreak && data[i] < 0x80) {
+            run = findAsciiRun(data + i, size - i, allowSpace);
+            if (run > 1) {
+                run--;
+                const size_t outputSize = _temp.size();
+                _temp.resize(outputSize + run);
+                mapAsciiCase(data + i, run, _temp.data() + outputSize, state.toAllCaps);
+                i += run - 1;
+                continue;
+            }
+        }
+        
         p = 0;
         //find char with tone/mark
-        if (i < data.size() - 1) {
-            switch (convertToolFromCode) {
+        if (i < size - 1) {
+            switch (state.fromCode) {
                 case 2: //VNI
                 case 4: //1258
                     t = (Uint16)data[i] | (data[i+1] << 8);
@@ -85,35 +271,35 @@ string convertUtil(const string& sourceString) {
                     break;
             }
             
-            if (findKeyCode(t, convertToolFromCode, j, k)) {
+            if (findKeyCode(t, state.fromCode, j, k)) {
                 i += p;
-                target = _codeTable[convertToolToCode][j][k];
-                if ((convertToolToAllCaps || shouldUpperCase) && k % 2 != 0) {
-                    target = _codeTable[convertToolToCode][j][k-1];
-                } else if ((convertToolToAllNonCaps || !shouldUpperCase) && k % 2 == 0) {
-                    target = _codeTable[convertToolToCode][j][k+1];
+                target = _codeTable[state.toCode][j][k];
+                if ((state.toAllCaps || state.shouldUpperCase) && k % 2 != 0) {
+                    target = _codeTable[state.toCode][j][k-1];
+                } else if ((state.toAllNonCaps || !state.shouldUpperCase) && k % 2 == 0) {
+                    target = _codeTable[state.toCode][j][k+1];
                 }
                 
                 //remove mark/tone
-                if (convertToolRemoveMark) {
-                    target = keyCodeToCharacter((Uint8)j);
-                    if (convertToolToAllCaps) {
-                        target = towupper(target);
-                    } else if (convertToolToAllNonCaps) {
-                        target = towlower(target);
+                if (state.removeMark) {
+                    target = keyCodeToCharacter((Uint8)_codeTableKey[j]);
+                    if (state.toAllCaps) {
+                        target = getConvertCase(target, state.toCode, true);
+                    } else if (state.toAllNonCaps) {
+                        target = getConvertCase(target, state.toCode, false);
                     }
                 }
                 
-                if (convertToolToCode == 0 || convertToolToCode == 1) { //Unicode
+                if (state.toCode == 0 || state.toCode == 1) { //Unicode
                     _temp.push_back(target);
-                } else if (convertToolToCode == 2 || convertToolToCode == 4) { //VNI, VN Locale 1258
+                } else if (state.toCode == 2 || state.toCode == 4) { //VNI, VN Locale 1258
                     if (HIBYTE(target) > 32) {
                         _temp.push_back((Uint8)target);
                         _temp.push_back(target>>8);
                     } else {
                         _temp.push_back((Uint8)target);
                     }
-                } else if (convertToolToCode == 3) { //Unicode Compound
+                } else if (state.toCode == 3) { //Unicode Compound
                     if ((target >> 13) > 0) {
                         _temp.push_back(target & 0x1FFF);
                         _temp.push_back(_unicodeCompoundMark[(target>>13) - 1]);
@@ -121,60 +307,329 @@ string convertUtil(const string& sourceString) {
                         _temp.push_back(target);
                     }
                 }
-                shouldUpperCase = false;
-                hasBreak = false;
+                state.shouldUpperCase = false;
+                state.hasBreak = false;
                 continue;
             }
         }
         
         //find primary keycode first
         t = (Uint16)data[i];
-        if (findKeyCode(t, convertToolFromCode, j, k)) {
-            target = _codeTable[convertToolToCode][j][k];
-            if ((convertToolToAllCaps || shouldUpperCase) && k % 2 != 0) {
-                target = _codeTable[convertToolToCode][j][k-1];
-            } else if ((convertToolToAllNonCaps || !shouldUpperCase) && k % 2 == 0) {
-                target = _codeTable[convertToolToCode][j][k+1];
+        if (findKeyCode(t, state.fromCode, j, k)) {
+            target = _codeTable[state.toCode][j][k];
+            if ((state.toAllCaps || state.shouldUpperCase) && k % 2 != 0) {
+                target = _codeTable[state.toCode][j][k-1];
+            } else if ((state.toAllNonCaps || !state.shouldUpperCase) && k % 2 == 0) {
+                target = _codeTable[state.toCode][j][k+1];
             }
             
             //remove mark/tone
-            if (convertToolRemoveMark) {
-                target = keyCodeToCharacter((Uint8)j);
-                if (convertToolToAllCaps) {
-                    target = towupper(target);
-                } else if (convertToolToAllNonCaps){
-                    target = towlower(target);
+            if (state.removeMark) {
+                target = keyCodeToCharacter((Uint8)_codeTableKey[j]);
+                if (state.toAllCaps) {
+                    target = getConvertCase(target, state.toCode, true);
+                } else if (state.toAllNonCaps){
+                    target = getConvertCase(target, state.toCode, false);
                 }
             }
             
             _temp.push_back(target);
-            shouldUpperCase = false;
-            hasBreak = false;
+            state.shouldUpperCase = false;
+            state.hasBreak = false;
             continue;
         }
         
         //if dont find => normal char
-        if (convertToolToAllCaps || shouldUpperCase)
-            _temp.push_back(towupper(data[i]));
-        else if (convertToolToAllNonCaps || !shouldUpperCase)
-            _temp.push_back(towlower(data[i]));
+        if (state.toAllCaps || state.shouldUpperCase)
+            _temp.push_back(getConvertCase(data[i], state.fromCode, true));
+        else if (state.toAllNonCaps || !state.shouldUpperCase)
+            _temp.push_back(getConvertCase(data[i], state.fromCode, false));
         else
             _temp.push_back(data[i]);
         
-        if (t == '\n' || (hasBreak && t == ' ')) {
-            if (convertToolToCapsFirstLetter || convertToolToCapsEachWord)
-                shouldUpperCase = true;
-        } else if (t == ' ' && convertToolToCapsEachWord) {
-            shouldUpperCase = true;
+        if (t == '\n' || (state.hasBreak && t == ' ')) {
+            if (state.toCapsFirstLetter || state.toCapsEachWord)
+                state.shouldUpperCase = true;
+        } else if (t == ' ' && state.toCapsEachWord) {
+            state.shouldUpperCase = true;
         } else if (std::find(_breakCode.begin(), _breakCode.end(), t) != _breakCode.end()) {
-            hasBreak = true;
+            state.hasBreak = true;
+        } else {
+            state.shouldUpperCase = false;
+            state.hasBreak = false;
+        }
+    }
+    return i;
+}
+
+void convertChunk(vConvertState& state, const char* data, const size_t& size, string& out, const bool& last) {
+    //input: the unit kept from last chunk + this chunk
+    vector<Uint16>& input = state.input;
+    input.resize(UTF8_DECODE_CAPACITY(size) + 1);
+    size_t inputSize = 0;
+    if (state.hasPendingUnit)
+        input[inputSize++] = state.pendingUnit;
+    inputSize += utf8ToUtf16(state.decoder, data, size, input.data() + inputSize, last);
+    
+    state.output.clear();
+    size_t used = convertUnits(state, input.data(), inputSize, last, state.output);
+    state.hasPendingUnit = used < inputSize;
+    if (state.hasPendingUnit)
+        state.pendingUnit = input[used];
+    
+    out.resize(UTF16_ENCODE_CAPACITY(state.output.size()));
+    out.resize(utf16ToUtf8(state.encoder, state.output.data(), state.output.size(), &out[0], last));
+}
+
+string convertUtil(const string& sourceString) {
+    vConvertState state;
+    string result;
+    beginConvert(state);
+    state.output.reserve(sourceString.size());
+    convertChunk(state, sourceString.data(), sourceString.size(), result, true);
+    return result;
+}
+
+/**
+ * A part of a parallel conversion can start after @separator if it's never a unit of a
+ * 2 units character of the source code table (so the part before it gives the same result)
+ */
+static bool isPartSeparator(const Uint8& fromCode, const Uint16& separator) {
+    int j, k;
+    for (j = 0; j < CODE_TABLE_ROW_COUNT; j++) {
+        for (k = 0; k < _codeTableRowSize[j]; k++) {
+            const Uint16 character = _codeTable[fromCode][j][k];
+            if ((fromCode == 2 || fromCode == 4) && ((character & 0xFF) == separator || (character >> 8) == separator))
+                return false;
+            if (fromCode == 3 && (character & 0x1FFF) == separator)
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Start of the next part after @position: after a new line, or the space after a sentence
+ */
+static size_t findPartStart(const char* data, const size_t& size, size_t position, const bool& canSplitLine, const bool& canSplitSentence) {
+    for (; position < size; position++) {
+        if (canSplitLine && data[position] == '\n')
+            return position + 1;
+        if (canSplitSentence && data[position] == ' ' && position > 0 &&
+            std::find(_breakCode.begin(), _breakCode.end(), (Uint8)data[position - 1]) != _breakCode.end())
+            return position + 1;
+    }
+    return size;
+}
+
+struct vConvertPart {
+    size_t start = 0;
+    size_t size = 0;
+    vConvertState state;
+    string output;
+};
+
+/**
+ * State at the start of a part: options of @stream, with its pending data if the part continues the stream
+ */
+static void initPartState(vConvertPart& part, const vConvertState& stream, const bool& continueStream,
+                          const bool& shouldUpperCase, const bool& hasBreak) {
+    vConvertState& state = part.state;
+    state.fromCode = stream.fromCode;
+    state.toCode = stream.toCode;
+    state.toAllCaps = stream.toAllCaps;
+    state.toAllNonCaps = stream.toAllNonCaps;
+    state.toCapsFirstLetter = stream.toCapsFirstLetter;
+    state.toCapsEachWord = stream.toCapsEachWord;
+    state.removeMark = stream.removeMark;
+    state.asciiFastPath = stream.asciiFastPath;
+    state.shouldUpperCase = shouldUpperCase;
+    state.hasBreak = hasBreak;
+    state.hasPendingUnit = continueStream && stream.hasPendingUnit;
+    state.pendingUnit = stream.pendingUnit;
+    state.decoder = continueStream ? stream.decoder : vUtf8Decoder();
+    state.encoder = continueStream ? stream.encoder : vUtf16Encoder();
+}
+
+void convertChunkParallel(vConvertState& state, const char* data, const size_t& size, string& out, const bool& last, int threadCount) {
+    if (threadCount <= 0)
+        threadCount = (int)std::thread::hardware_concurrency();
+    const bool canSplitLine = isPartSeparator(state.fromCode, '\n');
+    const bool canSplitSentence = isPartSeparator(state.fromCode, ' ');
+    if (threadCount <= 1 || size < PARALLEL_MIN_PART_SIZE * 2 || (!canSplitLine && !canSplitSentence)) {
+        convertChunk(state, data, size, out, last);
+        return;
+    }
+    
+    //split, some parts for each thread so a slow part doesn't keep the others waiting
+    size_t partSize = max((size_t)PARALLEL_MIN_PART_SIZE, size / (threadCount * 4));
+    vector<vConvertPart> parts;
+    size_t start = 0, end;
+    while (start < size) {
+        end = start + partSize >= size ? size : findPartStart(data, size, start + partSize, canSplitLine, canSplitSentence);
+        parts.push_back(vConvertPart());
+        parts.back().start = start;
+        parts.back().size = end - start;
+        start = end;
+    }
+    
+    //the first part continues the stream, others start after a line or sentence,
+    //their caps state is guessed like that and checked below
+    vector<bool> startShouldUpperCase(parts.size()), startHasBreak(parts.size());
+    const bool capsAfterBreak = state.toCapsFirstLetter || state.toCapsEachWord;
+    size_t i, k;
+    for (i = 0; i < parts.size(); i++) {
+        if (i == 0) {
+            startShouldUpperCase[i] = state.shouldUpperCase;
+            startHasBreak[i] = state.hasBreak;
         } else {
-            shouldUpperCase = false;
-            hasBreak = false;
+            for (k = parts[i].start; k > 0 && (data[k - 1] == ' ' || data[k - 1] == '\n'); k--);
+            startShouldUpperCase[i] = capsAfterBreak;
+            startHasBreak[i] = k > 0 && std::find(_breakCode.begin(), _breakCode.end(), (Uint8)data[k - 1]) != _breakCode.end();
         }
+        initPartState(parts[i], state, i == 0, startShouldUpperCase[i], startHasBreak[i]);
+    }
+    
+    //thread pool: each thread takes the next part, the last part keeps pending data for the next chunk
+    std::atomic<size_t> nextPart(0);
+    auto worker = [&]() {
+        size_t part;
+        while ((part = nextPart.fetch_add(1)) < parts.size())
+            convertChunk(parts[part].state, data + parts[part].start, parts[part].size, parts[part].output,
+                         part == parts.size() - 1 ? last : true);
+    };
+    vector<std::thread> threads;
+    for (int i = 1; i < threadCount && i < (int)parts.size(); i++)
+        threads.push_back(std::thread(worker));
+    worker();
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    
+    //a part which started with a wrong caps state is converted again
+    for (i = 1; i < parts.size(); i++) {
+        const vConvertState& previous = parts[i - 1].state;
+        if (startShouldUpperCase[i] == previous.shouldUpperCase && startHasBreak[i] == previous.hasBreak)
+            continue;
+        initPartState(parts[i], state, false, previous.shouldUpperCase, previous.hasBreak);
+        convertChunk(parts[i].state, data + parts[i].start, parts[i].size, parts[i].output, i == parts.size() - 1 ? last : true);
     }
-    _temp.push_back(0);
-    wstring str(_temp.begin(), _temp.end());
-    return wideStringToUtf8(str);
+    
+    size_t outputSize = 0;
+    for (i = 0; i < parts.size(); i++)
+        outputSize += parts[i].output.size();
+    out.clear();
+    out.reserve(outputSize);
+    for (i = 0; i < parts.size(); i++)
+        out += parts[i].output;
+    
+    //keep the stream state of the last part
+    vConvertState& lastState = parts.back().state;
+    state.shouldUpperCase = lastState.shouldUpperCase;
+    state.hasBreak = lastState.hasBreak;
+    state.hasPendingUnit = lastState.hasPendingUnit;
+    state.pendingUnit = lastState.pendingUnit;
+    state.decoder = lastState.decoder;
+    state.encoder = lastState.encoder;
+}
+
+string convertUtilParallel(const string& sourceString, const int& threadCount) {
+    vConvertState state;
+    string result;
+    beginConvert(state);
+    convertChunkParallel(state, sourceString.data(), sourceString.size(), result, true, threadCount);
+    return result;
+}
+
+struct vDetectUnitMask {
+    Byte mask[DETECT_UNIT_COUNT];
+    vDetectUnitMask() {
+        memset(mask, 0, sizeof(mask));
+        for (int code = 0; code < CODE_TABLE_COUNT; code++) {
+            for (int j = 0; j < CODE_TABLE_ROW_COUNT; j++) {
+                for (int k = 0; k < _codeTableRowSize[j]; k++) {
+                    const Uint16 character = _codeTable[code][j][k];
+                    if (character > 0 && character < DETECT_UNIT_COUNT)
+                        mask[character] |= 1 << code;
+                    if ((code == 2 || code == 4) && (character >> 8) > 0)
+                        mask[character >> 8] |= code == 2 ? DETECT_VNI_HIGH : DETECT_1258_HIGH;
+                }
+            }
+        }
+        for (int i = 0; i < 5; i++)
+            mask[_unicodeCompoundMark[i]] |= DETECT_COMPOUND_MARK;
+    }
+};
+
+/**
+ * Score of the unit at @i for each table: 2 if it's the second unit of a 2 units character
+ * (VNI/CP1258 pair, compound mark), 1 if it's a character. Pairs are strong evidence,
+ * because TCVN3 and Unicode have a character for most units of VNI and CP1258
+ */
+static void scoreCodeUnit(const Uint16* data, const size_t& i, int* score) {
+    static const vDetectUnitMask unitMask;
+    const Uint16 unit = data[i];
+    const Byte mask = unit < DETECT_UNIT_COUNT ? unitMask.mask[unit] : 0;
+    const Uint16 previous = i > 0 ? data[i - 1] : 0;
+    int j, k, code;
+    bool pair[CODE_TABLE_COUNT] = {false};
+    if ((mask & DETECT_VNI_HIGH) && previous > 0 && previous < 0x100)
+        pair[2] = findKeyCode(previous | (unit << 8), 2, j, k);
+    if ((mask & DETECT_1258_HIGH) && previous > 0 && previous < 0x100)
+        pair[4] = findKeyCode(previous | (unit << 8), 4, j, k);
+    if ((mask & DETECT_COMPOUND_MARK) && previous > 0)
+        pair[3] = findKeyCode(previous | getUnicodeCompoundMarkIndex(unit), 3, j, k);
+    for (code = 0; code < CODE_TABLE_COUNT; code++)
+        score[code] += pair[code] ? 2 : ((mask >> code) & 1);
 }
 
+static void scoreConvertCode(const Uint16* data, const size_t& size, int* score, int& total) {
+    size_t i = 0, k;
+    Uint16 mask;
+    while (i < size) {
+        //skip ASCII, 8 units at once
+        for (; i + 8 <= size; i += 8) {
+            for (mask = 0, k = 0; k < 8; k++)
+                mask |= data[i + k];
+            if (mask >= 0x80)
+                break;
+        }
+        for (; i < size && data[i] < 0x80; i++);
+        if (i >= size)
+            break;
+        if (data[i] != UTF_REPLACEMENT_CHARACTER) { //a sample can cut a UTF-8 sequence
+            total += 2;
+            scoreCodeUnit(data, i, score);
+        }
+        i++;
+    }
+}
+
+Uint8 detectConvertCode(const char* data, const size_t& size, int* confidence, int* score) {
+    int tableScore[CODE_TABLE_COUNT] = {0};
+    int total = 0, i;
+    Uint16 units[UTF8_DECODE_CAPACITY(DETECT_SAMPLE_SIZE)];
+    const size_t sampleCount = min((size_t)DETECT_SAMPLE_COUNT, (size + DETECT_SAMPLE_SIZE - 1) / DETECT_SAMPLE_SIZE);
+    for (size_t sample = 0; sample < sampleCount; sample++) {
+        size_t start = sampleCount < DETECT_SAMPLE_COUNT ? sample * DETECT_SAMPLE_SIZE : (size - DETECT_SAMPLE_SIZE) / (sampleCount - 1) * sample;
+        size_t end = min(size, start + DETECT_SAMPLE_SIZE);
+        for (i = 0; i < 3 && start < end && ((Byte)data[start] & 0xC0) == 0x80; i++) //start at a character
+            start++;
+        scoreConvertCode(units, utf8ToUtf16(data + start, end - start, units), tableScore, total);
+    }
+
+    //the table which explains most units, the first one if they are equal (Unicode)
+    int best = 0, second = -1;
+    for (i = 1; i < CODE_TABLE_COUNT; i++) {
+        if (tableScore[i] > tableScore[best]) {
+            second = best;
+            best = i;
+        } else if (second < 0 || tableScore[i] > tableScore[second]) {
+            second = i;
+        }
+    }
+    if (confidence)
+        *confidence = total == 0 ? 0 : (tableScore[best] - tableScore[second]) * 100 / total;
+    if (score)
+        memcpy(score, tableScore, sizeof(tableScore));
+    return (Uint8)best;
+}
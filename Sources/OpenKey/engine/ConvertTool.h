@@ -10,7 +10,9 @@
 #define ConvertTool_h
 
 #include "DataType.h"
+#include "Utf.h"
 #include <string>
+#include <vector>
 using namespace std;
 
 extern bool convertToolDontAlertWhenCompleted;
@@ -25,4 +27,56 @@ extern int convertToolHotKey;
 
 string convertUtil(const string& sourceString);
 
+/**
+ * State of a streaming conversion, options are copied by beginConvert() so they
+ * don't change in the middle of a document. Memory only depends on chunk size.
+ */
+struct vConvertState {
+    Uint8 fromCode = 0;
+    Uint8 toCode = 0;
+    bool toAllCaps = false;
+    bool toAllNonCaps = false;
+    bool toCapsFirstLetter = false;
+    bool toCapsEachWord = false;
+    bool removeMark = false;
+    bool asciiFastPath = false; //ASCII runs of the source table can be copied with case mapping
+    
+    bool shouldUpperCase = false;
+    bool hasBreak = false;
+    bool hasPendingUnit = false; //last unit of previous chunk, it can be the first unit of a VNI/compound character
+    Uint16 pendingUnit = 0;
+    vUtf8Decoder decoder;
+    vUtf16Encoder encoder;
+    
+    vector<Uint16> input; //buffers of one chunk
+    vector<Uint16> output;
+};
+
+/**
+ * Start converting a document with current convertTool options
+ */
+void beginConvert(vConvertState& state);
+
+/**
+ * Convert a chunk of UTF-8 @data, @out is the converted UTF-8 of this chunk.
+ * Chunks can be split anywhere; @last must be true for the last chunk (it can be empty).
+ * Result is the same as convertUtil() of the whole document
+ */
+void convertChunk(vConvertState& state, const char* data, const size_t& size, string& out, const bool& last);
+
+/**
+ * Same result as convertChunk(), the chunk is split after new lines (or sentences) and
+ * converted by @threadCount threads, 0: all cores. Small chunks are converted by this thread
+ */
+void convertChunkParallel(vConvertState& state, const char* data, const size_t& size, string& out, const bool& last, int threadCount=0);
+string convertUtilParallel(const string& sourceString, const int& threadCount=0);
+
+/**
+ * Guess the code table of @data (for convertToolFromCode), from samples of a big text.
+ * Each table scores 1 for a non-ASCII unit which is its character, 2 if the unit ends a VNI/CP1258
+ * pair or a compound mark. @confidence: 0..100, the lead of the best table over the second one in
+ * percent of the highest possible score, 0 if there isn't any non-ASCII unit. @score: CODE_TABLE_COUNT scores
+ */
+Uint8 detectConvertCode(const char* data, const size_t& size, int* confidence=NULL, int* score=NULL);
+
 #endif /* ConvertTool_h */
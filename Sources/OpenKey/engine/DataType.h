@@ -10,6 +10,7 @@
 #define DataType_h
 
 #include <vector>
+#include <stddef.h>
 
 using namespace std;
 
@@ -42,7 +43,7 @@ typedef signed char Int8;
 typedef unsigned char Uint8;
 typedef unsigned short Uint16;
 typedef unsigned int Uint32;
-typedef unsigned long int Uint64;
+typedef unsigned long long Uint64;
 
 enum HoolCodeState {
     vDoNothing = 0, //do not do anything
@@ -129,27 +130,31 @@ struct vKeyHookState {
 //Utilities macro
 #define IS_CONSONANT(keyCode) !(keyCode == KEY_A || keyCode == KEY_E || keyCode == KEY_U || keyCode == KEY_Y || keyCode == KEY_I || keyCode == KEY_O)
 //#define IS_MARK_KEY(keyCode) (keyCode == KEY_S || keyCode == KEY_F || keyCode == KEY_R || keyCode == KEY_J || keyCode == KEY_X)
-#define CHR(index) (Uint16)TypingWord[index]
+//these macros work on the engine context named `ctx` in the current scope
+//TypingWord and KeyStates are ring buffers, index 0 is the first cell of the current word
+#define TYPING_WORD(index) ctx.TypingWord[(ctx._wordHead + (index)) & (MAX_BUFF - 1)]
+#define KEY_STATE(index) ctx.KeyStates[(ctx._stateHead + (index)) & (MAX_BUFF - 1)]
+#define CHR(index) (Uint16)TYPING_WORD(index)
 #define IS_SPECIALKEY(keyCode) \
-        (vInputType == vTelex ? \
+        (ctx.config.inputType == vTelex ? \
             keyCode == KEY_W || keyCode == KEY_E || keyCode == KEY_R || keyCode == KEY_O || keyCode == KEY_LEFT_BRACKET || \
             keyCode == KEY_RIGHT_BRACKET || keyCode == KEY_A || keyCode == KEY_S || keyCode == KEY_D || keyCode == KEY_F || keyCode == KEY_J || \
             keyCode == KEY_Z || keyCode == KEY_X || keyCode == KEY_W \
-        : (vInputType == vVNI ? \
+        : (ctx.config.inputType == vVNI ? \
             keyCode == KEY_1 || keyCode == KEY_2 || keyCode == KEY_3 || keyCode == KEY_4 || \
             keyCode == KEY_5 || keyCode == KEY_6 || keyCode == KEY_7 || keyCode == KEY_8 || keyCode == KEY_9 || keyCode == KEY_0 \
-        : (vInputType == vSimpleTelex1 ? \
+        : (ctx.config.inputType == vSimpleTelex1 ? \
             keyCode == KEY_W || keyCode == KEY_E || keyCode == KEY_R || keyCode == KEY_O || keyCode == KEY_A || keyCode == KEY_S || \
             keyCode == KEY_D || keyCode == KEY_F || keyCode == KEY_J ||   keyCode == KEY_Z || keyCode == KEY_X || keyCode == KEY_W \
-        : (vInputType == vSimpleTelex2 ? \
+        : (ctx.config.inputType == vSimpleTelex2 ? \
             keyCode == KEY_W || keyCode == KEY_E || keyCode == KEY_R || keyCode == KEY_O || keyCode == KEY_A || keyCode == KEY_S || \
             keyCode == KEY_D || keyCode == KEY_F || keyCode == KEY_J ||   keyCode == KEY_Z || keyCode == KEY_X || keyCode == KEY_W : false))))
 
 //is VNI or Unicode compound...
 #define IS_DOUBLE_CODE(code) (code == 2 || code == 3)
 #define IS_VNI_CODE(code) (code == 2)
-#define IS_QUICK_TELEX_KEY(code) (_index > 0 && (code == KEY_C || code == KEY_G || code == KEY_K || code == KEY_N || code == KEY_Q || code == KEY_P || code == KEY_T) && \
-                                    (Uint16)TypingWord[_index-1] == code)
+#define IS_QUICK_TELEX_KEY(code) (ctx._index > 0 && (code == KEY_C || code == KEY_G || code == KEY_K || code == KEY_N || code == KEY_Q || code == KEY_P || code == KEY_T) && \
+                                    (Uint16)TYPING_WORD(ctx._index-1) == code)
 
 #define IS_NUMBER_KEY(code) (code == KEY_1 || code == KEY_2 || code == KEY_3 || code == KEY_4 || code == KEY_5 || code == KEY_6 || code == KEY_7 || code == KEY_8 || code == KEY_9 || code == KEY_0)
 
@@ -72,120 +72,96 @@ static Uint16 ProcessingChar[][11] = {
     {KEY_S, KEY_F, KEY_R, KEY_X, KEY_J, KEY_A, KEY_O, KEY_E, KEY_W, KEY_D, KEY_Z} //Simple Telex 2
 };
 
-#define IS_KEY_Z(key) (ProcessingChar[vInputType][10] == key)
-#define IS_KEY_D(key) (ProcessingChar[vInputType][9] == key)
-#define IS_KEY_W(key) ((vInputType != vVNI) ? ProcessingChar[vInputType][8] == key : \
-                                    (vInputType == vVNI ? (ProcessingChar[vInputType][8] == key || ProcessingChar[vInputType][7] == key) : false))
-#define IS_KEY_DOUBLE(key) ((vInputType != vVNI) ? (ProcessingChar[vInputType][5] == key || ProcessingChar[vInputType][6] == key || ProcessingChar[vInputType][7] == key) :\
-                                        (vInputType == vVNI ? ProcessingChar[vInputType][6] == key : false))
-#define IS_KEY_S(key) (ProcessingChar[vInputType][0] == key)
-#define IS_KEY_F(key) (ProcessingChar[vInputType][1] == key)
-#define IS_KEY_R(key) (ProcessingChar[vInputType][2] == key)
-#define IS_KEY_X(key) (ProcessingChar[vInputType][3] == key)
-#define IS_KEY_J(key) (ProcessingChar[vInputType][4] == key)
-
-#define IS_MARK_KEY(keyCode) (((vInputType != vVNI) && (keyCode == KEY_S || keyCode == KEY_F || keyCode == KEY_R || keyCode == KEY_J || keyCode == KEY_X)) || \
-                                        (vInputType == vVNI && (keyCode == KEY_1 || keyCode == KEY_2 || keyCode == KEY_3 || keyCode == KEY_5 || keyCode == KEY_4)))
+#define IS_KEY_Z(key) (ProcessingChar[ctx.config.inputType][10] == key)
+#define IS_KEY_D(key) (ProcessingChar[ctx.config.inputType][9] == key)
+#define IS_KEY_W(key) ((ctx.config.inputType != vVNI) ? ProcessingChar[ctx.config.inputType][8] == key : \
+                                    (ctx.config.inputType == vVNI ? (ProcessingChar[ctx.config.inputType][8] == key || ProcessingChar[ctx.config.inputType][7] == key) : false))
+#define IS_KEY_DOUBLE(key) ((ctx.config.inputType != vVNI) ? (ProcessingChar[ctx.config.inputType][5] == key || ProcessingChar[ctx.config.inputType][6] == key || ProcessingChar[ctx.config.inputType][7] == key) :\
+                                        (ctx.config.inputType == vVNI ? ProcessingChar[ctx.config.inputType][6] == key : false))
+#define IS_KEY_S(key) (ProcessingChar[ctx.config.inputType][0] == key)
+#define IS_KEY_F(key) (ProcessingChar[ctx.config.inputType][1] == key)
+#define IS_KEY_R(key) (ProcessingChar[ctx.config.inputType][2] == key)
+#define IS_KEY_X(key) (ProcessingChar[ctx.config.inputType][3] == key)
+#define IS_KEY_J(key) (ProcessingChar[ctx.config.inputType][4] == key)
+
+#define IS_MARK_KEY(keyCode) (((ctx.config.inputType != vVNI) && (keyCode == KEY_S || keyCode == KEY_F || keyCode == KEY_R || keyCode == KEY_J || keyCode == KEY_X)) || \
+                                        (ctx.config.inputType == vVNI && (keyCode == KEY_1 || keyCode == KEY_2 || keyCode == KEY_3 || keyCode == KEY_5 || keyCode == KEY_4)))
 #define IS_BRACKET_KEY(key) (key == KEY_LEFT_BRACKET || key == KEY_RIGHT_BRACKET)
 
-#define VSI vowelStartIndex
-#define VEI vowelEndIndex
-#define VWSM vowelWillSetMark
-#define hBPC HookState.backspaceCount
-#define hNCC HookState.newCharCount
-#define hCode HookState.code
-#define hExt HookState.extCode
-#define hData HookState.charData
-#define GET getCharacterCode
-#define hMacroKey HookState.macroKey
-#define hMacroData HookState.macroData
-
-//Data to sendback to main program
-vKeyHookState HookState;
-
-//private data
-/**
- * data structure of each element in TypingWord (Uint64)
- * first 2 byte is character code or key code.
- * bit 16: has caps or not
- * bit 17: has tone ^ or not
- * bit 18: has tone w or not
- * bit 19 - > 23: has mark or not (Sắc, huyền, hỏi, ngã, nặng)
- * bit 24: is standalone key? (w, [, ])
- * bit 25: is character code or keyboard code; 1: character code; 0: keycode
- */
-static Uint32 TypingWord[MAX_BUFF];
-static Byte _index = 0;
-static vector<Uint32> _longWordHelper; //save the word when _index >= MAX_BUFF
-static list<vector<Uint32>> _typingStates; //Aug 28th, 2019: typing helper, save long state of Typing word, can go back and modify the word
-vector<Uint32> _typingStatesData;
+#define VSI ctx.vowelStartIndex
+#define VEI ctx.vowelEndIndex
+#define VWSM ctx.vowelWillSetMark
+#define hBPC ctx.HookState.backspaceCount
+#define hNCC ctx.HookState.newCharCount
+#define hCode ctx.HookState.code
+#define hExt ctx.HookState.extCode
+#define hData ctx.HookState.charData
+#define GET(data) getCharacterCode(data, ctx.config.codeTable)
+#define MACRO_KEY(data) getCharacterCode(data, MACRO_KEY_CODE_TABLE)
+#define hMacroKey ctx.HookState.macroKey
+#define hMacroData ctx.HookState.macroData
+#define RENDERED_KEY_MASK 0x4000000 //rendered code of a key code which isn't a character
+#define LONG_RESTORE_MAX_BACKSPACE 254 //HookState.backspaceCount is a byte, the main program may add one
 
-/**
- * Use for restore key if invalid word
- */
-static Uint32 KeyStates[MAX_BUFF];
-static Byte _stateIndex = 0;
-
-static bool tempDisableKey = false;
-static int capsElem;
-static int key;
-static int markElem;
-static bool isCorect = false;
-static bool isChanged = false;
-static Byte vowelCount = 0;
-static Byte vowelStartIndex = 0;
-static Byte vowelEndIndex = 0;
-static Byte vowelWillSetMark = 0;
-static int i, ii, iii;
-static int j;
-static int k, kk;
-static int l;
-static bool isRestoredW;
-static Uint16 keyForAEO;
-static bool isCheckedGrammar;
-static bool _isCaps = false;
-static int _spaceCount = 0; //add: July 30th, 2019
-static bool _hasHandledMacro = false; //for macro flag August 9th, 2019
-static Byte _upperCaseStatus = 0; //for Write upper case for the first letter; 2: will upper case
-static bool _isCharKeyCode;
-static vector<Uint32> _specialChar;
-static bool _useSpellCheckingBefore;
-static bool _hasHandleQuickConsonant;
-static bool _willTempOffEngine = false;
+//Default context used by the global API (vKeyInit, vKeyHandleEvent,...)
+static vEngineContext _defaultContext;
 
 //function prototype
-void findAndCalculateVowel(const bool& forGrammar=false);
-void insertMark(const Uint32& markMask, const bool& canModifyFlag=true);
+void findAndCalculateVowel(vEngineContext& ctx, const bool& forGrammar=false);
+void insertMark(vEngineContext& ctx, const Uint32& markMask, const bool& canModifyFlag=true);
+static void initTypingHistory(vTypingHistory& history, const int& depth);
 
-static std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
 wstring utf8ToWideString(const string& str) {
-    return converter.from_bytes(str.c_str());
+    wstring result;
+    utf8ToWideString(str, result);
+    return result;
 }
 
 string wideStringToUtf8(const wstring& str) {
-    return converter.to_bytes(str.c_str());
+    string result;
+    wideStringToUtf8(str, result);
+    return result;
 }
 
-void* vKeyInit() {
-    _index = 0;
-    _stateIndex = 0;
-    _useSpellCheckingBefore = vCheckSpelling;
-    _typingStatesData.clear();
-    _typingStates.clear();
-    _longWordHelper.clear();
+void vLoadEngineConfig(vEngineConfig& config) {
+    config.inputType = vInputType;
+    config.freeMark = vFreeMark;
+    config.codeTable = vCodeTable;
+    config.checkSpelling = vCheckSpelling;
+    config.useModernOrthography = vUseModernOrthography;
+    config.quickTelex = vQuickTelex;
+    config.restoreIfWrongSpelling = vRestoreIfWrongSpelling;
+    config.useMacro = vUseMacro;
+    config.upperCaseFirstChar = vUpperCaseFirstChar;
+    config.allowConsonantZFWJ = vAllowConsonantZFWJ;
+    config.quickStartConsonant = vQuickStartConsonant;
+    config.quickEndConsonant = vQuickEndConsonant;
+    config.tempOffOpenKey = vTempOffOpenKey;
+    config.autoCapsMacro = vAutoCapsMacro;
+}
+
+void* vKeyInit(vEngineContext& ctx) {
+    ctx._index = 0;
+    ctx._stateIndex = 0;
+    ctx._useSpellCheckingBefore = ctx.config.checkSpelling;
+    initTypingHistory(ctx._typingStates, ctx.config.historyDepth);
+    ctx._longWordHelper.clear();
+    ctx._longStateHelper.clear();
+    ctx._spellingIndex = 0;
     
     // P2.1: Initialize lookup tables for O(1) performance
-    initLookupTables();
-    
     // FIX: Pre-initialize keyCodeToChar map to eliminate lazy init in critical path
     // While impact is minimal (~0.05ms), this ensures deterministic latency
-    static bool isMapInitialized = false;
-    if (!isMapInitialized || _keyCodeToChar.size() == 0) {
-        initKeyCodeToChar();
-        isMapInitialized = true;
-    }
+    // These tables are shared by all contexts, static init makes it run once even with many threads
+    static bool isTableInitialized = (initLookupTables(), initKeyCodeToChar(), initSpellingAutomaton(), true);
+    (void)isTableInitialized;
     
-    return &HookState;
+    return &ctx.HookState;
+}
+
+void* vKeyInit() {
+    vLoadEngineConfig(_defaultContext.config);
+    return vKeyInit(_defaultContext);
 }
 
 // P2.1: Optimized with O(1) lookup table instead of O(n) vector search
@@ -202,47 +178,95 @@ inline bool isMacroBreakCode(const int& data) {
     return (data >= 0 && data < 256) && _macroBreakCodeLookup[data];
 }
 
-void setKeyData(const Byte& index, const Uint16& keyCode, const bool& isCaps) {
+void setKeyData(vEngineContext& ctx, const Byte& index, const Uint16& keyCode, const bool& isCaps) {
     if (index < 0 || index >= MAX_BUFF)
         return;
-    TypingWord[index] = keyCode | (isCaps ? CAPS_MASK : 0);
+    TYPING_WORD(index) = keyCode | (isCaps ? CAPS_MASK : 0);
+}
+
+static inline Uint16 nextSpellingNode(const vSpellingTrie& trie, const Uint16& node, const Uint32& data) {
+    if (node == SPELLING_DEAD || (data & CHAR_MASK) > 0xFF)
+        return SPELLING_DEAD;
+    return trie.next[node * SPELLING_SYMBOL_COUNT +
+                     _spellingSymbol[data & 0xFF][((data & TONE_MASK) ? 1 : 0) | ((data & TONEW_MASK) ? 2 : 0)]];
+}
+
+/**
+ * Find the first row of _consonantTable which matches the start of the word.
+ * The automaton state of each cell is kept in ctx, only cells which changed since
+ * the last call are processed again (normally one transition for each new key).
+ * Return the size of that row, or where the check stopped on the last row if no row matches.
+ */
+static int matchFirstConsonant(vEngineContext& ctx, const Byte& endIndex) {
+    int i;
+    Byte variant = (ctx.config.quickStartConsonant ? 1 : 0) | (ctx.config.allowConsonantZFWJ ? 2 : 0);
+    if (variant != ctx._spellingVariant) {
+        ctx._spellingVariant = variant;
+        ctx._spellingIndex = 0;
+    }
+    
+    //skip cells which are the same as the last time
+    for (i = 0; i < ctx._spellingIndex && i < endIndex && ctx._spellingKey[i] == CHR(i); i++);
+    if (i < endIndex) {
+        const vSpellingTrie& trie = _spellingOnset[variant];
+        Uint16 node;
+        for (; i < endIndex; i++) {
+            ctx._spellingKey[i] = CHR(i);
+            node = nextSpellingNode(trie, ctx._spellingNode[i], CHR(i));
+            ctx._spellingNode[i + 1] = node;
+            ctx._spellingRow[i + 1] = (node != SPELLING_DEAD && trie.data[node] < ctx._spellingRow[i]) ?
+                                        trie.data[node] : ctx._spellingRow[i];
+        }
+        ctx._spellingIndex = endIndex;
+    }
+    
+    if (ctx._spellingRow[endIndex] != SPELLING_NO_ROW)
+        return (int)_consonantTable[ctx._spellingRow[endIndex]].size();
+    
+    //no row matches
+    const vector<Uint16>& lastRow = _consonantTable.back();
+    for (i = 0; i < lastRow.size(); i++) {
+        if (endIndex > i &&
+            (lastRow[i] & ~(ctx.config.quickStartConsonant ? END_CONSONANT_MASK : 0)) != CHR(i) &&
+            (lastRow[i] & ~(ctx.config.allowConsonantZFWJ ? CONSONANT_ALLOW_MASK : 0)) != CHR(i)) {
+            break;
+        }
+    }
+    return i;
 }
 
-bool _spellingOK = false;
-bool _spellingFlag = false;
-bool _spellingVowelOK = false;
-Byte _spellingEndIndex = 0;
+/**
+ * Check vowels from @startIndex with _vowelCombine, @vowelEndIndex is the cell after the last vowel
+ */
+static bool matchVowelCombine(vEngineContext& ctx, const int& startIndex, const int& vowelEndIndex, const Byte& endIndex) {
+    //if there is something after the vowels, the row must allow end consonant
+    const Uint8 endFlag = vowelEndIndex < endIndex ? SPELLING_NUCLEUS_END_ALLOW : SPELLING_NUCLEUS_END;
+    Uint16 node = CHR(startIndex) > 0xFF ? SPELLING_DEAD : _spellingNucleusRoot[CHR(startIndex)];
+    for (int i = startIndex; node != SPELLING_DEAD; i++) {
+        if (i >= endIndex) //end of word, rows longer than the word are OK too
+            return (_spellingNucleus.data[node] & (endFlag << 2)) != 0;
+        if ((_spellingNucleus.data[node] & endFlag) && IS_CONSONANT(CHR(i)))
+            return true;
+        node = nextSpellingNode(_spellingNucleus, node, CHR(i) | (TYPING_WORD(i) & (TONE_MASK | TONEW_MASK)));
+    }
+    return false;
+}
 
-void checkSpelling(const bool& forceCheckVowel=false) {
-    _spellingOK = false;
-    _spellingVowelOK = true;
-    _spellingEndIndex = _index;
+void checkSpelling(vEngineContext& ctx, const bool& forceCheckVowel=false) {
+    int i, j, k, l;
+    bool _spellingOK = false;
+    bool _spellingVowelOK = true;
+    Byte _spellingEndIndex = ctx._index;
     
-    if (_index > 0 && CHR(_index-1) == KEY_RIGHT_BRACKET) {
-        _spellingEndIndex = _index-1;
+    if (ctx._index > 0 && CHR(ctx._index-1) == KEY_RIGHT_BRACKET) {
+        _spellingEndIndex = ctx._index-1;
     }
     
     if (_spellingEndIndex > 0) {
         j = 0;
         //Check first consonant
         if (IS_CONSONANT(CHR(0))) {
-            for (i = 0; i < _consonantTable.size(); i++) {
-                _spellingFlag = false;
-                if (_spellingEndIndex < _consonantTable[i].size())
-                    _spellingFlag = true;
-                for (j = 0; j < _consonantTable[i].size(); j++) {
-                    if (_spellingEndIndex > j &&
-                        (_consonantTable[i][j] & ~(vQuickStartConsonant ? END_CONSONANT_MASK : 0)) != CHR(j) &&
-                        (_consonantTable[i][j] & ~(vAllowConsonantZFWJ ? CONSONANT_ALLOW_MASK : 0)) != CHR(j)) {
-                        _spellingFlag = true;
-                        break;
-                    }
-                }
-                if (_spellingFlag)
-                    continue;
-                
-                break;
-            }
+            j = matchFirstConsonant(ctx, _spellingEndIndex);
         }
         
         if (j == _spellingEndIndex){ //for "d" case
@@ -257,7 +281,7 @@ void checkSpelling(const bool& forceCheckVowel=false) {
             k = k + 1;
             j = k;
             VSI = k;
-        } else if (_index >= 2 && CHR(0) == KEY_G && CHR(1) == KEY_I && IS_CONSONANT(CHR(2))) {
+        } else if (ctx._index >= 2 && CHR(0) == KEY_G && CHR(1) == KEY_I && IS_CONSONANT(CHR(2))) {
             VSI = k = j = 1; //Sep 28th: fix gìn
         }
         for (l = 0; l < 3; l++) {
@@ -270,50 +294,26 @@ void checkSpelling(const bool& forceCheckVowel=false) {
             _spellingVowelOK = false;
             //check correct combined vowel
             if (k - j > 1 && forceCheckVowel) {
-                vector<vector<Uint32>>& vowelSet = _vowelCombine[CHR(j)];
-                for (l = 0; l < vowelSet.size(); l++) {
-                    _spellingFlag = false;
-                    for (ii = 1; ii < vowelSet[l].size(); ii++) {
-                        if (j + ii - 1 < _spellingEndIndex && vowelSet[l][ii] != ((CHR(j + ii - 1) | (TypingWord[j + ii - 1] & TONEW_MASK) | (TypingWord[j + ii - 1] & TONE_MASK)))) {
-                            _spellingFlag = true;
-                            break;
-                        }
-                    }
-                    if (_spellingFlag || (k < _spellingEndIndex && !vowelSet[l][0]) || (j + ii - 1 < _spellingEndIndex && !IS_CONSONANT(CHR(j + ii - 1))))
-                        continue;
-                    
-                    _spellingVowelOK = true;
-                    break;
-                }
+                _spellingVowelOK = matchVowelCombine(ctx, j, k, _spellingEndIndex);
             } else if (!IS_CONSONANT(CHR(j))) {
                 _spellingVowelOK = true;
             }
             
-            //continue check last consonant
-            for (ii = 0; ii < _endConsonantTable.size(); ii++) {
-                _spellingFlag = false;
-   
-                for (j = 0; j < _endConsonantTable[ii].size(); j++) {
-                    if (_spellingEndIndex > k+j &&
-                        (_endConsonantTable[ii][j] & ~(vQuickEndConsonant ? END_CONSONANT_MASK : 0)) != CHR(k + j)) {
-                        _spellingFlag = true;
-                        break;
-                    }
-                }
-                if (_spellingFlag)
-                    continue;
-                
-                if (k + j >= _spellingEndIndex) {
-                    _spellingOK = true;
-                    break;
-                }
+            //continue check last consonant: the rest of the word must be a prefix of a row in _endConsonantTable
+            const vSpellingTrie& coda = _spellingCoda[ctx.config.quickEndConsonant ? 1 : 0];
+            Uint16 node = 0;
+            for (i = k; i < _spellingEndIndex && node != SPELLING_DEAD; i++) {
+                node = nextSpellingNode(coda, node, CHR(i));
+            }
+            if (node != SPELLING_DEAD) {
+                _spellingOK = true;
             }
             
             //limit: end consonant "ch", "t" can not use with "~", "`", "?"
             if (_spellingOK) {
-                if (_index >= 3 && CHR(_index-1) == KEY_H && CHR(_index-2) == KEY_C && !((TypingWord[_index-3] & MARK1_MASK) || (TypingWord[_index-3] & MARK5_MASK) || !(TypingWord[_index-3] & MARK_MASK))) {
+                if (ctx._index >= 3 && CHR(ctx._index-1) == KEY_H && CHR(ctx._index-2) == KEY_C && !((TYPING_WORD(ctx._index-3) & MARK1_MASK) || (TYPING_WORD(ctx._index-3) & MARK5_MASK) || !(TYPING_WORD(ctx._index-3) & MARK_MASK))) {
                     _spellingOK = false;
-                } else if (_index >= 2 && CHR(_index-1) == KEY_T && !((TypingWord[_index-2] & MARK1_MASK) || (TypingWord[_index-2] & MARK5_MASK) || !(TypingWord[_index-2] & MARK_MASK))) {
+                } else if (ctx._index >= 2 && CHR(ctx._index-1) == KEY_T && !((TYPING_WORD(ctx._index-2) & MARK1_MASK) || (TYPING_WORD(ctx._index-2) & MARK5_MASK) || !(TYPING_WORD(ctx._index-2) & MARK_MASK))) {
                     _spellingOK = false;
                 }
             }
@@ -321,18 +321,20 @@ void checkSpelling(const bool& forceCheckVowel=false) {
     } else {
         _spellingOK = true;
     }
-    tempDisableKey = !(_spellingOK && _spellingVowelOK);
+    ctx.tempDisableKey = !(_spellingOK && _spellingVowelOK);
     
     //cout<<"spelling vowel: "<<(_spellingVowelOK ? "OK": "Err")<<endl;
     //cout<<"spelling: "<<(_spellingOK ? "OK": "Err")<<endl<<endl;
 }
 
-void checkGrammar(const int& deltaBackSpace) {
-    if (_index <= 1 || _index >= MAX_BUFF)
+void checkGrammar(vEngineContext& ctx, const int& deltaBackSpace) {
+    int i, l;
+    bool isCheckedGrammar;
+    if (ctx._index <= 1 || ctx._index >= MAX_BUFF)
         return;
     
-    findAndCalculateVowel(true);
-    if (vowelCount == 0)
+    findAndCalculateVowel(ctx, true);
+    if (ctx.vowelCount == 0)
         return;
     
     isCheckedGrammar = false;
@@ -340,14 +342,14 @@ void checkGrammar(const int& deltaBackSpace) {
     l = VSI;
     
     //if N key for case: "thuơn", "ưoi", "ưom", "ưoc"
-    if (_index >= 3) {
-        for (i = _index-1; i >= 0; i--) {
+    if (ctx._index >= 3) {
+        for (i = ctx._index-1; i >= 0; i--) {
             if (CHR(i) == KEY_N || CHR(i) == KEY_C || CHR(i) == KEY_I ||
                 CHR(i) == KEY_M || CHR(i) == KEY_P || CHR(i) == KEY_T) {
                 if (i - 2 >= 0 && CHR(i - 1) == KEY_O && CHR(i - 2) == KEY_U) {
-                    if ((TypingWord[i-1] & TONEW_MASK) ^ (TypingWord[i-2] & TONEW_MASK)) {
-                        TypingWord[i - 2] |= TONEW_MASK;
-                        TypingWord[i - 1] |= TONEW_MASK;
+                    if ((TYPING_WORD(i-1) & TONEW_MASK) ^ (TYPING_WORD(i-2) & TONEW_MASK)) {
+                        TYPING_WORD(i - 2) |= TONEW_MASK;
+                        TYPING_WORD(i - 1) |= TONEW_MASK;
                         isCheckedGrammar = true;
                         break;
                     }
@@ -357,13 +359,13 @@ void checkGrammar(const int& deltaBackSpace) {
     }
     
     //check mark
-    if (_index >= 2) {
+    if (ctx._index >= 2) {
         for (i = l; i <= VEI; i++) {
-            if (TypingWord[i] & MARK_MASK) {
-                Uint32 mark = TypingWord[i] & MARK_MASK;
-                TypingWord[i] &= ~MARK_MASK;
-                insertMark(mark, false);
-                if (i != vowelWillSetMark)
+            if (TYPING_WORD(i) & MARK_MASK) {
+                Uint32 mark = TYPING_WORD(i) & MARK_MASK;
+                TYPING_WORD(i) &= ~MARK_MASK;
+                insertMark(ctx, mark, false);
+                if (i != ctx.vowelWillSetMark)
                     isCheckedGrammar = true;
                 break;
             }
@@ -376,9 +378,9 @@ void checkGrammar(const int& deltaBackSpace) {
             hCode = vWillProcess;
         hBPC = 0;
         
-        for (i = _index - 1; i >= l; i--) {
+        for (i = ctx._index - 1; i >= l; i--) {
             hBPC++;
-            hData[_index - 1 - i] = GET(TypingWord[i]);
+            hData[ctx._index - 1 - i] = GET(TYPING_WORD(i));
         }
         hNCC = hBPC;
         hBPC += deltaBackSpace;
@@ -386,135 +388,221 @@ void checkGrammar(const int& deltaBackSpace) {
     }
 }
 
-void insertKey(const Uint16& keyCode, const bool& isCaps, const bool& isCheckSpelling=true) {
-    if (_index >= MAX_BUFF) {
-        _longWordHelper.push_back(TypingWord[0]); //save long word
-        //left shift
-        for (iii = 0; iii < MAX_BUFF - 1; iii++) {
-            TypingWord[iii] = TypingWord[iii + 1];
-        }
-        setKeyData(_index-1, keyCode, isCaps);
+void insertKey(vEngineContext& ctx, const Uint16& keyCode, const bool& isCaps, const bool& isCheckSpelling=true) {
+    if (ctx._index >= MAX_BUFF) {
+        ctx._longWordHelper.push_back(TYPING_WORD(0)); //save long word
+        //move the start of the ring buffer instead of left shift
+        ctx._wordHead = (ctx._wordHead + 1) & (MAX_BUFF - 1);
+        setKeyData(ctx, ctx._index-1, keyCode, isCaps);
     } else {
-        setKeyData(_index++, keyCode, isCaps);
+        setKeyData(ctx, ctx._index++, keyCode, isCaps);
     }
     
-    if (vCheckSpelling && isCheckSpelling)
-        checkSpelling();
+    if (ctx.config.checkSpelling && isCheckSpelling)
+        checkSpelling(ctx);
     
     //allow d after consonant
-    if (keyCode == KEY_D && _index - 2 >= 0 && IS_CONSONANT(CHR(_index - 2)))
-        tempDisableKey = false;
+    if (keyCode == KEY_D && ctx._index - 2 >= 0 && IS_CONSONANT(CHR(ctx._index - 2)))
+        ctx.tempDisableKey = false;
 }
 
-void insertState(const Uint16& keyCode, const bool& isCaps) {
-    if (_stateIndex >= MAX_BUFF) {
-        //left shift
-        for (iii = 0; iii < MAX_BUFF - 1; iii++) {
-            KeyStates[iii] = KeyStates[iii + 1];
-        }
-        KeyStates[_stateIndex-1] = keyCode | (isCaps ? CAPS_MASK : 0);
+void insertState(vEngineContext& ctx, const Uint16& keyCode, const bool& isCaps) {
+    if (ctx._stateIndex >= MAX_BUFF) {
+        ctx._longStateHelper.push_back(KEY_STATE(0)); //keep every key for restore
+        ctx._stateHead = (ctx._stateHead + 1) & (MAX_BUFF - 1);
+        KEY_STATE(ctx._stateIndex-1) = keyCode | (isCaps ? CAPS_MASK : 0);
     } else {
-        KeyStates[_stateIndex++] = keyCode | (isCaps ? CAPS_MASK : 0);
+        KEY_STATE(ctx._stateIndex++) = keyCode | (isCaps ? CAPS_MASK : 0);
     }
 }
 
-void saveWord() {
+/**
+ * Typing history: records are stored one after another in a ring of cells,
+ * when it is full the oldest records are dropped. Nothing is allocated here.
+ */
+static void initTypingHistory(vTypingHistory& history, const int& depth) {
+    int recordCount = depth > 0 ? depth : 1;
+    if (history.records.size() != recordCount) {
+        history.records.assign(recordCount, vTypingRecord());
+        history.cells.assign(recordCount * MAX_BUFF, 0);
+    }
+    history.firstRecord = history.recordCount = 0;
+    history.firstCell = history.cellCount = 0;
+}
+
+static inline void clearTypingHistory(vTypingHistory& history) {
+    history.firstRecord = history.recordCount = 0;
+    history.firstCell = history.cellCount = 0;
+}
+
+static void dropFirstTypingRecord(vTypingHistory& history) {
+    vTypingRecord& record = history.records[history.firstRecord];
+    history.firstCell = (history.firstCell + record.size) % history.cells.size();
+    history.cellCount -= record.size;
+    history.firstRecord = (history.firstRecord + 1) % history.records.size();
+    history.recordCount--;
+}
+
+/**
+ * Start a new record at the end of history, then add cells by pushTypingCell()
+ */
+static void beginTypingRecord(vTypingHistory& history) {
+    if (history.recordCount == history.records.size())
+        dropFirstTypingRecord(history);
+    vTypingRecord& record = history.records[(history.firstRecord + history.recordCount) % history.records.size()];
+    record.start = (history.firstCell + history.cellCount) % history.cells.size();
+    record.size = 0;
+    history.recordCount++;
+}
+
+static void pushTypingCell(vTypingHistory& history, const Uint32& cell) {
+    vTypingRecord& record = history.records[(history.firstRecord + history.recordCount - 1) % history.records.size()];
+    while (history.cellCount == history.cells.size()) {
+        if (history.recordCount > 1) {
+            dropFirstTypingRecord(history);
+        } else { //only this record, keep its last cells
+            record.start = (record.start + 1) % history.cells.size();
+            record.size--;
+            history.firstCell = record.start;
+            history.cellCount--;
+        }
+    }
+    history.cells[(record.start + record.size) % history.cells.size()] = cell;
+    record.size++;
+    history.cellCount++;
+}
+
+static inline Uint32 getTypingCell(const vTypingHistory& history, const vTypingRecord& record, const int& index) {
+    return history.cells[(record.start + index) % history.cells.size()];
+}
+
+/**
+ * A long word is restored with the macro output (checkRestoreIfWrongSpelling), not a macro:
+ * TypingWord is the restored word
+ */
+static inline bool isLongWordRestore(vEngineContext& ctx) {
+    return hCode == vReplaceMaro && !ctx._hasHandledMacro;
+}
+
+void saveWord(vEngineContext& ctx) {
+    int i;
     //save word history
-    if (hCode != vReplaceMaro) {
-        if (_index > 0) {
-            if (_longWordHelper.size() > 0) { //save long word first
-                _typingStatesData.clear();
-                for (i = 0; i < _longWordHelper.size(); i++) {
+    if (hCode != vReplaceMaro || isLongWordRestore(ctx)) {
+        if (ctx._index > 0) {
+            if (ctx._longWordHelper.size() > 0) { //save long word first
+                beginTypingRecord(ctx._typingStates);
+                for (i = 0; i < ctx._longWordHelper.size(); i++) {
                     if (i != 0 && i % MAX_BUFF == 0) { //save if overflow
-                        _typingStates.push_back(_typingStatesData);
-                        _typingStatesData.clear();
+                        beginTypingRecord(ctx._typingStates);
                     }
-                    _typingStatesData.push_back(_longWordHelper[i]);
+                    pushTypingCell(ctx._typingStates, ctx._longWordHelper[i]);
                 }
-                _typingStates.push_back(_typingStatesData);
-                _longWordHelper.clear();
+                ctx._longWordHelper.clear();
             }
             
             //save current word
-            _typingStatesData.clear();
-            for (i = 0; i < _index; i++) {
-                _typingStatesData.push_back(TypingWord[i]);
+            beginTypingRecord(ctx._typingStates);
+            for (i = 0; i < ctx._index; i++) {
+                pushTypingCell(ctx._typingStates, TYPING_WORD(i));
             }
-            _typingStates.push_back(_typingStatesData);
         }
     } else { //save macro words
-        _typingStatesData.clear();
+        beginTypingRecord(ctx._typingStates);
         for (i = 0; i < hMacroData.size(); i++) {
             if (i != 0 && i % MAX_BUFF == 0) { //break if overflow
-                _typingStates.push_back(_typingStatesData);
-                _typingStatesData.clear();
+                beginTypingRecord(ctx._typingStates);
             }
-            _typingStatesData.push_back(hMacroData[i]);
+            pushTypingCell(ctx._typingStates, hMacroData[i]);
         }
-        _typingStates.push_back(_typingStatesData);
     }
 }
 
-void saveWord(const Uint32& keyCode, const int& count) {
-    _typingStatesData.clear();
+void saveWord(vEngineContext& ctx, const Uint32& keyCode, const int& count) {
+    int i;
+    beginTypingRecord(ctx._typingStates);
     for (i = 0; i < count; i++) {
-        _typingStatesData.push_back(keyCode);
+        pushTypingCell(ctx._typingStates, keyCode);
     }
-    _typingStates.push_back(_typingStatesData);
 }
 
-void saveSpecialChar() {
-    _typingStatesData.clear();
-    for (i = 0; i < _specialChar.size(); i++) {
-        _typingStatesData.push_back(_specialChar[i]);
+void saveSpecialChar(vEngineContext& ctx) {
+    int i;
+    beginTypingRecord(ctx._typingStates);
+    for (i = 0; i < ctx._specialChar.size(); i++) {
+        pushTypingCell(ctx._typingStates, ctx._specialChar[i]);
     }
-    _typingStates.push_back(_typingStatesData);
-    _specialChar.clear();
+    ctx._specialChar.clear();
 }
 
-void restoreLastTypingState() {
-    if (_typingStates.size() > 0) {
-        _typingStatesData = _typingStates.back();
-        _typingStates.pop_back();
-        if (_typingStatesData.size() > 0){
-            if (_typingStatesData[0] == KEY_SPACE) {
-                _spaceCount = (int)_typingStatesData.size();
-                _index = 0;
-            } else if ((Uint16)_typingStatesData[0] < 256 && _charKeyCodeLookup[(Uint16)_typingStatesData[0]]) {
-                _index = 0;
-                _specialChar = _typingStatesData;
-                checkSpelling();
+void restoreLastTypingState(vEngineContext& ctx) {
+    int i;
+    vTypingHistory& history = ctx._typingStates;
+    if (history.recordCount > 0) {
+        //pop the record, its cells stay valid until the next beginTypingRecord()
+        const vTypingRecord& record = history.records[(history.firstRecord + history.recordCount - 1) % history.records.size()];
+        history.recordCount--;
+        history.cellCount -= record.size;
+        if (record.size > 0){
+            Uint32 first = getTypingCell(history, record, 0);
+            if (first == KEY_SPACE) {
+                ctx._spaceCount = (int)record.size;
+                ctx._index = 0;
+            } else if ((Uint16)first < 256 && _charKeyCodeLookup[(Uint16)first]) {
+                ctx._index = 0;
+                ctx._specialChar.clear();
+                for (i = 0; i < record.size; i++) {
+                    ctx._specialChar.push_back(getTypingCell(history, record, i));
+                }
+                checkSpelling(ctx);
             } else {
-                for (i = 0; i < _typingStatesData.size(); i++) {
-                    TypingWord[i] = _typingStatesData[i];
+                for (i = 0; i < record.size; i++) {
+                    TYPING_WORD(i) = getTypingCell(history, record, i);
                 }
-                _index = (Byte)_typingStatesData.size();
+                ctx._index = (Byte)record.size;
             }
         }
     }
 }
 
-void startNewSession() {
-    _index = 0;
+size_t vGetTypingHistoryMemory(const vEngineContext& ctx, int* recordCount, int* cellCount) {
+    const vTypingHistory& history = ctx._typingStates;
+    if (recordCount)
+        *recordCount = history.recordCount;
+    if (cellCount)
+        *cellCount = history.cellCount;
+    return sizeof(vTypingHistory) +
+           history.records.capacity() * sizeof(vTypingRecord) +
+           history.cells.capacity() * sizeof(Uint32);
+}
+
+void startNewSession(vEngineContext& ctx) {
+    ctx._index = 0;
     hBPC = 0;
     hNCC = 0;
-    tempDisableKey = false;
-    _stateIndex = 0;
-    _hasHandledMacro = false;
-    _hasHandleQuickConsonant = false;
-    _longWordHelper.clear();
+    ctx.tempDisableKey = false;
+    ctx._stateIndex = 0;
+    ctx._hasHandledMacro = false;
+    ctx._hasHandleQuickConsonant = false;
+    ctx._longWordHelper.clear();
+    ctx._longStateHelper.clear();
+    ctx._renderedCount = 0;
 }
 
-void checkCorrectVowel(vector<vector<Uint16>>& charset, int& i, int& k, const Uint16& markKey) {
+void startNewSession() {
+    startNewSession(_defaultContext);
+}
+
+void checkCorrectVowel(vEngineContext& ctx, vector<vector<Uint16>>& charset, int& i, int& k, const Uint16& markKey) {
+    int j;
     //ignore "qu" case
-    if (_index >= 2 && CHR(_index-1) == KEY_U && CHR(_index-2) == KEY_Q) {
-        isCorect = false;
+    if (ctx._index >= 2 && CHR(ctx._index-1) == KEY_U && CHR(ctx._index-2) == KEY_Q) {
+        ctx.isCorect = false;
         return;
     }
-    k = _index - 1;
+    k = ctx._index - 1;
     for (j = (int)charset[i].size() - 1; j >= 0; j--) {
-        if ((charset[i][j] & ~(vQuickEndConsonant ? END_CONSONANT_MASK : 0)) != CHR(k)) {
-            isCorect = false;
+        if ((charset[i][j] & ~(ctx.config.quickEndConsonant ? END_CONSONANT_MASK : 0)) != CHR(k)) {
+            ctx.isCorect = false;
             return;
         }
         k--;
@@ -523,89 +611,53 @@ void checkCorrectVowel(vector<vector<Uint16>>& charset, int& i, int& k, const Ui
     }
     
     //limit mark for end consonant: "C", "T"
-    if (isCorect && charset[i].size() > 1 && (IS_KEY_F(markKey) || IS_KEY_X(markKey) || IS_KEY_R(markKey))) {
+    if (ctx.isCorect && charset[i].size() > 1 && (IS_KEY_F(markKey) || IS_KEY_X(markKey) || IS_KEY_R(markKey))) {
         if (charset[i][1] == KEY_C || charset[i][1] == KEY_T) {
-            isCorect = false;
+            ctx.isCorect = false;
         } else if (charset[i].size() > 2 && (charset[i][2] == KEY_T)) {
-            isCorect = false;
+            ctx.isCorect = false;
         }
     }
     
-    if (isCorect && k >= 0) {
+    if (ctx.isCorect && k >= 0) {
         if (CHR(k) == CHR(k+1)) {
-            isCorect = false;
+            ctx.isCorect = false;
         }
     }
 }
 
+Uint32 getCharacterCode(const Uint32& data, const int& codeTable) {
+    //one indexed load from the compile time table, see buildCodeTableIndex()
+    Uint32 key = data & CHAR_MASK;
+    if (key > 0xFF || _codeTableIndex.base[key] == CODE_TABLE_NOT_FOUND)
+        return data; //not found
+    Uint8 mark = _codeTableIndex.mark[(data & MARK_MASK) >> 19];
+    if (mark == CODE_TABLE_NOT_FOUND)
+        return data;
+    Uint16 code = _codeTableIndex.character[codeTable]
+                                           [_codeTableIndex.base[key]]
+                                           [(data & TONE_MASK) ? 1 : ((data & TONEW_MASK) ? 2 : 0)]
+                                           [mark]
+                                           [(data & CAPS_MASK) ? 0 : 1];
+    if (code == 0)
+        return data; //not found
+    return code | CHAR_CODE_MASK;
+}
+
 Uint32 getCharacterCode(const Uint32& data) {
-    capsElem = (data & CAPS_MASK) ? 0 : 1;
-    key = data & CHAR_MASK;
-    if (data & MARK_MASK) { //has mark
-        markElem = -2;
-        switch (data & MARK_MASK) {
-            case MARK1_MASK:
-                markElem = 0;
-                break;
-            case MARK2_MASK:
-                markElem = 2;
-                break;
-            case MARK3_MASK:
-                markElem = 4;
-                break;
-            case MARK4_MASK:
-                markElem = 6;
-                break;
-            case MARK5_MASK:
-                markElem = 8;
-                break;
-        }
-        markElem += capsElem;
-        
-        switch (key) {
-            case KEY_A:
-            case KEY_O:
-            case KEY_U:
-            case KEY_E:
-                if ((data & TONE_MASK) == 0 && (data & TONEW_MASK) == 0)
-                    markElem += 4;
-                break;
-        }
-        
-        if (data & TONE_MASK) {
-            key |= TONE_MASK;
-        } else if (data & TONEW_MASK) {
-            key |= TONEW_MASK;
-        }
-        if (_codeTable[vCodeTable].find(key) == _codeTable[vCodeTable].end())
-            return data; //not found
-        
-        return _codeTable[vCodeTable][key][markElem] | CHAR_CODE_MASK;
-    } else { //doesn't has mark
-        if (_codeTable[vCodeTable].find(key) == _codeTable[vCodeTable].end())
-            return data; //not found
-        
-        if (data & TONE_MASK) {
-            return _codeTable[vCodeTable][key][capsElem] | CHAR_CODE_MASK;
-        } else if (data & TONEW_MASK) {
-            return _codeTable[vCodeTable][key][capsElem + 2] | CHAR_CODE_MASK;
-        } else {
-            return data; //not found
-        }
-    }
-    
-    return 0;
+    return getCharacterCode(data, vCodeTable);
 }
 
-void findAndCalculateVowel(const bool& forGrammar) {
-    vowelCount = 0;
+void findAndCalculateVowel(vEngineContext& ctx, const bool& forGrammar) {
+    int iii;
+    ctx.vowelCount = 0;
     VSI = VEI = 0;
-    for (iii = _index - 1; iii >= 0; iii--) {
+    for (iii = ctx._index - 1; iii >= 0; iii--) {
         if (IS_CONSONANT(CHR(iii))) {
-            if (vowelCount > 0)
+            if (ctx.vowelCount > 0)
                 break;
         } else {  //is vowel
-            if (vowelCount == 0)
+            if (ctx.vowelCount == 0)
                 VEI = iii;
             if (!forGrammar) {
                 if ((iii-1 >= 0 && (CHR(iii) == KEY_I && CHR(iii-1) == KEY_G)) ||
@@ -614,34 +666,35 @@ void findAndCalculateVowel(const bool& forGrammar) {
                 }
             }
             VSI = iii;
-            vowelCount++;
+            ctx.vowelCount++;
         }
     }
     //August 26th, 2019: don't count "u" at "q u" as a vowel
     if (VSI - 1 >= 0 && CHR(VSI) == KEY_U && CHR(VSI-1) == KEY_Q) {
         VSI++;
-        vowelCount--;
+        ctx.vowelCount--;
     }
 }
 
-void removeMark() {
-    findAndCalculateVowel(true);
-    isChanged = false;
-    if (_index > 0) {
+void removeMark(vEngineContext& ctx) {
+    int i;
+    findAndCalculateVowel(ctx, true);
+    ctx.isChanged = false;
+    if (ctx._index > 0) {
         for (i = VSI; i <= VEI; i++) {
-            if (TypingWord[i] & MARK_MASK) {
-                TypingWord[i] &= ~MARK_MASK;
-                isChanged = true;
+            if (TYPING_WORD(i) & MARK_MASK) {
+                TYPING_WORD(i) &= ~MARK_MASK;
+                ctx.isChanged = true;
             }
         }
     }
-    if (isChanged) {
+    if (ctx.isChanged) {
         hCode = vWillProcess;
         hBPC = 0;
         
-        for (i = _index - 1; i >= VSI; i--) {
+        for (i = ctx._index - 1; i >= VSI; i--) {
             hBPC++;
-            hData[_index - 1 - i] = GET(TypingWord[i]);
+            hData[ctx._index - 1 - i] = GET(TYPING_WORD(i));
         }
         hNCC = hBPC;
     } else {
@@ -649,12 +702,13 @@ void removeMark() {
     }
 }
 
-bool canHasEndConsonant() {
+bool canHasEndConsonant(vEngineContext& ctx) {
+    int ii, iii, kk;
     vector<vector<Uint32>>& vo = _vowelCombine[CHR(VSI)];
     for (ii = 0; ii < vo.size(); ii++) {
         kk = VSI;
         for (iii = 1; iii < vo[ii].size(); iii++) {
-            if (kk > VEI || ((CHR(kk) | (TypingWord[kk] & TONE_MASK) | (TypingWord[kk] & TONEW_MASK)) != vo[ii][iii])) {
+            if (kk > VEI || ((CHR(kk) | (TYPING_WORD(kk) & TONE_MASK) | (TYPING_WORD(kk) & TONEW_MASK)) != vo[ii][iii])) {
                 break;
             }
             kk++;
@@ -666,123 +720,124 @@ bool canHasEndConsonant() {
     return false;
 }
 
-void handleModernMark() {
+void handleModernMark(vEngineContext& ctx) {
     //default
     VWSM = VEI;
-    hBPC = (_index - VEI);
+    hBPC = (ctx._index - VEI);
     
     //rule 2
-    if (vowelCount == 3 && ((CHR(VSI) == KEY_O && CHR(VSI+1) == KEY_A && CHR(VSI+2) == KEY_I) ||
+    if (ctx.vowelCount == 3 && ((CHR(VSI) == KEY_O && CHR(VSI+1) == KEY_A && CHR(VSI+2) == KEY_I) ||
                             (CHR(VSI) == KEY_U && CHR(VSI+1) == KEY_Y && CHR(VSI+2) == KEY_U) ||
                             (CHR(VSI) == KEY_O && CHR(VSI+1) == KEY_E && CHR(VSI+2) == KEY_O) ||
                             (CHR(VSI) == KEY_U && CHR(VSI+1) == KEY_Y && CHR(VSI+2) == KEY_A))) {
         VWSM = VSI + 1;
-        hBPC = _index - VWSM;
+        hBPC = ctx._index - VWSM;
     } else if ((CHR(VSI) == KEY_O && CHR(VSI+1) == KEY_I) ||
                (CHR(VSI) == KEY_A && CHR(VSI+1) == KEY_I) ||
                (CHR(VSI)== KEY_U && CHR(VSI+1) == KEY_I) ) {
         
         VWSM = VSI;
-        hBPC = _index - VWSM;
+        hBPC = ctx._index - VWSM;
     } else if (CHR(VEI-1) == KEY_A && CHR(VEI) == KEY_Y) {
         VWSM = VEI - 1;
-        hBPC = (_index - VEI) + 1;
+        hBPC = (ctx._index - VEI) + 1;
     } else if (CHR(VSI) == KEY_U && CHR(VSI+1) == KEY_O) {
         VWSM = VSI + 1;
-        hBPC = _index - VWSM;
+        hBPC = ctx._index - VWSM;
     } else if (CHR(VSI+1) == KEY_O || CHR(VSI+1) == KEY_U) {
         VWSM = VEI - 1;
-        hBPC = (_index - VEI) + 1;
+        hBPC = (ctx._index - VEI) + 1;
     } else if (CHR(VSI) == KEY_O || CHR(VSI) == KEY_U) {
         VWSM = VEI;
-        hBPC = (_index - VEI);
+        hBPC = (ctx._index - VEI);
     }
     
     //rule 3.1
-    if ((CHR(VSI) == KEY_I && (TypingWord[VSI+1] & (KEY_E | TONE_MASK))) ||
-        (CHR(VSI) == KEY_Y && (TypingWord[VSI+1] & (KEY_E | TONE_MASK))) ||
-        (CHR(VSI) == KEY_U && (TypingWord[VSI+1] == (KEY_O | TONE_MASK))) ||
-        ((TypingWord[VSI] == (KEY_U | TONEW_MASK)) && (TypingWord[VSI+1] == (KEY_O | TONEW_MASK)))){
+    if ((CHR(VSI) == KEY_I && (TYPING_WORD(VSI+1) & (KEY_E | TONE_MASK))) ||
+        (CHR(VSI) == KEY_Y && (TYPING_WORD(VSI+1) & (KEY_E | TONE_MASK))) ||
+        (CHR(VSI) == KEY_U && (TYPING_WORD(VSI+1) == (KEY_O | TONE_MASK))) ||
+        ((TYPING_WORD(VSI) == (KEY_U | TONEW_MASK)) && (TYPING_WORD(VSI+1) == (KEY_O | TONEW_MASK)))){
         
-        if (VSI+2 < _index) {
+        if (VSI+2 < ctx._index) {
             if (CHR(VSI+2) == KEY_P || CHR(VSI+2) == KEY_T ||
                 CHR(VSI+2) == KEY_M || CHR(VSI+2) == KEY_N ||
                 CHR(VSI+2) == KEY_O || CHR(VSI+2) == KEY_U ||
                 CHR(VSI+2) == KEY_I || CHR(VSI+2) == KEY_C ||
-                (VSI+3 < _index && CHR(VSI+2) == KEY_C && CHR(VSI+2) == KEY_H) ||
-                (VSI+3 < _index && CHR(VSI+2) == KEY_N && CHR(VSI+2) == KEY_H) ||
-                (VSI+3 < _index && CHR(VSI+2) == KEY_N && CHR(VSI+2) == KEY_G)) {
+                (VSI+3 < ctx._index && CHR(VSI+2) == KEY_C && CHR(VSI+2) == KEY_H) ||
+                (VSI+3 < ctx._index && CHR(VSI+2) == KEY_N && CHR(VSI+2) == KEY_H) ||
+                (VSI+3 < ctx._index && CHR(VSI+2) == KEY_N && CHR(VSI+2) == KEY_G)) {
                 
                 VWSM = VSI + 1;
-                hBPC = _index - VWSM;
+                hBPC = ctx._index - VWSM;
             } else {
                 VWSM = VSI;
-                hBPC = _index - VWSM;
+                hBPC = ctx._index - VWSM;
             }
         } else {
             VWSM = VSI;
-            hBPC = _index - VWSM;
+            hBPC = ctx._index - VWSM;
         }
     }
     //rule 3.2
     else if ((CHR(VSI) == KEY_I && (CHR(VSI) == KEY_A)) ||
              (CHR(VSI) == KEY_Y && (CHR(VSI) == KEY_A)) ||
              (CHR(VSI) == KEY_U && (CHR(VSI) == KEY_A)) ||
-             (CHR(VSI) == KEY_U && (TypingWord[VSI+1] == (KEY_U | TONEW_MASK)))){
+             (CHR(VSI) == KEY_U && (TYPING_WORD(VSI+1) == (KEY_U | TONEW_MASK)))){
         
         VWSM = VSI;
-        hBPC = _index - VWSM;
+        hBPC = ctx._index - VWSM;
     }
     
     //rule 4
-    if (vowelCount == 2) {
+    if (ctx.vowelCount == 2) {
         if (((CHR(VSI) == KEY_I) && (CHR(VSI+1) == KEY_A)) ||
             ((CHR(VSI) == KEY_I) && (CHR(VSI+1) == KEY_U)) ||
             ((CHR(VSI) == KEY_I) && (CHR(VSI+1) == KEY_O))) {
             
             if (VSI == 0 || (CHR(VSI-1) != KEY_G)) { //dont have G
                 VWSM = VSI;
-                hBPC = _index - VWSM;
+                hBPC = ctx._index - VWSM;
             } else {
                 VWSM = VSI + 1;
-                hBPC = _index - VWSM;
+                hBPC = ctx._index - VWSM;
             }
         } else if ((CHR(VSI) == KEY_U) && (CHR(VSI+1) == KEY_A)) {
             if (VSI == 0 || (CHR(VSI-1) != KEY_Q)) { //dont have Q
-                if (VEI + 1 >= _index || !canHasEndConsonant()) {
+                if (VEI + 1 >= ctx._index || !canHasEndConsonant(ctx)) {
                     VWSM = VSI;
-                    hBPC = _index - VWSM;
+                    hBPC = ctx._index - VWSM;
                 }
             } else {
                 VWSM = VSI + 1;
-                hBPC = _index - VWSM;
+                hBPC = ctx._index - VWSM;
             }
         } else if ((CHR(VSI) == KEY_O) && (CHR(VSI+1) == KEY_O)) { //thoong
             VWSM = VEI;
-            hBPC = _index - VWSM;
+            hBPC = ctx._index - VWSM;
         }
     }
 }
 
-void handleOldMark() {
+void handleOldMark(vEngineContext& ctx) {
+    int ii;
     //default
-    if (vowelCount == 0 && CHR(VEI) == KEY_I)
+    if (ctx.vowelCount == 0 && CHR(VEI) == KEY_I)
         VWSM = VEI;
     else
         VWSM = VSI;
-    hBPC = (_index - VWSM);
+    hBPC = (ctx._index - VWSM);
     
     //rule 2
-    if (vowelCount == 3 || (VEI + 1 < _index && IS_CONSONANT(CHR(VEI + 1)) && canHasEndConsonant())) {
+    if (ctx.vowelCount == 3 || (VEI + 1 < ctx._index && IS_CONSONANT(CHR(VEI + 1)) && canHasEndConsonant(ctx))) {
         VWSM = VSI + 1;
-        hBPC = _index - VWSM;
+        hBPC = ctx._index - VWSM;
     }
     
     //rule 3
     for (ii = VSI; ii <= VEI; ii++) {
-        if ((CHR(ii) == KEY_E && TypingWord[ii] & TONE_MASK) || (CHR(ii) == KEY_O && TypingWord[ii] & TONEW_MASK)) {
+        if ((CHR(ii) == KEY_E && TYPING_WORD(ii) & TONE_MASK) || (CHR(ii) == KEY_O && TYPING_WORD(ii) & TONEW_MASK)) {
             VWSM = ii;
-            hBPC = _index - VWSM;
+            hBPC = ctx._index - VWSM;
             break;
         }
     }
@@ -790,182 +845,219 @@ void handleOldMark() {
     hNCC = hBPC;
 }
 
-void insertMark(const Uint32& markMask, const bool& canModifyFlag) {
-    vowelCount = 0;
-    
-    if (canModifyFlag)
-        hCode = vWillProcess;
-    hBPC = hNCC = 0;
-    
-    findAndCalculateVowel();
+/**
+ * Vowel of the word which will have the mark (VWSM), by ctx.config.useModernOrthography
+ */
+static void findMarkPosition(vEngineContext& ctx) {
+    findAndCalculateVowel(ctx);
     VWSM = 0;
     
-    //detect mark position
-    if (vowelCount == 1) {
+    if (ctx.vowelCount == 1) {
         VWSM = VEI;
-        hBPC = (_index - VEI);
+        hBPC = (ctx._index - VEI);
     } else { //vowel = 2 or 3
-        if (vUseModernOrthography == 0)
-            handleOldMark();
+        if (ctx.config.useModernOrthography == 0)
+            handleOldMark(ctx);
         else
-            handleModernMark();
-        if (TypingWord[VEI] & TONE_MASK || TypingWord[VEI] & TONEW_MASK)
-            vowelWillSetMark = VEI;
+            handleModernMark(ctx);
+        if (TYPING_WORD(VEI) & TONE_MASK || TYPING_WORD(VEI) & TONEW_MASK)
+            ctx.vowelWillSetMark = VEI;
+    }
+}
+
+bool vPlaceWordMark(vEngineContext& ctx) {
+    int i, markIndex = -1;
+    for (i = 0; i < ctx._index; i++) {
+        if (TYPING_WORD(i) & MARK_MASK) {
+            if (markIndex >= 0) //more than one mark
+                return false;
+            markIndex = i;
+        }
     }
+    if (markIndex < 0)
+        return false;
+    
+    checkSpelling(ctx, true);
+    if (ctx.tempDisableKey)
+        return false;
+    
+    findMarkPosition(ctx);
+    if (markIndex < VSI || markIndex > VEI || IS_CONSONANT(CHR(VWSM)))
+        return false;
+    const Uint32 mark = TYPING_WORD(markIndex) & MARK_MASK;
+    TYPING_WORD(markIndex) &= ~MARK_MASK;
+    TYPING_WORD(VWSM) |= mark;
+    return true;
+}
+
+void insertMark(vEngineContext& ctx, const Uint32& markMask, const bool& canModifyFlag) {
+    int ii, kk;
+    ctx.vowelCount = 0;
+    
+    if (canModifyFlag)
+        hCode = vWillProcess;
+    hBPC = hNCC = 0;
+    
+    //detect mark position
+    findMarkPosition(ctx);
     
     //send data
-    kk = _index - 1 - VSI;
+    kk = ctx._index - 1 - VSI;
     //if duplicate same mark -> restore
-    if (TypingWord[VWSM] & markMask) {
+    if (TYPING_WORD(VWSM) & markMask) {
         
-        TypingWord[VWSM] &= ~MARK_MASK;
+        TYPING_WORD(VWSM) &= ~MARK_MASK;
         if (canModifyFlag)
             hCode = vRestore;
-        for (ii = VSI; ii < _index; ii++) {
-            TypingWord[ii] &= ~MARK_MASK;
-            hData[kk--] = GET(TypingWord[ii]);
+        for (ii = VSI; ii < ctx._index; ii++) {
+            TYPING_WORD(ii) &= ~MARK_MASK;
+            hData[kk--] = GET(TYPING_WORD(ii));
         }
         //_index = 0;
-        tempDisableKey = true;
+        ctx.tempDisableKey = true;
     } else {
         //remove other mark
-        TypingWord[VWSM] &= ~MARK_MASK;
+        TYPING_WORD(VWSM) &= ~MARK_MASK;
         
         //add mark
-        TypingWord[VWSM] |= markMask;
-        for (ii = VSI; ii < _index; ii++) {
+        TYPING_WORD(VWSM) |= markMask;
+        for (ii = VSI; ii < ctx._index; ii++) {
             if (ii != VWSM) { //remove mark for other vowel
-                TypingWord[ii] &= ~MARK_MASK;
+                TYPING_WORD(ii) &= ~MARK_MASK;
             }
-            hData[kk--] = GET(TypingWord[ii]);
+            hData[kk--] = GET(TYPING_WORD(ii));
         }
         
-        hBPC = _index - VSI;
+        hBPC = ctx._index - VSI;
     }
     hNCC = hBPC;
 }
 
-void insertD(const Uint16& data, const bool& isCaps) {
+void insertD(vEngineContext& ctx, const Uint16& data, const bool& isCaps) {
+    int ii;
     hCode = vWillProcess;
     hBPC = 0;
-    for (ii = _index - 1; ii >= 0; ii--) {
+    for (ii = ctx._index - 1; ii >= 0; ii--) {
         hBPC++;
         if (CHR(ii) == KEY_D) { //reverse unicode char
-            if (TypingWord[ii] & TONE_MASK) {
+            if (TYPING_WORD(ii) & TONE_MASK) {
                 //restore and disable temporary
                 hCode = vRestore;
-                TypingWord[ii] &= ~TONE_MASK;
-                hData[_index - 1 - ii] = TypingWord[ii];
-                tempDisableKey = true;
+                TYPING_WORD(ii) &= ~TONE_MASK;
+                hData[ctx._index - 1 - ii] = TYPING_WORD(ii);
+                ctx.tempDisableKey = true;
                 break;
             } else {
-                TypingWord[ii] |= TONE_MASK;
-                hData[_index - 1 - ii] = GET(TypingWord[ii]);
+                TYPING_WORD(ii) |= TONE_MASK;
+                hData[ctx._index - 1 - ii] = GET(TYPING_WORD(ii));
             }
             break;
         } else { //preresent old char
-            hData[_index - 1 - ii] = GET(TypingWord[ii]);
+            hData[ctx._index - 1 - ii] = GET(TYPING_WORD(ii));
         }
     }
     hNCC = hBPC;
 }
 
-void insertAOE(const Uint16& data, const bool& isCaps) {
-    findAndCalculateVowel();
+void insertAOE(vEngineContext& ctx, const Uint16& data, const bool& isCaps) {
+    int ii;
+    findAndCalculateVowel(ctx);
     
     //remove W tone
     for (ii = VSI; ii <= VEI; ii++) {
-        TypingWord[ii] &= ~TONEW_MASK;
+        TYPING_WORD(ii) &= ~TONEW_MASK;
     }
     
     hCode = vWillProcess;
     hBPC = 0;
     
-    for (ii = _index - 1; ii >= 0; ii--) {
+    for (ii = ctx._index - 1; ii >= 0; ii--) {
         hBPC++;
         if (CHR(ii) == data) { //reverse unicode char
-            if (TypingWord[ii] & TONE_MASK) {
+            if (TYPING_WORD(ii) & TONE_MASK) {
                 //restore and disable temporary
                 hCode = vRestore;
-                TypingWord[ii] &= ~TONE_MASK;
-                hData[_index - 1 - ii] = TypingWord[ii];
+                TYPING_WORD(ii) &= ~TONE_MASK;
+                hData[ctx._index - 1 - ii] = TYPING_WORD(ii);
                 //_index = 0;
                 if (data != KEY_O) //case thoòng
-                    tempDisableKey = true;
+                    ctx.tempDisableKey = true;
                 break;
             } else {
-                TypingWord[ii] |= TONE_MASK;
+                TYPING_WORD(ii) |= TONE_MASK;
                 if (!IS_KEY_D(data))
-                    TypingWord[ii] &= ~TONEW_MASK;
-                hData[_index - 1 - ii] = GET(TypingWord[ii]);
+                    TYPING_WORD(ii) &= ~TONEW_MASK;
+                hData[ctx._index - 1 - ii] = GET(TYPING_WORD(ii));
                 
             }
             break;
         } else { //preresent old char
-            hData[_index - 1 - ii] = GET(TypingWord[ii]);
+            hData[ctx._index - 1 - ii] = GET(TYPING_WORD(ii));
         }
     }
     hNCC = hBPC;
 }
 
-void insertW(const Uint16& data, const bool& isCaps) {
+void insertW(vEngineContext& ctx, const Uint16& data, const bool& isCaps) {
+    int ii;
+    bool isRestoredW;
     isRestoredW = false;
     
-    findAndCalculateVowel();
+    findAndCalculateVowel(ctx);
     
     //remove ^ tone
     for (ii = VSI; ii <= VEI; ii++) {
-        TypingWord[ii] &= ~TONE_MASK;
+        TYPING_WORD(ii) &= ~TONE_MASK;
     }
     
-    if (vowelCount > 1) {
-        hBPC = _index - VSI;
+    if (ctx.vowelCount > 1) {
+        hBPC = ctx._index - VSI;
         hNCC = hBPC;
         
-        if (((TypingWord[VSI] & TONEW_MASK) && (TypingWord[VSI+1] & TONEW_MASK)) ||
-            ((TypingWord[VSI] & TONEW_MASK) && CHR(VSI+1) == KEY_I) ||
-            ((TypingWord[VSI] & TONEW_MASK) && CHR(VSI+1) == KEY_A)){
+        if (((TYPING_WORD(VSI) & TONEW_MASK) && (TYPING_WORD(VSI+1) & TONEW_MASK)) ||
+            ((TYPING_WORD(VSI) & TONEW_MASK) && CHR(VSI+1) == KEY_I) ||
+            ((TYPING_WORD(VSI) & TONEW_MASK) && CHR(VSI+1) == KEY_A)){
             //restore and disable temporary
             hCode = vRestore;
             
-            for (ii = VSI; ii < _index; ii++) {
-                TypingWord[ii] &= ~TONEW_MASK;
-                hData[_index - 1 - ii] = GET(TypingWord[ii]) & ~STANDALONE_MASK;
+            for (ii = VSI; ii < ctx._index; ii++) {
+                TYPING_WORD(ii) &= ~TONEW_MASK;
+                hData[ctx._index - 1 - ii] = GET(TYPING_WORD(ii)) & ~STANDALONE_MASK;
             }
             isRestoredW = true;
-            tempDisableKey = true;
+            ctx.tempDisableKey = true;
         } else {
             hCode = vWillProcess;
             
             if ((CHR(VSI) == KEY_U && CHR(VSI+1) == KEY_O)) {
-                if (VSI - 2 >= 0 && TypingWord[VSI - 2] == KEY_T && TypingWord[VSI - 1] == KEY_H) {
-                    TypingWord[VSI+1] |= TONEW_MASK;
-                    if (VSI + 2 < _index && CHR(VSI+2) == KEY_N) {
-                        TypingWord[VSI] |= TONEW_MASK;
+                if (VSI - 2 >= 0 && TYPING_WORD(VSI - 2) == KEY_T && TYPING_WORD(VSI - 1) == KEY_H) {
+                    TYPING_WORD(VSI+1) |= TONEW_MASK;
+                    if (VSI + 2 < ctx._index && CHR(VSI+2) == KEY_N) {
+                        TYPING_WORD(VSI) |= TONEW_MASK;
                     }
-                } else if (VSI - 1 >= 0 && TypingWord[VSI - 1] == KEY_Q) {
-                    TypingWord[VSI+1] |= TONEW_MASK;
+                } else if (VSI - 1 >= 0 && TYPING_WORD(VSI - 1) == KEY_Q) {
+                    TYPING_WORD(VSI+1) |= TONEW_MASK;
                 } else {
-                    TypingWord[VSI] |= TONEW_MASK;
-                    TypingWord[VSI+1] |= TONEW_MASK;
+                    TYPING_WORD(VSI) |= TONEW_MASK;
+                    TYPING_WORD(VSI+1) |= TONEW_MASK;
                 }
             } else if ((CHR(VSI) == KEY_U && CHR(VSI+1) == KEY_A) ||
                        (CHR(VSI) == KEY_U && CHR(VSI+1) == KEY_I) ||
                        (CHR(VSI) == KEY_U && CHR(VSI+1) == KEY_U) ||
                        (CHR(VSI) == KEY_O && CHR(VSI+1) == KEY_I)) {
-                TypingWord[VSI] |= TONEW_MASK;
+                TYPING_WORD(VSI) |= TONEW_MASK;
             } else if ((CHR(VSI) == KEY_I && CHR(VSI+1) == KEY_O) ||
                        (CHR(VSI) == KEY_O && CHR(VSI+1) == KEY_A)) {
-                TypingWord[VSI+1] |= TONEW_MASK;
+                TYPING_WORD(VSI+1) |= TONEW_MASK;
             } else {
                 //don't do anything
-                tempDisableKey = true;
-                isChanged = false;
+                ctx.tempDisableKey = true;
+                ctx.isChanged = false;
                 hCode = vDoNothing;
             }
             
-            for (ii = VSI; ii < _index; ii++) {
-                hData[_index - 1 - ii] = GET(TypingWord[ii]);
+            for (ii = VSI; ii < ctx._index; ii++) {
+                hData[ctx._index - 1 - ii] = GET(TYPING_WORD(ii));
             }
         }
         
@@ -975,7 +1067,7 @@ void insertW(const Uint16& data, const bool& isCaps) {
     hCode = vWillProcess;
     hBPC = 0;
     
-    for (ii = _index - 1; ii >= 0; ii--) {
+    for (ii = ctx._index - 1; ii >= 0; ii--) {
         if (ii < VSI)
             break;
         hBPC++;
@@ -983,36 +1075,36 @@ void insertW(const Uint16& data, const bool& isCaps) {
             case KEY_A:
             case KEY_U:
             case KEY_O:
-                if (TypingWord[ii] & TONEW_MASK) {
+                if (TYPING_WORD(ii) & TONEW_MASK) {
                     //restore and disable temporary
-                    if (TypingWord[ii] & STANDALONE_MASK) {
+                    if (TYPING_WORD(ii) & STANDALONE_MASK) {
                         hCode = vWillProcess;
                         if (CHR(ii) == KEY_U){
-                            TypingWord[ii] = KEY_W | ((TypingWord[ii] & CAPS_MASK) ? CAPS_MASK : 0);
+                            TYPING_WORD(ii) = KEY_W | ((TYPING_WORD(ii) & CAPS_MASK) ? CAPS_MASK : 0);
                         } else if (CHR(ii) == KEY_O) {
                             hCode = vRestore;
-                            TypingWord[ii] = KEY_O | ((TypingWord[ii] & CAPS_MASK) ? CAPS_MASK : 0);
+                            TYPING_WORD(ii) = KEY_O | ((TYPING_WORD(ii) & CAPS_MASK) ? CAPS_MASK : 0);
                             isRestoredW = true;
                         }
-                        hData[_index - 1 - ii] = TypingWord[ii];
+                        hData[ctx._index - 1 - ii] = TYPING_WORD(ii);
                     } else {
                         hCode = vRestore;
-                        TypingWord[ii] &= ~TONEW_MASK;
-                        hData[_index - 1 - ii] = TypingWord[ii];
+                        TYPING_WORD(ii) &= ~TONEW_MASK;
+                        hData[ctx._index - 1 - ii] = TYPING_WORD(ii);
                         isRestoredW = true;
                         //_index++;
                     }
                     
-                    tempDisableKey = true;
+                    ctx.tempDisableKey = true;
                 } else {
-                    TypingWord[ii] |= TONEW_MASK;
-                    TypingWord[ii] &= ~TONE_MASK;
-                    hData[_index - 1 - ii] = GET(TypingWord[ii]);
+                    TYPING_WORD(ii) |= TONEW_MASK;
+                    TYPING_WORD(ii) &= ~TONE_MASK;
+                    hData[ctx._index - 1 - ii] = GET(TYPING_WORD(ii));
                 }
                 break;
                 
             default:
-                hData[_index - 1 - ii] = GET(TypingWord[ii]);
+                hData[ctx._index - 1 - ii] = GET(TYPING_WORD(ii));
                 break;
         }
     }
@@ -1023,119 +1115,192 @@ void insertW(const Uint16& data, const bool& isCaps) {
     }
 }
 
-void reverseLastStandaloneChar(const Uint32& keyCode, const bool& isCaps) {
+void reverseLastStandaloneChar(vEngineContext& ctx, const Uint32& keyCode, const bool& isCaps) {
     hCode = vWillProcess;
     hBPC = 0;
     hNCC = 1;
     hExt = 4;
-    TypingWord[_index - 1] = (keyCode | TONEW_MASK | STANDALONE_MASK | (isCaps ? CAPS_MASK : 0));
-    hData[0] = GET(TypingWord[_index - 1]);
+    TYPING_WORD(ctx._index - 1) = (keyCode | TONEW_MASK | STANDALONE_MASK | (isCaps ? CAPS_MASK : 0));
+    hData[0] = GET(TYPING_WORD(ctx._index - 1));
 }
 
-void checkForStandaloneChar(const Uint16& data, const bool& isCaps, const Uint32& keyWillReverse) {
-    if (CHR(_index - 1) == keyWillReverse && TypingWord[_index - 1] & TONEW_MASK) {
+void checkForStandaloneChar(vEngineContext& ctx, const Uint16& data, const bool& isCaps, const Uint32& keyWillReverse) {
+    int i;
+    if (ctx._index > 0 && CHR(ctx._index - 1) == keyWillReverse && TYPING_WORD(ctx._index - 1) & TONEW_MASK) {
         hCode = vWillProcess;
         hBPC = 1;
         hNCC = 1;
-        TypingWord[_index - 1] = data | (isCaps ? CAPS_MASK : 0);
-        hData[0] = GET(TypingWord[_index - 1]);
+        TYPING_WORD(ctx._index - 1) = data | (isCaps ? CAPS_MASK : 0);
+        hData[0] = GET(TYPING_WORD(ctx._index - 1));
         return;
     }
     
     //check standalone w -> ư
     
-    if (_index > 0 && CHR(_index-1) == KEY_U && keyWillReverse == KEY_O) {
-        insertKey(keyWillReverse, isCaps);
-        reverseLastStandaloneChar(keyWillReverse, isCaps);
+    if (ctx._index > 0 && CHR(ctx._index-1) == KEY_U && keyWillReverse == KEY_O) {
+        insertKey(ctx, keyWillReverse, isCaps);
+        reverseLastStandaloneChar(ctx, keyWillReverse, isCaps);
         return;
     }
     
-    if (_index == 0) { //zero char
-        insertKey(data, isCaps, false);
-        reverseLastStandaloneChar(keyWillReverse, isCaps);
+    if (ctx._index == 0) { //zero char
+        insertKey(ctx, data, isCaps, false);
+        reverseLastStandaloneChar(ctx, keyWillReverse, isCaps);
         return;
-    } else if (_index == 1) { //1 char
+    } else if (ctx._index == 1) { //1 char
         for (i = 0; i < _standaloneWbad.size(); i++) {
             if (CHR(0) == _standaloneWbad[i]) {
-                insertKey(data, isCaps);
+                insertKey(ctx, data, isCaps);
                 return;
             }
         }
-        insertKey(data, isCaps, false);
-        reverseLastStandaloneChar(keyWillReverse, isCaps);
+        insertKey(ctx, data, isCaps, false);
+        reverseLastStandaloneChar(ctx, keyWillReverse, isCaps);
         return;
-    } else if (_index == 2) {
+    } else if (ctx._index == 2) {
         for (i = 0; i < _doubleWAllowed.size(); i++) {
             if (CHR(0) == _doubleWAllowed[i][0] && CHR(1) == _doubleWAllowed[i][1]) {
-                insertKey(data, isCaps, false);
-                reverseLastStandaloneChar(keyWillReverse, isCaps);
+                insertKey(ctx, data, isCaps, false);
+                reverseLastStandaloneChar(ctx, keyWillReverse, isCaps);
                 return;
             }
         }
-        insertKey(data, isCaps);
+        insertKey(ctx, data, isCaps);
         return;
     }
     
-    insertKey(data, isCaps);
+    insertKey(ctx, data, isCaps);
+}
+
+static inline void resetMacroMatch(vEngineContext& ctx, const size_t& index) {
+    if (ctx._macroNode.size() > index)
+        ctx._macroNode.resize(index);
+    if (ctx._macroCaseNode.size() > index)
+        ctx._macroCaseNode.resize(index);
 }
 
-void upperCaseFirstCharacter() {
-    if (!(TypingWord[0] & CAPS_MASK)) {
+/**
+ * Auto caps: code of hMacroKey[@i] in the key which findMacro() looks up when the first code is in
+ * upper case: the first code in lower case, and all codes if the second one is in upper case
+ */
+static inline Uint32 getMacroCaseCode(vEngineContext& ctx, const int& i) {
+    const Uint32 code = MACRO_KEY(hMacroKey[i]);
+    if (i < 2 || getKeyCodeCase(MACRO_KEY(hMacroKey[1]), MACRO_KEY_CODE_TABLE, false) != MACRO_KEY(hMacroKey[1]))
+        return getKeyCodeCase(code, MACRO_KEY_CODE_TABLE, false);
+    return code;
+}
+
+/**
+ * Move the macro trie nodes to the end of hMacroKey, one step for each new key
+ */
+static void matchMacroKey(vEngineContext& ctx) {
+    int i;
+    Uint32 code;
+    if (ctx._macroTrieVersion != getMacroTrieVersion()) {
+        ctx._macroNode.clear();
+        ctx._macroCaseNode.clear();
+        ctx._macroTrieVersion = getMacroTrieVersion();
+    }
+    resetMacroMatch(ctx, hMacroKey.size());
+    Uint32 node = ctx._macroNode.size() > 0 ? ctx._macroNode.back() : MACRO_TRIE_ROOT;
+    for (i = (int)ctx._macroNode.size(); i < hMacroKey.size(); i++) {
+        node = nextMacroNode(node, MACRO_KEY(hMacroKey[i]));
+        ctx._macroNode.push_back(node);
+    }
+    if (!ctx.config.autoCapsMacro)
+        return;
+    node = ctx._macroCaseNode.size() > 0 ? ctx._macroCaseNode.back() : MACRO_TRIE_ROOT;
+    for (i = (int)ctx._macroCaseNode.size(); i < hMacroKey.size(); i++) {
+        code = getMacroCaseCode(ctx, i);
+        node = i == 0 && code == MACRO_KEY(hMacroKey[0]) ? MACRO_TRIE_DEAD : nextMacroNode(node, code); //first code isn't in upper case
+        ctx._macroCaseNode.push_back(node);
+    }
+}
+
+/**
+ * Find macro of hMacroKey, the content is put into hMacroData
+ */
+static bool checkMacro(vEngineContext& ctx) {
+    int i;
+    Uint32 code, node, caseNode;
+    bool result;
+    matchMacroKey(ctx);
+    node = ctx._macroNode.size() > 0 ? ctx._macroNode.back() : MACRO_TRIE_ROOT;
+    caseNode = ctx._macroCaseNode.size() > 0 ? ctx._macroCaseNode.back() : MACRO_TRIE_DEAD;
+    for (i = 0; i < hMacroKey.size(); i++) {
+        code = MACRO_KEY(hMacroKey[i]);
+        if (code != hMacroKey[i]) { //the next nodes will be moved with new code
+            hMacroKey[i] = code;
+            resetMacroMatch(ctx, i);
+        }
+    }
+    result = findMacro(hMacroKey, node, caseNode, ctx.config.codeTable, ctx.config.autoCapsMacro, hMacroData);
+    if (ctx.config.autoCapsMacro) //key can be changed to lower case
+        resetMacroMatch(ctx, 0);
+    return result;
+}
+
+void upperCaseFirstCharacter(vEngineContext& ctx) {
+    if (!(TYPING_WORD(0) & CAPS_MASK)) {
         hCode = vWillProcess;
         hBPC = 0;
         hNCC = 1;
-        TypingWord[0] |= CAPS_MASK;
-        hData[0] = GET(TypingWord[0]);
-        _upperCaseStatus = 0;
-        if (vUseMacro)
+        TYPING_WORD(0) |= CAPS_MASK;
+        hData[0] = GET(TYPING_WORD(0));
+        ctx._upperCaseStatus = 0;
+        if (ctx.config.useMacro) {
             hMacroKey[0] |= CAPS_MASK;
+            resetMacroMatch(ctx, 0);
+        }
     }
 }
 
-void handleMainKey(const Uint16& data, const bool& isCaps) {
+void handleMainKey(vEngineContext& ctx, const Uint16& data, const bool& isCaps) {
+    int i, j, k, l;
+    Uint16 keyForAEO;
     //if is Z key, remove mark
     if (IS_KEY_Z(data)) {
-        removeMark();
-        if (!isChanged) {
-            insertKey(data, isCaps);
+        removeMark(ctx);
+        if (!ctx.isChanged) {
+            insertKey(ctx, data, isCaps);
         }
         return;
     }
     
     if (data == KEY_LEFT_BRACKET) { //standalone key [
-        checkForStandaloneChar(data, isCaps, KEY_O);
+        checkForStandaloneChar(ctx, data, isCaps, KEY_O);
         return;
     }
     
     if (data == KEY_RIGHT_BRACKET) { //standalone key }
-        checkForStandaloneChar(data, isCaps, KEY_U);
+        checkForStandaloneChar(ctx, data, isCaps, KEY_U);
         return;
     }
     
     //if is D key
     if (IS_KEY_D(data)) {
-        isCorect = false;
-        isChanged = false;
-        k = _index;
+        ctx.isCorect = false;
+        ctx.isChanged = false;
+        k = ctx._index;
         for (i = 0; i < _consonantD.size(); i++) {
-            if (_index < _consonantD[i].size())
+            if (ctx._index < _consonantD[i].size())
                 continue;
-            isCorect = true;
-            checkCorrectVowel(_consonantD, i, k, data);
+            ctx.isCorect = true;
+            checkCorrectVowel(ctx, _consonantD, i, k, data);
             
             //allow d after consonant
-            if (!isCorect && _index - 2 >= 0 && CHR(_index-1) == KEY_D && IS_CONSONANT(CHR(_index-2))) {
-                isCorect = true;
+            if (!ctx.isCorect && ctx._index - 2 >= 0 && CHR(ctx._index-1) == KEY_D && IS_CONSONANT(CHR(ctx._index-2))) {
+                ctx.isCorect = true;
             }
-            if (isCorect) {
-                isChanged = true;
-                insertD(data, isCaps);
+            if (ctx.isCorect) {
+                ctx.isChanged = true;
+                insertD(ctx, data, isCaps);
                 break;
             }
         }
     
-        if (!isChanged) {
-            insertKey(data, isCaps);
+        if (!ctx.isChanged) {
+            insertKey(ctx, data, isCaps);
         }
         return;
     }
@@ -1144,46 +1309,46 @@ void handleMainKey(const Uint16& data, const bool& isCaps) {
     if (IS_MARK_KEY(data)) {
         for (i = 0; i < _vowelForMark.size(); i++) {
             vector<vector<Uint16>>& charset = _vowelForMark[i];
-            isCorect = false;
-            isChanged = false;
-            k = _index;
+            ctx.isCorect = false;
+            ctx.isChanged = false;
+            k = ctx._index;
             for (l = 0; l < charset.size(); l++) {
-                if (_index < charset[l].size())
+                if (ctx._index < charset[l].size())
                     continue;
-                isCorect = true;
-                checkCorrectVowel(charset, l, k, data);
+                ctx.isCorect = true;
+                checkCorrectVowel(ctx, charset, l, k, data);
                 
-                if (isCorect) {
-                    isChanged = true;
+                if (ctx.isCorect) {
+                    ctx.isChanged = true;
                     if (IS_KEY_S(data))
-                        insertMark(MARK1_MASK);
+                        insertMark(ctx, MARK1_MASK);
                     else if (IS_KEY_F(data))
-                        insertMark(MARK2_MASK);
+                        insertMark(ctx, MARK2_MASK);
                     else if (IS_KEY_R(data))
-                        insertMark(MARK3_MASK);
+                        insertMark(ctx, MARK3_MASK);
                     else if (IS_KEY_X(data))
-                        insertMark(MARK4_MASK);
+                        insertMark(ctx, MARK4_MASK);
                     else if (IS_KEY_J(data))
-                        insertMark(MARK5_MASK);
+                        insertMark(ctx, MARK5_MASK);
                     break;
                 }
             }
 
-            if (isCorect) {
+            if (ctx.isCorect) {
                 break;
             }
         }
         
-        if (!isChanged) {
-            insertKey(data, isCaps);
+        if (!ctx.isChanged) {
+            insertKey(ctx, data, isCaps);
         }
         
         return;
     }
     
     //check Vowel
-    if (vInputType == vVNI) {
-        for (i = _index-1; i >= 0; i--) {
+    if (ctx.config.inputType == vVNI) {
+        for (i = ctx._index-1; i >= 0; i--) {
             if (CHR(i) == KEY_O || CHR(i) == KEY_A || CHR(i) == KEY_E) {
                 VEI = i;
                 break;
@@ -1191,24 +1356,24 @@ void handleMainKey(const Uint16& data, const bool& isCaps) {
         }
     }
     
-    keyForAEO = ((vInputType != vVNI) ? data : ((data == KEY_7 || data == KEY_8 ? KEY_W : (data == KEY_6 ? TypingWord[VEI] : data))));
+    keyForAEO = ((ctx.config.inputType != vVNI) ? data : ((data == KEY_7 || data == KEY_8 ? KEY_W : (data == KEY_6 ? TYPING_WORD(VEI) : data))));
     vector<vector<Uint16>>& charset = _vowel[keyForAEO];
-    isCorect = false;
-    isChanged = false;
-    k = _index;
+    ctx.isCorect = false;
+    ctx.isChanged = false;
+    k = ctx._index;
     for (i = 0; i < charset.size(); i++) {
-        if (_index < charset[i].size())
+        if (ctx._index < charset[i].size())
             continue;
-        isCorect = true;
-        checkCorrectVowel(charset, i, k, data);
+        ctx.isCorect = true;
+        checkCorrectVowel(ctx, charset, i, k, data);
         
-        if (isCorect) {
-            isChanged = true;
+        if (ctx.isCorect) {
+            ctx.isChanged = true;
             if (IS_KEY_DOUBLE(data)) {
-                insertAOE(keyForAEO, isCaps);
+                insertAOE(ctx, keyForAEO, isCaps);
             } else if (IS_KEY_W(data)) {
-                if (vInputType == vVNI) {
-                    for (j = _index-1; j >= 0; j--) {
+                if (ctx.config.inputType == vVNI) {
+                    for (j = ctx._index-1; j >= 0; j--) {
                         if (CHR(j) == KEY_O || CHR(j) == KEY_U ||CHR(j) == KEY_A || CHR(j) == KEY_E) {
                             VEI = j;
                             break;
@@ -1217,84 +1382,153 @@ void handleMainKey(const Uint16& data, const bool& isCaps) {
                     if ((data == KEY_7 && CHR(VEI) == KEY_A && (VEI-1>=0 ? CHR(VEI-1) != KEY_U : true)) || (data == KEY_8 && (CHR(VEI) == KEY_O || CHR(VEI) == KEY_U)))
                         break;
                 }
-                insertW(keyForAEO, isCaps);
+                insertW(ctx, keyForAEO, isCaps);
             }
             break;
         }
     }
     
-    if (!isChanged) {
-        if (data == KEY_W && vInputType != vSimpleTelex1) {
-            checkForStandaloneChar(data, isCaps, KEY_U);
+    if (!ctx.isChanged) {
+        if (data == KEY_W && ctx.config.inputType != vSimpleTelex1) {
+            checkForStandaloneChar(ctx, data, isCaps, KEY_U);
         } else {
-            insertKey(data, isCaps);
+            insertKey(ctx, data, isCaps);
         }
     }
 }
 
-void handleQuickTelex(const Uint16& data, const bool& isCaps) {
+void handleQuickTelex(vEngineContext& ctx, const Uint16& data, const bool& isCaps) {
     hCode = vWillProcess;
     hBPC = 1;
     hNCC = 2;
     hData[1] = _quickTelex[data][0] | (isCaps ? CAPS_MASK : 0);
     hData[0] = _quickTelex[data][1] | (isCaps ? CAPS_MASK : 0);
-    insertKey(_quickTelex[data][1], isCaps, false);
+    insertKey(ctx, _quickTelex[data][1], isCaps, false);
 }
 
-bool checkRestoreIfWrongSpelling(const int& handleCode) {
-    for (ii = 0; ii < _index; ii++) {
-        if (!IS_CONSONANT(CHR(ii)) &&
-            (TypingWord[ii] & MARK_MASK || TypingWord[ii] & TONE_MASK || TypingWord[ii] & TONEW_MASK)) {
-            
-            hCode = handleCode;
-            hBPC = _index;
-            hNCC = _stateIndex;
-            for (i = 0; i < _stateIndex; i++) {
-                TypingWord[i] = KeyStates[i];
-                hData[_stateIndex - 1 - i] = TypingWord[i];
+/**
+ * Cell @index of the whole word / of its keys, long words start in _longWordHelper / _longStateHelper
+ */
+static inline Uint32 getWordCell(vEngineContext& ctx, const int& index) {
+    const int longCount = (int)ctx._longWordHelper.size();
+    return index < longCount ? ctx._longWordHelper[index] : TYPING_WORD(index - longCount);
+}
+
+static inline Uint32 getStateCell(vEngineContext& ctx, const int& index) {
+    const int longCount = (int)ctx._longStateHelper.size();
+    return index < longCount ? ctx._longStateHelper[index] : KEY_STATE(index - longCount);
+}
+
+/**
+ * Remove the last key of the word, the first keys of a long word move back into the ring
+ */
+static inline void removeLastState(vEngineContext& ctx) {
+    if (ctx._stateIndex == 0)
+        return;
+    ctx._stateIndex--;
+    if (ctx._longStateHelper.size() > 0) {
+        ctx._stateHead = (ctx._stateHead - 1) & (MAX_BUFF - 1);
+        KEY_STATE(0) = ctx._longStateHelper.back();
+        ctx._longStateHelper.pop_back();
+        ctx._stateIndex++;
+    }
+}
+
+bool checkRestoreIfWrongSpelling(vEngineContext& ctx, const int& handleCode) {
+    int i, ii;
+    //the whole word is _longWordHelper + TypingWord, its keys are _longStateHelper + KeyStates
+    const int wordLength = (int)ctx._longWordHelper.size() + ctx._index;
+    const int stateLength = (int)ctx._longStateHelper.size() + ctx._stateIndex;
+    for (ii = 0; ii < wordLength; ii++) {
+        const Uint32 cell = getWordCell(ctx, ii);
+        if (!IS_CONSONANT((Uint16)cell) && (cell & MARK_MASK || cell & TONE_MASK || cell & TONEW_MASK)) {
+            int start = 0;
+            if (wordLength >= MAX_BUFF || stateLength > MAX_BUFF) {
+                //too long to send again: keep the first characters which are the same as the keys
+                while (start < wordLength && start < stateLength && getWordCell(ctx, start) == getStateCell(ctx, start))
+                    start++;
+            }
+            if (wordLength - start >= MAX_BUFF || stateLength - start > MAX_BUFF) {
+                //more than HookState.charData: send the keys with the macro output, which has no limit
+                if (wordLength - start >= LONG_RESTORE_MAX_BACKSPACE)
+                    return false;
+                hCode = vReplaceMaro;
+                hBPC = wordLength - start;
+                hNCC = 0;
+                hMacroData.clear();
+                for (i = start; i < stateLength; i++) {
+                    hMacroData.push_back(getStateCell(ctx, i));
+                }
+            } else {
+                hCode = handleCode;
+                hBPC = wordLength - start;
+                hNCC = stateLength - start;
+                for (i = start; i < stateLength; i++) {
+                    hData[stateLength - 1 - i] = getStateCell(ctx, i);
+                }
+            }
+            for (i = 0; i < ctx._stateIndex; i++) {
+                TYPING_WORD(i) = KEY_STATE(i);
             }
-            _index = _stateIndex;
+            ctx._longWordHelper = ctx._longStateHelper;
+            ctx._index = ctx._stateIndex;
             return true;
         }
     }
     return false;
 }
 
-void vTempOffSpellChecking() {
-    if (_useSpellCheckingBefore) {
-        vCheckSpelling = vCheckSpelling ? 0 : 1;
+void vTempOffSpellChecking(vEngineContext& ctx) {
+    if (ctx._useSpellCheckingBefore) {
+        ctx.config.checkSpelling = ctx.config.checkSpelling ? 0 : 1;
     }
 }
 
+void vSetCheckSpelling(vEngineContext& ctx) {
+    ctx._useSpellCheckingBefore = ctx.config.checkSpelling;
+}
+
+void vTempOffEngine(vEngineContext& ctx, const bool& off) {
+    ctx._willTempOffEngine = off;
+}
+
+void vTempOffSpellChecking() {
+    vLoadEngineConfig(_defaultContext.config);
+    vTempOffSpellChecking(_defaultContext);
+    vCheckSpelling = _defaultContext.config.checkSpelling;
+}
+
 void vSetCheckSpelling() {
-    _useSpellCheckingBefore = vCheckSpelling;
+    vLoadEngineConfig(_defaultContext.config);
+    vSetCheckSpelling(_defaultContext);
 }
 
 void vTempOffEngine(const bool& off) {
-    _willTempOffEngine = off;
+    vTempOffEngine(_defaultContext, off);
 }
 
-bool checkQuickConsonant() {
-    if (_index <= 1) return false;
+bool checkQuickConsonant(vEngineContext& ctx) {
+    int i, l;
+    if (ctx._index <= 1) return false;
     l = 0;
-    if (_index > 0) {
-        if (vQuickStartConsonant && _quickStartConsonant.find(CHR(0)) != _quickStartConsonant.end()) {
+    if (ctx._index > 0) {
+        if (ctx.config.quickStartConsonant && _quickStartConsonant.find(CHR(0)) != _quickStartConsonant.end()) {
             hCode = vRestore;
-            hBPC = _index;
-            hNCC = _index + 1;
-            if (_index < MAX_BUFF-1)
-                _index++;
+            hBPC = ctx._index;
+            hNCC = ctx._index + 1;
+            if (ctx._index < MAX_BUFF-1)
+                ctx._index++;
             //right shift
-            for (i = _index-1; i >= 2; i--) {
-                TypingWord[i] = TypingWord[i-1];
+            for (i = ctx._index-1; i >= 2; i--) {
+                TYPING_WORD(i) = TYPING_WORD(i-1);
             }
-            TypingWord[1] = _quickStartConsonant[CHR(0)][1] | ((TypingWord[0] & CAPS_MASK) && (TypingWord[2] & CAPS_MASK) ? CAPS_MASK : 0);
-            TypingWord[0] = _quickStartConsonant[CHR(0)][0] | (TypingWord[0] & CAPS_MASK ? CAPS_MASK : 0);
+            TYPING_WORD(1) = _quickStartConsonant[CHR(0)][1] | ((TYPING_WORD(0) & CAPS_MASK) && (TYPING_WORD(2) & CAPS_MASK) ? CAPS_MASK : 0);
+            TYPING_WORD(0) = _quickStartConsonant[CHR(0)][0] | (TYPING_WORD(0) & CAPS_MASK ? CAPS_MASK : 0);
             l = 1;;
         }
-        if (vQuickEndConsonant &&
-            (_index-2 >= 0 && !IS_CONSONANT(CHR(_index-2))) &&
-            _quickEndConsonant.find(CHR(_index-1)) != _quickEndConsonant.end()) {
+        if (ctx.config.quickEndConsonant &&
+            (ctx._index-2 >= 0 && !IS_CONSONANT(CHR(ctx._index-2))) &&
+            _quickEndConsonant.find(CHR(ctx._index-1)) != _quickEndConsonant.end()) {
             hCode = vRestore;
             if (l == 1) {
                 hNCC++;
@@ -1302,17 +1536,17 @@ bool checkQuickConsonant() {
                 hBPC = 1;
                 hNCC = 2;
             }
-            if (_index < MAX_BUFF-1)
-                _index++;
-            TypingWord[_index-1] = _quickEndConsonant[CHR(_index-2)][1] | (TypingWord[_index-2] & CAPS_MASK ? CAPS_MASK : 0);
-            TypingWord[_index-2] = _quickEndConsonant[CHR(_index-2)][0] | (TypingWord[_index-2] & CAPS_MASK ? CAPS_MASK : 0);
+            if (ctx._index < MAX_BUFF-1)
+                ctx._index++;
+            TYPING_WORD(ctx._index-1) = _quickEndConsonant[CHR(ctx._index-2)][1] | (TYPING_WORD(ctx._index-2) & CAPS_MASK ? CAPS_MASK : 0);
+            TYPING_WORD(ctx._index-2) = _quickEndConsonant[CHR(ctx._index-2)][0] | (TYPING_WORD(ctx._index-2) & CAPS_MASK ? CAPS_MASK : 0);
             
             l = 1;
         }
         if (l == 1) {
-            _hasHandleQuickConsonant = true;
-            for (i = _index - 1; i >= 0; i--) {
-                hData[_index - 1 - i] = GET(TypingWord[i]);
+            ctx._hasHandleQuickConsonant = true;
+            for (i = ctx._index - 1; i >= 0; i--) {
+                hData[ctx._index - 1 - i] = GET(TYPING_WORD(i));
             }
             return true;
         }
@@ -1321,316 +1555,429 @@ bool checkQuickConsonant() {
 }
 /*==========================================================================================================*/
 
-void vEnglishMode(const vKeyEventState& state, const Uint16& data, const bool& isCaps, const bool& otherControlKey) {
+void vEnglishMode(vEngineContext& ctx, const vKeyEventState& state, const Uint16& data, const bool& isCaps, const bool& otherControlKey) {
     hCode = vDoNothing;
+    ctx._renderedCount = 0;
     if (state == vKeyEventState::MouseDown || (otherControlKey && !isCaps)) {
         hMacroKey.clear();
-        _willTempOffEngine = false;
+        ctx._willTempOffEngine = false;
     } else if (data == KEY_SPACE) {
-        if (!_hasHandledMacro && findMacro(hMacroKey, hMacroData)) {
+        if (!ctx._hasHandledMacro && checkMacro(ctx)) {
             hCode = vReplaceMaro;
             hBPC = (Byte)hMacroKey.size();
         }
         hMacroKey.clear();
-        _willTempOffEngine = false;
+        ctx._willTempOffEngine = false;
     } else if (data == KEY_DELETE) {
         if (hMacroKey.size() > 0) {
             hMacroKey.pop_back();
         } else {
-            _willTempOffEngine = false;
+            ctx._willTempOffEngine = false;
         }
     } else {
         if (isWordBreak(vKeyEvent::Keyboard, state, data) &&
             !(data < 256 && _charKeyCodeLookup[data])) {
             hMacroKey.clear();
-            _willTempOffEngine = false;
+            ctx._willTempOffEngine = false;
         } else {
-            if (!_willTempOffEngine)
+            if (!ctx._willTempOffEngine)
                 hMacroKey.push_back(data | (isCaps ? CAPS_MASK : 0));
         }
     }
+    matchMacroKey(ctx);
 }
 
-void vKeyHandleEvent(const vKeyEvent& event,
+/**
+ * Code of a cell of HookState.charData as the main program sends it: character code,
+ * unicode of a key code or raw key code. Same rendered code means same characters on screen.
+ */
+static inline Uint32 getRenderedCode(const Uint32& data) {
+    if (data & CHAR_CODE_MASK)
+        return data & (CHAR_MASK | CHAR_CODE_MASK);
+    Uint16 ch = keyCodeToCharacter(data);
+    return ch != 0 ? ch : (Uint16)data | RENDERED_KEY_MASK;
+}
+
+static inline void pushRenderedCode(vEngineContext& ctx, const Uint32& code) {
+    if (ctx._renderedCount == MAX_BUFF) { //keep the last MAX_BUFF characters
+        memmove(ctx._rendered, ctx._rendered + 1, (MAX_BUFF - 1) * sizeof(Uint32));
+        ctx._renderedCount--;
+    }
+    ctx._rendered[ctx._renderedCount++] = code;
+}
+
+/**
+ * Remove the backspaces which delete characters that are sent again:
+ * the first characters of charData which are the same as the deleted characters on screen.
+ */
+static void minimizeOutput(vEngineContext& ctx) {
+    int i, start;
+    if (hBPC == 0 || hBPC >= MAX_BUFF || hBPC > ctx._renderedCount)
+        return;
+    start = ctx._renderedCount - hBPC;
+    for (i = 0; i < hBPC && i < hNCC; i++) {
+        if (ctx._rendered[start + i] != getRenderedCode(hData[hNCC - 1 - i]))
+            break;
+    }
+    hBPC -= i;
+    hNCC -= i;
+    ctx.outputStats.savedBackspaceCount += i;
+    ctx.outputStats.savedCharCount += i;
+}
+
+/**
+ * Update the shadow of screen after the main program handles HookState.
+ * When we don't know what happen on screen, the shadow is cleared.
+ */
+static void updateRenderedWord(vEngineContext& ctx, const vKeyEvent& event, const Uint16& data) {
+    int i;
+    if (event != vKeyEvent::Keyboard) {
+        ctx._renderedCount = 0;
+    } else if (hCode == vDoNothing) { //the key is sent to the app
+        if (data == KEY_DELETE && hExt == 2) {
+            if (ctx._renderedCount > 0)
+                ctx._renderedCount--;
+        } else if (hExt == 3 && keyCodeToCharacter(data | (ctx._isCaps ? CAPS_MASK : 0)) != 0) {
+            pushRenderedCode(ctx, keyCodeToCharacter(data | (ctx._isCaps ? CAPS_MASK : 0)));
+        } else {
+            ctx._renderedCount = 0;
+        }
+    } else if (hCode == vWillProcess || hCode == vRestore) {
+        minimizeOutput(ctx);
+        ctx.outputStats.outputCount++;
+        ctx.outputStats.backspaceCount += hBPC;
+        ctx.outputStats.newCharCount += hNCC;
+        ctx._renderedCount = hBPC <= ctx._renderedCount ? ctx._renderedCount - hBPC : 0;
+        for (i = hNCC - 1; i >= 0; i--) {
+            pushRenderedCode(ctx, getRenderedCode(hData[i]));
+        }
+        if (hCode == vRestore) //the key is sent with main program's caps status
+            ctx._renderedCount = 0;
+    } else {
+        ctx._renderedCount = 0;
+    }
+}
+
+static void handleKeyEvent(vEngineContext& ctx,
+                     const vKeyEvent& event,
                      const vKeyEventState& state,
                      const Uint16& data,
                      const Uint8& capsStatus,
                      const bool& otherControlKey) {
+    int i;
+    bool _isCharKeyCode;
     // OPTIMIZATION P1.2: Early exit for control key combinations
     // Skip Vietnamese processing for Ctrl+X, Alt+Tab, etc.
     // Exception: Allow if vTempOffOpenKey is enabled (user may use Alt for temp disable)
     // Exception: Continue processing if it's a potential macro trigger in English mode (handled in vEnglishMode)
-    if (otherControlKey && !vTempOffOpenKey) {
+    if (otherControlKey && !ctx.config.tempOffOpenKey) {
         hCode = vDoNothing;
         hBPC = 0;
         hNCC = 0;
         hExt = 1; //word break
         
         // Clear macro key buffer if using macro
-        if (vUseMacro) {
+        if (ctx.config.useMacro) {
             hMacroKey.clear();
         }
         
         // Reset state and exit early
-        startNewSession();
-        vCheckSpelling = _useSpellCheckingBefore;
-        _willTempOffEngine = false;
+        startNewSession(ctx);
+        ctx.config.checkSpelling = ctx._useSpellCheckingBefore;
+        ctx._willTempOffEngine = false;
         return;
     }
     
-    _isCaps = (capsStatus == 1 || //shift
+    ctx._isCaps = (capsStatus == 1 || //shift
                capsStatus == 2); //caps lock
     if ((IS_NUMBER_KEY(data) && capsStatus == 1)
-        || otherControlKey || isWordBreak(event, state, data) || (_index == 0 && IS_NUMBER_KEY(data))) {
+        || otherControlKey || isWordBreak(event, state, data) || (ctx._index == 0 && IS_NUMBER_KEY(data))) {
         hCode = vDoNothing;
         hBPC = 0;
         hNCC = 0;
         hExt = 1; //word break
         
         //check macro feature
-        if (vUseMacro && isMacroBreakCode(data) && !_hasHandledMacro && findMacro(hMacroKey, hMacroData)) {
+        if (ctx.config.useMacro && isMacroBreakCode(data) && !ctx._hasHandledMacro && checkMacro(ctx)) {
             hCode = vReplaceMaro;
             hBPC = (Byte)hMacroKey.size();
-            _hasHandledMacro = true;
-        } else if ((vQuickStartConsonant || vQuickEndConsonant) && !tempDisableKey && isMacroBreakCode(data)) {
-            checkQuickConsonant();
-        } else if (vRestoreIfWrongSpelling && isWordBreak(event, state, data)) { //restore key if wrong spelling with break-key
-            if (!tempDisableKey && vCheckSpelling) {
-                checkSpelling(true); //force check spelling
+            ctx._hasHandledMacro = true;
+        } else if ((ctx.config.quickStartConsonant || ctx.config.quickEndConsonant) && !ctx.tempDisableKey && isMacroBreakCode(data)) {
+            checkQuickConsonant(ctx);
+        } else if (ctx.config.restoreIfWrongSpelling && isWordBreak(event, state, data)) { //restore key if wrong spelling with break-key
+            if (!ctx.tempDisableKey && ctx.config.checkSpelling) {
+                checkSpelling(ctx, true); //force check spelling
             }
-            if (tempDisableKey && !checkRestoreIfWrongSpelling(vRestoreAndStartNewSession)) {
+            if (ctx.tempDisableKey && !checkRestoreIfWrongSpelling(ctx, vRestoreAndStartNewSession)) {
                 hCode = vDoNothing;
             }
         }
         
         _isCharKeyCode = state == KeyDown && (data < 256 && _charKeyCodeLookup[data]);
         if (!_isCharKeyCode) { //clear all line cache
-            _specialChar.clear();
-            _typingStates.clear();
+            ctx._specialChar.clear();
+            clearTypingHistory(ctx._typingStates);
         } else { //check and save current word
-            if (_spaceCount > 0) {
-                saveWord(KEY_SPACE, _spaceCount);
-                _spaceCount = 0;
+            if (ctx._spaceCount > 0) {
+                saveWord(ctx, KEY_SPACE, ctx._spaceCount);
+                ctx._spaceCount = 0;
             } else {
-                saveWord();
+                saveWord(ctx);
             }
-            _specialChar.push_back(data | (_isCaps ? CAPS_MASK : 0));
+            ctx._specialChar.push_back(data | (ctx._isCaps ? CAPS_MASK : 0));
             hExt = 3;//normal word
         }
         
         if (hCode == vDoNothing) {
-            startNewSession();
-            vCheckSpelling = _useSpellCheckingBefore;
-            _willTempOffEngine = false;
-        } else if (hCode == vReplaceMaro || _hasHandleQuickConsonant) {
-            _index = 0;
+            startNewSession(ctx);
+            ctx.config.checkSpelling = ctx._useSpellCheckingBefore;
+            ctx._willTempOffEngine = false;
+        } else if (isLongWordRestore(ctx)) { //like vRestoreAndStartNewSession
+            ctx._index = 0;
+            ctx._stateIndex = 0;
+            ctx._longWordHelper.clear();
+            ctx._longStateHelper.clear();
+        } else if (hCode == vReplaceMaro || ctx._hasHandleQuickConsonant) {
+            ctx._index = 0;
         }
         
         //insert key for macro function
-        if (vUseMacro) {
+        if (ctx.config.useMacro) {
             if (_isCharKeyCode) {
-                hMacroKey.push_back(data | (_isCaps ? CAPS_MASK : 0));
+                hMacroKey.push_back(data | (ctx._isCaps ? CAPS_MASK : 0));
             } else {
                 hMacroKey.clear();
             }
         }
         
-        if (vUpperCaseFirstChar) {
+        if (ctx.config.upperCaseFirstChar) {
             if (data == KEY_DOT)
-                _upperCaseStatus = 1;
+                ctx._upperCaseStatus = 1;
             else if (data == KEY_ENTER || data == KEY_RETURN)
-                _upperCaseStatus = 2;
+                ctx._upperCaseStatus = 2;
             else
-                _upperCaseStatus = 0;
+                ctx._upperCaseStatus = 0;
         }
     } else if (data == KEY_SPACE) {
-        if (!tempDisableKey && vCheckSpelling) {
-            checkSpelling(true); //force check spelling
+        if (!ctx.tempDisableKey && ctx.config.checkSpelling) {
+            checkSpelling(ctx, true); //force check spelling
         }
-        if (vUseMacro && !_hasHandledMacro && findMacro(hMacroKey, hMacroData)) { //macro
+        if (ctx.config.useMacro && !ctx._hasHandledMacro && checkMacro(ctx)) { //macro
             hCode = vReplaceMaro;
             hBPC = (Byte)hMacroKey.size();
-            _spaceCount++;
-            _hasHandledMacro = true;
-        } else if ((vQuickStartConsonant || vQuickEndConsonant) && !tempDisableKey && checkQuickConsonant()) {
-            _spaceCount++;
-        } else if (vRestoreIfWrongSpelling && tempDisableKey && !_hasHandledMacro) { //restore key if wrong spelling
-            if (!checkRestoreIfWrongSpelling(vRestore)) {
+            ctx._spaceCount++;
+            ctx._hasHandledMacro = true;
+        } else if ((ctx.config.quickStartConsonant || ctx.config.quickEndConsonant) && !ctx.tempDisableKey && checkQuickConsonant(ctx)) {
+            ctx._spaceCount++;
+        } else if (ctx.config.restoreIfWrongSpelling && ctx.tempDisableKey && !ctx._hasHandledMacro) { //restore key if wrong spelling
+            if (!checkRestoreIfWrongSpelling(ctx, vRestore)) {
                 hCode = vDoNothing;
             }
-            _spaceCount++;
+            ctx._spaceCount++;
         } else { //do nothing with SPACE KEY
             hCode = vDoNothing;
-            _spaceCount++;
+            ctx._spaceCount++;
         }
-        if (vUseMacro) {
+        if (ctx.config.useMacro) {
             hMacroKey.clear();
         }
-        if (vUpperCaseFirstChar && _upperCaseStatus == 1) {
-            _upperCaseStatus = 2;
+        if (ctx.config.upperCaseFirstChar && ctx._upperCaseStatus == 1) {
+            ctx._upperCaseStatus = 2;
         }
         //save word
-        if (_spaceCount == 1) {
-            if (_specialChar.size() > 0) {
-                saveSpecialChar();
+        if (ctx._spaceCount == 1) {
+            if (ctx._specialChar.size() > 0) {
+                saveSpecialChar(ctx);
             } else {
-                saveWord();
+                saveWord(ctx);
             }
         }
-        vCheckSpelling = _useSpellCheckingBefore;
-        _willTempOffEngine = false;
+        ctx.config.checkSpelling = ctx._useSpellCheckingBefore;
+        ctx._willTempOffEngine = false;
     } else if (data == KEY_DELETE) {
         hCode = vDoNothing;
         hExt = 2; //delete
-        if (_specialChar.size() > 0) {
-            _specialChar.pop_back();
-            if (_specialChar.size() == 0) {
-                restoreLastTypingState();
+        if (ctx._specialChar.size() > 0) {
+            ctx._specialChar.pop_back();
+            if (ctx._specialChar.size() == 0) {
+                restoreLastTypingState(ctx);
             }
-        } else if (_spaceCount > 0) { //previous char is space
-            _spaceCount--;
-            if (_spaceCount == 0) { //restore word
-                restoreLastTypingState();
+        } else if (ctx._spaceCount > 0) { //previous char is space
+            ctx._spaceCount--;
+            if (ctx._spaceCount == 0) { //restore word
+                restoreLastTypingState(ctx);
             }
         } else {
-            if (_stateIndex > 0) {
-                _stateIndex--;
-            }
-            if (_index > 0){
-                _index--;
-                if (_longWordHelper.size() > 0) {
-                    //right shift
-                    for (i = MAX_BUFF - 1; i > 0; i--) {
-                        TypingWord[i] = TypingWord[i-1];
-                    }
-                    TypingWord[0] = _longWordHelper.back();
-                    _longWordHelper.pop_back();
-                    _index++;
+            if (ctx._index > 0){
+                const bool isKeyCharacter = ctx._stateIndex > 0 &&
+                    getWordCell(ctx, (int)ctx._longWordHelper.size() + ctx._index - 1) ==
+                    getStateCell(ctx, (int)ctx._longStateHelper.size() + ctx._stateIndex - 1);
+                ctx._index--;
+                if (ctx._longWordHelper.size() > 0) {
+                    //move the start of the ring buffer back, the deleted cell becomes the first cell
+                    ctx._wordHead = (ctx._wordHead - 1) & (MAX_BUFF - 1);
+                    TYPING_WORD(0) = ctx._longWordHelper.back();
+                    ctx._longWordHelper.pop_back();
+                    ctx._index++;
                 }
                 
-                // FIX: Synchronize state index with typing index
-                // This ensures KeyStates and TypingWord buffers stay in sync after backspace
-                _stateIndex = _index;
+                // FIX: Synchronize KeyStates with TypingWord after backspace: a character which is the same
+                // as the last key is deleted with that key, else the keys are cut to the length of the word
+                if (isKeyCharacter) {
+                    removeLastState(ctx);
+                } else {
+                    while (ctx._longStateHelper.size() + ctx._stateIndex > ctx._longWordHelper.size() + ctx._index)
+                        removeLastState(ctx);
+                }
                 
                 // FIX: Clear garbage data in KeyStates buffer (defensive programming)
                 // Prevents checkSpelling from accidentally reading stale data beyond current index
-                for (i = _index; i < MAX_BUFF; i++) {
-                    KeyStates[i] = 0;
+                for (i = ctx._stateIndex; i < MAX_BUFF; i++) {
+                    KEY_STATE(i) = 0;
                 }
                 
                 // FIX: Reset Vietnamese mode flag to allow re-evaluation with fresh spell check
                 // Bug: After backspace, tempDisableKey was left true from previous spell check,
                 // causing engine to incorrectly stay in English mode
-                tempDisableKey = false;
+                ctx.tempDisableKey = false;
                 
-                if (vCheckSpelling)
-                    checkSpelling();
+                if (ctx.config.checkSpelling)
+                    checkSpelling(ctx);
             }
-            if (vUseMacro && hMacroKey.size() > 0) {
+            if (ctx.config.useMacro && hMacroKey.size() > 0) {
                 hMacroKey.pop_back();
             }
             
             hBPC = 0;
             hNCC = 0;
             hExt = 2; //delete key
-            if (_index == 0) {
-                startNewSession();
-                _specialChar.clear();
-                restoreLastTypingState();
+            if (ctx._index == 0) {
+                startNewSession(ctx);
+                ctx._specialChar.clear();
+                restoreLastTypingState(ctx);
             } else { //August 23rd continue check grammar
-                checkGrammar(1);
+                checkGrammar(ctx, 1);
             }
         }
     } else { //START AND CHECK KEY
-        if (_willTempOffEngine) {
+        if (ctx._willTempOffEngine) {
             hCode = vDoNothing;
             hExt = 3;
             return;
         }
-        if (_spaceCount > 0) {
+        if (ctx._spaceCount > 0) {
             hBPC = 0;
             hNCC = 0;
             hExt = 0;
-            startNewSession();
+            startNewSession(ctx);
             //continute save space
-            saveWord(KEY_SPACE, _spaceCount);
-            _spaceCount = 0;
-        } else if (_specialChar.size() > 0) {
-            saveSpecialChar();
+            saveWord(ctx, KEY_SPACE, ctx._spaceCount);
+            ctx._spaceCount = 0;
+        } else if (ctx._specialChar.size() > 0) {
+            saveSpecialChar(ctx);
         }
 
-        insertState(data, _isCaps); //save state
+        insertState(ctx, data, ctx._isCaps); //save state
         
-        if (!IS_SPECIALKEY(data) || tempDisableKey) { //do nothing
-            if (vQuickTelex && IS_QUICK_TELEX_KEY(data)) {
-                handleQuickTelex(data, _isCaps);
+        if (!IS_SPECIALKEY(data) || ctx.tempDisableKey) { //do nothing
+            if (ctx.config.quickTelex && IS_QUICK_TELEX_KEY(data)) {
+                handleQuickTelex(ctx, data, ctx._isCaps);
                 return;
             } else {
                 hCode = vDoNothing;
                 hBPC = 0;
                 hNCC = 0;
                 hExt = 3; //normal key
-                insertKey(data, _isCaps);
+                insertKey(ctx, data, ctx._isCaps);
             }
         } else { //check and update key
             //restore state
             hCode = vDoNothing;
             hExt = 3; //normal key
-            handleMainKey(data, _isCaps);
+            handleMainKey(ctx, data, ctx._isCaps);
         }
 
-        if (!vFreeMark && !IS_KEY_D(data)) {
+        if (!ctx.config.freeMark && !IS_KEY_D(data)) {
             if (hCode == vDoNothing) {
-                checkGrammar(-1);
+                checkGrammar(ctx, -1);
             } else {
-                checkGrammar(0);
+                checkGrammar(ctx, 0);
             }
         }
         
         if (hCode == vRestore) {
-            insertKey(data, _isCaps);
-            _stateIndex--;
+            insertKey(ctx, data, ctx._isCaps);
+            ctx._stateIndex--;
         }
         
         //insert or replace key for macro feature
-        if (vUseMacro) {
+        if (ctx.config.useMacro) {
             if (hCode == vDoNothing) {
-                hMacroKey.push_back(data | (_isCaps ? CAPS_MASK : 0));
+                hMacroKey.push_back(data | (ctx._isCaps ? CAPS_MASK : 0));
             } else if (hCode == vWillProcess || hCode == vRestore) {
                 for (i = 0; i < hBPC; i++) {
                     if (hMacroKey.size() > 0) {
                         hMacroKey.pop_back();
                     }
                 }
-                for (i = _index - hBPC; i < hNCC + (_index - hBPC); i++) {
-                    hMacroKey.push_back(TypingWord[i]);
+                resetMacroMatch(ctx, hMacroKey.size());
+                for (i = ctx._index - hBPC; i < hNCC + (ctx._index - hBPC); i++) {
+                    hMacroKey.push_back(TYPING_WORD(i));
                 }
             }
         }
         
-        if (vUpperCaseFirstChar) {
-            if (_index == 1 && _upperCaseStatus == 2) {
-                upperCaseFirstCharacter();
+        if (ctx.config.upperCaseFirstChar) {
+            if (ctx._index == 1 && ctx._upperCaseStatus == 2) {
+                upperCaseFirstCharacter(ctx);
             }
-            _upperCaseStatus = 0;
+            ctx._upperCaseStatus = 0;
         }
         
         //case [ ]
-        if (IS_BRACKET_KEY(data) && (( IS_BRACKET_KEY((Uint16)hData[0])) || vInputType == vSimpleTelex1 || vInputType == vSimpleTelex2)) {
-            if (_index - (hCode == vWillProcess ? hBPC : 0) > 0) {
-                _index--;
-                saveWord();
+        if (IS_BRACKET_KEY(data) && (( IS_BRACKET_KEY((Uint16)hData[0])) || ctx.config.inputType == vSimpleTelex1 || ctx.config.inputType == vSimpleTelex2)) {
+            if (ctx._index - (hCode == vWillProcess ? hBPC : 0) > 0) {
+                ctx._index--;
+                saveWord(ctx);
             }
-            _index = 0;
-            tempDisableKey = false;
-            _stateIndex = 0;
+            ctx._index = 0;
+            ctx.tempDisableKey = false;
+            ctx._stateIndex = 0;
+            ctx._longStateHelper.clear();
             hExt = 3;
-            _specialChar.push_back(data | (_isCaps ? CAPS_MASK : 0));
+            ctx._specialChar.push_back(data | (ctx._isCaps ? CAPS_MASK : 0));
         }
     }
     
     //Debug
-    //cout<<"index "<<(int)_index<< ", stateIndex "<<(int)_stateIndex<<", word "<<_typingStates.size()<<", long word "<<_longWordHelper.size()<< endl;
+    //cout<<"index "<<(int)_index<< ", stateIndex "<<(int)_stateIndex<<", word "<<_typingStates.recordCount<<", long word "<<_longWordHelper.size()<< endl;
     //cout<<"backspace "<<(int)hBPC<<endl;
     //cout<<"new char "<<(int)hNCC<<endl<<endl;
 }
+
+void vKeyHandleEvent(vEngineContext& ctx,
+                     const vKeyEvent& event,
+                     const vKeyEventState& state,
+                     const Uint16& data,
+                     const Uint8& capsStatus,
+                     const bool& otherControlKey) {
+    handleKeyEvent(ctx, event, state, data, capsStatus, otherControlKey);
+    updateRenderedWord(ctx, event, data);
+    if (ctx.config.useMacro)
+        matchMacroKey(ctx);
+}
+
+void vEnglishMode(const vKeyEventState& state, const Uint16& data, const bool& isCaps, const bool& otherControlKey) {
+    vLoadEngineConfig(_defaultContext.config);
+    vEnglishMode(_defaultContext, state, data, isCaps, otherControlKey);
+}
+
+void vKeyHandleEvent(const vKeyEvent& event,
+                     const vKeyEventState& state,
+                     const Uint16& data,
+                     const Uint8& capsStatus,
+                     const bool& otherControlKey) {
+    vLoadEngineConfig(_defaultContext.config);
+    vKeyHandleEvent(_defaultContext, event, state, data, capsStatus, otherControlKey);
+    vCheckSpelling = _defaultContext.config.checkSpelling; //engine can restore spell checking after temporarily turn off
+}
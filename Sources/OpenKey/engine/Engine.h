@@ -10,13 +10,17 @@
 #define Engine_h
 
 #include <locale>
-#include <codecvt>
+#include <list>
 
 #include "DataType.h"
+#include "Utf.h"
 #include "Vietnamese.h"
 #include "Macro.h"
 #include "SmartSwitchKey.h"
 #include "ConvertTool.h"
+#include "MarkupConvert.h"
+#include "ConvertJob.h"
+#include "Fold.h"
 
 #define IS_DEBUG 1
 
@@ -187,16 +191,179 @@ extern int vOtherLanguage;
  */
 extern int vTempOffOpenKey;
 
+/**
+ * Options of one engine context, same meaning as the global variables above
+ */
+struct vEngineConfig {
+    int inputType = 0;
+    int freeMark = 0;
+    int codeTable = 0;
+    int checkSpelling = 1;
+    int useModernOrthography = 1;
+    int quickTelex = 0;
+    int restoreIfWrongSpelling = 1;
+    int useMacro = 1;
+    int upperCaseFirstChar = 0;
+    int allowConsonantZFWJ = 0;
+    int quickStartConsonant = 0;
+    int quickEndConsonant = 0;
+    int tempOffOpenKey = 0;
+    int autoCapsMacro = 0;
+    
+    //number of previous words which can be restored by backspace, used by vKeyInit
+    int historyDepth = 64;
+};
+
+/**
+ * One word in the typing history: size cells from start in vTypingHistory::cells
+ */
+struct vTypingRecord {
+    Uint32 start = 0;
+    Uint32 size = 0;
+};
+
+/**
+ * Previous words of the line, used when user deletes back to a previous word.
+ * Fixed capacity: historyDepth records and historyDepth * MAX_BUFF cells, allocated in vKeyInit,
+ * the oldest word is dropped when it's full.
+ */
+struct vTypingHistory {
+    vector<vTypingRecord> records; //ring of records
+    vector<Uint32> cells; //ring of cells
+    int firstRecord = 0;
+    int recordCount = 0;
+    int firstCell = 0;
+    int cellCount = 0;
+};
+
+static_assert((MAX_BUFF & (MAX_BUFF - 1)) == 0, "TypingWord ring buffer needs MAX_BUFF to be a power of 2");
+
+/**
+ * Synthetic events sent by vWillProcess/vRestore results,
+ * saved* are the backspaces and characters which are removed by minimal output
+ */
+struct vOutputStats {
+    Uint64 outputCount = 0;
+    Uint64 backspaceCount = 0;
+    Uint64 newCharCount = 0;
+    Uint64 savedBackspaceCount = 0;
+    Uint64 savedCharCount = 0;
+};
+
+/**
+ * All typing state of one engine session.
+ * Each context is independent, so many contexts can be used at the same time
+ * (one for each text field, or one for each thread).
+ * Macro data and code tables are shared by all contexts and read only while typing.
+ */
+struct vEngineContext {
+    vEngineConfig config;
+    
+    //Data to sendback to main program
+    vKeyHookState HookState = vKeyHookState();
+    
+    /**
+     * data structure of each element in TypingWord (Uint64)
+     * first 2 byte is character code or key code.
+     * bit 16: has caps or not
+     * bit 17: has tone ^ or not
+     * bit 18: has tone w or not
+     * bit 19 - > 23: has mark or not (Sắc, huyền, hỏi, ngã, nặng)
+     * bit 24: is standalone key? (w, [, ])
+     * bit 25: is character code or keyboard code; 1: character code; 0: keycode
+     *
+     * TypingWord is a ring buffer (MAX_BUFF must be a power of 2), use TYPING_WORD(i) to read cell i.
+     * When the word is longer than MAX_BUFF, the first cells are moved to _longWordHelper,
+     * so the whole word is _longWordHelper + TYPING_WORD(0.._index-1)
+     */
+    Uint32 TypingWord[MAX_BUFF] = {0};
+    Byte _wordHead = 0; //position of cell 0 in TypingWord
+    Byte _index = 0;
+    vector<Uint32> _longWordHelper; //save the word when _index >= MAX_BUFF
+    vTypingHistory _typingStates; //Aug 28th, 2019: typing helper, save long state of Typing word, can go back and modify the word
+    
+    /**
+     * Use for restore key if invalid word
+     */
+    Uint32 KeyStates[MAX_BUFF] = {0}; //ring buffer like TypingWord, use KEY_STATE(i)
+    Byte _stateHead = 0;
+    Byte _stateIndex = 0;
+    vector<Uint32> _longStateHelper; //first keys of the word when _stateIndex >= MAX_BUFF, like _longWordHelper
+    
+    bool tempDisableKey = false;
+    bool isCorect = false;
+    bool isChanged = false;
+    Byte vowelCount = 0;
+    Byte vowelStartIndex = 0;
+    Byte vowelEndIndex = 0;
+    Byte vowelWillSetMark = 0;
+    bool _isCaps = false;
+    int _spaceCount = 0; //add: July 30th, 2019
+    bool _hasHandledMacro = false; //for macro flag August 9th, 2019
+    Byte _upperCaseStatus = 0; //for Write upper case for the first letter; 2: will upper case
+    vector<Uint32> _specialChar;
+    bool _useSpellCheckingBefore = false;
+    bool _hasHandleQuickConsonant = false;
+    bool _willTempOffEngine = false;
+    
+    /**
+     * State of the first consonant automaton for each cell of TypingWord, see checkSpelling()
+     * _spellingNode[i], _spellingRow[i]: state after reading i cells
+     */
+    Byte _spellingIndex = 0; //number of cells which have state
+    Byte _spellingVariant = 0;
+    Uint16 _spellingKey[MAX_BUFF] = {0};
+    Uint16 _spellingNode[MAX_BUFF + 1] = {0};
+    Uint8 _spellingRow[MAX_BUFF + 1] = {SPELLING_NO_ROW};
+    
+    /**
+     * Shadow of the last characters on screen, as rendered code (see getRenderedCode()),
+     * the last one is _rendered[_renderedCount - 1]. Used to remove the backspaces which
+     * delete the same characters that will be sent again.
+     */
+    Uint32 _rendered[MAX_BUFF] = {0};
+    Byte _renderedCount = 0;
+    vOutputStats outputStats;
+    
+    /**
+     * Macro trie node after each code of HookState.macroKey, see nextMacroNode()
+     */
+    vector<Uint32> _macroNode;
+    vector<Uint32> _macroCaseNode; //same for the key in lower case (auto caps), see findMacro()
+    Uint32 _macroTrieVersion = 0;
+};
+
+/**
+ * Copy the global options above to @config
+ */
+void vLoadEngineConfig(vEngineConfig& config);
+
+/**
+ * Memory used by the typing history of @ctx in bytes,
+ * optional @recordCount and @cellCount receive number of saved words and cells
+ */
+size_t vGetTypingHistoryMemory(const vEngineContext& ctx, int* recordCount=NULL, int* cellCount=NULL);
+
 /**
  * Call this function first to receive data pointer
  */
 void* vKeyInit();
 
+/**
+ * Reset @ctx before using it, return pointer to its vKeyHookState
+ */
+void* vKeyInit(vEngineContext& ctx);
+
 /**
  * Convert engine character to real character
  */
 Uint32 getCharacterCode(const Uint32& data);
 
+/**
+ * Convert engine character to real character of @codeTable
+ */
+Uint32 getCharacterCode(const Uint32& data, const int& codeTable);
+
 /**
  * MAIN entry point for each key
  * event: mouse or keyboard event
@@ -211,30 +378,52 @@ void vKeyHandleEvent(const vKeyEvent& event,
                      const Uint8& capsStatus=0,
                      const bool& otherControlKey=false);
 
+/**
+ * Same as above, but work on @ctx instead of the default context
+ */
+void vKeyHandleEvent(vEngineContext& ctx,
+                     const vKeyEvent& event,
+                     const vKeyEventState& state,
+                     const Uint16& data,
+                     const Uint8& capsStatus=0,
+                     const bool& otherControlKey=false);
+
+/**
+ * Move the mark of the word in ctx.TypingWord (cells 0.._index-1) to the vowel chosen by
+ * ctx.config.useModernOrthography, like typing it again. Return false and don't change
+ * the word if it doesn't have exactly one mark or it's wrong spelling
+ */
+bool vPlaceWordMark(vEngineContext& ctx);
+
 /**
  * Start a new word
  */
 void startNewSession();
+void startNewSession(vEngineContext& ctx);
 
 /**
  * do some task in english mode (use for macro)
  */
 void vEnglishMode(const vKeyEventState& state, const Uint16& data, const bool& isCaps, const bool& otherControlKey);
+void vEnglishMode(vEngineContext& ctx, const vKeyEventState& state, const Uint16& data, const bool& isCaps, const bool& otherControlKey);
 
 /**
  * temporarily turn off spell checking
  */
 void vTempOffSpellChecking();
+void vTempOffSpellChecking(vEngineContext& ctx);
 
 /**
  * reset spelling value
  */
 void vSetCheckSpelling();
+void vSetCheckSpelling(vEngineContext& ctx);
 
 /**
  * temporarily turn off OpenKey engine
  */
 void vTempOffEngine(const bool& off=true);
+void vTempOffEngine(vEngineContext& ctx, const bool& off=true);
 
 /**
  * some utils function
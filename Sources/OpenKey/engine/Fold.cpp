@@ -0,0 +1,208 @@
+//
+//  Fold.cpp
+//  OpenKey
+//
+//  Folding works on UTF-8 bytes: ASCII runs are copied by vectors, only the leads of
+//  Vietnamese characters (C3..C6, E1 BA/BB) and marks (CC) are decoded, with tables
+//  built from the Unicode code table.
+//
+
+#include "Fold.h"
+#include "Vietnamese.h"
+#include <memory.h>
+
+#if defined(__AVX2__)
+#define FOLD_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FOLD_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define FOLD_NEON
+#include <arm_neon.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define FOLD_LATIN_FIRST        0x00C0 //2 bytes characters with lead C3..C6
+#define FOLD_LATIN_COUNT        0x0100
+#define FOLD_VIETNAMESE_FIRST   0x1EA0 //Latin Extended Additional, lead E1 BA/BB
+#define FOLD_VIETNAMESE_COUNT   0x0060
+#define FOLD_MARK_LAST          0x0323 //combining marks U+0300..U+0323 are removed
+
+/**
+ * Base letter of each Vietnamese character, 0 if it's another character
+ */
+struct vFoldTable {
+    Byte latin[FOLD_LATIN_COUNT];
+    Byte vietnamese[FOLD_VIETNAMESE_COUNT];
+    vFoldTable() {
+        memset(latin, 0, sizeof(latin));
+        memset(vietnamese, 0, sizeof(vietnamese));
+        for (int j = 0; j < CODE_TABLE_ROW_COUNT; j++) {
+            const Byte base = (Byte)keyCodeToCharacter((Uint8)_codeTableKey[j]);
+            for (int k = 0; k < _codeTableRowSize[j]; k++) {
+                const Uint16 character = _codeTable[0][j][k];
+                const Byte letter = k % 2 == 0 ? base - 0x20 : base; //even columns are caps
+                if (character >= FOLD_LATIN_FIRST && character < FOLD_LATIN_FIRST + FOLD_LATIN_COUNT)
+                    latin[character - FOLD_LATIN_FIRST] = letter;
+                else if (character >= FOLD_VIETNAMESE_FIRST && character < FOLD_VIETNAMESE_FIRST + FOLD_VIETNAMESE_COUNT)
+                    vietnamese[character - FOLD_VIETNAMESE_FIRST] = letter;
+            }
+        }
+    }
+};
+
+static inline int countTrailingZeros(const Uint32& mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static inline Byte foldAsciiByte(const Byte& c, const bool& caseFold) {
+    return caseFold && c >= 'A' && c <= 'Z' ? c + 0x20 : c;
+}
+
+/**
+ * Copy the ASCII run at @data to @out, return its length. Whole vectors are written,
+ * so @out must have @size bytes
+ */
+static size_t foldAscii(const Byte* data, const size_t& size, Byte* out, const bool& caseFold) {
+    size_t i = 0;
+#if defined(FOLD_AVX2)
+    const __m256i below = _mm256_set1_epi8('A' - 1), above = _mm256_set1_epi8('Z' + 1);
+    const __m256i delta = _mm256_set1_epi8(caseFold ? 0x20 : 0);
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        Uint32 mask = (Uint32)_mm256_movemask_epi8(v);
+        __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(v, below), _mm256_cmpgt_epi8(above, v)); //non ASCII is negative
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi8(v, _mm256_and_si256(letter, delta)));
+        if (mask != 0)
+            return i + countTrailingZeros(mask);
+    }
+#elif defined(FOLD_SSE2)
+    const __m128i below = _mm_set1_epi8('A' - 1), above = _mm_set1_epi8('Z' + 1);
+    const __m128i delta = _mm_set1_epi8(caseFold ? 0x20 : 0);
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        Uint32 mask = (Uint32)_mm_movemask_epi8(v);
+        __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(v, below), _mm_cmplt_epi8(v, above));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi8(v, _mm_and_si128(letter, delta)));
+        if (mask != 0)
+            return i + countTrailingZeros(mask);
+    }
+#elif defined(FOLD_NEON)
+    const uint8x16_t below = vdupq_n_u8('A'), above = vdupq_n_u8('Z');
+    const uint8x16_t delta = vdupq_n_u8(caseFold ? 0x20 : 0);
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t v = vld1q_u8(data + i);
+        if (vmaxvq_u8(v) >= 0x80)
+            break; //the scalar loop finds the byte
+        uint8x16_t letter = vandq_u8(vcgeq_u8(v, below), vcleq_u8(v, above));
+        vst1q_u8(out + i, vaddq_u8(v, vandq_u8(letter, delta)));
+    }
+#endif
+    for (; i < size && data[i] < 0x80; i++)
+        out[i] = foldAsciiByte(data[i], caseFold);
+    return i;
+}
+
+/**
+ * Fold @data to @out, return the number of bytes written. @consumed stops before a
+ * Vietnamese character or mark which is cut at the end of @data, unless it's @last
+ */
+static size_t foldBuffer(const vFoldTable& table, const Byte* data, const size_t& size, Byte* out, const bool& caseFold, const bool& last, size_t& consumed) {
+    size_t i = 0, o = 0, run, need;
+    Byte lead, letter;
+    Uint16 character;
+    while (i < size) {
+        run = foldAscii(data + i, size - i, out + o, caseFold);
+        i += run;
+        o += run;
+        if (i >= size)
+            break;
+
+        lead = data[i];
+        if ((lead >= 0xC3 && lead <= 0xC6) || lead == 0xCC)
+            need = 2;
+        else if (lead == 0xE1 && (i + 1 >= size || data[i + 1] == 0xBA || data[i + 1] == 0xBB))
+            need = 3;
+        else
+            need = 1; //other characters are copied byte by byte
+        if (i + need > size) {
+            if (!last)
+                break;
+            need = 1;
+        }
+        for (size_t k = 1; k < need; k++) {
+            if ((data[i + k] & 0xC0) != 0x80) //invalid sequence, copy its lead
+                need = 1;
+        }
+
+        letter = 0;
+        if (need == 2) {
+            character = (Uint16)(((lead & 0x1F) << 6) | (data[i + 1] & 0x3F));
+            if (lead == 0xCC) {
+                if (character <= FOLD_MARK_LAST) { //remove mark
+                    i += 2;
+                    continue;
+                }
+            } else {
+                letter = table.latin[character - FOLD_LATIN_FIRST];
+            }
+        } else if (need == 3) {
+            character = (Uint16)(((lead & 0x0F) << 12) | ((data[i + 1] & 0x3F) << 6) | (data[i + 2] & 0x3F));
+            if (character >= FOLD_VIETNAMESE_FIRST)
+                letter = table.vietnamese[character - FOLD_VIETNAMESE_FIRST];
+        }
+        if (letter) {
+            out[o++] = foldAsciiByte(letter, caseFold);
+        } else {
+            memcpy(out + o, data + i, need);
+            o += need;
+        }
+        i += need;
+    }
+    consumed = i;
+    return o;
+}
+
+void beginFold(vFoldState& state, const bool& caseFold) {
+    state.caseFold = caseFold;
+    state.pendingSize = 0;
+}
+
+size_t foldChunk(vFoldState& state, const char* data, const size_t& size, char* out, const bool& last) {
+    static const vFoldTable table;
+    const Byte* src = (const Byte*)data;
+    size_t written = 0, consumed, start = 0;
+
+    //complete the character of last chunk with the first bytes of this chunk
+    if (state.pendingSize > 0) {
+        const size_t need = state.pending[0] == 0xE1 ? 3 : 2;
+        while (state.pendingSize < need && start < size)
+            state.pending[state.pendingSize++] = src[start++];
+        if (state.pendingSize < need && !last)
+            return 0;
+        written = foldBuffer(table, state.pending, state.pendingSize, (Byte*)out, state.caseFold, true, consumed);
+        state.pendingSize = 0;
+    }
+
+    written += foldBuffer(table, src + start, size - start, (Byte*)out + written, state.caseFold, last, consumed);
+    for (start += consumed; start < size; start++)
+        state.pending[state.pendingSize++] = src[start];
+    return written;
+}
+
+string foldUtil(const string& sourceString, const bool& caseFold) {
+    vFoldState state;
+    string result(FOLD_CAPACITY(sourceString.size()), '\0');
+    beginFold(state, caseFold);
+    result.resize(foldChunk(state, sourceString.data(), sourceString.size(), &result[0], true));
+    return result;
+}
@@ -0,0 +1,45 @@
+//
+//  Fold.h
+//  OpenKey
+//
+//  Accent insensitive folding of UTF-8 text (for search indexes): Vietnamese letters
+//  of the Unicode table become their base Latin letter (ệ -> e, Đ -> D) and combining
+//  marks U+0300..U+0323 are removed, so precomposed and compound text fold the same.
+//  Other characters are copied unchanged, the output is never longer than the input.
+//
+
+#ifndef Fold_h
+#define Fold_h
+
+#include <string>
+#include "DataType.h"
+
+using namespace std;
+
+//max bytes written by foldChunk for @size bytes (streaming or not)
+#define FOLD_CAPACITY(size)     ((size) + 4)
+
+/**
+ * State of a streaming fold: the incomplete Vietnamese character or mark at the end of last chunk
+ */
+struct vFoldState {
+    bool caseFold = false;
+    Byte pending[4];
+    Byte pendingSize = 0;
+};
+
+/**
+ * Start folding a document, @caseFold: ASCII and Vietnamese letters also become lower case
+ */
+void beginFold(vFoldState& state, const bool& caseFold);
+
+/**
+ * Fold a chunk of UTF-8 @data to @out (FOLD_CAPACITY(@size) bytes), return the number of bytes
+ * written. Chunks can be split anywhere; @last must be true for the last chunk. vKeyInit() must be
+ * called before the first fold
+ */
+size_t foldChunk(vFoldState& state, const char* data, const size_t& size, char* out, const bool& last);
+
+string foldUtil(const string& sourceString, const bool& caseFold=false);
+
+#endif /* Fold_h */
@@ -7,78 +7,472 @@
 //
 
 #include "Macro.h"
+#include "MacroLibrary.h"
+#include "MacroChange.h"
 #include "Vietnamese.h"
 #include "Engine.h"
 #include <iostream>
 #include <memory.h>
 #include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
 
 using namespace std;
 
-//main data
-map<vector<Uint32>, MacroData> macroMap;
+#define MACRO_ARENA_COMPACT_SIZE        (64 << 10) //free bytes of macro arena before it's compacted
 
-extern int vCodeTable;
-//local variable
-static int c = 0;
-static bool _macroFlag = false;
-static Uint16 _kChar = 0;
-static Uint32 _charBuff;
-static int _kMacro;
+//macro arena: key codes, macroText and macroContent of all macros
+static vector<Byte> _macroArena;
+static size_t _macroArenaFree = 0; //bytes of deleted macros and unused contents
+static vector<MacroData> _macros; //deleted macros are kept until the arena is compacted
+static vector<MacroContentData> _macroContents;
+static vector<Uint32> _macroContentSlot; //hash table of _macroContents (open addressing), MACRO_NONE: empty slot
+static Uint32 _macroCount = 0; //macros which aren't deleted
 
-static void convert(const string& str, vector<Uint32>& outData) {
+//the keyboard thread walks the trie and findMacro() adds converted content to the caches
+//while the main thread changes macro data: both hold this lock
+static mutex _macroLock;
+
+//macro trie, see nextMacroNode()
+static unordered_map<Uint64, Uint32> _macroTrieEdge; //(node << 32) | code -> child node
+static vector<Uint32> _macroTrieData = { MACRO_NONE }; //macro of each node (index of _macros), MACRO_NONE if the node isn't a macro key
+static Uint32 _macroTrieVersion = 0;
+
+//macro library file, it is used instead of macro arena until macro data is changed
+static vMacroLibrary _macroLibrary;
+static bool _useMacroLibrary = false;
+static unordered_map<Uint32, Uint32> _macroLibraryContent; //content of library entries, added to macro arena when it's used
+
+#define MACRO_ASCII_NONE                0xFFFFFFFF
+
+/**
+ * _characterMap of ASCII characters, MACRO_ASCII_NONE if it isn't in the map
+ */
+struct vMacroAsciiTable {
+    Uint32 code[128];
+    vMacroAsciiTable() {
+        for (Uint32 c = 0; c < 128; c++) {
+            map<Uint32, Uint32>::const_iterator it = _characterMap.find(c);
+            code[c] = it != _characterMap.end() ? it->second : MACRO_ASCII_NONE;
+        }
+    }
+};
+
+/**
+ * @codeTable: code table of characters which have tone/mark, MACRO_KEY_CODE_TABLE for macro keys
+ */
+static void convert(const string& str, vector<Uint32>& outData, const int& codeTable=MACRO_KEY_CODE_TABLE) {
+    static const vMacroAsciiTable asciiTable;
     outData.clear();
-    wstring data = utf8ToWideString(str);
+    vector<Uint16> data;
+    utf8ToUtf16(str, data);
+    outData.reserve(data.size());
     Uint32 t = 0;
-    int kSign = -1;
-    int k = 0;
+    int row = 0, column = 0;
     for (int i = 0; i < data.size(); i++) {
         t = (Uint32)data[i];
+        if (t < 128 && asciiTable.code[t] != MACRO_ASCII_NONE) {
+            outData.push_back(asciiTable.code[t]);
+            continue;
+        }
         
         //find normal character fist
-        if (_characterMap.find(t) != _characterMap.end()) {
-            outData.push_back(_characterMap[t]);
+        map<Uint32, Uint32>::const_iterator it = _characterMap.find(t);
+        if (it != _characterMap.end()) {
+            outData.push_back(it->second);
             continue;
         }
         
         //find character which has tone/mark
-        for (map<Uint32, vector<Uint16>>::iterator it = _codeTable[0].begin(); it != _codeTable[0].end(); ++it) {
-            kSign = -1;
-            k = 0;
-            for (int j = 0; j < it->second.size(); j++) {
-                if ((Uint16)t == it->second[j]) {
-                    kSign = 0;
-                    outData.push_back(_codeTable[vCodeTable][it->first][k] | CHAR_CODE_MASK);
-                    break;
-                }//end if
-                k++;
-            }
-            if (kSign != -1)
-                break;
-        }
-        if (kSign != -1)
+        if (findCodeTableCharacter((Uint16)t, 0, row, column)) {
+            outData.push_back(_codeTable[codeTable][row][column] | CHAR_CODE_MASK);
             continue;
+        }
         
         //find other character
         outData.push_back(t | PURE_CHARACTER_MASK); //mark it as pure character
     }
 }
 
+#define MACRO_CONVERT_BLOCK_SIZE        1024 //macros converted by a thread each time
+#define MACRO_FILE_BUFFER_SIZE          (1 << 20) //bytes written to macro file each time
+
 /**
- * data structure:
- * byte 0 and 1: macro count
- *
- * byte n: macroText size (macroTextSize)
- * byte n + macroTextSize: macroText data
- *
- * byte m, m+1: macroContentSize
- * byte m+1 + macroContentSize: macroContent data
- *
- * ...
- * next macro
+ * convert() all @strs on all cores, for bulk import
  */
-void initMacroMap(const Byte* pData, const int& size) {
-    macroMap.clear();
+static void convertAll(const vector<string>& strs, vector<vector<Uint32>>& outData, const int& codeTable) {
+    outData.resize(strs.size());
+    const size_t blockCount = (strs.size() + MACRO_CONVERT_BLOCK_SIZE - 1) / MACRO_CONVERT_BLOCK_SIZE;
+    std::atomic<size_t> nextBlock(0);
+    auto worker = [&]() {
+        size_t block, i;
+        while ((block = nextBlock.fetch_add(1)) < blockCount) {
+            for (i = block * MACRO_CONVERT_BLOCK_SIZE; i < strs.size() && i < (block + 1) * MACRO_CONVERT_BLOCK_SIZE; i++)
+                convert(strs[i], outData[i], codeTable);
+        }
+    };
+    vector<std::thread> threads;
+    const size_t threadCount = max((size_t)std::thread::hardware_concurrency(), (size_t)1);
+    for (size_t k = 1; k < threadCount && k < blockCount; k++)
+        threads.push_back(std::thread(worker));
+    worker();
+    for (size_t k = 0; k < threads.size(); k++)
+        threads[k].join();
+}
+
+/**
+ * Index of each unique key in @keys, sorted by key
+ * @keepFirst: the first macro of same key is used, else the last one
+ */
+static void sortMacroKeys(const vector<vector<Uint32>>& keys, const bool& keepFirst, vector<size_t>& order) {
+    order.resize(keys.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    stable_sort(order.begin(), order.end(), [&](const size_t& a, const size_t& b) {
+        return keys[a] < keys[b];
+    });
+    size_t count = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+        if (count > 0 && keys[order[count - 1]] == keys[order[i]]) {
+            if (!keepFirst)
+                order[count - 1] = order[i];
+            continue;
+        }
+        order[count++] = order[i];
+    }
+    order.resize(count);
+}
+
+static void clearMacroTrie() {
+    _macroTrieEdge.clear();
+    _macroTrieData.assign(1, MACRO_NONE);
+    _macroTrieVersion++;
+}
+
+static Uint32 getNextMacroNode(const Uint32& node, const Uint32& code) {
+    if (node == MACRO_TRIE_DEAD)
+        return MACRO_TRIE_DEAD;
+    if (_useMacroLibrary)
+        return nextMacroLibraryNode(_macroLibrary, node, code);
+    unordered_map<Uint64, Uint32>::const_iterator it = _macroTrieEdge.find(((Uint64)node << 32) | code);
+    return it != _macroTrieEdge.end() ? it->second : MACRO_TRIE_DEAD;
+}
+
+static Uint32 findMacroNode(const vector<Uint32>& key) {
+    Uint32 node = MACRO_TRIE_ROOT;
+    for (int i = 0; i < key.size() && node != MACRO_TRIE_DEAD; i++) {
+        node = getNextMacroNode(node, key[i]);
+    }
+    return node;
+}
+
+static void setMacroNode(const vector<Uint32>& key, const Uint32& macro) {
+    Uint32 node = MACRO_TRIE_ROOT;
+    for (int i = 0; i < key.size(); i++) {
+        pair<unordered_map<Uint64, Uint32>::iterator, bool> edge = _macroTrieEdge.emplace(((Uint64)node << 32) | key[i], (Uint32)_macroTrieData.size());
+        node = edge.first->second;
+        if (edge.second) //new node
+            _macroTrieData.push_back(MACRO_NONE);
+    }
+    _macroTrieData[node] = macro;
+    _macroTrieVersion++;
+}
+
+Uint32 nextMacroNode(const Uint32& node, const Uint32& code) {
+    if (node == MACRO_TRIE_DEAD)
+        return MACRO_TRIE_DEAD;
+    lock_guard<mutex> lock(_macroLock);
+    return getNextMacroNode(node, code);
+}
+
+Uint32 getMacroTrieVersion() {
+    lock_guard<mutex> lock(_macroLock);
+    return _macroTrieVersion;
+}
+
+static void clearMacroData() {
+    _macroArena.clear();
+    _macroArenaFree = 0;
+    _macros.clear();
+    _macroContents.clear();
+    _macroContentSlot.clear();
+    _macroCount = 0;
+    clearMacroTrie();
+}
+
+static inline Uint32 appendMacroArena(const string& str) {
+    const Uint32 offset = (Uint32)_macroArena.size();
+    _macroArena.insert(_macroArena.end(), str.begin(), str.end());
+    return offset;
+}
+
+static inline string getMacroArenaString(const Uint32& offset, const Uint32& size) {
+    return string((const char*)_macroArena.data() + offset, size);
+}
+
+/**
+ * Key codes are stored with variable width, the first byte tells the size like UTF-8:
+ * 0xxxxxxx: < 0x80, 10xxxxxx +1 byte: < 0x4000, 110xxxxx +2 bytes: < 0x200000, 11100000 +4 bytes.
+ * Bytes are big endian, so keys are compared (sorted) like vector<Uint32> by memcmp
+ */
+static void appendMacroKey(const vector<Uint32>& key, MacroData& macro) {
+    macro.keyOffset = (Uint32)_macroArena.size();
+    for (size_t i = 0; i < key.size(); i++) {
+        const Uint32 code = key[i];
+        if (code < 0x80) {
+            _macroArena.push_back((Byte)code);
+        } else if (code < 0x4000) {
+            _macroArena.push_back((Byte)(0x80 | (code >> 8)));
+            _macroArena.push_back((Byte)code);
+        } else if (code < 0x200000) {
+            _macroArena.push_back((Byte)(0xC0 | (code >> 16)));
+            _macroArena.push_back((Byte)(code >> 8));
+            _macroArena.push_back((Byte)code);
+        } else {
+            _macroArena.push_back(0xE0);
+            for (int shift = 24; shift >= 0; shift -= 8)
+                _macroArena.push_back((Byte)(code >> shift));
+        }
+    }
+    macro.keySize = (Uint32)_macroArena.size() - macro.keyOffset;
+}
+
+static void getMacroKey(const MacroData& macro, vector<Uint32>& key) {
+    const Byte* data = _macroArena.data() + macro.keyOffset;
+    const Byte* end = data + macro.keySize;
+    key.clear();
+    while (data < end) {
+        if (data[0] < 0x80) {
+            key.push_back(data[0]);
+            data += 1;
+        } else if (data[0] < 0xC0) {
+            key.push_back(((Uint32)(data[0] & 0x3F) << 8) | data[1]);
+            data += 2;
+        } else if (data[0] < 0xE0) {
+            key.push_back(((Uint32)(data[0] & 0x1F) << 16) | ((Uint32)data[1] << 8) | data[2]);
+            data += 3;
+        } else {
+            key.push_back(((Uint32)data[1] << 24) | ((Uint32)data[2] << 16) | ((Uint32)data[3] << 8) | data[4]);
+            data += 5;
+        }
+    }
+}
+
+static inline Uint32 hashMacroContent(const char* data, const size_t& size) {
+    Uint32 hash = 2166136261u; //FNV-1a
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ (Byte)data[i]) * 16777619u;
+    return hash;
+}
+
+static void rehashMacroContent(const size_t& slotCount) {
+    _macroContentSlot.assign(slotCount, MACRO_NONE);
+    for (Uint32 i = 0; i < _macroContents.size(); i++) {
+        const MacroContentData& data = _macroContents[i];
+        Uint32 slot = hashMacroContent((const char*)_macroArena.data() + data.offset, data.size) & (slotCount - 1);
+        while (_macroContentSlot[slot] != MACRO_NONE)
+            slot = (slot + 1) & (slotCount - 1);
+        _macroContentSlot[slot] = i;
+    }
+}
+
+/**
+ * Use @macroContent for a macro: same content is stored once, return its index
+ */
+static Uint32 useMacroContent(const string& macroContent) {
+    if (_macroContents.size() * 2 >= _macroContentSlot.size())
+        rehashMacroContent(max(_macroContentSlot.size() * 2, (size_t)64));
+    const Uint32 mask = (Uint32)_macroContentSlot.size() - 1;
+    Uint32 slot = hashMacroContent(macroContent.data(), macroContent.size()) & mask, index;
+    while ((index = _macroContentSlot[slot]) != MACRO_NONE) {
+        MacroContentData& data = _macroContents[index];
+        if (data.size == macroContent.size() &&
+            (data.size == 0 || memcmp(_macroArena.data() + data.offset, macroContent.data(), data.size) == 0)) {
+            if (data.useCount++ == 0) //it was unused
+                _macroArenaFree -= data.size;
+            return index;
+        }
+        slot = (slot + 1) & mask;
+    }
+    index = (Uint32)_macroContents.size();
+    _macroContentSlot[slot] = index;
+    _macroContents.push_back(MacroContentData());
+    MacroContentData& data = _macroContents.back();
+    data.offset = appendMacroArena(macroContent);
+    data.size = (Uint32)macroContent.size();
+    data.useCount = 1;
+    return index;
+}
+
+static void releaseMacroContent(const Uint32& index) {
+    MacroContentData& data = _macroContents[index];
+    if (--data.useCount == 0) //it's kept until the arena is compacted, same content can use it again
+        _macroArenaFree += data.size;
+}
+
+static Uint32 findMacroData(const vector<Uint32>& key) {
+    const Uint32 node = findMacroNode(key);
+    return node == MACRO_TRIE_DEAD ? MACRO_NONE : _macroTrieData[node];
+}
+
+/**
+ * Index of all macros (not deleted) which are sorted by key, like the macro library
+ */
+static void getSortedMacros(vector<Uint32>& macros) {
+    macros.clear();
+    macros.reserve(_macroCount);
+    for (Uint32 i = 0; i < _macros.size(); i++) {
+        if (_macros[i].content != MACRO_NONE)
+            macros.push_back(i);
+    }
+    const Byte* arena = _macroArena.data();
+    sort(macros.begin(), macros.end(), [&](const Uint32& a, const Uint32& b) {
+        const MacroData& first = _macros[a];
+        const MacroData& second = _macros[b];
+        const int result = memcmp(arena + first.keyOffset, arena + second.keyOffset, min(first.keySize, second.keySize));
+        return result != 0 ? result < 0 : first.keySize < second.keySize;
+    });
+}
+
+/**
+ * Add new macro or change content of the macro which has @key
+ * @replace: false: the old macro is kept
+ */
+static void setMacro(const vector<Uint32>& key, const string& macroText, const string& macroContent, const bool& replace=true) {
+    Uint32 macro = findMacroData(key);
+    if (macro != MACRO_NONE) {
+        if (replace) { //macroText isn't changed, it has same key
+            releaseMacroContent(_macros[macro].content);
+            _macros[macro].content = useMacroContent(macroContent);
+        }
+        return;
+    }
+    MacroData data;
+    appendMacroKey(key, data);
+    data.textOffset = appendMacroArena(macroText);
+    data.textSize = (Uint32)macroText.size();
+    data.content = useMacroContent(macroContent);
+    _macros.push_back(data);
+    _macroCount++;
+    setMacroNode(key, (Uint32)_macros.size() - 1);
+}
+
+/**
+ * Make room for new macros, for bulk loading
+ */
+static void reserveMacroData(const vector<string>& macroTexts, const vector<string>& macroContents) {
+    size_t textSize = 0, contentSize = 0;
+    for (size_t i = 0; i < macroTexts.size(); i++) {
+        textSize += macroTexts[i].size();
+        contentSize += macroContents[i].size();
+    }
+    _macroArena.reserve(_macroArena.size() + textSize * 2 + contentSize); //key codes of ASCII characters use 1 byte
+    _macros.reserve(_macros.size() + macroTexts.size());
+    _macroContents.reserve(_macroContents.size() + macroContents.size());
+}
+
+/**
+ * Copy all macros to a new arena when most of it is free
+ */
+static void compactMacroArena() {
+    if (_macroArenaFree < MACRO_ARENA_COMPACT_SIZE || _macroArenaFree * 2 < _macroArena.size())
+        return;
+    vector<Uint32> macros;
+    getSortedMacros(macros);
+    vector<vector<Uint32>> keys(macros.size());
+    vector<string> macroTexts, macroContents;
+    for (size_t i = 0; i < macros.size(); i++) {
+        const MacroData& data = _macros[macros[i]];
+        getMacroKey(data, keys[i]);
+        macroTexts.push_back(getMacroArenaString(data.textOffset, data.textSize));
+        macroContents.push_back(getMacroArenaString(_macroContents[data.content].offset, _macroContents[data.content].size));
+    }
+    clearMacroData();
+    for (size_t i = 0; i < macros.size(); i++)
+        setMacro(keys[i], macroTexts[i], macroContents[i]);
+}
+
+static void closeMacroLibraryData() {
+    if (_useMacroLibrary) {
+        closeMacroLibrary(_macroLibrary);
+        _useMacroLibrary = false;
+        _macroLibraryContent.clear();
+        clearMacroData();
+    }
+}
+
+/**
+ * Macro data is going to change: move all macros of library to macro arena
+ */
+static void copyMacroLibraryToMap() {
+    if (!_useMacroLibrary)
+        return;
+    vector<vector<Uint32>> keys;
+    vector<string> macroTexts, macroContents;
+    getAllMacro(keys, macroTexts, macroContents);
+    closeMacroLibraryData();
+    for (int i = 0; i < keys.size(); i++)
+        setMacro(keys[i], macroTexts[i], macroContents[i]);
+}
+
+static bool useMacroLibrary() {
+    clearMacroData();
+    _macroLibraryContent.clear();
+    _useMacroLibrary = true;
+    if (!canUseMacroLibraryKey(_macroLibrary, MACRO_KEY_CODE_TABLE)) //key codes are made for other platform/code table
+        copyMacroLibraryToMap();
+    return true;
+}
+
+/**
+ * Content of the macro at @node, MACRO_NONE if @node isn't a macro
+ */
+static Uint32 getMacroNodeContent(const Uint32& node) {
+    if (node == MACRO_TRIE_DEAD)
+        return MACRO_NONE;
+    if (_useMacroLibrary) {
+        Uint32 entry = getMacroLibraryEntry(_macroLibrary, node);
+        if (entry == MACRO_LIBRARY_NONE)
+            return MACRO_NONE;
+        unordered_map<Uint32, Uint32>::iterator it = _macroLibraryContent.find(entry);
+        if (it != _macroLibraryContent.end())
+            return it->second;
+        string macroText, macroContent;
+        if (!getMacroLibraryText(_macroLibrary, entry, macroText, macroContent))
+            return MACRO_NONE;
+        return _macroLibraryContent[entry] = useMacroContent(macroContent);
+    }
+    const Uint32 macro = _macroTrieData[node];
+    return macro != MACRO_NONE ? _macros[macro].content : MACRO_NONE;
+}
+
+/**
+ * Content in @codeTable, it's converted when the code table is used first
+ */
+static MacroTableContent& getMacroTableContent(MacroContentData& data, const int& codeTable) {
+    for (size_t i = 0; i < data.tableContent.size(); i++) {
+        if (data.tableContent[i].codeTable == codeTable)
+            return data.tableContent[i];
+    }
+    data.tableContent.push_back(MacroTableContent());
+    MacroTableContent& tableContent = data.tableContent.back();
+    tableContent.codeTable = codeTable;
+    convert(getMacroArenaString(data.offset, data.size), tableContent.content, codeTable);
+    return tableContent;
+}
+
+static const vector<Uint32>* getMacroContentCode(const Uint32& node, const int& codeTable) {
+    const Uint32 content = getMacroNodeContent(node);
+    return content != MACRO_NONE ? &getMacroTableContent(_macroContents[content], codeTable).content : NULL;
+}
+
+/**
+ * read macro data of initMacroMap()
+ */
+static void readMacroData(const Byte* pData, const int& size, vector<string>& macroTexts, vector<string>& macroContents) {
     Uint16 macroCount = 0;
     Uint32 cursor = 0;
     if (size >= 2) {
@@ -89,106 +483,208 @@ void initMacroMap(const Byte* pData, const int& size) {
     Uint16 macroContentSize;
     for (int i = 0; i < macroCount; i++) {
         macroTextSize = pData[cursor++];
-        string macroText((char*)pData + cursor, macroTextSize);
+        macroTexts.push_back(string((char*)pData + cursor, macroTextSize));
         cursor += macroTextSize;
         
         memcpy(&macroContentSize, pData + cursor, 2);
         cursor+=2;
-        string macroContent((char*)pData + cursor, macroContentSize);
+        macroContents.push_back(string((char*)pData + cursor, macroContentSize));
         cursor += macroContentSize;
+    }
+}
+
+/**
+ * read UniKey macro file, the first line is header. Each line is "name:content", a name
+ * which begins with ':' ends at the second ':'. The file is mapped and read in one pass
+ */
+static bool readMacroFile(const string& path, vector<string>& macroTexts, vector<string>& macroContents) {
+    const Byte* pData;
+    size_t size;
+    if (!mapMacroFile(path, pData, size))
+        return false;
+    const char* data = (const char*)pData;
+    const char *line, *lineEnd, *colon;
+    size_t start = 0, lineSize, pos;
+    bool header = true;
+    while (start < size) {
+        line = data + start;
+        lineEnd = (const char*)memchr(line, '\n', size - start);
+        lineSize = lineEnd ? lineEnd - line : size - start;
+        start += lineSize + 1;
+        if (lineSize > 0 && line[lineSize - 1] == '\r') //file of Windows
+            lineSize--;
+        if (header) {
+            header = false;
+            continue;
+        }
         
-        MacroData data;
-        data.macroText = macroText;
-        data.macroContent = macroContent;
-        
-        vector<Uint32> key;
-        convert(macroText, key);
-        convert(macroContent, data.macroContentCode);
-        
-        macroMap[key] = data;
+        colon = (const char*)memchr(line, ':', lineSize);
+        if (colon == line && lineSize > 1)
+            colon = (const char*)memchr(line + 1, ':', lineSize - 1);
+        if (colon == NULL || colon == line)
+            continue;
+        pos = colon - line;
+        macroTexts.push_back(string(line, pos));
+        macroContents.push_back(string(line + pos + 1, lineSize - pos - 1));
+    }
+    unmapMacroFile(pData, size);
+    return true;
+}
+
+/**
+ * @keepFirst: same macro key is ignored (UniKey file), else it replaces the old one (initMacroMap)
+ */
+static void buildMacroLibraryData(const vector<string>& macroTexts, const vector<string>& macroContents, const bool& keepFirst, vector<Byte>& outData) {
+    vector<vector<Uint32>> allKeys, keys;
+    vector<size_t> order;
+    convertAll(macroTexts, allKeys, MACRO_KEY_CODE_TABLE);
+    sortMacroKeys(allKeys, keepFirst, order);
+    vector<string> texts, contents;
+    keys.reserve(order.size());
+    texts.reserve(order.size());
+    contents.reserve(order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        keys.push_back(std::move(allKeys[order[i]]));
+        texts.push_back(macroTexts[order[i]]);
+        contents.push_back(macroContents[order[i]]);
+    }
+    buildMacroLibrary(keys, texts, contents, MACRO_KEY_CODE_TABLE, outData);
+}
+
+/**
+ * data structure:
+ * byte 0 and 1: macro count
+ *
+ * byte n: macroText size (macroTextSize)
+ * byte n + macroTextSize: macroText data
+ *
+ * byte m, m+1: macroContentSize
+ * byte m+1 + macroContentSize: macroContent data
+ *
+ * ...
+ * next macro
+ */
+void initMacroMap(const Byte* pData, const int& size) {
+    lock_guard<mutex> lock(_macroLock);
+    closeMacroLibraryData();
+    clearMacroData();
+    startMacroGeneration(pData, pData != NULL && size > 0 ? size : 0);
+    if (isMacroLibraryData(pData, size)) {
+        if (loadMacroLibrary(_macroLibrary, pData, size))
+            useMacroLibrary();
+        return;
+    }
+    vector<string> macroTexts, macroContents;
+    readMacroData(pData, size, macroTexts, macroContents);
+    reserveMacroData(macroTexts, macroContents);
+    vector<Uint32> key;
+    for (int i = 0; i < macroTexts.size(); i++) {
+        convert(macroTexts[i], key);
+        setMacro(key, macroTexts[i], macroContents[i]);
     }
 }
 
+bool initMacroLibrary(const string& path) {
+    lock_guard<mutex> lock(_macroLock);
+    closeMacroLibraryData();
+    if (!openMacroLibrary(_macroLibrary, path))
+        return false;
+    startNewMacroGeneration();
+    return useMacroLibrary();
+}
+
+void getMacroLibraryData(vector<Byte>& outData) {
+    vector<vector<Uint32>> keys;
+    vector<string> macroTexts, macroContents;
+    getAllMacro(keys, macroTexts, macroContents);
+    buildMacroLibraryData(macroTexts, macroContents, false, outData);
+}
+
+void convertMacroDataToLibrary(const Byte* pData, const int& size, vector<Byte>& outData) {
+    vector<string> macroTexts, macroContents;
+    readMacroData(pData, size, macroTexts, macroContents);
+    buildMacroLibraryData(macroTexts, macroContents, false, outData);
+}
+
+bool convertMacroFileToLibrary(const string& path, vector<Byte>& outData) {
+    vector<string> macroTexts, macroContents;
+    if (!readMacroFile(path, macroTexts, macroContents))
+        return false;
+    buildMacroLibraryData(macroTexts, macroContents, true, outData);
+    return true;
+}
+
 void getMacroSaveData(vector<Byte>& outData) {
-    Uint16 totalMacro = (Uint16)macroMap.size();
+    vector<vector<Uint32>> keys;
+    vector<string> macroTexts, macroContents;
+    getAllMacro(keys, macroTexts, macroContents);
+    Uint16 totalMacro = (Uint16)macroTexts.size();
     outData.push_back((Byte)totalMacro);
     outData.push_back((Byte)(totalMacro>>8));
     
-    for (std::map<vector<Uint32>, MacroData>::iterator it = macroMap.begin(); it != macroMap.end(); ++it) {
-        outData.push_back((Byte)it->second.macroText.size());
-        for (int j = 0; j < it->second.macroText.size(); j++) {
-            outData.push_back(it->second.macroText[j]);
+    for (int i = 0; i < macroTexts.size(); i++) {
+        outData.push_back((Byte)macroTexts[i].size());
+        for (int j = 0; j < macroTexts[i].size(); j++) {
+            outData.push_back(macroTexts[i][j]);
         }
         
-        Uint16 macroContentSize = (Uint16)it->second.macroContent.size();
+        Uint16 macroContentSize = (Uint16)macroContents[i].size();
         outData.push_back((Byte)macroContentSize);
         outData.push_back(macroContentSize>>8);
         for (int j = 0; j < macroContentSize; j++) {
-            outData.push_back(it->second.macroContent[j]);
+            outData.push_back(macroContents[i][j]);
         }
     }
 }
 
-static bool modifyCaseUnicode(Uint32& code, const bool& isUpperCase=true) {
-    _charBuff = code;
-    if (!(code & CHAR_CODE_MASK)) { //for normal char
-        code &= isUpperCase ? CAPS_MASK :  ~CAPS_MASK;
-        return code != _charBuff;
-    }
-    
-    //for unicode character
-    for (map<Uint32, vector<Uint16>>::iterator it = _codeTable[vCodeTable].begin(); it != _codeTable[vCodeTable].end(); ++it) {
-        for (_kMacro = 0; _kMacro < it->second.size(); _kMacro++) {
-            if ((Uint16)code == it->second[_kMacro]) {
-                if (_kMacro % 2 == 0 && !isUpperCase)
-                    _kMacro++;
-                else if (_kMacro % 2 != 0 && isUpperCase)
-                    _kMacro--;
-                code = _codeTable[vCodeTable][it->first][_kMacro] | CHAR_CODE_MASK;
-                return code != _charBuff;;
-            }//end if
-        }
-    }
-    return false;
+static bool modifyCaseUnicode(Uint32& code, const int& codeTable, const bool& isUpperCase=true) {
+    const Uint32 _charBuff = code;
+    code = getKeyCodeCase(code, codeTable, isUpperCase);
+    return code != _charBuff;
 }
 
-bool findMacro(vector<Uint32>& key, vector<Uint32>& macroContentCode) {
-    for (c = 0; c < key.size(); c++) {
-        key[c] = getCharacterCode(key[c]);
+/**
+ * Content of the macro at @node in Title or UPPER case, NULL if @node isn't a macro
+ */
+static const vector<Uint32>* getMacroCaseContent(const Uint32& node, const int& codeTable, const bool& upperCase) {
+    const Uint32 index = getMacroNodeContent(node);
+    if (index == MACRO_NONE)
+        return NULL;
+    MacroTableContent& tableContent = getMacroTableContent(_macroContents[index], codeTable);
+    const vector<Uint32>& content = tableContent.content;
+    if (tableContent.contentTitle.size() != content.size()) {
+        tableContent.contentTitle = content;
+        tableContent.contentUpper = content;
+        if (tableContent.contentTitle.size() > 0)
+            modifyCaseUnicode(tableContent.contentTitle[0], codeTable);
+        for (size_t c = 0; c < tableContent.contentUpper.size(); c++)
+            modifyCaseUnicode(tableContent.contentUpper[c], codeTable);
     }
-    if (macroMap.find(key) != macroMap.end()) {
-        macroContentCode.clear();
-        MacroData data = macroMap[key];
-        macroContentCode = data.macroContentCode;
+    return upperCase ? &tableContent.contentUpper : &tableContent.contentTitle;
+}
+
+bool findMacro(vector<Uint32>& key, const Uint32& node, const Uint32& caseNode, const int& codeTable, const bool& autoCaps, vector<Uint32>& macroContent) {
+    int c;
+    bool _macroFlag;
+    lock_guard<mutex> lock(_macroLock);
+    const vector<Uint32>* data = getMacroContentCode(node, codeTable);
+    if (data) {
+        macroContent.assign(data->begin(), data->end()); //copy: the cache can change after the lock is released
         return true;
     }
-    if (vAutoCapsMacro) {
+    if (autoCaps) {
         _macroFlag = false;
-        if (key.size() > 1 && modifyCaseUnicode(key[1], false)) {
+        if (key.size() > 1 && modifyCaseUnicode(key[1], MACRO_KEY_CODE_TABLE, false)) {
             _macroFlag = true;
             for (c = 2; c < key.size(); c++) {
-                modifyCaseUnicode(key[c], false);
+                modifyCaseUnicode(key[c], MACRO_KEY_CODE_TABLE, false);
             }
         }
         
-        if (key.size() > 0 && modifyCaseUnicode(key[0], false)) {
-            if (macroMap.find(key) != macroMap.end()) {
-                macroContentCode.clear();
-                MacroData data = macroMap[key];
-                macroContentCode = data.macroContentCode;
-                for (c = 0; c < macroContentCode.size(); c++) {
-                    if (c == 0 || _macroFlag) {
-                        _kChar = keyCodeToCharacter(macroContentCode[c]);
-                        if (_kChar != 0) {
-                            _kChar = toupper(_kChar);
-                            macroContentCode[c] = _characterMap[_kChar];
-                            continue;
-                        }
-                        if (macroContentCode[c] & CHAR_CODE_MASK) {
-                            modifyCaseUnicode(macroContentCode[c]);
-                        }
-                    }
-                }
+        if (key.size() > 0 && modifyCaseUnicode(key[0], MACRO_KEY_CODE_TABLE, false)) {
+            data = getMacroCaseContent(caseNode, codeTable, _macroFlag);
+            if (data) {
+                macroContent.assign(data->begin(), data->end());
                 return true;
             }
         }
@@ -199,95 +695,164 @@ bool findMacro(vector<Uint32>& key, vector<Uint32>& macroContentCode) {
 bool hasMacro(const string& macroName) {
     vector<Uint32> key;
     convert(macroName, key);
-    return (macroMap.find(key) != macroMap.end());
+    if (_useMacroLibrary)
+        return getMacroLibraryEntry(_macroLibrary, findMacroNode(key)) != MACRO_LIBRARY_NONE;
+    return findMacroData(key) != MACRO_NONE;
 }
 
 void getAllMacro(vector<vector<Uint32>>& keys, vector<string>& macroTexts, vector<string>& macroContents) {
     keys.clear();
     macroTexts.clear();
     macroContents.clear();
-    for (std::map<vector<Uint32>, MacroData>::iterator it = macroMap.begin(); it != macroMap.end(); ++it) {
-        keys.push_back(it->first);
-        macroTexts.push_back(it->second.macroText);
-        macroContents.push_back(it->second.macroContent);
+    if (_useMacroLibrary) {
+        const Uint32* key;
+        Uint32 keySize;
+        string macroText, macroContent;
+        bool useKey = canUseMacroLibraryKey(_macroLibrary, MACRO_KEY_CODE_TABLE);
+        for (Uint32 i = 0; i < _macroLibrary.header->macroCount; i++) {
+            if (!getMacroLibraryText(_macroLibrary, i, macroText, macroContent))
+                continue;
+            if (useKey && getMacroLibraryKey(_macroLibrary, i, key, keySize)) {
+                keys.push_back(vector<Uint32>(key, key + keySize));
+            } else {
+                keys.push_back(vector<Uint32>());
+                convert(macroText, keys.back());
+            }
+            macroTexts.push_back(macroText);
+            macroContents.push_back(macroContent);
+        }
+        return;
+    }
+    vector<Uint32> macros;
+    getSortedMacros(macros);
+    keys.resize(macros.size());
+    for (size_t i = 0; i < macros.size(); i++) {
+        const MacroData& data = _macros[macros[i]];
+        getMacroKey(data, keys[i]);
+        macroTexts.push_back(getMacroArenaString(data.textOffset, data.textSize));
+        macroContents.push_back(getMacroArenaString(_macroContents[data.content].offset, _macroContents[data.content].size));
     }
 }
 
 bool addMacro(const string& macroText, const string& macroContent) {
+    lock_guard<mutex> lock(_macroLock);
+    copyMacroLibraryToMap();
     vector<Uint32> key;
     convert(macroText, key);
-    if (macroMap.find(key) == macroMap.end()) { //add new macro
-        MacroData data;
-        data.macroText = macroText;
-        data.macroContent = macroContent;
-        convert(macroContent, data.macroContentCode);
-        macroMap[key] = data;
-    } else { //edit this macro
-        macroMap[key].macroContent = macroContent;
-        convert(macroContent, macroMap[key].macroContentCode);
-    }
+    recordMacroChange(findMacroData(key) == MACRO_NONE ? vMacroChangeAdd : vMacroChangeUpdate, macroText, macroContent);
+    setMacro(key, macroText, macroContent); //add new macro or edit this macro
+    compactMacroArena();
     return true;
 }
 
 bool deleteMacro(const string& macroText) {
+    lock_guard<mutex> lock(_macroLock);
+    copyMacroLibraryToMap();
     vector<Uint32> key;
     convert(macroText, key);
-    if (macroMap.find(key) != macroMap.end()) {
-        macroMap.erase(key);
+    const Uint32 macro = findMacroData(key);
+    if (macro != MACRO_NONE) {
+        MacroData& data = _macros[macro];
+        releaseMacroContent(data.content);
+        data.content = MACRO_NONE;
+        _macroArenaFree += data.keySize + data.textSize;
+        _macroCount--;
+        setMacroNode(key, MACRO_NONE);
+        compactMacroArena();
+        recordMacroChange(vMacroChangeDelete, macroText, "");
         return true;
     }
     return false;
 }
 
-void onTableCodeChange() {
-    for (std::map<vector<Uint32>, MacroData>::iterator it = macroMap.begin(); it != macroMap.end(); ++it) {
-        convert(it->second.macroContent, it->second.macroContentCode);
+void getMacroMemoryUsage(vMacroMemoryUsage& usage) {
+    lock_guard<mutex> lock(_macroLock);
+    usage = vMacroMemoryUsage();
+    usage.macroCount = _useMacroLibrary ? _macroLibrary.header->macroCount : _macroCount;
+    for (size_t i = 0; i < _macros.size(); i++) {
+        if (_macros[i].content != MACRO_NONE) {
+            usage.keyBytes += _macros[i].keySize;
+            usage.textBytes += _macros[i].textSize;
+        }
     }
+    for (size_t i = 0; i < _macroContents.size(); i++) {
+        const MacroContentData& data = _macroContents[i];
+        if (data.useCount > 0) {
+            usage.contentCount++;
+            usage.contentBytes += data.size;
+        }
+        usage.cacheBytes += data.tableContent.capacity() * sizeof(MacroTableContent);
+        for (size_t j = 0; j < data.tableContent.size(); j++) {
+            const MacroTableContent& tableContent = data.tableContent[j];
+            usage.cacheBytes += (tableContent.content.capacity() + tableContent.contentTitle.capacity() + tableContent.contentUpper.capacity()) * sizeof(Uint32);
+        }
+    }
+    usage.freeBytes = _macroArena.capacity() - usage.keyBytes - usage.textBytes - usage.contentBytes;
+    usage.macroBytes = _macros.capacity() * sizeof(MacroData) + _macroContents.capacity() * sizeof(MacroContentData) +
+                       _macroContentSlot.capacity() * sizeof(Uint32) +
+                       _macroLibraryContent.size() * (sizeof(pair<Uint32, Uint32>) + sizeof(void*)) + _macroLibraryContent.bucket_count() * sizeof(void*);
+    //each edge is a node of unordered_map: next pointer, key and value
+    usage.trieBytes = _macroTrieData.capacity() * sizeof(Uint32) +
+                      _macroTrieEdge.size() * (sizeof(void*) + sizeof(pair<Uint64, Uint32>)) + _macroTrieEdge.bucket_count() * sizeof(void*);
+    usage.libraryBytes = _useMacroLibrary ? (_macroLibrary.mapping != NULL ? _macroLibrary.mappingSize : _macroLibrary.buffer.capacity()) : 0;
+    usage.totalBytes = _macroArena.capacity() + usage.macroBytes + usage.trieBytes + usage.cacheBytes + usage.libraryBytes;
+}
+
+void onTableCodeChange() {
+    //content of the new code table is encoded when it's used, see getMacroTableContent()
 }
 
 void saveToFile(const string& path) {
     ofstream myfile;
     myfile.open(path.c_str());
-    myfile << ";Compatible OpenKey Macro Data file for UniKey*** version=1 ***\n";
-    for (std::map<vector<Uint32>, MacroData>::iterator it = macroMap.begin(); it != macroMap.end(); ++it) {
-        myfile <<it->second.macroText << ":" << it->second.macroContent<<"\n";
+    string buffer = ";Compatible OpenKey Macro Data file for UniKey*** version=1 ***\n";
+    buffer.reserve(MACRO_FILE_BUFFER_SIZE * 2);
+    auto writeMacro = [&](const char* macroText, const size_t& textSize, const char* macroContent, const size_t& contentSize) {
+        buffer.append(macroText, textSize);
+        buffer += ':';
+        buffer.append(macroContent, contentSize);
+        buffer += '\n';
+        if (buffer.size() >= MACRO_FILE_BUFFER_SIZE) {
+            myfile.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    };
+    if (_useMacroLibrary) {
+        string macroText, macroContent;
+        for (Uint32 i = 0; i < _macroLibrary.header->macroCount; i++) {
+            if (getMacroLibraryText(_macroLibrary, i, macroText, macroContent))
+                writeMacro(macroText.data(), macroText.size(), macroContent.data(), macroContent.size());
+        }
+    } else {
+        vector<Uint32> macros;
+        getSortedMacros(macros);
+        for (size_t i = 0; i < macros.size(); i++) {
+            const MacroData& data = _macros[macros[i]];
+            const MacroContentData& content = _macroContents[data.content];
+            writeMacro((const char*)_macroArena.data() + data.textOffset, data.textSize,
+                       (const char*)_macroArena.data() + content.offset, content.size);
+        }
     }
+    myfile.write(buffer.data(), buffer.size());
     myfile.close();
 }
 
 void readFromFile(const string& path, const bool& append) {
-    ifstream myfile(path.c_str());
-    string line;
-    int k = 0;
-    size_t pos = 0;
-    string name, content;
-    if (myfile.is_open()) {
-        if (!append) {
-            macroMap.clear();
-        }
-        while (getline (myfile,line) ) {
-            k++;
-            if (k == 1) continue;
-            pos = line.find(":");
-            if (string::npos != pos) {
-                name = line.substr(0, pos);
-                content = line.substr(pos + 1, line.length() - pos - 1);
-				while (name.compare("") == 0 && content.compare("") != 0) {
-					pos = content.find(":");
-					if (string::npos != pos) {
-						name += ":";
-						name += content.substr(0, pos);
-						content = content.substr(pos + 1, line.length() - pos - 1);
-					} else {
-						break;
-					}
-				}
-
-                if (name.compare("") != 0 && !hasMacro(name)) {
-                    addMacro(name, content);
-                }
-            }
-        }
-        myfile.close();
+    vector<string> macroTexts, macroContents;
+    if (!readMacroFile(path, macroTexts, macroContents))
+        return;
+    lock_guard<mutex> lock(_macroLock);
+    if (!append) {
+        closeMacroLibraryData();
+        clearMacroData();
     }
+    copyMacroLibraryToMap();
+    startNewMacroGeneration();
+    
+    //the first macro of each key is used, macros which already exist are kept
+    vector<vector<Uint32>> keys;
+    convertAll(macroTexts, keys, MACRO_KEY_CODE_TABLE);
+    reserveMacroData(macroTexts, macroContents);
+    for (size_t i = 0; i < keys.size(); i++)
+        setMacro(keys[i], macroTexts[i], macroContents[i], false);
 }
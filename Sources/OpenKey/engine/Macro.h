@@ -16,10 +16,52 @@
 
 using namespace std;
 
+#define MACRO_NONE                      0xFFFFFFFF
+#define MACRO_KEY_CODE_TABLE            0 //macro keys use Unicode codes for characters which have tone/mark, so they're the same on every code table
+
+/**
+ * Macro content encoded for a code table
+ */
+struct MacroTableContent {
+    int codeTable;
+    vector<Uint32> content; //converted of macroContent
+    vector<Uint32> contentTitle; //auto caps: content in Title/UPPER case, made when it's used first
+    vector<Uint32> contentUpper;
+};
+
+/**
+ * Macro content, same content of many macros is stored once in macro arena
+ */
+struct MacroContentData {
+    Uint32 offset; //UTF-8 macroContent in macro arena, ex: "millisecond"
+    Uint32 size;
+    Uint32 useCount; //macros which use this content
+    vector<MacroTableContent> tableContent; //for each code table which is used, made when it's used first
+};
+
 struct MacroData {
-    string macroText; //ex: "ms"
-    string macroContent; //ex: "millisecond"
-    vector<Uint32> macroContentCode; //converted of macroContent
+    Uint32 keyOffset; //key codes (converted macroText) in macro arena, variable width
+    Uint32 keySize; //bytes
+    Uint32 textOffset; //UTF-8 macroText in macro arena, ex: "ms"
+    Uint32 textSize;
+    Uint32 content; //index of MacroContentData, MACRO_NONE if this macro is deleted
+};
+
+/**
+ * Memory used by macro data, in bytes (capacity of each table)
+ */
+struct vMacroMemoryUsage {
+    size_t macroCount = 0;
+    size_t contentCount = 0; //different contents
+    size_t keyBytes = 0; //macro arena
+    size_t textBytes = 0;
+    size_t contentBytes = 0;
+    size_t freeBytes = 0; //deleted macros and unused space, until the arena is compacted
+    size_t macroBytes = 0; //MacroData, MacroContentData and the content hash table
+    size_t trieBytes = 0; //macro trie (edges are estimated)
+    size_t cacheBytes = 0; //content of each code table, Title/UPPER case
+    size_t libraryBytes = 0; //macro library file, mapped or copied
+    size_t totalBytes = 0;
 };
 
 /**
@@ -32,10 +74,52 @@ void initMacroMap(const Byte* pData, const int& size);
  */
 void getMacroSaveData(vector<Byte>& outData);
 
+/**
+ * Use macro library file (MacroLibrary.h) as macro data, it's mapped and read in place.
+ * initMacroMap() also accepts library data.
+ * When macro data is changed (addMacro, deleteMacro,...), the library is copied to memory.
+ */
+bool initMacroLibrary(const string& path);
+
+/**
+ * convert all macro data to macro library format
+ */
+void getMacroLibraryData(vector<Byte>& outData);
+
+/**
+ * convert data of initMacroMap() or UniKey macro file (readFromFile) to macro library format
+ */
+void convertMacroDataToLibrary(const Byte* pData, const int& size, vector<Byte>& outData);
+bool convertMacroFileToLibrary(const string& path, vector<Byte>& outData);
+
+#define MACRO_TRIE_ROOT                 0
+#define MACRO_TRIE_DEAD                 0xFFFFFFFF
+
+/**
+ * Macro trie: every macro key (converted macroText) is a path from MACRO_TRIE_ROOT,
+ * engine moves one step for each key while typing, so the match is ready at break key.
+ * Walk the trie with the codes returned by getCharacterCode(data, MACRO_KEY_CODE_TABLE), MACRO_TRIE_DEAD has no child.
+ */
+Uint32 nextMacroNode(const Uint32& node, const Uint32& code);
+
+/**
+ * Increases when macro table changes, nodes of the old version are invalid
+ */
+Uint32 getMacroTrieVersion();
+
 /**
  * Use to find full text by macro
+ * @key: macro key, each code is converted by getCharacterCode(data, MACRO_KEY_CODE_TABLE)
+ * @node: trie node of @key, see nextMacroNode()
+ * @caseNode: auto caps, trie node of @key with the first code in lower case (all codes if the
+ * second one is in upper case too), MACRO_TRIE_DEAD if the first code isn't in upper case
+ * @codeTable: code table of the content, the one of the engine context
+ * @autoCaps: vAutoCapsMacro of the engine context
+ * @macroContent: copy of the content in @codeTable; with auto caps, of its Title/UPPER case
+ * variant which is made once and kept with the macro. It's thread safe with the functions which
+ * change macro data
  */
-bool findMacro(vector<Uint32>& key, vector<Uint32>& macroContentCode);
+bool findMacro(vector<Uint32>& key, const Uint32& node, const Uint32& caseNode, const int& codeTable, const bool& autoCaps, vector<Uint32>& macroContent);
 
 /**
  * check has this macro or not
@@ -58,7 +142,13 @@ bool addMacro(const string& macroText, const string& macroContent);
 bool deleteMacro(const string& macroText);
 
 /**
- * When table code changed, we have to call this function to reload all macroContentCode
+ * Bytes used by each part of macro data, to size macro libraries
+ */
+void getMacroMemoryUsage(vMacroMemoryUsage& usage);
+
+/**
+ * When table code changed. Macro content is encoded for each code table when it's used
+ * and kept until the macro is edited, so there is nothing to reload
  */
 void onTableCodeChange();
 
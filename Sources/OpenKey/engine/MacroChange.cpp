@@ -0,0 +1,215 @@
+//
+//  MacroChange.cpp
+//  OpenKey
+//
+//  Macro data in memory keeps its version and the last MACRO_CHANGE_LOG_SIZE changes; a process
+//  which has the same version applies the changes with addMacro/deleteMacro, one macro each time.
+//
+
+#include "MacroChange.h"
+#include "Macro.h"
+#include <memory.h>
+#include <chrono>
+#include <deque>
+
+static vMacroVersion _macroVersion;
+static deque<vMacroChange> _macroChangeLog; //changes of this generation, the last one has _macroVersion.sequence
+
+static inline void writeMacroChangeNumber(vector<Byte>& outData, const Uint32& value, const int& size) {
+    for (int i = 0; i < size; i++)
+        outData.push_back((Byte)(value >> (8 * i)));
+}
+
+static inline bool readMacroChangeNumber(const Byte* pData, const size_t& size, size_t& pos, Uint32& value, const int& valueSize) {
+    if (pos + valueSize > size)
+        return false;
+    value = 0;
+    for (int i = 0; i < valueSize; i++)
+        value |= (Uint32)pData[pos + i] << (8 * i);
+    pos += valueSize;
+    return true;
+}
+
+static inline bool readMacroChangeString(const Byte* pData, const size_t& size, size_t& pos, string& str, const int& lengthSize) {
+    Uint32 length;
+    if (!readMacroChangeNumber(pData, size, pos, length, lengthSize) || length > size - pos)
+        return false;
+    str.assign((const char*)pData + pos, length);
+    pos += length;
+    return true;
+}
+
+/**
+ * FNV-1a of 4 bytes words, it's the same on every platform
+ */
+static Uint32 hashMacroData(const Byte* pData, const size_t& size) {
+    Uint32 hash = 2166136261u;
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        hash ^= (Uint32)pData[i] | ((Uint32)pData[i + 1] << 8) | ((Uint32)pData[i + 2] << 16) | ((Uint32)pData[i + 3] << 24);
+        hash *= 16777619u;
+    }
+    for (; i < size; i++) {
+        hash ^= pData[i];
+        hash *= 16777619u;
+    }
+    return hash ^ (Uint32)size;
+}
+
+void writeMacroChanges(const vMacroVersion& base, const vector<vMacroChange>& changes, vector<Byte>& outData) {
+    outData.assign(MACRO_CHANGE_MAGIC, MACRO_CHANGE_MAGIC + 4);
+    writeMacroChangeNumber(outData, 0, 4); //size, set at the end
+    writeMacroChangeNumber(outData, MACRO_CHANGE_FORMAT, 2);
+    writeMacroChangeNumber(outData, base.generation, 4);
+    writeMacroChangeNumber(outData, base.sequence, 4);
+    writeMacroChangeNumber(outData, (Uint32)changes.size(), 4);
+    for (size_t i = 0; i < changes.size(); i++) {
+        const vMacroChange& change = changes[i];
+        outData.push_back(change.type);
+        writeMacroChangeNumber(outData, change.sequence, 4);
+        writeMacroChangeNumber(outData, (Uint32)change.macroText.size(), 2);
+        outData.insert(outData.end(), change.macroText.begin(), change.macroText.end());
+        writeMacroChangeNumber(outData, (Uint32)change.macroContent.size(), 4);
+        outData.insert(outData.end(), change.macroContent.begin(), change.macroContent.end());
+    }
+    const Uint32 size = (Uint32)outData.size();
+    for (int i = 0; i < 4; i++)
+        outData[4 + i] = (Byte)(size >> (8 * i));
+}
+
+size_t getMacroChangeDataSize(const Byte* pData, const size_t& size) {
+    size_t pos = 4;
+    Uint32 dataSize;
+    if (size < 8 || memcmp(pData, MACRO_CHANGE_MAGIC, 4) != 0 || !readMacroChangeNumber(pData, size, pos, dataSize, 4))
+        return 0;
+    return dataSize >= MACRO_CHANGE_HEADER_SIZE ? dataSize : 0;
+}
+
+bool readMacroChanges(const Byte* pData, const size_t& size, vMacroVersion& base, vector<vMacroChange>& changes) {
+    changes.clear();
+    if (pData == NULL || getMacroChangeDataSize(pData, size) != size)
+        return false;
+    size_t pos = 8;
+    Uint32 format, count, type;
+    if (!readMacroChangeNumber(pData, size, pos, format, 2) || format != MACRO_CHANGE_FORMAT ||
+        !readMacroChangeNumber(pData, size, pos, base.generation, 4) ||
+        !readMacroChangeNumber(pData, size, pos, base.sequence, 4) ||
+        !readMacroChangeNumber(pData, size, pos, count, 4) || count > size - pos)
+        return false;
+    changes.resize(count);
+    for (Uint32 i = 0; i < count; i++) {
+        vMacroChange& change = changes[i];
+        if (!readMacroChangeNumber(pData, size, pos, type, 1) ||
+            !readMacroChangeNumber(pData, size, pos, change.sequence, 4) ||
+            !readMacroChangeString(pData, size, pos, change.macroText, 2) ||
+            !readMacroChangeString(pData, size, pos, change.macroContent, 4))
+            return false;
+        if (type < vMacroChangeAdd || type > vMacroChangeDelete || change.sequence != base.sequence + i + 1)
+            return false;
+        change.type = (Byte)type;
+    }
+    return pos == size;
+}
+
+void getMacroVersion(vMacroVersion& version) {
+    version = _macroVersion;
+}
+
+bool getMacroChangeVersion(const Byte* pData, const size_t& size, vMacroVersion& version) {
+    vector<vMacroChange> changes;
+    if (!readMacroChanges(pData, size, version, changes))
+        return false;
+    version.sequence += (Uint32)changes.size();
+    return true;
+}
+
+void setMacroVersion(const vMacroVersion& version) {
+    _macroVersion = version;
+    _macroChangeLog.clear();
+}
+
+void getMacroVersionData(const Byte* pData, const size_t& size, vector<Byte>& outData) {
+    outData.clear();
+    writeMacroChangeNumber(outData, _macroVersion.generation, 4);
+    writeMacroChangeNumber(outData, _macroVersion.sequence, 4);
+    writeMacroChangeNumber(outData, hashMacroData(pData, size), 4);
+}
+
+static bool readMacroVersionData(const Byte* pData, const size_t& size, vMacroVersion& version, Uint32& dataHash) {
+    size_t pos = 0;
+    return pData != NULL && size == MACRO_VERSION_DATA_SIZE &&
+           readMacroChangeNumber(pData, size, pos, version.generation, 4) &&
+           readMacroChangeNumber(pData, size, pos, version.sequence, 4) &&
+           readMacroChangeNumber(pData, size, pos, dataHash, 4);
+}
+
+bool readMacroVersionData(const Byte* pData, const size_t& size, vMacroVersion& version) {
+    Uint32 dataHash;
+    return readMacroVersionData(pData, size, version, dataHash);
+}
+
+bool setMacroVersionData(const Byte* pData, const size_t& size) {
+    vMacroVersion version;
+    Uint32 dataHash;
+    //startMacroGeneration() made the generation from the loaded data, nothing is changed since then
+    if (!readMacroVersionData(pData, size, version, dataHash) ||
+        dataHash != _macroVersion.generation || _macroVersion.sequence != 0)
+        return false;
+    setMacroVersion(version);
+    return true;
+}
+
+bool getMacroChanges(const Uint32& sequence, vector<Byte>& outData) {
+    if (sequence > _macroVersion.sequence || _macroVersion.sequence - sequence > _macroChangeLog.size())
+        return false;
+    vector<vMacroChange> changes(_macroChangeLog.end() - (_macroVersion.sequence - sequence), _macroChangeLog.end());
+    vMacroVersion base;
+    base.generation = _macroVersion.generation;
+    base.sequence = sequence;
+    writeMacroChanges(base, changes, outData);
+    return true;
+}
+
+bool applyMacroChanges(const Byte* pData, const size_t& size) {
+    vMacroVersion base;
+    vector<vMacroChange> changes;
+    if (!readMacroChanges(pData, size, base, changes))
+        return false;
+    //macro data must be a version between the first and the last change
+    if (base.generation != _macroVersion.generation || _macroVersion.sequence < base.sequence ||
+        _macroVersion.sequence > base.sequence + changes.size())
+        return false;
+    for (size_t i = _macroVersion.sequence - base.sequence; i < changes.size(); i++) {
+        const vMacroChange& change = changes[i];
+        if (change.type == vMacroChangeDelete)
+            deleteMacro(change.macroText);
+        else
+            addMacro(change.macroText, change.macroContent);
+    }
+    return true;
+}
+
+void startMacroGeneration(const Byte* pData, const size_t& size) {
+    vMacroVersion version;
+    version.generation = hashMacroData(pData, size);
+    setMacroVersion(version);
+}
+
+void startNewMacroGeneration() {
+    const Uint64 now = (Uint64)chrono::system_clock::now().time_since_epoch().count() ^
+                       (Uint64)chrono::steady_clock::now().time_since_epoch().count();
+    const Uint32 seed[3] = { (Uint32)now, (Uint32)(now >> 32), _macroVersion.generation + _macroVersion.sequence };
+    startMacroGeneration((const Byte*)seed, sizeof(seed));
+}
+
+void recordMacroChange(const Byte& type, const string& macroText, const string& macroContent) {
+    vMacroChange change;
+    change.type = type;
+    change.sequence = ++_macroVersion.sequence;
+    change.macroText = macroText;
+    if (type != vMacroChangeDelete)
+        change.macroContent = macroContent;
+    _macroChangeLog.push_back(change);
+    if (_macroChangeLog.size() > MACRO_CHANGE_LOG_SIZE)
+        _macroChangeLog.pop_front();
+}
@@ -0,0 +1,131 @@
+//
+//  MacroChange.h
+//  OpenKey
+//
+//  Change log of macro data, to send macro edits from the macro dialog (another process)
+//  to the engine without reloading all macro data.
+//
+
+#ifndef MacroChange_h
+#define MacroChange_h
+
+#include <vector>
+#include <string>
+#include "DataType.h"
+
+using namespace std;
+
+#define MACRO_CHANGE_MAGIC              "OKMC"
+#define MACRO_CHANGE_FORMAT             1
+#define MACRO_CHANGE_HEADER_SIZE        22
+#define MACRO_CHANGE_LOG_SIZE           1024 //last changes which are kept to be sent
+#define MACRO_VERSION_DATA_SIZE         12
+
+enum vMacroChangeType {
+    vMacroChangeAdd = 1,
+    vMacroChangeUpdate,
+    vMacroChangeDelete
+};
+
+/**
+ * Version of macro data: @generation is made when all macro data is loaded (a hash of data, so
+ * processes which load the same data have the same generation), @sequence is the number of changes
+ * since then
+ */
+struct vMacroVersion {
+    Uint32 generation = 0;
+    Uint32 sequence = 0;
+};
+
+struct vMacroChange {
+    Byte type;
+    Uint32 sequence; //version of macro data after this change
+    string macroText;
+    string macroContent; //empty for vMacroChangeDelete
+};
+
+/**
+ * Change data, all numbers are little endian:
+ * byte 0..3: MACRO_CHANGE_MAGIC
+ * byte 4..7: size of change data, header included
+ * byte 8..9: MACRO_CHANGE_FORMAT
+ * byte 10..13: generation
+ * byte 14..17: sequence of macro data before the first change
+ * byte 18..21: change count
+ *
+ * each change:
+ * byte 0: vMacroChangeType
+ * byte 1..4: sequence
+ * byte 5..6: macroText size, then macroText data
+ * 4 bytes: macroContent size, then macroContent data
+ */
+void writeMacroChanges(const vMacroVersion& base, const vector<vMacroChange>& changes, vector<Byte>& outData);
+bool readMacroChanges(const Byte* pData, const size_t& size, vMacroVersion& base, vector<vMacroChange>& changes);
+
+/**
+ * Size of change data which starts with @pData (the header, at least 8 bytes), 0 if it isn't change data.
+ * Use to read change data from a stream
+ */
+size_t getMacroChangeDataSize(const Byte* pData, const size_t& size);
+
+/**
+ * Version of macro data in memory
+ */
+void getMacroVersion(vMacroVersion& version);
+
+/**
+ * Version of macro data after @pData is applied
+ */
+bool getMacroChangeVersion(const Byte* pData, const size_t& size, vMacroVersion& version);
+
+/**
+ * Set version of macro data after it's reloaded, ex: from data which is saved with the changes
+ * in @pData, so the next changes are applied
+ */
+void setMacroVersion(const vMacroVersion& version);
+
+/**
+ * Version data to save with macro data @pData (getMacroSaveData()), little endian:
+ * byte 0..3: generation
+ * byte 4..7: sequence
+ * byte 8..11: hash of @pData
+ */
+void getMacroVersionData(const Byte* pData, const size_t& size, vector<Byte>& outData);
+
+/**
+ * Use version data which is saved with the macro data just loaded by initMacroMap(), so this process
+ * has the same version as the one which saved it and their next changes are applied without a reload.
+ * Return false and change nothing if it's saved with other macro data (ex: an old version of OpenKey
+ * saved macro data only)
+ */
+bool setMacroVersionData(const Byte* pData, const size_t& size);
+
+/**
+ * Version of macro data in @pData (getMacroVersionData()), false if it's invalid
+ */
+bool readMacroVersionData(const Byte* pData, const size_t& size, vMacroVersion& version);
+
+/**
+ * Changes after version @sequence of macro data in memory, return false if they aren't kept
+ * any more (send all macro data instead)
+ */
+bool getMacroChanges(const Uint32& sequence, vector<Byte>& outData);
+
+/**
+ * Apply change data (getMacroChanges() of another process) to macro data in memory. Changes which are
+ * already applied are skipped. Return false and change nothing if the data is made from other macro
+ * data (generation or sequence mismatch) or is invalid: load all macro data again
+ */
+bool applyMacroChanges(const Byte* pData, const size_t& size);
+
+/**
+ * Called by macro data (Macro.cpp)
+ * startMacroGeneration: all macro data is loaded from @pData (@size can be 0)
+ * startNewMacroGeneration: other changes, ex: import from file, a generation which no other process has
+ * recordMacroChange: a macro is added, updated or deleted
+ */
+void startMacroGeneration(const Byte* pData, const size_t& size);
+void startNewMacroGeneration();
+void recordMacroChange(const Byte& type, const string& macroText, const string& macroContent);
+
+#endif /* MacroChange_h */
@@ -0,0 +1,304 @@
+//
+//  MacroLibrary.cpp
+//  OpenKey
+//
+//  Indexed binary file of macro data, which is read in place (memory mapped).
+//
+
+#include "MacroLibrary.h"
+#include "Engine.h"
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static inline Uint32 hashMacroEdge(const Uint32& node, const Uint32& code) {
+    Uint32 h = node * 0x9E3779B1u ^ code * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+static inline Uint32 alignMacroLibrary(const Uint32& offset) {
+    return (offset + 3) & ~3u;
+}
+
+static bool isInFile(const Uint32& offset, const Uint64& size, const Uint32& fileSize) {
+    return offset % 4 == 0 && (Uint64)offset + size <= fileSize;
+}
+
+bool isMacroLibraryData(const Byte* pData, const size_t& size) {
+    return pData != NULL && size >= sizeof(vMacroLibraryHeader) && memcmp(pData, MACRO_LIBRARY_MAGIC, sizeof(MACRO_LIBRARY_MAGIC)) == 0;
+}
+
+/**
+ * Check header and set section pointers, O(1)
+ */
+static bool attachMacroLibrary(vMacroLibrary& library, const Byte* pData, const size_t& size) {
+    if (!isMacroLibraryData(pData, size))
+        return false;
+    const vMacroLibraryHeader* header = (const vMacroLibraryHeader*)pData;
+    if (header->version != MACRO_LIBRARY_VERSION || header->fileSize != size ||
+        header->nodeCount == 0 || header->edgeSlotCount == 0 || (header->edgeSlotCount & (header->edgeSlotCount - 1)) != 0 ||
+        !isInFile(header->entryOffset, (Uint64)header->macroCount * sizeof(vMacroLibraryEntry), header->fileSize) ||
+        !isInFile(header->nodeOffset, (Uint64)header->nodeCount * sizeof(Uint32), header->fileSize) ||
+        !isInFile(header->edgeOffset, (Uint64)header->edgeSlotCount * sizeof(vMacroLibraryEdge), header->fileSize) ||
+        !isInFile(header->keyOffset, (Uint64)header->keyCount * sizeof(Uint32), header->fileSize) ||
+        !isInFile(header->stringOffset, header->stringSize, header->fileSize))
+        return false;
+    library.data = pData;
+    library.header = header;
+    library.entries = (const vMacroLibraryEntry*)(pData + header->entryOffset);
+    library.nodes = (const Uint32*)(pData + header->nodeOffset);
+    library.edges = (const vMacroLibraryEdge*)(pData + header->edgeOffset);
+    library.keys = (const Uint32*)(pData + header->keyOffset);
+    library.strings = (const char*)(pData + header->stringOffset);
+    return true;
+}
+
+bool mapMacroFile(const string& path, const Byte*& pData, size_t& size) {
+    pData = NULL;
+    size = 0;
+#ifdef _WIN32
+    HANDLE file = CreateFileW(utf8ToWideString(path).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || (Uint64)fileSize.QuadPart > (Uint64)SIZE_MAX) {
+        CloseHandle(file);
+        return false;
+    }
+    if (fileSize.QuadPart == 0) { //empty file can't be mapped
+        CloseHandle(file);
+        return true;
+    }
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return false;
+    pData = (const Byte*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (pData == NULL)
+        return false;
+    size = (size_t)fileSize.QuadPart;
+#else
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+    struct stat fileStat;
+    if (fstat(file, &fileStat) != 0) {
+        close(file);
+        return false;
+    }
+    if (fileStat.st_size == 0) { //empty file can't be mapped
+        close(file);
+        return true;
+    }
+    void* mapping = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (mapping == MAP_FAILED)
+        return false;
+    pData = (const Byte*)mapping;
+    size = (size_t)fileStat.st_size;
+#endif
+    return true;
+}
+
+void unmapMacroFile(const Byte* pData, const size_t& size) {
+    if (pData == NULL)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(pData);
+#else
+    munmap((void*)pData, size);
+#endif
+}
+
+bool openMacroLibrary(vMacroLibrary& library, const string& path) {
+    closeMacroLibrary(library);
+    const Byte* pData;
+    size_t size;
+    if (!mapMacroFile(path, pData, size))
+        return false;
+    library.mapping = (void*)pData;
+    library.mappingSize = size;
+    if (size < sizeof(vMacroLibraryHeader) || size > 0xFFFFFFFF ||
+        !attachMacroLibrary(library, (const Byte*)library.mapping, library.mappingSize)) {
+        closeMacroLibrary(library);
+        return false;
+    }
+    return true;
+}
+
+bool loadMacroLibrary(vMacroLibrary& library, const Byte* pData, const size_t& size) {
+    closeMacroLibrary(library);
+    if (!isMacroLibraryData(pData, size))
+        return false;
+    library.buffer.assign(pData, pData + size);
+    if (!attachMacroLibrary(library, library.buffer.data(), library.buffer.size())) {
+        closeMacroLibrary(library);
+        return false;
+    }
+    return true;
+}
+
+void closeMacroLibrary(vMacroLibrary& library) {
+    unmapMacroFile((const Byte*)library.mapping, library.mappingSize);
+    library = vMacroLibrary();
+}
+
+bool canUseMacroLibraryKey(const vMacroLibrary& library, const int& codeTable) {
+    if (library.header == NULL || library.header->platform != MACRO_LIBRARY_PLATFORM)
+        return false;
+    return !(library.header->flags & MACRO_LIBRARY_CODE_TABLE_KEY) || library.header->codeTable == codeTable;
+}
+
+Uint32 nextMacroLibraryNode(const vMacroLibrary& library, const Uint32& node, const Uint32& code) {
+    if (library.header == NULL || node >= library.header->nodeCount)
+        return MACRO_LIBRARY_NONE;
+    Uint32 mask = library.header->edgeSlotCount - 1;
+    Uint32 slot = hashMacroEdge(node, code) & mask;
+    for (Uint32 i = 0; i <= mask; i++) {
+        const vMacroLibraryEdge& edge = library.edges[slot];
+        if (edge.node == MACRO_LIBRARY_NONE)
+            break;
+        if (edge.node == node && edge.code == code)
+            return edge.child < library.header->nodeCount ? edge.child : MACRO_LIBRARY_NONE;
+        slot = (slot + 1) & mask;
+    }
+    return MACRO_LIBRARY_NONE;
+}
+
+Uint32 getMacroLibraryEntry(const vMacroLibrary& library, const Uint32& node) {
+    if (library.header == NULL || node >= library.header->nodeCount)
+        return MACRO_LIBRARY_NONE;
+    Uint32 entry = library.nodes[node];
+    return entry < library.header->macroCount ? entry : MACRO_LIBRARY_NONE;
+}
+
+bool getMacroLibraryKey(const vMacroLibrary& library, const Uint32& entry, const Uint32*& key, Uint32& keySize) {
+    if (library.header == NULL || entry >= library.header->macroCount)
+        return false;
+    const vMacroLibraryEntry& e = library.entries[entry];
+    if ((Uint64)e.keyStart + e.keySize > library.header->keyCount)
+        return false;
+    key = library.keys + e.keyStart;
+    keySize = e.keySize;
+    return true;
+}
+
+bool getMacroLibraryText(const vMacroLibrary& library, const Uint32& entry, string& macroText, string& macroContent) {
+    if (library.header == NULL || entry >= library.header->macroCount)
+        return false;
+    const vMacroLibraryEntry& e = library.entries[entry];
+    if ((Uint64)e.textStart + e.textSize > library.header->stringSize ||
+        (Uint64)e.contentStart + e.contentSize > library.header->stringSize)
+        return false;
+    macroText.assign(library.strings + e.textStart, e.textSize);
+    macroContent.assign(library.strings + e.contentStart, e.contentSize);
+    return true;
+}
+
+template<class T>
+static inline void writeMacroLibrary(vector<Byte>& outData, const Uint32& offset, const T& value) {
+    memcpy(outData.data() + offset, &value, sizeof(T));
+}
+
+void buildMacroLibrary(const vector<vector<Uint32>>& keys,
+                       const vector<string>& macroTexts,
+                       const vector<string>& macroContents,
+                       const int& codeTable,
+                       vector<Byte>& outData) {
+    Uint32 i, j, slot;
+    vMacroLibraryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MACRO_LIBRARY_MAGIC, sizeof(MACRO_LIBRARY_MAGIC));
+    header.version = MACRO_LIBRARY_VERSION;
+    header.platform = MACRO_LIBRARY_PLATFORM;
+    header.codeTable = (Uint16)codeTable;
+    header.macroCount = (Uint32)keys.size();
+
+    //trie: keys are sorted, so a new node is a child of a node on the path of previous key
+    vector<Uint32> nodes(1, MACRO_LIBRARY_NONE);
+    vector<vMacroLibraryEdge> edges;
+    vector<Uint32> path(1, 0); //path[k]: node after k codes of previous key
+    for (i = 0; i < keys.size(); i++) {
+        const vector<Uint32>& key = keys[i];
+        //common prefix with previous key
+        j = 0;
+        if (i > 0) {
+            while (j < key.size() && j < keys[i - 1].size() && key[j] == keys[i - 1][j])
+                j++;
+        }
+        path.resize(j + 1);
+        for (; j < key.size(); j++) {
+            vMacroLibraryEdge edge = { path.back(), key[j], (Uint32)nodes.size() };
+            edges.push_back(edge);
+            path.push_back((Uint32)nodes.size());
+            nodes.push_back(MACRO_LIBRARY_NONE);
+        }
+        nodes[path.back()] = i;
+        for (j = 0; j < key.size(); j++) {
+            if (key[j] & CHAR_CODE_MASK)
+                header.flags |= MACRO_LIBRARY_CODE_TABLE_KEY;
+        }
+        header.keyCount += (Uint32)key.size();
+        header.stringSize += (Uint32)(macroTexts[i].size() + macroContents[i].size());
+    }
+    header.nodeCount = (Uint32)nodes.size();
+    header.edgeSlotCount = 1;
+    while (header.edgeSlotCount < edges.size() + edges.size() / 3 + 1) //load factor <= 0.75
+        header.edgeSlotCount <<= 1;
+
+    header.entryOffset = alignMacroLibrary(sizeof(vMacroLibraryHeader));
+    header.nodeOffset = alignMacroLibrary(header.entryOffset + header.macroCount * sizeof(vMacroLibraryEntry));
+    header.edgeOffset = alignMacroLibrary(header.nodeOffset + header.nodeCount * sizeof(Uint32));
+    header.keyOffset = alignMacroLibrary(header.edgeOffset + header.edgeSlotCount * sizeof(vMacroLibraryEdge));
+    header.stringOffset = alignMacroLibrary(header.keyOffset + header.keyCount * sizeof(Uint32));
+    header.fileSize = alignMacroLibrary(header.stringOffset + header.stringSize);
+
+    outData.assign(header.fileSize, 0);
+    writeMacroLibrary(outData, 0, header);
+    memcpy(outData.data() + header.nodeOffset, nodes.data(), nodes.size() * sizeof(Uint32));
+
+    //edges
+    vMacroLibraryEdge emptyEdge = { MACRO_LIBRARY_NONE, 0, 0 };
+    for (i = 0; i < header.edgeSlotCount; i++)
+        writeMacroLibrary(outData, header.edgeOffset + i * sizeof(vMacroLibraryEdge), emptyEdge);
+    vMacroLibraryEdge* table = (vMacroLibraryEdge*)(outData.data() + header.edgeOffset);
+    for (i = 0; i < edges.size(); i++) {
+        slot = hashMacroEdge(edges[i].node, edges[i].code) & (header.edgeSlotCount - 1);
+        while (table[slot].node != MACRO_LIBRARY_NONE)
+            slot = (slot + 1) & (header.edgeSlotCount - 1);
+        table[slot] = edges[i];
+    }
+
+    //entries, keys, strings
+    Uint32 keyStart = 0, stringStart = 0;
+    for (i = 0; i < keys.size(); i++) {
+        vMacroLibraryEntry entry;
+        entry.keyStart = keyStart;
+        entry.keySize = (Uint32)keys[i].size();
+        entry.textStart = stringStart;
+        entry.textSize = (Uint32)macroTexts[i].size();
+        entry.contentStart = stringStart + entry.textSize;
+        entry.contentSize = (Uint32)macroContents[i].size();
+        writeMacroLibrary(outData, header.entryOffset + i * sizeof(vMacroLibraryEntry), entry);
+        if (entry.keySize > 0)
+            memcpy(outData.data() + header.keyOffset + keyStart * sizeof(Uint32), keys[i].data(), entry.keySize * sizeof(Uint32));
+        memcpy(outData.data() + header.stringOffset + entry.textStart, macroTexts[i].data(), entry.textSize);
+        memcpy(outData.data() + header.stringOffset + entry.contentStart, macroContents[i].data(), entry.contentSize);
+        keyStart += entry.keySize;
+        stringStart += entry.textSize + entry.contentSize;
+    }
+}
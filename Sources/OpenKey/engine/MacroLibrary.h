@@ -0,0 +1,147 @@
+//
+//  MacroLibrary.h
+//  OpenKey
+//
+//  Indexed binary file of macro data, which is read in place (memory mapped).
+//
+
+#ifndef MacroLibrary_h
+#define MacroLibrary_h
+
+#include <vector>
+#include <string>
+#include "DataType.h"
+
+using namespace std;
+
+#define MACRO_LIBRARY_MAGIC             "OKMACRO"
+#define MACRO_LIBRARY_VERSION           1
+#define MACRO_LIBRARY_NONE              0xFFFFFFFF
+
+//platform of the key codes in library, key codes are different on each platform
+#ifdef LINUX
+#define MACRO_LIBRARY_PLATFORM          3
+#elif _WIN32
+#define MACRO_LIBRARY_PLATFORM          2
+#else
+#define MACRO_LIBRARY_PLATFORM          1
+#endif
+
+//flags
+#define MACRO_LIBRARY_CODE_TABLE_KEY    1 //some keys have character code, they are only valid for header code table
+
+/**
+ * File structure, all numbers are little endian, all sections are 4 bytes aligned:
+ * - vMacroLibraryHeader
+ * - vMacroLibraryEntry[macroCount]: sorted by key codes, same order as getAllMacro()
+ * - Uint32[nodeCount]: macro trie, entry of each node, MACRO_LIBRARY_NONE if the node isn't a macro key.
+ *   Node 0 is the root
+ * - vMacroLibraryEdge[edgeSlotCount]: hash table of trie edges (open addressing), edgeSlotCount is a power of 2
+ * - Uint32[keyCount]: key codes of all macros, like convert() of macroText
+ * - char[stringSize]: UTF-8 macroText and macroContent of all macros
+ */
+struct vMacroLibraryHeader {
+    char magic[8];
+    Uint16 version;
+    Uint16 platform;
+    Uint16 codeTable; //code table of key codes
+    Uint16 flags;
+    Uint32 macroCount;
+    Uint32 nodeCount;
+    Uint32 edgeSlotCount;
+    Uint32 keyCount;
+    Uint32 stringSize;
+    Uint32 entryOffset;
+    Uint32 nodeOffset;
+    Uint32 edgeOffset;
+    Uint32 keyOffset;
+    Uint32 stringOffset;
+    Uint32 fileSize;
+};
+
+struct vMacroLibraryEntry {
+    Uint32 keyStart;
+    Uint32 keySize;
+    Uint32 textStart;
+    Uint32 textSize;
+    Uint32 contentStart;
+    Uint32 contentSize;
+};
+
+struct vMacroLibraryEdge {
+    Uint32 node; //MACRO_LIBRARY_NONE: empty slot
+    Uint32 code;
+    Uint32 child;
+};
+
+/**
+ * Opened library, data is a mapped file or a copy of memory data
+ */
+struct vMacroLibrary {
+    const Byte* data = NULL;
+    const vMacroLibraryHeader* header = NULL;
+    const vMacroLibraryEntry* entries = NULL;
+    const Uint32* nodes = NULL;
+    const vMacroLibraryEdge* edges = NULL;
+    const Uint32* keys = NULL;
+    const char* strings = NULL;
+
+    void* mapping = NULL; //platform data of mapped file
+    size_t mappingSize = 0;
+    vector<Byte> buffer; //data is a copy
+};
+
+/**
+ * Check magic number of library data
+ */
+bool isMacroLibraryData(const Byte* pData, const size_t& size);
+
+/**
+ * Map a file to memory (read only), @pData is NULL if the file is empty
+ */
+bool mapMacroFile(const string& path, const Byte*& pData, size_t& size);
+void unmapMacroFile(const Byte* pData, const size_t& size);
+
+/**
+ * Map library file to memory, only the header is checked here
+ */
+bool openMacroLibrary(vMacroLibrary& library, const string& path);
+
+/**
+ * Use a copy of library data
+ */
+bool loadMacroLibrary(vMacroLibrary& library, const Byte* pData, const size_t& size);
+
+void closeMacroLibrary(vMacroLibrary& library);
+
+/**
+ * Key codes of library can be used with current platform and @codeTable
+ */
+bool canUseMacroLibraryKey(const vMacroLibrary& library, const int& codeTable);
+
+/**
+ * Next trie node, MACRO_LIBRARY_NONE if there isn't any macro key with this prefix
+ */
+Uint32 nextMacroLibraryNode(const vMacroLibrary& library, const Uint32& node, const Uint32& code);
+
+/**
+ * Entry of a trie node, MACRO_LIBRARY_NONE if it isn't a macro key
+ */
+Uint32 getMacroLibraryEntry(const vMacroLibrary& library, const Uint32& node);
+
+/**
+ * Read entry data in place, return false if the entry is out of the file
+ */
+bool getMacroLibraryKey(const vMacroLibrary& library, const Uint32& entry, const Uint32*& key, Uint32& keySize);
+bool getMacroLibraryText(const vMacroLibrary& library, const Uint32& entry, string& macroText, string& macroContent);
+
+/**
+ * Build library data, @keys must be sorted and unique (like keys of getAllMacro())
+ */
+void buildMacroLibrary(const vector<vector<Uint32>>& keys,
+                       const vector<string>& macroTexts,
+                       const vector<string>& macroContents,
+                       const int& codeTable,
+                       vector<Byte>& outData);
+
+#endif /* MacroLibrary_h */
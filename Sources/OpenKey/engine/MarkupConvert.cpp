@@ -0,0 +1,751 @@
+//
+//  MarkupConvert.cpp
+//  OpenKey
+//
+//  Streaming conversion of HTML and RTF documents (clipboard rich text).
+//
+
+#include "MarkupConvert.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+enum vMarkupMode {
+    MarkupText = 0,
+    MarkupHeader,   //line of "HTML Format" header
+    MarkupTagOpen,  //after '<', it's a tag if a letter, '/', '!' or '?' follows
+    MarkupTag,
+    MarkupComment,
+    MarkupRawText,  //content of script/style
+    MarkupEntity,
+    MarkupControl,  //RTF control word or symbol
+    MarkupHex,      //RTF \'hh
+    MarkupBinary    //RTF data of \binN
+};
+
+#define MARKUP_MAX_TOKEN 64 //a longer entity or control word is invalid
+#define MARKUP_MAX_TAG_NAME 16
+#define MARKUP_MAX_HEADER_LINE 256
+#define MARKUP_MAX_UNICODE_SKIP 16
+#define MARKUP_TEXT_BUFFER_SIZE 16384 //a long text run is converted in parts
+
+//tags and control words which start a new line, like '\n' for caps first letter
+static const char* _htmlBreakTags[] = {
+    "br", "p", "div", "li", "tr", "td", "th", "h1", "h2", "h3", "h4", "h5", "h6", "hr",
+    "table", "ul", "ol", "dt", "dd", "blockquote", "pre", "title", NULL
+};
+static const char* _rtfBreakWords[] = { "par", "line", "sect", "page", "row", "cell", NULL };
+
+//RTF destinations which aren't text
+static const char* _rtfDestinations[] = {
+    "fonttbl", "colortbl", "stylesheet", "info", "pict", "object", "objdata", "listtable",
+    "listoverridetable", "revtbl", "rsidtbl", "generator", "xmlnstbl", "themedata",
+    "colorschememapping", "datastore", "latentstyles", "pgdsctbl", "filetbl", "fldinst", NULL
+};
+
+//offsets of "HTML Format" header
+static const char* _headerFieldNames[] = {
+    "StartHTML", "EndHTML", "StartFragment", "EndFragment", "StartSelection", "EndSelection", NULL
+};
+
+//Windows-1252 0x80..0x9F, undefined bytes are kept
+static const Uint16 _cp1252High[32] = {
+    0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+    0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178
+};
+
+static inline bool isAsciiAlpha(const char& c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline bool isAsciiDigit(const char& c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool isHexDigit(const char& c) {
+    return isAsciiDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static inline char lowerAscii(const char& c) {
+    return c >= 'A' && c <= 'Z' ? (char)(c + 0x20) : c;
+}
+
+static bool isInList(const char** list, const char* name, const size_t& size) {
+    for (int i = 0; list[i] != NULL; i++) {
+        if (strlen(list[i]) == size && memcmp(list[i], name, size) == 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Character of byte @c in Windows code page @codePage (1252 or 1258) of RTF \'hh
+ */
+static Uint16 codePageCharacter(const int& codePage, const Byte& c) {
+    if (c < 0x80)
+        return c;
+    if (codePage == 1258) {
+        switch (c) {
+            case 0x8A: case 0x8E: case 0x9A: case 0x9E: return c;
+            case 0xC3: return 0x0102;
+            case 0xCC: return 0x0300;
+            case 0xD0: return 0x0110;
+            case 0xD2: return 0x0309;
+            case 0xD5: return 0x01A0;
+            case 0xDD: return 0x01AF;
+            case 0xDE: return 0x0303;
+            case 0xE3: return 0x0103;
+            case 0xEC: return 0x0301;
+            case 0xF0: return 0x0111;
+            case 0xF2: return 0x0323;
+            case 0xF5: return 0x01A1;
+            case 0xFD: return 0x01B0;
+            case 0xFE: return 0x20AB;
+        }
+    }
+    return c < 0xA0 ? _cp1252High[c - 0x80] : c;
+}
+
+/**
+ * Markup which starts a new line, same as '\n' in convertUnits()
+ */
+static void breakLine(vConvertState& text) {
+    if (text.toCapsFirstLetter || text.toCapsEachWord)
+        text.shouldUpperCase = true;
+}
+
+static inline size_t outputPosition(const vMarkupConvertState& state, const string& out) {
+    return state.outputSize + out.size();
+}
+
+/**
+ * Write converted text to @out, RTF is 7-bit: '\', '{', '}' are escaped and other
+ * characters are \uN with fallback characters for the current \ucN
+ */
+static void writeConverted(vMarkupConvertState& state, string& out) {
+    if (state.format != vMarkupRtf) {
+        out += state.converted;
+        return;
+    }
+    utf8ToUtf16(state.converted, state.units);
+    const int fallbackCount = state.groups.back().unicodeSkip;
+    char escape[8];
+    int size, number;
+    for (size_t i = 0; i < state.units.size(); i++) {
+        const Uint16 c = state.units[i];
+        if (c == '\\' || c == '{' || c == '}') {
+            out += '\\';
+            out += (char)c;
+        } else if (c < 0x80) {
+            out += (char)c;
+        } else {
+            //\uN, N is signed 16-bit
+            out += "\\u";
+            number = (short)c;
+            if (number < 0) {
+                out += '-';
+                number = -number;
+            }
+            for (size = 0; number > 0 || size == 0; number /= 10)
+                escape[size++] = (char)('0' + number % 10);
+            while (size > 0)
+                out += escape[--size];
+            if (fallbackCount == 0)
+                out += ' '; //delimiter of control word
+            else
+                out.append(fallbackCount, '?');
+        }
+    }
+}
+
+/**
+ * Text is collected to convert a text run at once
+ */
+static void convertText(vMarkupConvertState& state, const char* data, const size_t& size, string& out) {
+    if (size == 0)
+        return;
+    state.textBuffer.append(data, size);
+    state.hasText = true;
+    if (state.textBuffer.size() >= MARKUP_TEXT_BUFFER_SIZE) {
+        convertChunk(state.text, state.textBuffer.data(), state.textBuffer.size(), state.converted, false);
+        state.textBuffer.clear();
+        writeConverted(state, out);
+    }
+}
+
+/**
+ * End of a text run before markup: the last unit can't be a part of a 2 units character
+ * with text after markup
+ */
+static void flushText(vMarkupConvertState& state, string& out) {
+    if (!state.hasText)
+        return;
+    convertChunk(state.text, state.textBuffer.data(), state.textBuffer.size(), state.converted, true);
+    state.textBuffer.clear();
+    writeConverted(state, out);
+    state.hasText = false;
+}
+
+/**
+ * Convert a character of an entity or escape, RTF writes a surrogate pair as 2 \uN
+ */
+static void convertCharacter(vMarkupConvertState& state, const Uint32& code, string& out) {
+    Uint32 characters[2];
+    size_t count = 0;
+    char bytes[UTF32_ENCODE_CAPACITY(2)];
+    const bool isLowSurrogate = code >= 0xDC00 && code <= 0xDFFF;
+    if (state.highSurrogate != 0) {
+        characters[count++] = isLowSurrogate ? 0x10000 + ((state.highSurrogate - 0xD800) << 10) + (code - 0xDC00) : UTF_REPLACEMENT_CHARACTER;
+        state.highSurrogate = 0;
+    } else if (isLowSurrogate) {
+        characters[count++] = UTF_REPLACEMENT_CHARACTER;
+    }
+    if (code >= 0xD800 && code <= 0xDBFF)
+        state.highSurrogate = (Uint16)code;
+    else if (!isLowSurrogate)
+        characters[count++] = code;
+    convertText(state, bytes, utf32ToUtf8(characters, count, bytes), out);
+}
+
+/*-------------------------------------
+ * HTML
+ *-------------------------------------*/
+
+/**
+ * "Name:digits" of "HTML Format" header
+ */
+static void parseHeaderLine(vMarkupConvertState& state) {
+    const string& line = state.headerLine;
+    const size_t colon = line.find(':');
+    if (colon == string::npos)
+        return;
+    int i;
+    for (i = 0; _headerFieldNames[i] != NULL; i++) {
+        if (line.compare(0, colon, _headerFieldNames[i]) == 0)
+            break;
+    }
+    size_t end = colon + 1;
+    while (end < line.size() && isAsciiDigit(line[end]))
+        end++;
+    if (_headerFieldNames[i] == NULL || end == colon + 1) //-1 if there isn't a part
+        return;
+    vMarkupHeaderField field;
+    field.position = state.headerLineStart + colon + 1;
+    field.width = end - colon - 1;
+    field.offset = (size_t)strtoull(line.c_str() + colon + 1, NULL, 10);
+    state.headerFields.push_back(field);
+}
+
+static void endTag(vMarkupConvertState& state) {
+    const bool isClosing = !state.tagName.empty() && state.tagName[0] == '/';
+    const char* name = state.tagName.c_str() + (isClosing ? 1 : 0);
+    const size_t nameSize = state.tagName.size() - (isClosing ? 1 : 0);
+    state.mode = MarkupText;
+    if (!isClosing && (strcmp(name, "script") == 0 || strcmp(name, "style") == 0)) {
+        state.rawTextEnd = name[1] == 'c' ? "</script" : "</style";
+        state.rawTextMatch = 0;
+        state.mode = MarkupRawText;
+    } else if (isInList(_htmlBreakTags, name, nameSize)) {
+        breakLine(state.text);
+    }
+}
+
+/**
+ * &#NNNN; and &#xHHHH; are text, named entities are copied
+ */
+static void endEntity(vMarkupConvertState& state, string& out) {
+    const string& token = state.token;
+    const bool isTerminated = token.back() == ';';
+    state.mode = MarkupText;
+    if (token.size() > 1 && token[1] == '#') {
+        const bool isHex = token.size() > 2 && (token[2] == 'x' || token[2] == 'X');
+        size_t i = isHex ? 3 : 2;
+        const size_t end = token.size() - (isTerminated ? 1 : 0);
+        Uint32 code = 0;
+        bool isValid = i < end;
+        for (; i < end && isValid; i++) {
+            if (isHex ? !isHexDigit(token[i]) : !isAsciiDigit(token[i])) {
+                isValid = false;
+                break;
+            }
+            code = code * (isHex ? 16 : 10) + (Uint32)(isAsciiDigit(token[i]) ? token[i] - '0' : lowerAscii(token[i]) - 'a' + 10);
+            if (code > 0x10FFFF)
+                isValid = false;
+        }
+        if (isValid) {
+            //a character which would be markup again is kept as entity
+            if ((code >= 0x20 || code == '\t' || code == '\n' || code == '\r') && code != '<' && code != '>' && code != '&' &&
+                !(code >= 0xD800 && code <= 0xDFFF)) {
+                convertCharacter(state, code, out);
+            } else {
+                flushText(state, out);
+                out += token;
+            }
+            return;
+        }
+    } else if (token.size() > 2 && isTerminated) {
+        flushText(state, out);
+        out += token;
+        return;
+    }
+    convertText(state, token.data(), token.size(), out);
+}
+
+static void convertHtml(vMarkupConvertState& state, const char* data, const size_t& size, string& out) {
+    size_t i = 0, start;
+    char c;
+    while (i < size) {
+        c = data[i];
+        switch (state.mode) {
+            case MarkupText:
+                start = i;
+                while (i < size && data[i] != '<' && data[i] != '&')
+                    i++;
+                convertText(state, data + start, i - start, out);
+                if (i < size) {
+                    state.mode = data[i] == '<' ? MarkupTagOpen : MarkupEntity;
+                    state.token.assign(1, data[i]);
+                    i++;
+                }
+                break;
+            case MarkupHeader:
+                if (state.headerLine.empty()) {
+                    if (c == '<') { //HTML without StartHTML
+                        state.mode = MarkupText;
+                        break;
+                    }
+                    state.headerLineStart = outputPosition(state, out);
+                }
+                start = i;
+                while (i < size && data[i] != '\n')
+                    i++;
+                if (i < size)
+                    i++;
+                out.append(data + start, i - start);
+                if (state.headerLine.size() < MARKUP_MAX_HEADER_LINE)
+                    state.headerLine.append(data + start, std::min(i - start, (size_t)MARKUP_MAX_HEADER_LINE));
+                if (data[i - 1] == '\n') {
+                    parseHeaderLine(state);
+                    state.headerLine.clear();
+                }
+                break;
+            case MarkupTagOpen:
+                if (isAsciiAlpha(c) || c == '/' || c == '!' || c == '?') {
+                    flushText(state, out);
+                    out += '<';
+                    state.tagName.clear();
+                    state.tagNameDone = false;
+                    state.quote = 0;
+                    state.afterEquals = false;
+                    state.mode = MarkupTag;
+                } else { //"a < b"
+                    convertText(state, "<", 1, out);
+                    state.mode = MarkupText;
+                }
+                break;
+            case MarkupTag:
+                //copy to the end of tag, '>' can be in quoted attribute values
+                start = i;
+                for (; i < size; i++) {
+                    c = data[i];
+                    if (!state.tagNameDone) {
+                        if (state.tagName.size() < MARKUP_MAX_TAG_NAME &&
+                            (isAsciiAlpha(c) || isAsciiDigit(c) || c == '-' || (state.tagName.empty() && (c == '/' || c == '!' || c == '?')))) {
+                            state.tagName += lowerAscii(c);
+                            if (state.tagName == "!--") {
+                                state.dashCount = 0;
+                                state.mode = MarkupComment;
+                                i++;
+                                break;
+                            }
+                            continue;
+                        }
+                        state.tagNameDone = true;
+                    }
+                    if (state.quote != 0) {
+                        if (c == state.quote)
+                            state.quote = 0;
+                    } else if (c == '>') {
+                        i++;
+                        endTag(state);
+                        break;
+                    } else if (c == '=') {
+                        state.afterEquals = true;
+                    } else if ((c == '"' || c == '\'') && state.afterEquals) {
+                        state.quote = c;
+                        state.afterEquals = false;
+                    } else if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+                        state.afterEquals = false;
+                    }
+                }
+                out.append(data + start, i - start);
+                break;
+            case MarkupComment:
+                start = i;
+                for (; i < size; i++) {
+                    if (data[i] == '-') {
+                        state.dashCount++;
+                    } else if (data[i] == '>' && state.dashCount >= 2) {
+                        i++;
+                        state.mode = MarkupText;
+                        break;
+                    } else {
+                        state.dashCount = 0;
+                    }
+                }
+                out.append(data + start, i - start);
+                break;
+            case MarkupRawText:
+                start = i;
+                for (; i < size; i++) {
+                    c = lowerAscii(data[i]);
+                    if (c == state.rawTextEnd[state.rawTextMatch]) {
+                        if (state.rawTextEnd[++state.rawTextMatch] == 0) {
+                            i++;
+                            break;
+                        }
+                    } else {
+                        state.rawTextMatch = c == '<' ? 1 : 0;
+                    }
+                }
+                out.append(data + start, i - start);
+                if (state.rawTextEnd[state.rawTextMatch] == 0) { //rest of the end tag
+                    state.tagName = state.rawTextEnd + 1;
+                    state.tagNameDone = false;
+                    state.quote = 0;
+                    state.afterEquals = false;
+                    state.mode = MarkupTag;
+                }
+                break;
+            case MarkupEntity:
+                if (c != ';' && state.token.size() < MARKUP_MAX_TOKEN &&
+                    (isAsciiAlpha(c) || isAsciiDigit(c) || (c == '#' && state.token.size() == 1))) {
+                    state.token += c;
+                    i++;
+                    break;
+                }
+                if (c == ';') {
+                    state.token += c;
+                    i++;
+                }
+                endEntity(state, out);
+                break;
+        }
+    }
+}
+
+/*-------------------------------------
+ * RTF
+ *-------------------------------------*/
+static inline bool isRtfSpecial(const char& c) {
+    return c == '\\' || c == '{' || c == '}' || c == '\r' || c == '\n';
+}
+
+static void controlSymbol(vMarkupConvertState& state, const char& c, string& out) {
+    vRtfGroup& group = state.groups.back();
+    if (group.skip) {
+        out += state.token;
+        return;
+    }
+    if (state.fallbackCount > 0) {
+        state.fallbackCount--;
+        return;
+    }
+    if (c == '\\' || c == '{' || c == '}') {
+        convertText(state, &c, 1, out);
+        return;
+    }
+    flushText(state, out);
+    out += state.token;
+    if (c == '*') //ignorable destination
+        group.skip = true;
+    else if (c == '\r' || c == '\n') //same as \par
+        breakLine(state.text);
+}
+
+static void controlWord(vMarkupConvertState& state, string& out) {
+    const string& token = state.token;
+    size_t nameSize = 1;
+    while (nameSize < token.size() && isAsciiAlpha(token[nameSize]))
+        nameSize++;
+    const char* name = token.c_str() + 1;
+    nameSize--;
+    const bool hasParameter = nameSize + 1 < token.size() && token[nameSize + 1] != ' ';
+    const int parameter = hasParameter ? atoi(token.c_str() + nameSize + 1) : 0;
+    vRtfGroup& group = state.groups.back();
+
+    if (nameSize == 3 && memcmp(name, "bin", 3) == 0) { //raw data
+        flushText(state, out);
+        out += token;
+        state.binaryCount = parameter > 0 ? (size_t)parameter : 0;
+        if (state.binaryCount > 0)
+            state.mode = MarkupBinary;
+        return;
+    }
+    if (group.skip) {
+        out += token;
+        return;
+    }
+    if (state.fallbackCount > 0) {
+        state.fallbackCount--;
+        return;
+    }
+    if (nameSize == 1 && name[0] == 'u' && hasParameter) {
+        convertCharacter(state, (Uint16)parameter, out);
+        state.fallbackCount = group.unicodeSkip;
+        return;
+    }
+    flushText(state, out);
+    out += token;
+    if (nameSize == 2 && memcmp(name, "uc", 2) == 0)
+        group.unicodeSkip = std::min(std::max(parameter, 0), MARKUP_MAX_UNICODE_SKIP);
+    else if (nameSize == 7 && memcmp(name, "ansicpg", 7) == 0)
+        state.codePage = parameter;
+    else if (isInList(_rtfBreakWords, name, nameSize))
+        breakLine(state.text);
+    else if (isInList(_rtfDestinations, name, nameSize))
+        group.skip = true;
+}
+
+static void hexEscape(vMarkupConvertState& state, string& out) {
+    const string& token = state.token;
+    if (state.groups.back().skip || token.size() < 4) {
+        flushText(state, out);
+        out += token;
+        return;
+    }
+    if (state.fallbackCount > 0) {
+        state.fallbackCount--;
+        return;
+    }
+    convertCharacter(state, codePageCharacter(state.codePage, (Byte)strtol(token.c_str() + 2, NULL, 16)), out);
+}
+
+static void convertRtf(vMarkupConvertState& state, const char* data, const size_t& size, string& out) {
+    size_t i = 0, start, count;
+    char c;
+    while (i < size) {
+        c = data[i];
+        switch (state.mode) {
+            case MarkupText:
+                if (c == '\\') {
+                    state.token.assign(1, c);
+                    state.mode = MarkupControl;
+                    i++;
+                } else if (c == '{' || c == '}') {
+                    flushText(state, out);
+                    state.fallbackCount = 0;
+                    if (c == '{') {
+                        const vRtfGroup parent = state.groups.back();
+                        state.groups.push_back(parent);
+                    } else if (state.groups.size() > 1) {
+                        state.groups.pop_back();
+                    }
+                    out += c;
+                    i++;
+                } else if (c == '\r' || c == '\n') { //readers ignore it
+                    flushText(state, out);
+                    out += c;
+                    i++;
+                } else if (state.groups.back().skip) {
+                    start = i;
+                    while (i < size && !isRtfSpecial(data[i]))
+                        i++;
+                    out.append(data + start, i - start);
+                } else if (state.fallbackCount > 0) {
+                    state.fallbackCount--;
+                    i++;
+                } else if ((Byte)c >= 0x80) { //8-bit text in code page
+                    convertCharacter(state, codePageCharacter(state.codePage, (Byte)c), out);
+                    i++;
+                } else {
+                    start = i;
+                    while (i < size && (Byte)data[i] < 0x80 && !isRtfSpecial(data[i]))
+                        i++;
+                    convertText(state, data + start, i - start, out);
+                }
+                break;
+            case MarkupControl:
+                if (state.token.size() == 1) {
+                    state.token += c;
+                    i++;
+                    if (isAsciiAlpha(c))
+                        break;
+                    if (c == '\'') {
+                        state.mode = MarkupHex;
+                        break;
+                    }
+                    state.mode = MarkupText;
+                    controlSymbol(state, c, out);
+                    break;
+                }
+                if (state.token.size() < MARKUP_MAX_TOKEN &&
+                    ((isAsciiAlpha(c) && isAsciiAlpha(state.token.back())) || (c == '-' && isAsciiAlpha(state.token.back())) || isAsciiDigit(c))) {
+                    state.token += c;
+                    i++;
+                    break;
+                }
+                if (c == ' ') { //delimiter is a part of control word
+                    state.token += c;
+                    i++;
+                }
+                state.mode = MarkupText;
+                controlWord(state, out);
+                break;
+            case MarkupHex:
+                if (state.token.size() < 4 && isHexDigit(c)) {
+                    state.token += c;
+                    i++;
+                    if (state.token.size() < 4)
+                        break;
+                }
+                state.mode = MarkupText;
+                hexEscape(state, out);
+                break;
+            case MarkupBinary:
+                count = std::min(state.binaryCount, size - i);
+                out.append(data + i, count);
+                i += count;
+                state.binaryCount -= count;
+                if (state.binaryCount == 0)
+                    state.mode = MarkupText;
+                break;
+        }
+    }
+}
+
+/**
+ * Incomplete token at the end of document
+ */
+static void finishToken(vMarkupConvertState& state, string& out) {
+    switch (state.mode) {
+        case MarkupTagOpen:
+            convertText(state, "<", 1, out);
+            break;
+        case MarkupEntity:
+            endEntity(state, out);
+            break;
+        case MarkupControl:
+            if (state.token.size() == 1) {
+                flushText(state, out);
+                out += state.token;
+            } else {
+                controlWord(state, out);
+            }
+            break;
+        case MarkupHex:
+            hexEscape(state, out);
+            break;
+    }
+    state.mode = MarkupText;
+}
+
+/**
+ * Offset of "HTML Format" header which isn't found yet, SIZE_MAX if there isn't any
+ */
+static size_t nextHeaderOffset(const vMarkupConvertState& state) {
+    size_t offset = (size_t)-1;
+    for (size_t i = 0; i < state.headerFields.size(); i++) {
+        const vMarkupHeaderField& field = state.headerFields[i];
+        if (!field.found && field.offset >= state.inputSize)
+            offset = std::min(offset, field.offset);
+    }
+    return offset;
+}
+
+static void findHeaderOffset(vMarkupConvertState& state, string& out) {
+    //text is converted to here, the header ends at StartHTML
+    if (state.mode == MarkupText)
+        flushText(state, out);
+    else if (state.mode == MarkupHeader && state.headerLine.empty())
+        state.mode = MarkupText;
+    for (size_t i = 0; i < state.headerFields.size(); i++) {
+        vMarkupHeaderField& field = state.headerFields[i];
+        if (!field.found && field.offset == state.inputSize) {
+            field.newOffset = outputPosition(state, out);
+            field.found = true;
+        }
+    }
+}
+
+void beginMarkupConvert(vMarkupConvertState& state, const Uint8& format) {
+    state.format = format;
+    beginConvert(state.text);
+    state.hasText = false;
+    state.textBuffer.clear();
+    state.mode = format == vMarkupClipboardHtml ? MarkupHeader : MarkupText;
+    state.token.clear();
+    state.inputSize = 0;
+    state.outputSize = 0;
+    state.tagName.clear();
+    state.quote = 0;
+    state.rawTextEnd = NULL;
+    state.headerLine.clear();
+    state.headerFields.clear();
+    state.groups.assign(1, vRtfGroup());
+    state.fallbackCount = 0;
+    state.highSurrogate = 0;
+    state.binaryCount = 0;
+    state.codePage = 1252;
+}
+
+void convertMarkupChunk(vMarkupConvertState& state, const char* data, const size_t& size, string& out, const bool& last) {
+    out.clear();
+    size_t i = 0, end, offset;
+    while (i < size) {
+        //stop at each offset of header to find it in output
+        end = size;
+        offset = nextHeaderOffset(state);
+        if (offset == state.inputSize) {
+            findHeaderOffset(state, out);
+            continue;
+        }
+        if (offset - state.inputSize < size - i)
+            end = i + (offset - state.inputSize);
+        if (state.mode == MarkupHeader) { //a line can add an offset
+            const char* lineEnd = (const char*)memchr(data + i, '\n', end - i);
+            if (lineEnd != NULL)
+                end = lineEnd - data + 1;
+        }
+        if (state.format == vMarkupRtf)
+            convertRtf(state, data + i, end - i, out);
+        else
+            convertHtml(state, data + i, end - i, out);
+        state.inputSize += end - i;
+        i = end;
+    }
+    if (last) {
+        finishToken(state, out);
+        flushText(state, out);
+        if (nextHeaderOffset(state) == state.inputSize) //EndHTML
+            findHeaderOffset(state, out);
+    }
+    state.outputSize += out.size();
+}
+
+bool updateMarkupHeader(const vMarkupConvertState& state, char* data, const size_t& size) {
+    char digits[32];
+    bool result = true;
+    for (size_t i = 0; i < state.headerFields.size(); i++) {
+        const vMarkupHeaderField& field = state.headerFields[i];
+        if (!field.found || field.position + field.width > size)
+            continue;
+        if (snprintf(digits, sizeof(digits), "%0*zu", (int)field.width, field.newOffset) != (int)field.width) {
+            result = false;
+            continue;
+        }
+        memcpy(data + field.position, digits, field.width);
+    }
+    return result;
+}
+
+string convertMarkupUtil(const string& sourceString, const Uint8& format) {
+    vMarkupConvertState state;
+    string result;
+    beginMarkupConvert(state, format);
+    convertMarkupChunk(state, sourceString.data(), sourceString.size(), result, true);
+    if (format == vMarkupClipboardHtml && !result.empty())
+        updateMarkupHeader(state, &result[0], result.size());
+    return result;
+}
@@ -0,0 +1,99 @@
+//
+//  MarkupConvert.h
+//  OpenKey
+//
+//  Streaming conversion of HTML and RTF documents (clipboard rich text): only text runs
+//  go through the convert tool, tags, attributes, control words and destinations are
+//  copied unchanged.
+//
+
+#ifndef MarkupConvert_h
+#define MarkupConvert_h
+
+#include <string>
+#include <vector>
+#include "DataType.h"
+#include "ConvertTool.h"
+
+using namespace std;
+
+enum vMarkupFormat {
+    vMarkupHtml = 0,        //UTF-8 HTML document or fragment
+    vMarkupClipboardHtml,   //"HTML Format" of Windows clipboard: a header with byte offsets, then HTML
+    vMarkupRtf              //Rich Text Format, 7-bit with \uN and \'hh escapes
+};
+
+/**
+ * A byte offset in the header of "HTML Format" (StartHTML, EndFragment...), it's updated
+ * after conversion because text can change its size
+ */
+struct vMarkupHeaderField {
+    size_t position = 0; //position of the digits in output
+    size_t width = 0;
+    size_t offset = 0; //value in input
+    size_t newOffset = 0; //value in output
+    bool found = false; //newOffset is valid
+};
+
+struct vRtfGroup {
+    int unicodeSkip = 1; //\ucN: characters after \uN for readers without Unicode
+    bool skip = false; //destination which isn't text (font table, picture, field instruction...)
+};
+
+/**
+ * State of a streaming markup conversion. Tokens can be split anywhere between chunks,
+ * memory only depends on chunk size (and RTF group depth)
+ */
+struct vMarkupConvertState {
+    Uint8 format = vMarkupHtml;
+    vConvertState text; //text runs are one document for caps options
+    bool hasText = false; //text was converted after the last markup
+    int mode = 0;
+    string token; //incomplete tag name, entity or control word
+    string textBuffer; //text run which isn't converted yet
+    string converted; //buffers
+    vector<Uint16> units;
+    size_t inputSize = 0; //bytes before this chunk
+    size_t outputSize = 0;
+
+    //HTML
+    string tagName;
+    bool tagNameDone = false;
+    char quote = 0;
+    bool afterEquals = false;
+    int dashCount = 0; //end of comment
+    const char* rawTextEnd = NULL; //end tag of script/style
+    size_t rawTextMatch = 0;
+    string headerLine;
+    size_t headerLineStart = 0;
+    vector<vMarkupHeaderField> headerFields;
+
+    //RTF
+    vector<vRtfGroup> groups;
+    int fallbackCount = 0; //characters to drop after \uN
+    Uint16 highSurrogate = 0;
+    size_t binaryCount = 0; //raw bytes of \binN
+    int codePage = 1252; //\ansicpgN, for \'hh
+};
+
+/**
+ * Start converting a document in @format with current convertTool options
+ */
+void beginMarkupConvert(vMarkupConvertState& state, const Uint8& format);
+
+/**
+ * Convert a chunk of @data, @out is the output of this chunk, @last must be true for the
+ * last chunk. HTML numeric entities (&#NNNN; &#xHHHH;) are converted as text and written
+ * as UTF-8; in RTF, \uN and \'hh are text and all converted non-ASCII characters are \uN
+ */
+void convertMarkupChunk(vMarkupConvertState& state, const char* data, const size_t& size, string& out, const bool& last);
+
+/**
+ * Write the new offsets of "HTML Format" to the first @size bytes of output (the header
+ * is at the beginning). Return false if a new offset doesn't fit in its digits
+ */
+bool updateMarkupHeader(const vMarkupConvertState& state, char* data, const size_t& size);
+
+string convertMarkupUtil(const string& sourceString, const Uint8& format);
+
+#endif /* MarkupConvert_h */
@@ -0,0 +1,343 @@
+//
+//  Orthography.cpp
+//  OpenKey
+//
+//  Normalize tone mark placement of Unicode text. Each word is loaded to TypingWord
+//  (key, tone, mark, caps) and its mark is placed again by vPlaceWordMark().
+//
+
+#include "Orthography.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#define ORTHOGRAPHY_PART_MIN_SIZE 262144 //bytes of the smallest part of a parallel normalization
+
+struct vOrthographyPart {
+    size_t start = 0;
+    size_t size = 0;
+    string output;
+};
+
+/**
+ * TypingWord cell of each ASCII letter, 0 if it isn't a letter
+ */
+struct vAsciiCellTable {
+    Uint32 cell[128];
+    vAsciiCellTable() {
+        for (int c = 0; c < 128; c++) {
+            map<Uint32, Uint32>::const_iterator it = _characterMap.find(c);
+            cell[c] = ((c | 0x20) >= 'a' && (c | 0x20) <= 'z' && it != _characterMap.end()) ? it->second : 0;
+        }
+    }
+};
+
+static inline int getCompoundMarkIndex(const Uint32& character) {
+    for (int i = 0; i < 5; i++) {
+        if (character == _unicodeCompoundMark[i])
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * Character at @data[@i], @length is its size, 0 if it's cut at the end of @data.
+ * An invalid sequence is one byte of U+FFFD
+ */
+static inline Uint32 decodeCharacter(const char* data, const size_t& size, const size_t& i, int& length) {
+    const Byte lead = (Byte)data[i];
+    Uint32 character;
+    int need, k;
+    if (lead < 0x80) {
+        length = 1;
+        return lead;
+    } else if (lead >= 0xC2 && lead <= 0xDF) {
+        need = 2;
+        character = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        need = 3;
+        character = lead & 0x0F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        need = 4;
+        character = lead & 0x07;
+    } else {
+        length = 1;
+        return UTF_REPLACEMENT_CHARACTER;
+    }
+    for (k = 1; k < need; k++) {
+        if (i + k >= size) {
+            length = 0;
+            return 0;
+        }
+        if (((Byte)data[i + k] & 0xC0) != 0x80) {
+            length = 1;
+            return UTF_REPLACEMENT_CHARACTER;
+        }
+        character = (character << 6) | ((Byte)data[i + k] & 0x3F);
+    }
+    if ((need == 3 && character < 0x800) || (need == 4 && character < 0x10000)) { //overlong
+        length = 1;
+        return UTF_REPLACEMENT_CHARACTER;
+    }
+    length = need;
+    return character;
+}
+
+static inline void appendCharacter(string& out, const Uint16& character) {
+    if (character < 0x80) {
+        out += (char)character;
+    } else if (character < 0x800) {
+        out += (char)(0xC0 | (character >> 6));
+        out += (char)(0x80 | (character & 0x3F));
+    } else {
+        out += (char)(0xE0 | (character >> 12));
+        out += (char)(0x80 | ((character >> 6) & 0x3F));
+        out += (char)(0x80 | (character & 0x3F));
+    }
+}
+
+/**
+ * Precomposed character of @cell
+ */
+static inline Uint16 getCellCharacter(const Uint32& cell) {
+    const Uint32 code = getCharacterCode(cell, 0);
+    if (code & CHAR_CODE_MASK)
+        return (Uint16)code;
+    return keyCodeToCharacter(cell & (CHAR_MASK | CAPS_MASK)); //vowel without tone and mark
+}
+
+/**
+ * Write @word to @out if its mark must be moved, return false if it doesn't change
+ */
+static bool normalizeWord(vOrthographyState& state, const char* word, const size_t& size, string& out) {
+    static const vAsciiCellTable asciiCell;
+    vEngineContext& ctx = state.ctx;
+    Uint32 cells[MAX_BUFF], character;
+    size_t start[MAX_BUFF], baseEnd[MAX_BUFF], i; //bytes of each cell, baseEnd: before its compound mark
+    int count = 0, length, row, column, mark, oldIndex = -1, newIndex = -1;
+    bool compound = false;
+    for (i = 0; i < size; i += length) {
+        character = decodeCharacter(word, size, i, length);
+        if (character < 0x80) {
+            cells[count] = asciiCell.cell[character];
+        } else if ((mark = getCompoundMarkIndex(character)) >= 0) {
+            if (count == 0 || (cells[count - 1] & MARK_MASK))
+                return false;
+            cells[count - 1] |= MARK1_MASK << mark;
+            baseEnd[count - 1] = i;
+            compound = true;
+            continue;
+        } else if (character <= 0xFFFF && findCodeTableCharacter((Uint16)character, 0, row, column)) {
+            cells[count] = _codeTableKey[row] | ((column & 1) ? 0 : CAPS_MASK);
+            if (_codeTableRowSize[row] == 2 || (_codeTableRowSize[row] == 14 && column < 4))
+                cells[count] |= column < 2 ? TONE_MASK : TONEW_MASK; //â, ă, đ...
+            else
+                cells[count] |= MARK1_MASK << ((_codeTableRowSize[row] == 14 ? column - 4 : column) / 2);
+        } else {
+            return false;
+        }
+        if (count == MAX_BUFF - 1)
+            return false;
+        start[count] = i;
+        baseEnd[count] = i + length;
+        count++;
+    }
+
+    //mark of the word, and where the engine puts it
+    ctx._wordHead = 0;
+    ctx._index = (Byte)count;
+    for (i = 0; i < (size_t)count; i++) {
+        ctx.TypingWord[i] = cells[i];
+        if (cells[i] & MARK_MASK)
+            oldIndex = (int)i;
+    }
+    if (oldIndex < 0 || !vPlaceWordMark(ctx))
+        return false;
+    for (i = 0; i < (size_t)count; i++) {
+        if (ctx.TypingWord[i] & MARK_MASK)
+            newIndex = (int)i;
+    }
+    if (newIndex == oldIndex || !(getCharacterCode(ctx.TypingWord[newIndex], 0) & CHAR_CODE_MASK))
+        return false;
+
+    //copy other cells, a compound mark moves with its mark
+    const Uint32 markMask = cells[oldIndex] & MARK_MASK;
+    for (i = 0; i < (size_t)count; i++) {
+        const size_t end = i + 1 < (size_t)count ? start[i + 1] : size;
+        if ((int)i == oldIndex) {
+            if (compound)
+                out.append(word + start[i], baseEnd[i] - start[i]);
+            else
+                appendCharacter(out, getCellCharacter(cells[i] & ~MARK_MASK));
+        } else if ((int)i == newIndex) {
+            if (compound) {
+                out.append(word + start[i], end - start[i]);
+                appendCharacter(out, _unicodeCompoundMark[markMask == MARK1_MASK ? 0 : markMask == MARK2_MASK ? 1 :
+                                                          markMask == MARK3_MASK ? 2 : markMask == MARK4_MASK ? 3 : 4]);
+            } else {
+                appendCharacter(out, getCellCharacter(cells[i] | markMask));
+            }
+        } else {
+            out.append(word + start[i], end - start[i]);
+        }
+    }
+    return true;
+}
+
+static inline bool isWordCharacter(const Uint32& character) {
+    int row, column;
+    if (character < 0x80)
+        return (character | 0x20) >= 'a' && (character | 0x20) <= 'z';
+    return character <= 0xFFFF && (getCompoundMarkIndex(character) >= 0 || findCodeTableCharacter((Uint16)character, 0, row, column));
+}
+
+/**
+ * Normalize @data, return the bytes which are done; the rest (an unfinished word or
+ * UTF-8 sequence) must be given again with the next chunk
+ */
+static size_t normalizeBuffer(vOrthographyState& state, const char* data, const size_t& size, string& out, const bool& last) {
+    size_t i = 0, wordStart = 0, copied = 0, done;
+    bool inWord = false, hasNonAscii = false;
+    int cellCount = 0, length;
+    Uint32 character;
+    
+    //words which are changed are written to out, other data is copied in blocks
+    auto endWord = [&](const size_t& end) {
+        if (inWord && hasNonAscii) {
+            const size_t outSize = out.size();
+            out.append(data + copied, wordStart - copied);
+            if (normalizeWord(state, data + wordStart, end - wordStart, out)) {
+                copied = end;
+                state.changedWordCount++;
+            } else {
+                out.resize(outSize);
+            }
+        }
+        inWord = false;
+        state.longWord = false;
+    };
+    
+    while (i < size) {
+        character = (Byte)data[i];
+        length = 1;
+        if (character >= 0x80) {
+            character = decodeCharacter(data, size, i, length);
+            if (length == 0) //next chunk
+                break;
+        }
+        if (!isWordCharacter(character)) {
+            endWord(i);
+        } else if (!state.longWord) {
+            if (!inWord) {
+                inWord = true;
+                hasNonAscii = false;
+                wordStart = i;
+                cellCount = 0;
+            }
+            if (character >= 0x80)
+                hasNonAscii = true;
+            if (getCompoundMarkIndex(character) < 0 && ++cellCount >= MAX_BUFF) {
+                //too long for a Vietnamese word, copy it
+                inWord = false;
+                state.longWord = true;
+            }
+        }
+        i += length;
+    }
+    if (last) {
+        endWord(i);
+        done = size; //cut UTF-8 sequence at the end is copied
+    } else {
+        done = inWord ? wordStart : i;
+    }
+    out.append(data + copied, done - copied);
+    return done;
+}
+
+void beginNormalizeOrthography(vOrthographyState& state, const bool& modern) {
+    state.modern = modern;
+    state.longWord = false;
+    state.pending.clear();
+    state.changedWordCount = 0;
+    state.ctx.config = vEngineConfig(); //spelling without quick consonants or z, f, w, j
+    state.ctx.config.useModernOrthography = modern ? 1 : 0;
+    state.ctx.config.historyDepth = 1;
+    vKeyInit(state.ctx);
+}
+
+void normalizeOrthographyChunk(vOrthographyState& state, const char* data, const size_t& size, string& out, const bool& last) {
+    out.clear();
+    const char* input = data;
+    size_t inputSize = size;
+    if (!state.pending.empty()) {
+        state.buffer.assign(state.pending);
+        state.buffer.append(data, size);
+        input = state.buffer.data();
+        inputSize = state.buffer.size();
+    }
+    const size_t done = normalizeBuffer(state, input, inputSize, out, last);
+    state.pending.assign(input + done, inputSize - done);
+}
+
+void normalizeOrthographyChunkParallel(vOrthographyState& state, const char* data, const size_t& size, string& out, const bool& last, int threadCount) {
+    if (threadCount <= 0)
+        threadCount = (int)std::thread::hardware_concurrency();
+    if (threadCount <= 1 || size < ORTHOGRAPHY_PART_MIN_SIZE * 2) {
+        normalizeOrthographyChunk(state, data, size, out, last);
+        return;
+    }
+    
+    //split after a space or new line: words don't continue to the next part
+    size_t partSize = max((size_t)ORTHOGRAPHY_PART_MIN_SIZE, size / (threadCount * 4));
+    vector<vOrthographyPart> parts;
+    size_t start = 0, end;
+    while (start < size) {
+        for (end = min(start + partSize, size); end < size && data[end - 1] != ' ' && data[end - 1] != '\n'; end++);
+        parts.push_back(vOrthographyPart());
+        parts.back().start = start;
+        parts.back().size = end - start;
+        start = end;
+    }
+    
+    //the first part continues the stream, the last part keeps pending data for the next chunk
+    vector<vOrthographyState> states(parts.size());
+    size_t i;
+    for (i = 0; i < parts.size(); i++)
+        beginNormalizeOrthography(states[i], state.modern);
+    states[0].pending.swap(state.pending);
+    states[0].longWord = state.longWord;
+    
+    std::atomic<size_t> nextPart(0);
+    auto worker = [&]() {
+        size_t part;
+        while ((part = nextPart.fetch_add(1)) < parts.size())
+            normalizeOrthographyChunk(states[part], data + parts[part].start, parts[part].size, parts[part].output,
+                                      part == parts.size() - 1 ? last : false);
+    };
+    vector<std::thread> threads;
+    for (int k = 1; k < threadCount && k < (int)parts.size(); k++)
+        threads.push_back(std::thread(worker));
+    worker();
+    for (i = 0; i < threads.size(); i++)
+        threads[i].join();
+    
+    size_t outputSize = 0;
+    for (i = 0; i < parts.size(); i++)
+        outputSize += parts[i].output.size();
+    out.clear();
+    out.reserve(outputSize);
+    for (i = 0; i < parts.size(); i++) {
+        out += parts[i].output;
+        state.changedWordCount += states[i].changedWordCount;
+    }
+    state.pending.swap(states.back().pending);
+    state.longWord = states.back().longWord;
+}
+
+string normalizeOrthographyUtil(const string& sourceString, const bool& modern, const int& threadCount) {
+    vOrthographyState state;
+    string result;
+    beginNormalizeOrthography(state, modern);
+    normalizeOrthographyChunkParallel(state, sourceString.data(), sourceString.size(), result, true, threadCount);
+    return result;
+}
@@ -0,0 +1,50 @@
+//
+//  Orthography.h
+//  OpenKey
+//
+//  Normalize tone mark placement of Unicode text (precomposed and compound) to the old
+//  (òa, úy) or modern (oà, uý) style, with the same rules as typing (vUseModernOrthography).
+//
+
+#ifndef Orthography_h
+#define Orthography_h
+
+#include <string>
+#include "Engine.h"
+
+using namespace std;
+
+/**
+ * State of a streaming normalization. Words can be split anywhere between chunks,
+ * memory only depends on chunk size
+ */
+struct vOrthographyState {
+    bool modern = true;
+    bool longWord = false; //the current word is longer than MAX_BUFF, it's copied unchanged
+    string pending; //unfinished word or UTF-8 sequence at the end of last chunk
+    string buffer;
+    size_t changedWordCount = 0;
+    vEngineContext ctx; //only TypingWord and spelling state are used
+};
+
+/**
+ * Start normalizing a document to @modern (1: oà, uý) or old (0: òa, úy) style
+ */
+void beginNormalizeOrthography(vOrthographyState& state, const bool& modern);
+
+/**
+ * Normalize a chunk of UTF-8 @data, @out is the output of this chunk, @last must be true
+ * for the last chunk. Only words with one mark and right spelling are changed, a word keeps
+ * its form (precomposed or compound); other characters are copied unchanged
+ */
+void normalizeOrthographyChunk(vOrthographyState& state, const char* data, const size_t& size, string& out, const bool& last);
+
+/**
+ * Same result as normalizeOrthographyChunk(), the chunk is split after spaces and new lines
+ * and normalized by @threadCount threads, 0: all cores
+ */
+void normalizeOrthographyChunkParallel(vOrthographyState& state, const char* data, const size_t& size, string& out, const bool& last, int threadCount=0);
+
+string normalizeOrthographyUtil(const string& sourceString, const bool& modern, const int& threadCount=1);
+
+#endif /* Orthography_h */
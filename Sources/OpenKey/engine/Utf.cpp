@@ -0,0 +1,403 @@
+//
+//  Utf.cpp
+//  OpenKey
+//
+//  UTF-8 <-> UTF-16/UTF-32 transcoder with explicit width.
+//
+
+#include "Utf.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define UTF_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define UTF_NEON
+#include <arm_neon.h>
+#endif
+
+#define ASCII_MASK_64 0x8080808080808080ULL
+
+/*-------------------------------------
+ * ASCII runs: copy the leading ASCII characters, return how many were copied.
+ * Each block is checked before it's written, so a run stops at the first byte/unit >= 0x80
+ *-------------------------------------*/
+static size_t asciiToUnit16(const Byte* src, const size_t& size, Uint16* out) {
+    size_t i = 0;
+#if defined(UTF_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        if (_mm_movemask_epi8(v) != 0)
+            break;
+        _mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i*)(out + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+#elif defined(UTF_NEON)
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        if (vmaxvq_u8(v) >= 0x80)
+            break;
+        vst1q_u16(out + i, vmovl_u8(vget_low_u8(v)));
+        vst1q_u16(out + i + 8, vmovl_u8(vget_high_u8(v)));
+    }
+#else
+    Uint64 block;
+    for (; i + 8 <= size; i += 8) {
+        memcpy(&block, src + i, 8);
+        if (block & ASCII_MASK_64)
+            break;
+        for (int j = 0; j < 8; j++)
+            out[i + j] = src[i + j];
+    }
+#endif
+    for (; i < size && src[i] < 0x80; i++)
+        out[i] = src[i];
+    return i;
+}
+
+static size_t asciiToUnit32(const Byte* src, const size_t& size, Uint32* out) {
+    size_t i = 0;
+#if defined(UTF_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        if (_mm_movemask_epi8(v) != 0)
+            break;
+        __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128((__m128i*)(out + i + 4), _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128((__m128i*)(out + i + 8), _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128((__m128i*)(out + i + 12), _mm_unpackhi_epi16(hi, zero));
+    }
+#elif defined(UTF_NEON)
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        if (vmaxvq_u8(v) >= 0x80)
+            break;
+        uint16x8_t lo = vmovl_u8(vget_low_u8(v)), hi = vmovl_u8(vget_high_u8(v));
+        vst1q_u32(out + i, vmovl_u16(vget_low_u16(lo)));
+        vst1q_u32(out + i + 4, vmovl_u16(vget_high_u16(lo)));
+        vst1q_u32(out + i + 8, vmovl_u16(vget_low_u16(hi)));
+        vst1q_u32(out + i + 12, vmovl_u16(vget_high_u16(hi)));
+    }
+#else
+    Uint64 block;
+    for (; i + 8 <= size; i += 8) {
+        memcpy(&block, src + i, 8);
+        if (block & ASCII_MASK_64)
+            break;
+        for (int j = 0; j < 8; j++)
+            out[i + j] = src[i + j];
+    }
+#endif
+    for (; i < size && src[i] < 0x80; i++)
+        out[i] = src[i];
+    return i;
+}
+
+static size_t unit16ToAscii(const Uint16* src, const size_t& size, char* out) {
+    size_t i = 0;
+#if defined(UTF_SSE2)
+    const __m128i mask = _mm_set1_epi16((short)0xFF80);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 8));
+        __m128i high = _mm_and_si128(_mm_or_si128(a, b), mask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xFFFF)
+            break;
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(a, b));
+    }
+#elif defined(UTF_NEON)
+    for (; i + 16 <= size; i += 16) {
+        uint16x8_t a = vld1q_u16(src + i), b = vld1q_u16(src + i + 8);
+        if (vmaxvq_u16(vorrq_u16(a, b)) >= 0x80)
+            break;
+        vst1q_u8((uint8_t*)(out + i), vcombine_u8(vmovn_u16(a), vmovn_u16(b)));
+    }
+#endif
+    for (; i < size && src[i] < 0x80; i++)
+        out[i] = (char)src[i];
+    return i;
+}
+
+/*-------------------------------------
+ * UTF-8 decoding
+ *-------------------------------------*/
+
+/**
+ * Decode one sequence at @src, invalid sequences are replaced by U+FFFD (maximal subpart, like WHATWG).
+ * Return the number of bytes used, 0 if @src ends inside a valid sequence
+ */
+static inline size_t decodeUtf8Char(const Byte* src, const size_t& size, Uint32& code) {
+    Byte c = src[0];
+    int need;
+    Byte low = 0x80, high = 0xBF;
+    if (c < 0x80) {
+        code = c;
+        return 1;
+    } else if (c >= 0xC2 && c <= 0xDF) {
+        need = 1;
+        code = c & 0x1F;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        need = 2;
+        code = c & 0x0F;
+        if (c == 0xE0) low = 0xA0; //overlong
+        else if (c == 0xED) high = 0x9F; //surrogate
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        need = 3;
+        code = c & 0x07;
+        if (c == 0xF0) low = 0x90; //overlong
+        else if (c == 0xF4) high = 0x8F; //> U+10FFFF
+    } else {
+        code = UTF_REPLACEMENT_CHARACTER;
+        return 1;
+    }
+    for (int i = 1; i <= need; i++) {
+        if (i >= size)
+            return 0;
+        if (src[i] < low || src[i] > high) {
+            code = UTF_REPLACEMENT_CHARACTER;
+            return i;
+        }
+        low = 0x80;
+        high = 0xBF;
+        code = (code << 6) | (src[i] & 0x3F);
+    }
+    return need + 1;
+}
+
+template<class T>
+static inline size_t putUnit16(T* out, const Uint32& code) {
+    if (code < 0x10000) {
+        out[0] = (T)code;
+        return 1;
+    }
+    out[0] = (T)(0xD800 + ((code - 0x10000) >> 10));
+    out[1] = (T)(0xDC00 + ((code - 0x10000) & 0x3FF));
+    return 2;
+}
+
+template<class T>
+static inline size_t putUnit32(T* out, const Uint32& code) {
+    out[0] = (T)code;
+    return 1;
+}
+
+static inline size_t asciiRun(const Byte* src, const size_t& size, Uint16* out) {
+    return asciiToUnit16(src, size, out);
+}
+
+static inline size_t asciiRun(const Byte* src, const size_t& size, Uint32* out) {
+    return asciiToUnit32(src, size, out);
+}
+
+/**
+ * @T: unit type of @out, @utf16: write UTF-16 units or code points
+ */
+template<class T, bool utf16>
+static size_t decodeUtf8(vUtf8Decoder* decoder, const Byte* src, const size_t& size, T* out, const bool& last) {
+    size_t i = 0, outSize = 0, used;
+    Uint32 code;
+
+    //finish the sequence of last chunk
+    if (decoder != NULL && decoder->pendingSize > 0) {
+        Byte temp[4];
+        size_t pendingSize = decoder->pendingSize;
+        size_t tempSize = pendingSize;
+        memcpy(temp, decoder->pending, pendingSize);
+        while (tempSize < 4 && i < size)
+            temp[tempSize++] = src[i++];
+        used = decodeUtf8Char(temp, tempSize, code);
+        if (used == 0) { //still incomplete, so all bytes of this chunk are in temp
+            if (last) {
+                decoder->pendingSize = 0;
+                outSize += utf16 ? putUnit16(out, UTF_REPLACEMENT_CHARACTER) : putUnit32(out, UTF_REPLACEMENT_CHARACTER);
+            } else {
+                memcpy(decoder->pending, temp, tempSize);
+                decoder->pendingSize = (Byte)tempSize;
+            }
+            return outSize;
+        }
+        decoder->pendingSize = 0;
+        outSize += utf16 ? putUnit16(out, code) : putUnit32(out, code);
+        i = used - pendingSize; //pending bytes are a valid prefix, so used >= pendingSize
+    }
+
+    while (i < size) {
+        if (src[i] < 0x80) {
+            if (sizeof(T) == sizeof(Uint16)) {
+                used = asciiRun(src + i, size - i, (Uint16*)(out + outSize));
+            } else if (sizeof(T) == sizeof(Uint32)) {
+                used = asciiRun(src + i, size - i, (Uint32*)(out + outSize));
+            } else {
+                for (used = 0; i + used < size && src[i + used] < 0x80; used++)
+                    out[outSize + used] = src[i + used];
+            }
+            i += used;
+            outSize += used;
+            continue;
+        }
+        used = decodeUtf8Char(src + i, size - i, code);
+        if (used == 0) { //incomplete sequence at the end
+            if (decoder != NULL && !last) {
+                decoder->pendingSize = (Byte)(size - i);
+                memcpy(decoder->pending, src + i, size - i);
+            } else {
+                outSize += utf16 ? putUnit16(out + outSize, UTF_REPLACEMENT_CHARACTER) : putUnit32(out + outSize, UTF_REPLACEMENT_CHARACTER);
+            }
+            break;
+        }
+        outSize += utf16 ? putUnit16(out + outSize, code) : putUnit32(out + outSize, code);
+        i += used;
+    }
+    return outSize;
+}
+
+/*-------------------------------------
+ * UTF-8 encoding
+ *-------------------------------------*/
+static inline size_t putUtf8(char* out, const Uint32& code) {
+    if (code < 0x80) {
+        out[0] = (char)code;
+        return 1;
+    } else if (code < 0x800) {
+        out[0] = (char)(0xC0 | (code >> 6));
+        out[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    } else if (code < 0x10000) {
+        out[0] = (char)(0xE0 | (code >> 12));
+        out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (code & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (code >> 18));
+    out[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (code & 0x3F));
+    return 4;
+}
+
+#define IS_HIGH_SURROGATE(c) ((c) >= 0xD800 && (c) <= 0xDBFF)
+#define IS_LOW_SURROGATE(c) ((c) >= 0xDC00 && (c) <= 0xDFFF)
+
+/**
+ * @T: unit type of UTF-16 data, lone surrogates are replaced by U+FFFD
+ */
+template<class T>
+static size_t encodeUtf16(vUtf16Encoder* encoder, const T* src, const size_t& size, char* out, const bool& last) {
+    size_t i = 0, outSize = 0, used;
+    Uint32 c;
+    if (encoder != NULL && encoder->highSurrogate != 0) {
+        if (size > 0 && IS_LOW_SURROGATE((Uint32)src[0])) {
+            outSize += putUtf8(out, 0x10000 + ((encoder->highSurrogate - 0xD800) << 10) + ((Uint32)src[0] - 0xDC00));
+            i = 1;
+        } else if (size > 0 || last) {
+            outSize += putUtf8(out, UTF_REPLACEMENT_CHARACTER);
+        } else {
+            return 0;
+        }
+        encoder->highSurrogate = 0;
+    }
+    while (i < size) {
+        c = (Uint32)src[i];
+        if (c < 0x80) {
+            if (sizeof(T) == sizeof(Uint16)) {
+                used = unit16ToAscii((const Uint16*)(src + i), size - i, out + outSize);
+            } else {
+                for (used = 0; i + used < size && (Uint32)src[i + used] < 0x80; used++)
+                    out[outSize + used] = (char)src[i + used];
+            }
+            i += used;
+            outSize += used;
+            continue;
+        }
+        if (IS_HIGH_SURROGATE(c)) {
+            if (i + 1 < size && IS_LOW_SURROGATE((Uint32)src[i + 1])) {
+                outSize += putUtf8(out + outSize, 0x10000 + ((c - 0xD800) << 10) + ((Uint32)src[i + 1] - 0xDC00));
+                i += 2;
+                continue;
+            }
+            if (i + 1 == size && encoder != NULL && !last) {
+                encoder->highSurrogate = (Uint16)c;
+                break;
+            }
+            c = UTF_REPLACEMENT_CHARACTER;
+        } else if (IS_LOW_SURROGATE(c) || c > 0xFFFF) {
+            c = UTF_REPLACEMENT_CHARACTER;
+        }
+        outSize += putUtf8(out + outSize, c);
+        i++;
+    }
+    return outSize;
+}
+
+/*-------------------------------------
+ * API
+ *-------------------------------------*/
+size_t utf8ToUtf16(const char* src, const size_t& size, Uint16* out) {
+    return decodeUtf8<Uint16, true>(NULL, (const Byte*)src, size, out, true);
+}
+
+size_t utf8ToUtf32(const char* src, const size_t& size, Uint32* out) {
+    return decodeUtf8<Uint32, false>(NULL, (const Byte*)src, size, out, true);
+}
+
+size_t utf8ToUtf16(vUtf8Decoder& decoder, const char* src, const size_t& size, Uint16* out, const bool& last) {
+    return decodeUtf8<Uint16, true>(&decoder, (const Byte*)src, size, out, last);
+}
+
+size_t utf8ToUtf32(vUtf8Decoder& decoder, const char* src, const size_t& size, Uint32* out, const bool& last) {
+    return decodeUtf8<Uint32, false>(&decoder, (const Byte*)src, size, out, last);
+}
+
+size_t utf16ToUtf8(const Uint16* src, const size_t& size, char* out) {
+    return encodeUtf16<Uint16>(NULL, src, size, out, true);
+}
+
+size_t utf16ToUtf8(vUtf16Encoder& encoder, const Uint16* src, const size_t& size, char* out, const bool& last) {
+    return encodeUtf16<Uint16>(&encoder, src, size, out, last);
+}
+
+size_t utf32ToUtf8(const Uint32* src, const size_t& size, char* out) {
+    size_t outSize = 0;
+    Uint32 c;
+    for (size_t i = 0; i < size; i++) {
+        c = src[i];
+        if (c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+            c = UTF_REPLACEMENT_CHARACTER;
+        outSize += putUtf8(out + outSize, c);
+    }
+    return outSize;
+}
+
+void utf8ToUtf16(const string& str, vector<Uint16>& out) {
+    out.resize(UTF8_DECODE_CAPACITY(str.size()));
+    out.resize(utf8ToUtf16(str.data(), str.size(), out.data()));
+}
+
+void utf8ToUtf32(const string& str, vector<Uint32>& out) {
+    out.resize(UTF8_DECODE_CAPACITY(str.size()));
+    out.resize(utf8ToUtf32(str.data(), str.size(), out.data()));
+}
+
+void utf16ToUtf8(const Uint16* src, const size_t& size, string& out) {
+    out.resize(UTF16_ENCODE_CAPACITY(size));
+    out.resize(utf16ToUtf8(src, size, &out[0]));
+}
+
+void utf32ToUtf8(const Uint32* src, const size_t& size, string& out) {
+    out.resize(UTF32_ENCODE_CAPACITY(size));
+    out.resize(utf32ToUtf8(src, size, &out[0]));
+}
+
+void utf8ToWideString(const string& str, wstring& out) {
+    out.resize(UTF8_DECODE_CAPACITY(str.size()));
+    out.resize(decodeUtf8<wchar_t, true>(NULL, (const Byte*)str.data(), str.size(), &out[0], true));
+}
+
+void wideStringToUtf8(const wstring& str, string& out) {
+    out.resize(UTF16_ENCODE_CAPACITY(str.size()));
+    out.resize(encodeUtf16<wchar_t>(NULL, str.data(), str.size(), &out[0], true));
+}
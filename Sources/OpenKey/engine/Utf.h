@@ -0,0 +1,82 @@
+//
+//  Utf.h
+//  OpenKey
+//
+//  UTF-8 <-> UTF-16/UTF-32 transcoder with explicit width, it works the same
+//  on all platforms (wchar_t is 16 bits on Windows and 32 bits on Mac/Linux).
+//
+//  - Output is written to a buffer of the caller, use the capacity macros below.
+//  - Invalid data never throws: each invalid sequence is replaced by U+FFFD.
+//  - Streaming: a sequence which is split between 2 chunks is kept in the
+//    decoder/encoder until the next chunk.
+//
+
+#ifndef Utf_h
+#define Utf_h
+
+#include <string>
+#include <vector>
+#include "DataType.h"
+
+using namespace std;
+
+#define UTF_REPLACEMENT_CHARACTER       0xFFFD
+
+//max units written by utf8ToUtf16/utf8ToUtf32 for @size bytes (streaming or not)
+#define UTF8_DECODE_CAPACITY(size)      ((size) + 4)
+
+//max bytes written by utf16ToUtf8 for @size units (streaming or not)
+#define UTF16_ENCODE_CAPACITY(size)     ((size) * 3 + 4)
+
+//max bytes written by utf32ToUtf8 for @size code points
+#define UTF32_ENCODE_CAPACITY(size)     ((size) * 4)
+
+/**
+ * State of chunked UTF-8 decoding: the incomplete sequence at the end of last chunk
+ */
+struct vUtf8Decoder {
+    Byte pending[4];
+    Byte pendingSize = 0;
+};
+
+/**
+ * State of chunked UTF-16 encoding: the high surrogate at the end of last chunk
+ */
+struct vUtf16Encoder {
+    Uint16 highSurrogate = 0;
+};
+
+/**
+ * Decode UTF-8, return the number of units written to @out
+ */
+size_t utf8ToUtf16(const char* src, const size_t& size, Uint16* out);
+size_t utf8ToUtf32(const char* src, const size_t& size, Uint32* out);
+
+/**
+ * Decode a chunk of UTF-8, @last must be true for the last chunk to flush the decoder
+ */
+size_t utf8ToUtf16(vUtf8Decoder& decoder, const char* src, const size_t& size, Uint16* out, const bool& last);
+size_t utf8ToUtf32(vUtf8Decoder& decoder, const char* src, const size_t& size, Uint32* out, const bool& last);
+
+/**
+ * Encode to UTF-8, return the number of bytes written to @out
+ */
+size_t utf16ToUtf8(const Uint16* src, const size_t& size, char* out);
+size_t utf16ToUtf8(vUtf16Encoder& encoder, const Uint16* src, const size_t& size, char* out, const bool& last);
+size_t utf32ToUtf8(const Uint32* src, const size_t& size, char* out);
+
+/**
+ * String helpers, they reuse the memory of @out
+ */
+void utf8ToUtf16(const string& str, vector<Uint16>& out);
+void utf8ToUtf32(const string& str, vector<Uint32>& out);
+void utf16ToUtf8(const Uint16* src, const size_t& size, string& out);
+void utf32ToUtf8(const Uint32* src, const size_t& size, string& out);
+
+/**
+ * wstring holds UTF-16 units on all platforms (like codecvt_utf8_utf16<wchar_t>)
+ */
+void utf8ToWideString(const string& str, wstring& out);
+void wideStringToUtf8(const wstring& str, string& out);
+
+#endif /* Utf_h */
@@ -8,6 +8,7 @@
 
 #include "Vietnamese.h"
 #include "iostream"
+#include <string.h>
 using namespace std;
 
 //unicode
@@ -407,88 +408,243 @@ map<Uint16, vector<Uint16>> _quickEndConsonant = {
  * 3: Unicode Compound
  * 4: Vietnamese Locale CP 1258
  */
-map<Uint32, vector<Uint16>> _codeTable[] = {
+constexpr Uint16 _codeTable[CODE_TABLE_COUNT][CODE_TABLE_ROW_COUNT][CODE_TABLE_COLUMN_COUNT] = {
     {
-        //{keyCode, {CAPS_CHAR,    NORMAL_CHAR,     CAPS_W_CHAR,     NORMAL_W_CHAR}}
+        //keyCode: {CAPS_CHAR,    NORMAL_CHAR,     CAPS_W_CHAR,     NORMAL_W_CHAR}
         //KEY_A,            {Â, â, Ă, ă, Á, á, À, à, Ả, ả, Ã, ã, Ạ, ạ
-        { KEY_A,            {0x00C2, 0x00E2, 0x0102, 0x0103, 0x00C1, 0x00E1, 0x00C0, 0x00E0, 0x1EA2, 0x1EA3, 0x00C3, 0x00E3, 0x1EA0, 0x1EA1}},
-        { KEY_O,            {0x00D4, 0x00F4, 0x01A0, 0x01A1, 0x00D3, 0x00F3, 0x00D2, 0x00F2, 0x1ECE, 0x1ECF, 0x00D5, 0x00F5, 0x1ECC, 0x1ECD}},
-        { KEY_U,            {0x0000, 0x0000, 0x01AF, 0x01B0, 0x00DA, 0x00FA, 0x00D9, 0x00F9, 0x1EE6, 0x1EE7, 0x0168, 0x0169, 0x1EE4, 0x1EE5}},
-        { KEY_E,            {0x00CA, 0x00EA, 0x0000, 0x0000, 0x00C9, 0x00E9, 0x00C8, 0x00E8, 0x1EBA, 0x1EBB, 0x1EBC, 0x1EBD, 0x1EB8, 0x1EB9}},
-        { KEY_D,            {0x0110, 0x0111}},
+        /*KEY_A            */ {0x00C2, 0x00E2, 0x0102, 0x0103, 0x00C1, 0x00E1, 0x00C0, 0x00E0, 0x1EA2, 0x1EA3, 0x00C3, 0x00E3, 0x1EA0, 0x1EA1},
+        /*KEY_O            */ {0x00D4, 0x00F4, 0x01A0, 0x01A1, 0x00D3, 0x00F3, 0x00D2, 0x00F2, 0x1ECE, 0x1ECF, 0x00D5, 0x00F5, 0x1ECC, 0x1ECD},
+        /*KEY_U            */ {0x0000, 0x0000, 0x01AF, 0x01B0, 0x00DA, 0x00FA, 0x00D9, 0x00F9, 0x1EE6, 0x1EE7, 0x0168, 0x0169, 0x1EE4, 0x1EE5},
+        /*KEY_E            */ {0x00CA, 0x00EA, 0x0000, 0x0000, 0x00C9, 0x00E9, 0x00C8, 0x00E8, 0x1EBA, 0x1EBB, 0x1EBC, 0x1EBD, 0x1EB8, 0x1EB9},
+        /*KEY_D            */ {0x0110, 0x0111},
                                 //Ấ, ấ, Ầ, ầ, Ẩ, ẩ, Ẫ, ẫ, Ậ, ậ ,
-        { KEY_A|TONE_MASK,  {0x1EA4, 0x1EA5, 0x1EA6, 0x1EA7, 0x1EA8, 0x1EA9, 0x1EAA, 0x1EAB, 0x1EAC, 0x1EAD}},
+        /*KEY_A|TONE_MASK  */ {0x1EA4, 0x1EA5, 0x1EA6, 0x1EA7, 0x1EA8, 0x1EA9, 0x1EAA, 0x1EAB, 0x1EAC, 0x1EAD},
                                // Ắ, ắ, Ằ, ằ, Ẳ, ẳ, Ẵ, ẵ, Ặ, ặ
-        { KEY_A|TONEW_MASK, {0x1EAE, 0x1EAF, 0x1EB0, 0x1EB1, 0x1EB2, 0x1EB3, 0x1EB4, 0x1EB5, 0x1EB6, 0x1EB7}},
-        { KEY_O|TONE_MASK,  {0x1ED0, 0x1ED1, 0x1ED2, 0x1ED3, 0x1ED4, 0x1ED5, 0x1ED6, 0x1ED7, 0x1ED8, 0x1ED9}},
-        { KEY_O|TONEW_MASK, {0x1EDA, 0x1EDB, 0x1EDC, 0x1EDD, 0x1EDE, 0x1EDF, 0x1EE0, 0x1EE1, 0x1EE2, 0x1EE3}},
-        { KEY_U|TONEW_MASK, {0x1EE8, 0x1EE9, 0x1EEA, 0x1EEB, 0x1EEC, 0x1EED, 0x1EEE, 0x1EEF, 0x1EF0, 0x1EF1}},
-        { KEY_E|TONE_MASK,  {0x1EBE, 0x1EBF, 0x1EC0, 0x1EC1, 0x1EC2, 0x1EC3, 0x1EC4, 0x1EC5, 0x1EC6, 0x1EC7}},
-        { KEY_I,            {0x00CD, 0x00ED, 0x00CC, 0x00EC, 0x1EC8, 0x1EC9, 0x128, 0x129, 0x1ECA, 0x1ECB}},
-        { KEY_Y,            {0x00DD, 0x00FD, 0x1EF2, 0x1EF3, 0x1EF6, 0x1EF7, 0x1EF8, 0x1EF9, 0x1EF4, 0x1EF5}},
+        /*KEY_A|TONEW_MASK */ {0x1EAE, 0x1EAF, 0x1EB0, 0x1EB1, 0x1EB2, 0x1EB3, 0x1EB4, 0x1EB5, 0x1EB6, 0x1EB7},
+        /*KEY_O|TONE_MASK  */ {0x1ED0, 0x1ED1, 0x1ED2, 0x1ED3, 0x1ED4, 0x1ED5, 0x1ED6, 0x1ED7, 0x1ED8, 0x1ED9},
+        /*KEY_O|TONEW_MASK */ {0x1EDA, 0x1EDB, 0x1EDC, 0x1EDD, 0x1EDE, 0x1EDF, 0x1EE0, 0x1EE1, 0x1EE2, 0x1EE3},
+        /*KEY_U|TONEW_MASK */ {0x1EE8, 0x1EE9, 0x1EEA, 0x1EEB, 0x1EEC, 0x1EED, 0x1EEE, 0x1EEF, 0x1EF0, 0x1EF1},
+        /*KEY_E|TONE_MASK  */ {0x1EBE, 0x1EBF, 0x1EC0, 0x1EC1, 0x1EC2, 0x1EC3, 0x1EC4, 0x1EC5, 0x1EC6, 0x1EC7},
+        /*KEY_I            */ {0x00CD, 0x00ED, 0x00CC, 0x00EC, 0x1EC8, 0x1EC9, 0x128, 0x129, 0x1ECA, 0x1ECB},
+        /*KEY_Y            */ {0x00DD, 0x00FD, 0x1EF2, 0x1EF3, 0x1EF6, 0x1EF7, 0x1EF8, 0x1EF9, 0x1EF4, 0x1EF5},
     },
     {   //TCVN3 (ABC) - 1 byte character
-        { KEY_A,            {0xA2, 0xA9, 0xA1, 0xA8, 0xB8, 0xB8, 0xB5, 0xB5, 0xB6, 0xB6, 0xB7, 0xB7, 0xB9, 0xB9}},
-        { KEY_O,            {0xA4, 0xAB, 0xA5, 0xAC, 0xE3, 0xE3, 0xDF, 0xDF, 0xE1, 0xE1, 0xE2, 0xE2, 0xE4, 0xE4}},
-        { KEY_U,            {0x00, 0x00, 0xA6, 0xAD, 0xF3, 0xF3, 0xEF, 0xEF, 0xF1, 0xF1, 0xF2, 0xF2, 0xF4, 0xF4}},
-        { KEY_E,            {0xA3, 0xAA, 0x00, 0x00, 0xD0, 0xD0, 0xCC, 0xCC, 0xCE, 0xCE, 0xCF, 0xCF, 0xD1, 0xD1}},
-        { KEY_D,            {0xA7, 0xAE}},
-        { KEY_A|TONE_MASK,  {0xCA, 0xCA, 0xC7, 0xC7, 0xC8, 0xC8, 0xC9, 0xC9, 0xCB, 0xCB}},
-        { KEY_A|TONEW_MASK, {0xBE, 0xBE, 0xBB, 0xBB, 0xBC, 0xBC, 0xBD, 0xBD, 0xC6, 0xC6}},
-        { KEY_O|TONE_MASK,  {0xE8, 0xE8, 0xE5, 0xE5, 0xE6, 0xE6, 0xE7, 0xE7, 0xE9, 0xE9}},
-        { KEY_O|TONEW_MASK, {0xED, 0xED, 0xEA, 0xEA, 0xEB, 0xEB, 0xEC, 0xEC, 0xEE, 0xEE}},
-        { KEY_U|TONEW_MASK, {0xF8, 0xF8, 0xF5, 0xF5, 0xF6, 0xF6, 0xF7, 0xF7, 0xF9, 0xF9}},
-        { KEY_E|TONE_MASK,  {0xD5, 0xD5, 0xD2, 0xD2, 0xD3, 0xD3, 0xD4, 0xD4, 0xD6, 0xD6}},
-        { KEY_I,            {0xDD, 0xDD, 0xD7, 0xD7, 0xD8, 0xD8, 0xDc, 0xDc, 0xDe, 0xDe}},
-        { KEY_Y,            {0xFD, 0xFD, 0xFA, 0xFA, 0xFB, 0xFB, 0xFC, 0xFC, 0xFE, 0xFE}},
+        /*KEY_A            */ {0xA2, 0xA9, 0xA1, 0xA8, 0xB8, 0xB8, 0xB5, 0xB5, 0xB6, 0xB6, 0xB7, 0xB7, 0xB9, 0xB9},
+        /*KEY_O            */ {0xA4, 0xAB, 0xA5, 0xAC, 0xE3, 0xE3, 0xDF, 0xDF, 0xE1, 0xE1, 0xE2, 0xE2, 0xE4, 0xE4},
+        /*KEY_U            */ {0x00, 0x00, 0xA6, 0xAD, 0xF3, 0xF3, 0xEF, 0xEF, 0xF1, 0xF1, 0xF2, 0xF2, 0xF4, 0xF4},
+        /*KEY_E            */ {0xA3, 0xAA, 0x00, 0x00, 0xD0, 0xD0, 0xCC, 0xCC, 0xCE, 0xCE, 0xCF, 0xCF, 0xD1, 0xD1},
+        /*KEY_D            */ {0xA7, 0xAE},
+        /*KEY_A|TONE_MASK  */ {0xCA, 0xCA, 0xC7, 0xC7, 0xC8, 0xC8, 0xC9, 0xC9, 0xCB, 0xCB},
+        /*KEY_A|TONEW_MASK */ {0xBE, 0xBE, 0xBB, 0xBB, 0xBC, 0xBC, 0xBD, 0xBD, 0xC6, 0xC6},
+        /*KEY_O|TONE_MASK  */ {0xE8, 0xE8, 0xE5, 0xE5, 0xE6, 0xE6, 0xE7, 0xE7, 0xE9, 0xE9},
+        /*KEY_O|TONEW_MASK */ {0xED, 0xED, 0xEA, 0xEA, 0xEB, 0xEB, 0xEC, 0xEC, 0xEE, 0xEE},
+        /*KEY_U|TONEW_MASK */ {0xF8, 0xF8, 0xF5, 0xF5, 0xF6, 0xF6, 0xF7, 0xF7, 0xF9, 0xF9},
+        /*KEY_E|TONE_MASK  */ {0xD5, 0xD5, 0xD2, 0xD2, 0xD3, 0xD3, 0xD4, 0xD4, 0xD6, 0xD6},
+        /*KEY_I            */ {0xDD, 0xDD, 0xD7, 0xD7, 0xD8, 0xD8, 0xDc, 0xDc, 0xDe, 0xDe},
+        /*KEY_Y            */ {0xFD, 0xFD, 0xFA, 0xFA, 0xFB, 0xFB, 0xFC, 0xFC, 0xFE, 0xFE},
     },
     {   //VNI Windows
-        { KEY_A,            {0xC241, 0xE261, 0xCA41, 0xEA61, 0xD941, 0xF961, 0xD841, 0xF861, 0xDB41, 0xFB61, 0xD541, 0xF561, 0xCF41, 0xEF61}},
-        { KEY_O,            {0xC24F, 0xE26F, 0x00D4, 0x00F4, 0xD94F, 0xF96F, 0xD84F, 0xF86F, 0xDB4F, 0xFB6F, 0xD54F, 0xF56F, 0xCF4F, 0xEF6F}},
-        { KEY_U,            {0x0000, 0x0000, 0x00D6, 0x00F6, 0xD955, 0xF975, 0xD855, 0xF875, 0xDB55, 0xFB75, 0xD555, 0xF575, 0xCF55, 0xEF75}},
-        { KEY_E,            {0xC245, 0xE265, 0x0000, 0x0000, 0xD945, 0xF965, 0xD845, 0xF865, 0xDB45, 0xFB65, 0xD545, 0xF565, 0xCF45, 0xEF65}},
-        { KEY_D,            {0x00D1, 0x00F1}},
-        { KEY_A|TONE_MASK,  {0xC141, 0xE161, 0xC041, 0xE061, 0xC541, 0xE561, 0xC341, 0xE361, 0xC441, 0xE461}},
-        { KEY_A|TONEW_MASK, {0xC941, 0xE961, 0xC841, 0xE861, 0xDA41, 0xFA61, 0xDC41, 0xFC61, 0xCB41, 0xEB61}},
-        { KEY_O|TONE_MASK,  {0xC14F, 0xE16F, 0xC04F, 0xE06F, 0xC54F, 0xE56F, 0xC34F, 0xE36F, 0xC44F, 0xE46F}},
-        { KEY_O|TONEW_MASK, {0xD9D4, 0xF9F4, 0xD8D4, 0xF8F4, 0xDBD4, 0xFBF4, 0xD5D4, 0xF5F4, 0xCFD4, 0xEFF4}},
-        { KEY_U|TONEW_MASK, {0xD9D6, 0xF9F6, 0xD8D6, 0xF8F6, 0xDBD6, 0xFBF6, 0xD5D6, 0xF5F6, 0xCFD6, 0xEFF6}},
-        { KEY_E|TONE_MASK,  {0xC145, 0xE165, 0xC045, 0xE065, 0xC545, 0xE565, 0xC345, 0xE365, 0xC445, 0xE465}},
-        { KEY_I,            {0x00CD, 0x00ED, 0x00CC, 0x00EC, 0x00C6, 0x00E6, 0x00D3, 0x00F3, 0x00D2, 0x00F2}},
-        { KEY_Y,            {0xD959, 0xF979, 0xD859, 0xF879, 0xDB59, 0xFB79, 0xD559, 0xF579, 0x00CE, 0x00EE}},
+        /*KEY_A            */ {0xC241, 0xE261, 0xCA41, 0xEA61, 0xD941, 0xF961, 0xD841, 0xF861, 0xDB41, 0xFB61, 0xD541, 0xF561, 0xCF41, 0xEF61},
+        /*KEY_O            */ {0xC24F, 0xE26F, 0x00D4, 0x00F4, 0xD94F, 0xF96F, 0xD84F, 0xF86F, 0xDB4F, 0xFB6F, 0xD54F, 0xF56F, 0xCF4F, 0xEF6F},
+        /*KEY_U            */ {0x0000, 0x0000, 0x00D6, 0x00F6, 0xD955, 0xF975, 0xD855, 0xF875, 0xDB55, 0xFB75, 0xD555, 0xF575, 0xCF55, 0xEF75},
+        /*KEY_E            */ {0xC245, 0xE265, 0x0000, 0x0000, 0xD945, 0xF965, 0xD845, 0xF865, 0xDB45, 0xFB65, 0xD545, 0xF565, 0xCF45, 0xEF65},
+        /*KEY_D            */ {0x00D1, 0x00F1},
+        /*KEY_A|TONE_MASK  */ {0xC141, 0xE161, 0xC041, 0xE061, 0xC541, 0xE561, 0xC341, 0xE361, 0xC441, 0xE461},
+        /*KEY_A|TONEW_MASK */ {0xC941, 0xE961, 0xC841, 0xE861, 0xDA41, 0xFA61, 0xDC41, 0xFC61, 0xCB41, 0xEB61},
+        /*KEY_O|TONE_MASK  */ {0xC14F, 0xE16F, 0xC04F, 0xE06F, 0xC54F, 0xE56F, 0xC34F, 0xE36F, 0xC44F, 0xE46F},
+        /*KEY_O|TONEW_MASK */ {0xD9D4, 0xF9F4, 0xD8D4, 0xF8F4, 0xDBD4, 0xFBF4, 0xD5D4, 0xF5F4, 0xCFD4, 0xEFF4},
+        /*KEY_U|TONEW_MASK */ {0xD9D6, 0xF9F6, 0xD8D6, 0xF8F6, 0xDBD6, 0xFBF6, 0xD5D6, 0xF5F6, 0xCFD6, 0xEFF6},
+        /*KEY_E|TONE_MASK  */ {0xC145, 0xE165, 0xC045, 0xE065, 0xC545, 0xE565, 0xC345, 0xE365, 0xC445, 0xE465},
+        /*KEY_I            */ {0x00CD, 0x00ED, 0x00CC, 0x00EC, 0x00C6, 0x00E6, 0x00D3, 0x00F3, 0x00D2, 0x00F2},
+        /*KEY_Y            */ {0xD959, 0xF979, 0xD859, 0xF879, 0xDB59, 0xFB79, 0xD559, 0xF579, 0x00CE, 0x00EE},
     },
     {   //Unicode Compound  {Â, â, Ă, ă, Á, á, À, à, Ả, ả, Ã, ã, Ạ, ạ
-        { KEY_A,            {0x00C2, 0x00E2, 0x0102, 0x0103, 0x2041, 0x2061, 0x4041, 0x4061, 0x6041, 0x6061, 0x8041, 0x8061, 0xA041, 0xA061}},
-        { KEY_O,            {0x00D4, 0x00F4, 0x01A0, 0x01A1, 0x204F, 0x206F, 0x404F, 0x406F, 0x604F, 0x606F, 0x804F, 0x806F, 0xA04F, 0xA06F}},
-        { KEY_U,            {0x0000, 0x0000, 0x01AF, 0x01B0, 0x2055, 0x2075, 0x4055, 0x4075, 0x6055, 0x6075, 0x8055, 0x8075, 0xA055, 0xA075}},
-        { KEY_E,            {0x00CA, 0x00EA, 0x0000, 0x0000, 0x2045, 0x2065, 0x4045, 0x4065, 0x6045, 0x6065, 0x8045, 0x8065, 0xA045, 0xA065}},
-        { KEY_D,            {0x0110, 0x0111}},
-        { KEY_A|TONE_MASK,  {0x20C2, 0x20E2, 0x40C2, 0x40E2, 0x60C2, 0x60E2, 0x80C2, 0x80E2, 0xA0C2, 0xA0E2}},
-        { KEY_A|TONEW_MASK, {0x2102, 0x2103, 0x4102, 0x4103, 0x6102, 0x6103, 0x8102, 0x8103, 0xA102, 0xA103}},
-        { KEY_O|TONE_MASK,  {0x20D4, 0x20F4, 0x40D4, 0x40F4, 0x60D4, 0x60F4, 0x80D4, 0x80F4, 0xA0D4, 0xA0F4}},
-        { KEY_O|TONEW_MASK, {0x21A0, 0x21A1, 0x41A0, 0x41A1, 0x61A0, 0x61A1, 0x81A0, 0x81A1, 0xA1A0, 0xA1A1}},
-        { KEY_U|TONEW_MASK, {0x21AF, 0x21B0, 0x41AF, 0x41B0, 0x61AF, 0x61B0, 0x81AF, 0x81B0, 0xA1AF, 0xA1B0}},
-        { KEY_E|TONE_MASK,  {0x20CA, 0x20EA, 0x40CA, 0x40EA, 0x60CA, 0x60EA, 0x80CA, 0x80EA, 0xA0CA, 0xA0EA}},
-        { KEY_I,            {0x2049, 0x2069, 0x4049, 0x4069, 0x6049, 0x6069, 0x8049, 0x8069, 0xA049, 0xA069}},
-        { KEY_Y,            {0x2059, 0x2079, 0x4059, 0x4079, 0x6059, 0x6079, 0x8059, 0x8079, 0xA059, 0xA079}},
+        /*KEY_A            */ {0x00C2, 0x00E2, 0x0102, 0x0103, 0x2041, 0x2061, 0x4041, 0x4061, 0x6041, 0x6061, 0x8041, 0x8061, 0xA041, 0xA061},
+        /*KEY_O            */ {0x00D4, 0x00F4, 0x01A0, 0x01A1, 0x204F, 0x206F, 0x404F, 0x406F, 0x604F, 0x606F, 0x804F, 0x806F, 0xA04F, 0xA06F},
+        /*KEY_U            */ {0x0000, 0x0000, 0x01AF, 0x01B0, 0x2055, 0x2075, 0x4055, 0x4075, 0x6055, 0x6075, 0x8055, 0x8075, 0xA055, 0xA075},
+        /*KEY_E            */ {0x00CA, 0x00EA, 0x0000, 0x0000, 0x2045, 0x2065, 0x4045, 0x4065, 0x6045, 0x6065, 0x8045, 0x8065, 0xA045, 0xA065},
+        /*KEY_D            */ {0x0110, 0x0111},
+        /*KEY_A|TONE_MASK  */ {0x20C2, 0x20E2, 0x40C2, 0x40E2, 0x60C2, 0x60E2, 0x80C2, 0x80E2, 0xA0C2, 0xA0E2},
+        /*KEY_A|TONEW_MASK */ {0x2102, 0x2103, 0x4102, 0x4103, 0x6102, 0x6103, 0x8102, 0x8103, 0xA102, 0xA103},
+        /*KEY_O|TONE_MASK  */ {0x20D4, 0x20F4, 0x40D4, 0x40F4, 0x60D4, 0x60F4, 0x80D4, 0x80F4, 0xA0D4, 0xA0F4},
+        /*KEY_O|TONEW_MASK */ {0x21A0, 0x21A1, 0x41A0, 0x41A1, 0x61A0, 0x61A1, 0x81A0, 0x81A1, 0xA1A0, 0xA1A1},
+        /*KEY_U|TONEW_MASK */ {0x21AF, 0x21B0, 0x41AF, 0x41B0, 0x61AF, 0x61B0, 0x81AF, 0x81B0, 0xA1AF, 0xA1B0},
+        /*KEY_E|TONE_MASK  */ {0x20CA, 0x20EA, 0x40CA, 0x40EA, 0x60CA, 0x60EA, 0x80CA, 0x80EA, 0xA0CA, 0xA0EA},
+        /*KEY_I            */ {0x2049, 0x2069, 0x4049, 0x4069, 0x6049, 0x6069, 0x8049, 0x8069, 0xA049, 0xA069},
+        /*KEY_Y            */ {0x2059, 0x2079, 0x4059, 0x4079, 0x6059, 0x6079, 0x8059, 0x8079, 0xA059, 0xA079},
     },
     {   //Vietnamese Locale CP 1258
-        { KEY_A,            {0x00C2, 0x00E2, 0x00C3, 0x00E3, 0xEC41, 0xEC61, 0xCC41, 0xCC61, 0xD241, 0xD261, 0xDE41, 0xDE61, 0xF241, 0xF261}},
-        { KEY_O,            {0x00D4, 0x00F4, 0x00D5, 0x00F5, 0xEC4F, 0xEC6F, 0xCC4F, 0xCC6F, 0xD24F, 0xD26F, 0xDE4F, 0xDE6F, 0xF24F, 0xF26F}},
-        { KEY_U,            {0x0000, 0x0000, 0x00DD, 0x00FD, 0xEC55, 0xEC75, 0xCC55, 0xCC75, 0xD255, 0xD275, 0xDE55, 0xDE75, 0xF255, 0xF275}},
-        { KEY_E,            {0x00CA, 0x00EA, 0x0000, 0x0000, 0xEC45, 0xEC65, 0xCC45, 0xCC65, 0xD245, 0xD265, 0xDE45, 0xDE65, 0xF245, 0xF265}},
-        { KEY_D,            {0x00D0, 0x00F0}},
-        { KEY_A|TONE_MASK,  {0xECC2, 0xECE2, 0xCCC2, 0xCCE2, 0xD2C2, 0xD2E2, 0xDEC2, 0xDEE2, 0xF2C2, 0xF2E2}},
-        { KEY_A|TONEW_MASK, {0xECC3, 0xECE3, 0xCCC3, 0xCCE3, 0xD2C3, 0xD2E3, 0xDEC3, 0xDEE3, 0xF2C3, 0xF2E3}},
-        { KEY_O|TONE_MASK,  {0xECD4, 0xECF4, 0xCCD4, 0xCCF4, 0xD2D4, 0xD2F4, 0xDED4, 0xDEF4, 0xF2D4, 0xF2F4}},
-        { KEY_O|TONEW_MASK, {0xECD5, 0xECF5, 0xCCD5, 0xCCF5, 0xD2D5, 0xD2F5, 0xDED5, 0xDEF5, 0xF2D5, 0xF2F5}},
-        { KEY_U|TONEW_MASK, {0xECDD, 0xECFD, 0xCCDD, 0xCCFD, 0xD2DD, 0xD2FD, 0xDEDD, 0xDEFD, 0xF2DD, 0xF2FD}},
-        { KEY_E|TONE_MASK,  {0xECCA, 0xECEA, 0xCCCA, 0xCCEA, 0xD2CA, 0xD2EA, 0xDECA, 0xDEEA, 0xF2CA, 0xF2EA}},
-        { KEY_I,            {0xEC49, 0xEC69, 0xCC49, 0xCC69, 0xD249, 0xD269, 0xDE49, 0xDE69, 0xF249, 0xF269}},
-        { KEY_Y,            {0xEC59, 0xEC79, 0xCC59, 0xCC79, 0xD259, 0xD279, 0xDE59, 0xDE79, 0xF259, 0xF279}},
+        /*KEY_A            */ {0x00C2, 0x00E2, 0x00C3, 0x00E3, 0xEC41, 0xEC61, 0xCC41, 0xCC61, 0xD241, 0xD261, 0xDE41, 0xDE61, 0xF241, 0xF261},
+        /*KEY_O            */ {0x00D4, 0x00F4, 0x00D5, 0x00F5, 0xEC4F, 0xEC6F, 0xCC4F, 0xCC6F, 0xD24F, 0xD26F, 0xDE4F, 0xDE6F, 0xF24F, 0xF26F},
+        /*KEY_U            */ {0x0000, 0x0000, 0x00DD, 0x00FD, 0xEC55, 0xEC75, 0xCC55, 0xCC75, 0xD255, 0xD275, 0xDE55, 0xDE75, 0xF255, 0xF275},
+        /*KEY_E            */ {0x00CA, 0x00EA, 0x0000, 0x0000, 0xEC45, 0xEC65, 0xCC45, 0xCC65, 0xD245, 0xD265, 0xDE45, 0xDE65, 0xF245, 0xF265},
+        /*KEY_D            */ {0x00D0, 0x00F0},
+        /*KEY_A|TONE_MASK  */ {0xECC2, 0xECE2, 0xCCC2, 0xCCE2, 0xD2C2, 0xD2E2, 0xDEC2, 0xDEE2, 0xF2C2, 0xF2E2},
+        /*KEY_A|TONEW_MASK */ {0xECC3, 0xECE3, 0xCCC3, 0xCCE3, 0xD2C3, 0xD2E3, 0xDEC3, 0xDEE3, 0xF2C3, 0xF2E3},
+        /*KEY_O|TONE_MASK  */ {0xECD4, 0xECF4, 0xCCD4, 0xCCF4, 0xD2D4, 0xD2F4, 0xDED4, 0xDEF4, 0xF2D4, 0xF2F4},
+        /*KEY_O|TONEW_MASK */ {0xECD5, 0xECF5, 0xCCD5, 0xCCF5, 0xD2D5, 0xD2F5, 0xDED5, 0xDEF5, 0xF2D5, 0xF2F5},
+        /*KEY_U|TONEW_MASK */ {0xECDD, 0xECFD, 0xCCDD, 0xCCFD, 0xD2DD, 0xD2FD, 0xDEDD, 0xDEFD, 0xF2DD, 0xF2FD},
+        /*KEY_E|TONE_MASK  */ {0xECCA, 0xECEA, 0xCCCA, 0xCCEA, 0xD2CA, 0xD2EA, 0xDECA, 0xDEEA, 0xF2CA, 0xF2EA},
+        /*KEY_I            */ {0xEC49, 0xEC69, 0xCC49, 0xCC69, 0xD249, 0xD269, 0xDE49, 0xDE69, 0xF249, 0xF269},
+        /*KEY_Y            */ {0xEC59, 0xEC79, 0xCC59, 0xCC79, 0xD259, 0xD279, 0xDE59, 0xDE79, 0xF259, 0xF279},
     }
 };
 
+//key of each row in _codeTable
+constexpr Uint32 _codeTableKey[CODE_TABLE_ROW_COUNT] = {
+    KEY_A, KEY_O, KEY_U, KEY_E, KEY_D,
+    KEY_A|TONE_MASK, KEY_A|TONEW_MASK, KEY_O|TONE_MASK, KEY_O|TONEW_MASK, KEY_U|TONEW_MASK, KEY_E|TONE_MASK,
+    KEY_I, KEY_Y
+};
+
+//number of characters in each row of _codeTable
+constexpr Uint8 _codeTableRowSize[CODE_TABLE_ROW_COUNT] = {
+    14, 14, 14, 14, 2,
+    10, 10, 10, 10, 10, 10,
+    10, 10
+};
+
+//characters which have a row in _codeTable
+static constexpr Uint32 _codeTableBase[CODE_TABLE_BASE_COUNT] = { KEY_A, KEY_O, KEY_U, KEY_E, KEY_D, KEY_I, KEY_Y };
+
+static constexpr int findCodeTableRow(const Uint32& key) {
+    for (int i = 0; i < CODE_TABLE_ROW_COUNT; i++) {
+        if (_codeTableKey[i] == key)
+            return i;
+    }
+    return -1;
+}
+
+static constexpr Uint32 hashCodeTableCharacter(const Uint16& character) {
+    return (Uint16)(character * 40503u) >> 7; //0..CODE_TABLE_HASH_SIZE-1
+}
+
+/**
+ * Build all indexes of _codeTable at compile time.
+ * character[][][][][] gives the same result as the old map lookup in getCharacterCode:
+ * a mark selects column (mark - 1) * 2 + caps, plus 4 for A, O, U, E without tone;
+ * no mark selects column caps for ^ and caps + 2 for w.
+ */
+static constexpr vCodeTableIndex buildCodeTableIndex() {
+    vCodeTableIndex index = {};
+    int i = 0, j = 0, base = 0, tone = 0, mark = 0, caps = 0, row = 0, column = 0, toneRow = 0;
+    
+    //rows sorted by key, so they are checked in the same order as the old map
+    for (i = 0; i < CODE_TABLE_ROW_COUNT; i++)
+        index.rowOrder[i] = (Uint8)i;
+    for (i = 0; i < CODE_TABLE_ROW_COUNT; i++) {
+        for (j = i + 1; j < CODE_TABLE_ROW_COUNT; j++) {
+            if (_codeTableKey[index.rowOrder[j]] < _codeTableKey[index.rowOrder[i]]) {
+                Uint8 temp = index.rowOrder[i];
+                index.rowOrder[i] = index.rowOrder[j];
+                index.rowOrder[j] = temp;
+            }
+        }
+    }
+    
+    for (i = 0; i < 256; i++)
+        index.base[i] = CODE_TABLE_NOT_FOUND;
+    for (base = 0; base < CODE_TABLE_BASE_COUNT; base++)
+        index.base[_codeTableBase[base]] = (Uint8)base;
+    
+    for (i = 0; i < 32; i++)
+        index.mark[i] = CODE_TABLE_NOT_FOUND;
+    index.mark[0] = 0;
+    for (mark = 1; mark <= 5; mark++)
+        index.mark[1 << (mark - 1)] = (Uint8)mark;
+    
+    for (base = 0; base < CODE_TABLE_BASE_COUNT; base++) {
+        for (tone = 0; tone < 3; tone++) {
+            toneRow = findCodeTableRow(_codeTableBase[base] | (tone == 1 ? TONE_MASK : (tone == 2 ? TONEW_MASK : 0)));
+            index.row[base][tone] = toneRow >= 0 ? (Uint8)toneRow : CODE_TABLE_NOT_FOUND;
+            for (mark = 0; mark <= 5; mark++) {
+                for (caps = 0; caps < 2; caps++) {
+                    if (mark > 0) {
+                        row = toneRow;
+                        column = (mark - 1) * 2 + caps;
+                        if (tone == 0 && (_codeTableBase[base] == KEY_A || _codeTableBase[base] == KEY_O ||
+                                          _codeTableBase[base] == KEY_U || _codeTableBase[base] == KEY_E))
+                            column += 4;
+                    } else {
+                        row = findCodeTableRow(_codeTableBase[base]);
+                        column = tone == 1 ? caps : (tone == 2 ? caps + 2 : -1);
+                    }
+                    if (row < 0 || column < 0 || column >= _codeTableRowSize[row])
+                        continue;
+                    for (i = 0; i < CODE_TABLE_COUNT; i++)
+                        index.character[i][base][tone][mark][caps] = _codeTable[i][row][column];
+                }
+            }
+        }
+    }
+    
+    const Uint32 letters[] = { KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F, KEY_G, KEY_H, KEY_I, KEY_J, KEY_K, KEY_L, KEY_M,
+                               KEY_N, KEY_O, KEY_P, KEY_Q, KEY_R, KEY_S, KEY_T, KEY_U, KEY_V, KEY_W, KEY_X, KEY_Y, KEY_Z };
+    for (i = 0; i < 26; i++)
+        index.letterKey[letters[i]] = true;
+    
+    //reverse index, the first (row, column) of a character is kept
+    Uint32 slot = 0;
+    for (i = 0; i < CODE_TABLE_COUNT; i++) {
+        for (j = 0; j < CODE_TABLE_HASH_SIZE; j++)
+            index.hashRow[i][j] = CODE_TABLE_NOT_FOUND;
+        for (j = 0; j < CODE_TABLE_ROW_COUNT; j++) {
+            row = index.rowOrder[j];
+            for (column = 0; column < _codeTableRowSize[row]; column++) {
+                slot = hashCodeTableCharacter(_codeTable[i][row][column]);
+                while (index.hashRow[i][slot] != CODE_TABLE_NOT_FOUND && index.hashCharacter[i][slot] != _codeTable[i][row][column])
+                    slot = (slot + 1) & (CODE_TABLE_HASH_SIZE - 1);
+                if (index.hashRow[i][slot] != CODE_TABLE_NOT_FOUND)
+                    continue;
+                index.hashCharacter[i][slot] = _codeTable[i][row][column];
+                index.hashRow[i][slot] = (Uint8)row;
+                index.hashColumn[i][slot] = (Uint8)column;
+                index.hashCase[i][slot][0] = _codeTable[i][row][column | 1]; //even columns are caps
+                index.hashCase[i][slot][1] = _codeTable[i][row][column & ~1];
+            }
+        }
+    }
+    return index;
+}
+
+constexpr vCodeTableIndex _codeTableIndex = buildCodeTableIndex();
+
+bool findCodeTableCharacter(const Uint16& character, const int& table, int& row, int& column) {
+    Uint32 slot = hashCodeTableCharacter(character);
+    while (_codeTableIndex.hashRow[table][slot] != CODE_TABLE_NOT_FOUND) {
+        if (_codeTableIndex.hashCharacter[table][slot] == character) {
+            row = _codeTableIndex.hashRow[table][slot];
+            column = _codeTableIndex.hashColumn[table][slot];
+            return true;
+        }
+        slot = (slot + 1) & (CODE_TABLE_HASH_SIZE - 1);
+    }
+    return false;
+}
+
+Uint16 getCharacterCase(const Uint16& character, const int& table, const bool& upperCase) {
+    if (character < 0x80) {
+        if (upperCase)
+            return character >= 'a' && character <= 'z' ? character - 0x20 : character;
+        return character >= 'A' && character <= 'Z' ? character + 0x20 : character;
+    }
+    Uint32 slot = hashCodeTableCharacter(character);
+    while (_codeTableIndex.hashRow[table][slot] != CODE_TABLE_NOT_FOUND) {
+        if (_codeTableIndex.hashCharacter[table][slot] == character)
+            return _codeTableIndex.hashCase[table][slot][upperCase ? 1 : 0];
+        slot = (slot + 1) & (CODE_TABLE_HASH_SIZE - 1);
+    }
+    return character;
+}
+
+Uint32 getKeyCodeCase(const Uint32& data, const int& table, const bool& upperCase) {
+    if (data & CHAR_CODE_MASK)
+        return getCharacterCase((Uint16)data, table, upperCase) | (data & ~CHAR_MASK);
+    if ((data & PURE_CHARACTER_MASK) || (data & CHAR_MASK) > 0xFF || !_codeTableIndex.letterKey[data & CHAR_MASK])
+        return data;
+    return upperCase ? data | CAPS_MASK : data & ~CAPS_MASK;
+}
+
 // sắc, huyền, hỏi, ngã, nặng - for Unicode Compound
 Uint16 _unicodeCompoundMark[] = {0x0301, 0x0300, 0x0309, 0x0303, 0x0323};
 
@@ -566,8 +722,123 @@ void initKeyCodeToChar() {
 
 Uint16 keyCodeToCharacter(const Uint32& keyCode) {
     // Map is pre-initialized in vKeyInit(), no need for lazy check
-    if (_keyCodeToChar.find(keyCode) != _keyCodeToChar.end()) {
-        return _keyCodeToChar[keyCode];
+    //read only, the convert tool calls it from many threads
+    map<Uint32, Uint32>::const_iterator it = _keyCodeToChar.find(keyCode);
+    if (it != _keyCodeToChar.end()) {
+        return it->second;
     }
     return 0;
 }
+
+Uint8 _spellingSymbol[256][4];
+vSpellingTrie _spellingOnset[4];
+vSpellingTrie _spellingCoda[2];
+vSpellingTrie _spellingNucleus;
+Uint16 _spellingNucleusRoot[256];
+
+static Uint8 _spellingSymbolCount = 0;
+
+static Uint8 getOrAddSpellingSymbol(const Uint32& key) {
+    Uint8 tone = ((key & TONE_MASK) ? 1 : 0) | ((key & TONEW_MASK) ? 2 : 0);
+    Uint8& symbol = _spellingSymbol[key & 0xFF][tone];
+    if (symbol == SPELLING_NO_SYMBOL && _spellingSymbolCount + 1 < SPELLING_SYMBOL_COUNT)
+        symbol = ++_spellingSymbolCount;
+    return symbol;
+}
+
+static Uint16 addSpellingNode(vSpellingTrie& trie, const Uint8& data) {
+    Uint16 node = (Uint16)trie.data.size();
+    trie.next.resize(trie.next.size() + SPELLING_SYMBOL_COUNT, SPELLING_DEAD);
+    trie.data.push_back(data);
+    return node;
+}
+
+static Uint16 addSpellingTransition(vSpellingTrie& trie, const Uint16& node, const Uint32& key, const Uint8& data) {
+    Uint8 symbol = getOrAddSpellingSymbol(key);
+    Uint16 next = trie.next[node * SPELLING_SYMBOL_COUNT + symbol];
+    if (next == SPELLING_DEAD) {
+        next = addSpellingNode(trie, data);
+        trie.next[node * SPELLING_SYMBOL_COUNT + symbol] = next;
+    }
+    return next;
+}
+
+/**
+ * Key code which matches @key when some masks are allowed, 0xFFFF if it can't match any key.
+ * Same rule as the old row by row check: (key & ~mask) == CHR(j)
+ */
+static Uint16 getSpellingKey(const Uint16& key, const Uint16& allowMask1, const Uint16& allowMask2) {
+    if ((key & ~allowMask1) <= 0xFF)
+        return key & ~allowMask1;
+    if ((key & ~allowMask2) <= 0xFF)
+        return key & ~allowMask2;
+    return 0xFFFF;
+}
+
+void initSpellingAutomaton() {
+    int i, j, variant;
+    Uint16 node, key;
+    memset(_spellingSymbol, SPELLING_NO_SYMBOL, sizeof(_spellingSymbol));
+    for (i = 0; i < 256; i++)
+        _spellingNucleusRoot[i] = SPELLING_DEAD;
+    _spellingSymbolCount = 0;
+    
+    //first consonant: data of a node is the first row of _consonantTable which ends there
+    for (variant = 0; variant < 4; variant++) {
+        vSpellingTrie& trie = _spellingOnset[variant];
+        trie.next.clear();
+        trie.data.clear();
+        addSpellingNode(trie, SPELLING_NO_ROW);
+        for (i = 0; i < _consonantTable.size(); i++) {
+            node = 0;
+            for (j = 0; j < _consonantTable[i].size(); j++) {
+                key = getSpellingKey(_consonantTable[i][j],
+                                     (variant & 1) ? END_CONSONANT_MASK : 0,
+                                     (variant & 2) ? CONSONANT_ALLOW_MASK : 0);
+                if (key == 0xFFFF)
+                    break;
+                node = addSpellingTransition(trie, node, key, SPELLING_NO_ROW);
+            }
+            if (j < _consonantTable[i].size())
+                continue; //this row never matches
+            if (i < trie.data[node])
+                trie.data[node] = (Uint8)i;
+        }
+    }
+    
+    //last consonant: every node is the prefix of a row, so reaching the end of the word on any node is valid
+    for (variant = 0; variant < 2; variant++) {
+        vSpellingTrie& trie = _spellingCoda[variant];
+        trie.next.clear();
+        trie.data.clear();
+        addSpellingNode(trie, 0);
+        for (i = 0; i < _endConsonantTable.size(); i++) {
+            node = 0;
+            for (j = 0; j < _endConsonantTable[i].size(); j++) {
+                key = getSpellingKey(_endConsonantTable[i][j], variant ? END_CONSONANT_MASK : 0, 0);
+                if (key == 0xFFFF)
+                    break; //the rest of this row can't match
+                node = addSpellingTransition(trie, node, key, 0);
+            }
+        }
+    }
+    
+    //vowel: each key of _vowelCombine has its own root, data is SPELLING_NUCLEUS_* flags
+    _spellingNucleus.next.clear();
+    _spellingNucleus.data.clear();
+    for (map<Uint16, vector<vector<Uint32>>>::const_iterator it = _vowelCombine.begin(); it != _vowelCombine.end(); ++it) {
+        Uint16 root = addSpellingNode(_spellingNucleus, 0);
+        _spellingNucleusRoot[it->first & 0xFF] = root;
+        for (i = 0; i < it->second.size(); i++) {
+            const vector<Uint32>& row = it->second[i];
+            Uint8 endFlag = row[0] ? SPELLING_NUCLEUS_END_ALLOW | SPELLING_NUCLEUS_END : SPELLING_NUCLEUS_END;
+            node = root;
+            _spellingNucleus.data[node] |= endFlag << 2;
+            for (j = 1; j < row.size(); j++) {
+                node = addSpellingTransition(_spellingNucleus, node, row[j], 0);
+                _spellingNucleus.data[node] |= endFlag << 2;
+            }
+            _spellingNucleus.data[node] |= endFlag;
+        }
+    }
+}
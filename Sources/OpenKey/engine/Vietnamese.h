@@ -25,13 +25,88 @@ extern vector<vector<Uint16>> _endConsonantTable;
 extern vector<Uint16> _standaloneWbad;
 extern vector<vector<Uint16>> _doubleWAllowed;
 
-extern map<Uint32, vector<Uint16>> _codeTable[];
+/*
+ * Code tables are built at compile time and stay in read only memory.
+ * _codeTable[table][row][column]: each row is one key of _codeTableKey,
+ * columns are {CAPS_CHAR, NORMAL_CHAR, ...} like the comment in Vietnamese.cpp
+ */
+#define CODE_TABLE_COUNT                        5
+#define CODE_TABLE_ROW_COUNT                    13
+#define CODE_TABLE_COLUMN_COUNT                 14
+#define CODE_TABLE_BASE_COUNT                   7 //A, O, U, E, D, I, Y
+#define CODE_TABLE_NOT_FOUND                    0xFF
+#define CODE_TABLE_HASH_SIZE                    512 //power of 2, more than 2 times the characters of one table
+
+struct vCodeTableIndex {
+    Uint8 rowOrder[CODE_TABLE_ROW_COUNT]; //rows sorted by key
+    Uint8 base[256]; //key code -> base character, CODE_TABLE_NOT_FOUND if it doesn't have a row
+    Uint8 mark[32]; //(data & MARK_MASK) >> 19 -> 0: no mark, 1..5: MARK1..MARK5
+    Uint8 row[CODE_TABLE_BASE_COUNT][3]; //[base][no tone, TONE_MASK, TONEW_MASK] -> row
+    Uint16 character[CODE_TABLE_COUNT][CODE_TABLE_BASE_COUNT][3][6][2]; //[table][base][tone][mark][caps], 0: not found
+    
+    //reverse index: character of a table -> row, column (open addressing, hashRow is CODE_TABLE_NOT_FOUND for empty slots)
+    Uint16 hashCharacter[CODE_TABLE_COUNT][CODE_TABLE_HASH_SIZE];
+    Uint8 hashRow[CODE_TABLE_COUNT][CODE_TABLE_HASH_SIZE];
+    Uint8 hashColumn[CODE_TABLE_COUNT][CODE_TABLE_HASH_SIZE];
+    Uint16 hashCase[CODE_TABLE_COUNT][CODE_TABLE_HASH_SIZE][2]; //[table][slot][upper case] -> the character of the slot in that case
+    bool letterKey[256]; //key code -> it's a letter, CAPS_MASK is its case
+};
+
+extern const Uint16 _codeTable[CODE_TABLE_COUNT][CODE_TABLE_ROW_COUNT][CODE_TABLE_COLUMN_COUNT];
+extern const Uint32 _codeTableKey[CODE_TABLE_ROW_COUNT];
+extern const Uint8 _codeTableRowSize[CODE_TABLE_ROW_COUNT];
+extern const vCodeTableIndex _codeTableIndex;
 extern Uint16 _unicodeCompoundMark[];
 
+/**
+ * Find @character in _codeTable[@table], same result as checking rows by _codeTableIndex.rowOrder
+ * and columns from left to right. Packed characters (VNI, CP1258, Unicode Compound) are one Uint16 like in _codeTable
+ */
+bool findCodeTableCharacter(const Uint16& character, const int& table, int& row, int& column);
+
+/**
+ * Upper or lower case of @character of _codeTable[@table] (packed like findCodeTableCharacter)
+ * or of an ASCII letter, other characters don't change. Title case is the upper case of the first
+ * letter. It's one lookup and doesn't depend on the locale like towupper/towlower
+ */
+Uint16 getCharacterCase(const Uint16& character, const int& table, const bool& upperCase);
+
+/**
+ * Same for engine data: a key code with CAPS_MASK or a character of _codeTable[@table] with
+ * CHAR_CODE_MASK (macro data). Pure characters don't change
+ */
+Uint32 getKeyCodeCase(const Uint32& data, const int& table, const bool& upperCase);
+
 extern map<Uint32, vector<Uint16>> _quickTelex;
 extern map<Uint16, vector<Uint16>> _quickStartConsonant;
 extern map<Uint16, vector<Uint16>> _quickEndConsonant;
 
+/*
+ * Spelling automaton: _consonantTable, _vowelCombine and _endConsonantTable compiled to
+ * tries with dense transitions, so checkSpelling() makes one transition for each key
+ * instead of scanning every row. Built once by initSpellingAutomaton().
+ */
+#define SPELLING_SYMBOL_COUNT                   64
+#define SPELLING_NO_SYMBOL                      0 //transition of symbol 0 is always dead
+#define SPELLING_DEAD                           0xFFFF
+#define SPELLING_NO_ROW                         0xFF
+#define SPELLING_NUCLEUS_END                    1 //a row ends here
+#define SPELLING_NUCLEUS_END_ALLOW              2 //a row which can have end consonant ends here
+#define SPELLING_NUCLEUS_SUBTREE                4 //a row ends here or after this node
+#define SPELLING_NUCLEUS_SUBTREE_ALLOW          8
+
+struct vSpellingTrie {
+    vector<Uint16> next; //next[node * SPELLING_SYMBOL_COUNT + symbol], SPELLING_DEAD if no transition
+    vector<Uint8> data; //data of each node
+};
+
+extern Uint8 _spellingSymbol[256][4]; //[key code][TONE_MASK: 1, TONEW_MASK: 2] -> symbol
+extern vSpellingTrie _spellingOnset[4]; //[quickStartConsonant | allowConsonantZFWJ << 1], data: row in _consonantTable
+extern vSpellingTrie _spellingCoda[2]; //[quickEndConsonant]
+extern vSpellingTrie _spellingNucleus; //data: SPELLING_NUCLEUS_* flags
+extern Uint16 _spellingNucleusRoot[256]; //first vowel -> root node in _spellingNucleus
+void initSpellingAutomaton();
+
 // Character to KeyCode mapping (for convert tool)
 extern map<Uint32, Uint32> _characterMap;
 extern map<Uint32, Uint32> _keyCodeToChar;
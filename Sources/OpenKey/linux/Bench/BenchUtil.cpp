@@ -0,0 +1,35 @@
+//
+//  BenchUtil.cpp
+//  OpenKey
+//
+//  Documents and timers shared by the Linux benchmarks.
+//
+
+#include "BenchUtil.h"
+
+const char* VIETNAMESE_TEXT =
+    "Tiếng Việt là ngôn ngữ của người Việt và là ngôn ngữ chính thức tại Việt Nam. "
+    "Đây là tiếng mẹ đẻ của khoảng 85% dân cư Việt Nam, cùng với hơn 4 triệu người Việt hải ngoại.\n";
+
+const char* MIXED_TEXT =
+    "The quick brown fox jumps over the lazy dog, then writes some plain ASCII source code:\n"
+    "    for (int i = 0; i < data.size(); i++) { outData.push_back(data[i]); } // Việt Nam\n"
+    "Release notes: fixed typing in Chrome and Firefox, see issue #123 (lỗi gõ dấu).\n";
+
+const char* ASCII_TEXT =
+    "The quick brown fox jumps over the lazy dog. Pack my box with five dozen liquor jugs!\n";
+
+string makeDocument(const char* text, const size_t& size) {
+    string document, line = text;
+    while (document.size() < size)
+        document += line;
+    return document;
+}
+
+Uint64 nowNs() {
+    return (Uint64)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double elapsedMs(const chrono::steady_clock::time_point& start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,41 @@
+//
+//  BenchUtil.h
+//  OpenKey
+//
+//  Documents and timers shared by the Linux benchmarks.
+//
+
+#ifndef BenchUtil_h
+#define BenchUtil_h
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../../engine/DataType.h"
+
+using namespace std;
+
+extern const char* VIETNAMESE_TEXT;
+extern const char* MIXED_TEXT; //about 85% ASCII, like source code or English documents with some Vietnamese
+extern const char* ASCII_TEXT;
+
+/**
+ * @text repeated until the document has at least @size bytes
+ */
+string makeDocument(const char* text, const size_t& size);
+
+Uint64 nowNs();
+double elapsedMs(const chrono::steady_clock::time_point& start);
+
+/**
+ * Value at @p (0..1) of @samples, which are reordered
+ */
+template<class T>
+double percentile(vector<T>& samples, const double& p) {
+    size_t n = (size_t)(p * (samples.size() - 1));
+    nth_element(samples.begin(), samples.begin() + n, samples.end());
+    return samples[n];
+}
+
+#endif /* BenchUtil_h */
@@ -0,0 +1,116 @@
+//
+//  ConvertBench.cpp
+//  OpenKey
+//
+//  Throughput of convertUtil on mixed (mostly ASCII), Vietnamese and ASCII documents,
+//  and detectConvertCode on the same documents in each code table.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../../engine/Engine.h"
+#include "BenchUtil.h"
+
+using namespace std;
+
+struct vConvertCase {
+    const char* name;
+    Uint8 fromCode;
+    Uint8 toCode;
+    bool capsEachWord;
+};
+
+static const char* CODE_TABLE_NAMES[CODE_TABLE_COUNT] = { "unicode", "tcvn3", "vni", "unicode_compound", "cp1258" };
+
+static const vConvertCase CONVERT_CASES[] = {
+    { "unicode_to_vni", 0, 2, false },
+    { "unicode_to_tcvn3_caps_each_word", 0, 1, true },
+    { "vni_to_unicode", 2, 0, false },
+};
+
+static void setOptions(const vConvertCase& convertCase, const Uint8& fromCode) {
+    convertToolFromCode = fromCode;
+    convertToolToCode = convertCase.toCode;
+    convertToolToCapsEachWord = convertCase.capsEachWord;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --size MB        size of each document (default 8)\n"
+            "  --rounds N       best of N rounds (default 3)\n",
+            name);
+}
+
+int main(int argc, char** argv) {
+    int sizeMb = 8, rounds = 3;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--size" && hasValue) sizeMb = atoi(argv[++i]);
+        else if (arg == "--rounds" && hasValue) rounds = atoi(argv[++i]);
+        else { usage(argv[0]); return 1; }
+    }
+    vKeyInit();
+
+    vector<pair<string, string>> documents;
+    documents.push_back(make_pair(string("mixed"), makeDocument(MIXED_TEXT, (size_t)sizeMb << 20)));
+    documents.push_back(make_pair(string("vietnamese"), makeDocument(VIETNAMESE_TEXT, (size_t)sizeMb << 20)));
+    documents.push_back(make_pair(string("ascii"), makeDocument(ASCII_TEXT, (size_t)sizeMb << 20)));
+
+    const size_t caseCount = sizeof(CONVERT_CASES) / sizeof(CONVERT_CASES[0]);
+    printf("{\n");
+    printf("  \"benchmark\": \"convert\",\n");
+    printf("  \"commit\": \"%s\",\n", BENCH_COMMIT);
+    printf("  \"rounds\": %d,\n", rounds);
+    printf("  \"results\": [\n");
+    for (size_t d = 0; d < documents.size(); d++) {
+        for (size_t c = 0; c < caseCount; c++) {
+            const vConvertCase& convertCase = CONVERT_CASES[c];
+            //source document in the source code table
+            setOptions(convertCase, 0);
+            convertToolToCode = convertCase.fromCode;
+            convertToolToCapsEachWord = false;
+            string source = convertCase.fromCode == 0 ? documents[d].second : convertUtil(documents[d].second);
+            setOptions(convertCase, convertCase.fromCode);
+
+            double best = 1e18;
+            size_t outputSize = 0;
+            for (int r = 0; r < rounds; r++) {
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                outputSize = convertUtil(source).size();
+                best = min(best, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+            }
+            printf("    { \"document\": \"%s\", \"conversion\": \"%s\", \"bytes\": %zu, \"output_bytes\": %zu, \"ms\": %.1f, \"mb_per_sec\": %.0f }%s\n",
+                   documents[d].first.c_str(), convertCase.name, source.size(), outputSize, best, source.size() / best / 1000.0,
+                   d + 1 < documents.size() || c + 1 < caseCount ? "," : "");
+        }
+    }
+    printf("  ],\n");
+
+    //detection of each table, ASCII documents are the same in all tables
+    printf("  \"detection\": [\n");
+    const int detectRounds = 100;
+    for (size_t d = 0; d < 2; d++) {
+        for (int code = 0; code < CODE_TABLE_COUNT; code++) {
+            convertToolFromCode = 0;
+            convertToolToCode = (Uint8)code;
+            convertToolToCapsEachWord = false;
+            string source = code == 0 ? documents[d].second : convertUtil(documents[d].second);
+            int confidence = 0;
+            Uint8 detected = 0;
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for (int r = 0; r < detectRounds; r++)
+                detected = detectConvertCode(source.data(), source.size(), &confidence);
+            double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / detectRounds;
+            printf("    { \"document\": \"%s\", \"code_table\": \"%s\", \"bytes\": %zu, \"detected\": \"%s\", \"confidence\": %d, \"us\": %.1f }%s\n",
+                   documents[d].first.c_str(), CODE_TABLE_NAMES[code], source.size(), CODE_TABLE_NAMES[detected], confidence, us,
+                   d + 1 < 2 || code + 1 < CODE_TABLE_COUNT ? "," : "");
+        }
+    }
+    printf("  ]\n}\n");
+    return 0;
+}
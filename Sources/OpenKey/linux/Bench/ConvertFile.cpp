@@ -0,0 +1,132 @@
+//
+//  ConvertFile.cpp
+//  OpenKey
+//
+//  Convert a UTF-8 file between Vietnamese code tables with the streaming
+//  converter (beginConvert/convertChunk), memory doesn't depend on file size.
+//  With --threads, each chunk is converted by convertChunkParallel. With --format,
+//  HTML/RTF documents are converted by convertMarkupChunk (only text runs).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../../engine/Engine.h"
+
+using namespace std;
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [options] INPUT OUTPUT     (- is stdin/stdout)\n"
+            "  --from N         source code table: 0 Unicode, 1 TCVN3, 2 VNI, 3 Unicode Compound, 4 CP1258\n"
+            "  --to N           target code table (default 0)\n"
+            "  --caps           all caps\n"
+            "  --lower          all non caps\n"
+            "  --caps-first     caps first letter of sentences\n"
+            "  --caps-each      caps first letter of words\n"
+            "  --remove-mark    remove tone and mark\n"
+            "  --chunk N        bytes read each time (default 65536, 16MB with --threads)\n"
+            "  --threads N      convert each chunk with N threads, 0: all cores (default 1)\n"
+            "  --format F       text (default), html, cf_html (clipboard \"HTML Format\") or rtf\n"
+            "  --stats          print size and time to stderr\n",
+            name);
+}
+
+int main(int argc, char** argv) {
+    size_t chunkSize = 0;
+    int threadCount = 1;
+    int format = -1; //plain text
+    bool stats = false;
+    vector<string> paths;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--from" && hasValue) convertToolFromCode = (Uint8)atoi(argv[++i]);
+        else if (arg == "--to" && hasValue) convertToolToCode = (Uint8)atoi(argv[++i]);
+        else if (arg == "--caps") convertToolToAllCaps = true;
+        else if (arg == "--lower") convertToolToAllNonCaps = true;
+        else if (arg == "--caps-first") convertToolToCapsFirstLetter = true;
+        else if (arg == "--caps-each") convertToolToCapsEachWord = true;
+        else if (arg == "--remove-mark") convertToolRemoveMark = true;
+        else if (arg == "--chunk" && hasValue) chunkSize = (size_t)atol(argv[++i]);
+        else if (arg == "--threads" && hasValue) threadCount = atoi(argv[++i]);
+        else if (arg == "--format" && hasValue) {
+            string name = argv[++i];
+            if (name == "html") format = vMarkupHtml;
+            else if (name == "cf_html") format = vMarkupClipboardHtml;
+            else if (name == "rtf") format = vMarkupRtf;
+            else if (name != "text") { usage(argv[0]); return 1; }
+        }
+        else if (arg == "--stats") stats = true;
+        else if (arg.size() > 1 && arg[0] == '-') { usage(argv[0]); return 1; }
+        else paths.push_back(arg);
+    }
+    if (chunkSize == 0)
+        chunkSize = threadCount == 1 ? 65536 : 16 << 20;
+    if (paths.size() != 2 || (format >= 0 && threadCount != 1) || convertToolFromCode >= CODE_TABLE_COUNT || convertToolToCode >= CODE_TABLE_COUNT) {
+        usage(argv[0]);
+        return 1;
+    }
+    vKeyInit(); //tables of --remove-mark
+
+    FILE* input = paths[0] == "-" ? stdin : fopen(paths[0].c_str(), "rb");
+    if (input == NULL) {
+        fprintf(stderr, "can't read %s\n", paths[0].c_str());
+        return 1;
+    }
+    FILE* output = paths[1] == "-" ? stdout : fopen(paths[1].c_str(), format == vMarkupClipboardHtml ? "w+b" : "wb");
+    if (output == NULL) {
+        fprintf(stderr, "can't write %s\n", paths[1].c_str());
+        return 1;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vConvertState state;
+    vMarkupConvertState markupState;
+    beginConvert(state);
+    if (format >= 0)
+        beginMarkupConvert(markupState, (Uint8)format);
+    vector<char> buffer(chunkSize);
+    string converted;
+    size_t inputSize = 0, outputSize = 0, size;
+    bool last = false;
+    while (!last) {
+        size = fread(buffer.data(), 1, chunkSize, input);
+        last = size < chunkSize;
+        if (format >= 0)
+            convertMarkupChunk(markupState, buffer.data(), size, converted, last);
+        else if (threadCount == 1)
+            convertChunk(state, buffer.data(), size, converted, last);
+        else
+            convertChunkParallel(state, buffer.data(), size, converted, last, threadCount);
+        if (fwrite(converted.data(), 1, converted.size(), output) != converted.size()) {
+            fprintf(stderr, "can't write %s\n", paths[1].c_str());
+            return 1;
+        }
+        inputSize += size;
+        outputSize += converted.size();
+    }
+    bool ok = !ferror(input);
+    //offsets of "HTML Format" header, it's at the beginning of output
+    if (format == vMarkupClipboardHtml && output != stdout) {
+        char header[1024];
+        size_t headerSize = min(outputSize, sizeof(header));
+        ok = ok && fseek(output, 0, SEEK_SET) == 0 && fread(header, 1, headerSize, output) == headerSize;
+        ok = ok && updateMarkupHeader(markupState, header, headerSize);
+        ok = ok && fseek(output, 0, SEEK_SET) == 0 && fwrite(header, 1, headerSize, output) == headerSize;
+    }
+    if (input != stdin)
+        fclose(input);
+    if (output != stdout)
+        ok = fclose(output) == 0 && ok;
+    else
+        ok = fflush(output) == 0 && ok;
+
+    if (stats) {
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        fprintf(stderr, "%zu bytes -> %zu bytes in %.1f ms (%.0f MB/s)\n", inputSize, outputSize, ms, inputSize / ms / 1000.0);
+    }
+    return ok ? 0 : 1;
+}
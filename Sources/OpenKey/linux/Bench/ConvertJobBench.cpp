@@ -0,0 +1,220 @@
+//
+//  ConvertJobBench.cpp
+//  OpenKey
+//
+//  Keystroke latency while a big clipboard is converted. A producer thread posts a key
+//  every few milliseconds to the keystroke thread, like the keyboard hook; the quick
+//  convert hotkey is one of these keys. Latency is measured from posting a key to the end
+//  of vKeyHandleEvent for keys posted while the document is converted:
+//    idle      no conversion
+//    sync      convertUtil on the keystroke thread (quick convert before conversion jobs)
+//    async     a conversion job, which copies the clipboard on its worker thread
+//  then a job is cancelled to measure how long it takes to stop.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../../engine/Engine.h"
+#include "BenchUtil.h"
+
+using namespace std;
+
+#ifndef BENCH_COMMIT
+#define BENCH_COMMIT ""
+#endif
+
+//time before the hotkey, and after the conversion
+#define JOB_BENCH_MARGIN_MS 200
+//time between the hotkey and cancelConvertJob
+#define JOB_BENCH_CANCEL_MS 50
+
+static const char* TELEX_TEXT = "tieesng vieejt laf ngoon ngwx cura ngwowfi vieejt ";
+
+enum JobBenchScenario {
+    JobBenchIdle = 0,
+    JobBenchSync,
+    JobBenchAsync,
+    JobBenchCancel
+};
+
+static const char* _scenarioName[] = { "idle", "sync", "async", "cancel" };
+
+struct JobBenchKey {
+    Uint16 keyCode;
+    Uint8 caps;
+};
+
+struct JobBenchResult {
+    size_t keys = 0;
+    double p50 = 0, p99 = 0, max = 0; //microseconds
+    double convertMs = 0; //hotkey to the end of conversion
+    double cancelMs = 0; //cancelConvertJob to completion callback
+    size_t progressCalls = 0;
+};
+
+static void makeKeys(const char* text, vector<JobBenchKey>& keys) {
+    for (const char* c = text; *c; c++) {
+        if (_characterMap.find((Uint8)*c) != _characterMap.end()) {
+            Uint32 data = _characterMap[(Uint8)*c];
+            keys.push_back({ (Uint16)(data & 0xFFFF), (Uint8)((data & CAPS_MASK) ? 1 : 0) });
+        }
+    }
+}
+
+//keys posted by the producer thread
+static mutex _queueLock;
+static condition_variable _queueChanged;
+static deque<Uint64> _queue;
+static atomic<bool> _stop;
+
+static atomic<Uint64> _convertEnd;
+static atomic<size_t> _progressCalls;
+
+static void postKeys(const int intervalMs) {
+    Uint64 start = nowNs();
+    for (Uint64 i = 0; !_stop; i++) {
+        this_thread::sleep_until(chrono::steady_clock::time_point(chrono::nanoseconds(start + i * intervalMs * 1000000ULL)));
+        {
+            lock_guard<mutex> lock(_queueLock);
+            _queue.push_back(nowNs());
+        }
+        _queueChanged.notify_one();
+    }
+}
+
+static void loadClipboard(vConvertJob& job, void* context) {
+    addConvertJobDocument(job, *(const string*)context, CONVERT_JOB_TEXT);
+}
+
+static void onJobProgress(vConvertJob& job, const size_t& processed, const size_t& total, void* context) {
+    _progressCalls++;
+}
+
+static void onJobCompleted(vConvertJob& job, void* context) {
+    _convertEnd = nowNs();
+}
+
+static JobBenchResult runScenario(const int& scenario, const string& document, const vector<JobBenchKey>& keys, const int& intervalMs) {
+    JobBenchResult result;
+    vEngineContext ctx;
+    vLoadEngineConfig(ctx.config);
+    vKeyInit(ctx);
+
+    _queue.clear();
+    _stop = false;
+    _convertEnd = 0;
+    _progressCalls = 0;
+    thread producer(postKeys, intervalMs);
+
+    vector<pair<Uint64, double>> samples; //posted, latency
+    shared_ptr<vConvertJob> job;
+    Uint64 start = nowNs(), hotKey = 0, cancel = 0, posted;
+    size_t keyIndex = 0;
+    while (true) {
+        {
+            unique_lock<mutex> lock(_queueLock);
+            _queueChanged.wait(lock, [] { return !_queue.empty(); });
+            posted = _queue.front();
+            _queue.pop_front();
+        }
+        if (hotKey == 0 && posted - start >= JOB_BENCH_MARGIN_MS * 1000000ULL) {
+            hotKey = posted;
+            if (scenario == JobBenchSync) {
+                string converted = convertUtil(document);
+                _convertEnd = nowNs();
+            } else if (scenario == JobBenchAsync || scenario == JobBenchCancel) {
+                job = createConvertJob();
+                startConvertJob(job, loadClipboard, onJobProgress, onJobCompleted, (void*)&document);
+            } else {
+                _convertEnd = hotKey + 1000000000ULL;
+            }
+        } else {
+            const JobBenchKey& key = keys[keyIndex++ % keys.size()];
+            vKeyHandleEvent(ctx, vKeyEvent::Keyboard, vKeyEventState::KeyDown, key.keyCode, key.caps);
+            samples.push_back(make_pair(posted, (nowNs() - posted) / 1000.0));
+        }
+        if (scenario == JobBenchCancel && hotKey && cancel == 0 && _convertEnd == 0 && posted - hotKey >= JOB_BENCH_CANCEL_MS * 1000000ULL) {
+            cancel = nowNs();
+            cancelConvertJob(*job);
+        }
+        if (_convertEnd && posted > _convertEnd + JOB_BENCH_MARGIN_MS * 1000000ULL)
+            break;
+    }
+    _stop = true;
+    producer.join();
+
+    vector<double> latency;
+    for (const pair<Uint64, double>& sample : samples) {
+        if (sample.first >= hotKey && sample.first <= _convertEnd)
+            latency.push_back(sample.second);
+    }
+    result.keys = latency.size();
+    if (!latency.empty()) {
+        result.max = *max_element(latency.begin(), latency.end());
+        result.p50 = percentile(latency, 0.5);
+        result.p99 = percentile(latency, 0.99);
+    }
+    if (scenario != JobBenchIdle)
+        result.convertMs = (_convertEnd - hotKey) / 1e6;
+    if (job && job->status == vConvertJobCancelled)
+        result.cancelMs = (_convertEnd - cancel) / 1e6;
+    result.progressCalls = _progressCalls;
+    return result;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --size MB        size of the clipboard (default 50)\n"
+            "  --interval MS    time between keys (default 5)\n",
+            name);
+}
+
+int main(int argc, char** argv) {
+    int sizeMb = 50, intervalMs = 5;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--size" && hasValue) sizeMb = atoi(argv[++i]);
+        else if (arg == "--interval" && hasValue) intervalMs = atoi(argv[++i]);
+        else { usage(argv[0]); return 1; }
+    }
+    if (sizeMb <= 0 || intervalMs <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    vKeyInit();
+
+    string document = makeDocument(VIETNAMESE_TEXT, (size_t)sizeMb << 20);
+    vector<JobBenchKey> keys;
+    makeKeys(TELEX_TEXT, keys);
+
+    //Unicode to VNI Windows
+    convertToolFromCode = 0;
+    convertToolToCode = 2;
+
+    printf("{\n");
+    printf("  \"benchmark\": \"convert_job\",\n");
+    printf("  \"commit\": \"%s\",\n", BENCH_COMMIT);
+    printf("  \"bytes\": %zu,\n", document.size());
+    printf("  \"interval_ms\": %d,\n", intervalMs);
+    printf("  \"results\": [\n");
+    for (int scenario = JobBenchIdle; scenario <= JobBenchCancel; scenario++) {
+        JobBenchResult result = runScenario(scenario, document, keys, intervalMs);
+        printf("    { \"scenario\": \"%s\", \"keys\": %zu, \"p50_us\": %.0f, \"p99_us\": %.0f, \"max_us\": %.0f, "
+               "\"convert_ms\": %.1f, \"cancel_ms\": %.1f, \"progress_calls\": %zu }%s\n",
+               _scenarioName[scenario], result.keys, result.p50, result.p99, result.max,
+               result.convertMs, result.cancelMs, result.progressCalls, scenario < JobBenchCancel ? "," : "");
+    }
+    printf("  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,424 @@
+//
+//  EngineBench.cpp
+//  OpenKey
+//
+//  Headless keystroke replay benchmark for the engine.
+//  Replays synthetic or recorded keystroke streams through vKeyHandleEvent
+//  for every input type and code table, and prints the result as JSON.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../../engine/Engine.h"
+#include "BenchUtil.h"
+
+using namespace std;
+
+static const char* _inputTypeName[] = { "Telex", "VNI", "SimpleTelex1", "SimpleTelex2" };
+static const char* _codeTableName[] = { "Unicode", "TCVN3", "VNI", "UnicodeCompound", "CP1258" };
+
+#ifndef BENCH_COMMIT
+#define BENCH_COMMIT ""
+#endif
+
+//backspace in a keystroke stream
+#define BENCH_BACKSPACE '\b'
+
+/**
+ * Sample text typed with Telex, the tone key is always at the end of a word
+ * so that it can be translated to VNI.
+ */
+static const char* _telexCorpus =
+    "Tieengs Vieetj laf ngoon ngwx cuar nguwowfi Vieetj vaf laf ngoon ngwx chinhs thwcs tai Vieetj Nam. "
+    "Ddaay laf tieengs mej ddeer cuar khoangr chins mwowi phaafn traem daan soos Vieetj Nam, "
+    "cungf vowis hown boons trieeuj nguwowfi Vieetj ddinhj cuw owr nuwowcs ngoaif. "
+    "Tieengs Vieetj cos nhieeuf tuwf vay muwownj tuwf tieengs Hans vaf tieengs Phaps. "
+    "Chuwx vieets tieengs Vieetj hieenj nay duwngf chuwx caais Latinh goij laf chuwx Quoocs ngwx, "
+    "cungf caac daaus thanh ddeer vieets. "
+    "Hoom nay tooi ddi hocj vaf gawpj nhieeuf banj bef, chungs tooi cungf nhau ddocj sachs trong thuw vieenj. "
+    "Thowif tieets hoom nay raats ddepj, trowif xanh, naawngs vangf vaf gios nhej thoir qua thaanhf phoos. "
+    "Khuyeens khichs moij nguwowfi giuwx gifn suwj trong sangs cuar tieengs Vieetj. ";
+
+/**
+ * Convert telex words to VNI
+ */
+static string telexToVni(const string& telex) {
+    string result;
+    size_t i = 0;
+    while (i < telex.size()) {
+        size_t end = i;
+        while (end < telex.size() && isalpha((unsigned char)telex[end])) end++;
+        if (end == i) {
+            result += telex[i++];
+            continue;
+        }
+        string word = telex.substr(i, end - i), out;
+        char toneKey = 0;
+        const char* tones = "sfrxj";
+        if (word.size() > 1 && strchr(tones, tolower(word.back())) && strpbrk(word.substr(0, word.size() - 1).c_str(), "aeiouyAEIOUY")) {
+            toneKey = (char)('1' + (strchr(tones, tolower(word.back())) - tones));
+            word.pop_back();
+        }
+        for (size_t j = 0; j < word.size(); j++) {
+            char c = word[j], next = j + 1 < word.size() ? (char)tolower(word[j + 1]) : 0;
+            char lc = (char)tolower(c);
+            out += c;
+            if ((lc == 'a' || lc == 'e' || lc == 'o') && next == lc) {
+                out += '6'; j++;
+            } else if (lc == 'd' && next == 'd') {
+                out += '9'; j++;
+            } else if (lc == 'a' && next == 'w') {
+                out += '8'; j++;
+            } else if ((lc == 'o' || lc == 'u') && next == 'w') {
+                out += '7'; j++;
+            } else if (lc == 'w') { //standalone w = ư
+                out.back() = c == 'W' ? 'U' : 'u';
+                out += '7';
+            }
+        }
+        if (toneKey) out += toneKey;
+        result += out;
+        i = end;
+    }
+    return result;
+}
+
+/**
+ * Simple Telex doesn't have standalone w, so type uw instead
+ */
+static string telexToSimpleTelex(const string& telex) {
+    string result;
+    for (size_t i = 0; i < telex.size(); i++) {
+        char c = telex[i];
+        char prev = i > 0 ? (char)tolower(telex[i - 1]) : 0;
+        if ((c == 'w' || c == 'W') && prev != 'u' && prev != 'o' && prev != 'a') {
+            result += c == 'W' ? 'U' : 'u';
+            result += 'w';
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+/**
+ * Add some typing errors: a random key followed by backspace, with a fixed seed
+ */
+static string addTypingErrors(const string& text, const int& errorPercent, const unsigned& seed) {
+    string result;
+    srand(seed);
+    for (char c : text) {
+        if (isalpha((unsigned char)c) && rand() % 100 < errorPercent) {
+            result += (char)('a' + rand() % 26);
+            result += BENCH_BACKSPACE;
+        }
+        result += c;
+    }
+    return result;
+}
+
+/**
+ * Recorded stream: a text file, one character for each key, 0x08 is backspace.
+ * Characters which don't have a key code are skipped.
+ */
+static bool loadStream(const string& path, string& stream) {
+    ifstream file(path.c_str(), ios::binary);
+    if (!file.is_open())
+        return false;
+    stringstream buffer;
+    buffer << file.rdbuf();
+    stream = buffer.str();
+    return true;
+}
+
+struct BenchKey {
+    Uint16 keyCode;
+    Uint8 caps;
+};
+
+static void makeKeys(const string& stream, vector<BenchKey>& keys) {
+    keys.clear();
+    for (char c : stream) {
+        if (c == BENCH_BACKSPACE) {
+            keys.push_back({ KEY_DELETE, 0 });
+        } else if (c == '\n') {
+            keys.push_back({ KEY_ENTER, 0 });
+        } else if (_characterMap.find((Uint8)c) != _characterMap.end()) {
+            Uint32 data = _characterMap[(Uint8)c];
+            keys.push_back({ (Uint16)(data & 0xFFFF), (Uint8)((data & CAPS_MASK) ? 1 : 0) });
+        }
+    }
+}
+
+struct BenchResult {
+    int inputType;
+    int codeTable;
+    size_t keys;
+    double keysPerSec;
+    double p50, p99, p999, max;
+    size_t historyBytes;
+    vOutputStats output;
+};
+
+static BenchResult runBench(const int& inputType, const int& codeTable, const vector<BenchKey>& keys, const int& rounds) {
+    BenchResult result;
+    result.inputType = inputType;
+    result.codeTable = codeTable;
+    result.keys = keys.size() * rounds;
+
+    vInputType = inputType;
+    vCodeTable = codeTable;
+    onTableCodeChange();
+
+    vEngineContext ctx;
+    vLoadEngineConfig(ctx.config);
+    vKeyInit(ctx);
+
+    //warm up
+    for (const BenchKey& key : keys)
+        vKeyHandleEvent(ctx, vKeyEvent::Keyboard, vKeyEventState::KeyDown, key.keyCode, key.caps);
+
+    //throughput, without per key timer
+    startNewSession(ctx);
+    Uint64 start = nowNs();
+    for (int r = 0; r < rounds; r++) {
+        for (const BenchKey& key : keys)
+            vKeyHandleEvent(ctx, vKeyEvent::Keyboard, vKeyEventState::KeyDown, key.keyCode, key.caps);
+    }
+    Uint64 total = nowNs() - start;
+    result.keysPerSec = total ? result.keys * 1e9 / total : 0;
+
+    result.output = ctx.outputStats;
+
+    //latency of each key
+    vector<Uint32> samples;
+    samples.reserve(result.keys);
+    startNewSession(ctx);
+    for (int r = 0; r < rounds; r++) {
+        for (const BenchKey& key : keys) {
+            Uint64 t = nowNs();
+            vKeyHandleEvent(ctx, vKeyEvent::Keyboard, vKeyEventState::KeyDown, key.keyCode, key.caps);
+            samples.push_back((Uint32)(nowNs() - t));
+        }
+    }
+    result.max = *max_element(samples.begin(), samples.end());
+    result.p50 = percentile(samples, 0.5);
+    result.p99 = percentile(samples, 0.99);
+    result.p999 = percentile(samples, 0.999);
+    result.historyBytes = vGetTypingHistoryMemory(ctx);
+    return result;
+}
+
+/**
+ * Cases of --check: keys typed with Telex ('<' is backspace) and the text on screen after them,
+ * with spell checking and restore of wrong spelling
+ */
+struct TypingCase {
+    const char* keys;
+    const char* screen;
+};
+
+static const TypingCase _typingCases[] = {
+    { "tieesng ", "tiếng " },
+    { "tieengs< ", "tiến " },
+    { "thisiss<<i ", "thisii " },
+    //longer than MAX_BUFF: backspace keeps the keys of the characters left, restore sends the whole word
+    { "thisisaverylongidentifiernameforthetestcase<<<<<<<<<<<<<<<<<<<<f ", "thisisaverylongidentifif " },
+    { "thisisaverylongidentifiernameforthetestcase<<<<<<<<<<<<< ", "thisisaverylongidentifiernamef " },
+    { "thisisxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx ", "thisisxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx " },
+    { "thisisxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx.", "thisisxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx." },
+};
+
+static void pushScreenCharacter(wstring& screen, const Uint32& data) {
+    screen.push_back(data & CHAR_CODE_MASK ? (wchar_t)(data & CHAR_MASK) : (wchar_t)keyCodeToCharacter(data));
+}
+
+/**
+ * Type @keys and apply HookState like the main program does with Unicode
+ */
+static string typeKeys(vEngineContext& ctx, const string& keys) {
+    vKeyHookState& state = ctx.HookState;
+    wstring screen;
+    for (char c : keys) {
+        Uint32 data = c == '<' ? KEY_DELETE : _characterMap[(Uint8)c];
+        Uint16 keyCode = (Uint16)(data & 0xFFFF);
+        Uint8 caps = (data & CAPS_MASK) ? 1 : 0;
+        vKeyHandleEvent(ctx, vKeyEvent::Keyboard, vKeyEventState::KeyDown, keyCode, caps);
+        if (state.code == vDoNothing) {
+            if (keyCode != KEY_DELETE)
+                screen.push_back((wchar_t)c);
+            else if (!screen.empty())
+                screen.pop_back();
+            continue;
+        }
+        screen.resize(screen.size() > state.backspaceCount ? screen.size() - state.backspaceCount : 0);
+        if (state.code == vReplaceMaro) {
+            for (Uint32 cell : state.macroData)
+                pushScreenCharacter(screen, cell);
+        } else {
+            for (int i = state.newCharCount - 1; i >= 0; i--)
+                pushScreenCharacter(screen, state.charData[i]);
+        }
+        if (state.code != vWillProcess) //the key is sent after the new characters
+            screen.push_back((wchar_t)c);
+    }
+    return wideStringToUtf8(screen);
+}
+
+static int checkTyping() {
+    int failCount = 0;
+    vInputType = 0;
+    vCodeTable = 0;
+    onTableCodeChange();
+    vEngineContext ctx;
+    vLoadEngineConfig(ctx.config);
+    ctx.config.checkSpelling = 1;
+    ctx.config.restoreIfWrongSpelling = 1;
+    ctx.config.useMacro = 0;
+    vKeyInit(ctx);
+    for (const TypingCase& typingCase : _typingCases) {
+        startNewSession(ctx);
+        string screen = typeKeys(ctx, typingCase.keys);
+        if (screen != typingCase.screen) {
+            printf("FAIL %s: \"%s\", expected \"%s\"\n", typingCase.keys, screen.c_str(), typingCase.screen);
+            failCount++;
+        }
+    }
+    printf("%s typing: %d of %zu cases\n", failCount ? "FAIL" : "ok  ", (int)(sizeof(_typingCases) / sizeof(_typingCases[0])) - failCount,
+           sizeof(_typingCases) / sizeof(_typingCases[0]));
+    return failCount ? 1 : 0;
+}
+
+static string readFirstLine(const char* path) {
+    ifstream file(path);
+    string line;
+    if (file.is_open())
+        getline(file, line);
+    return line;
+}
+
+static void loadDefaultMacros() {
+    const char* macros[][2] = {
+        { "btw", "by the way" }, { "ko", "không" }, { "vn", "Việt Nam" }, { "dc", "được" }, { "hn", "Hà Nội" }
+    };
+    for (auto& macro : macros)
+        addMacro(macro[0], macro[1]);
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --rounds N       replay each stream N times (default 200)\n"
+            "  --input FILE     replay a recorded Telex stream instead of the built-in text\n"
+            "  --input-vni FILE recorded stream for VNI\n"
+            "  --errors N       percent of keys followed by a typo + backspace (default 3)\n"
+            "  --cpu N          pin the benchmark to CPU N\n"
+            "  --output FILE    write JSON to FILE instead of stdout\n"
+            "  --check          type the regression cases and compare the text on screen\n",
+            name);
+}
+
+int main(int argc, char** argv) {
+    int rounds = 200, errorPercent = 3, cpu = -1;
+    bool check = false;
+    string inputPath, inputVniPath, outputPath;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--rounds" && hasValue) rounds = atoi(argv[++i]);
+        else if (arg == "--input" && hasValue) inputPath = argv[++i];
+        else if (arg == "--input-vni" && hasValue) inputVniPath = argv[++i];
+        else if (arg == "--errors" && hasValue) errorPercent = atoi(argv[++i]);
+        else if (arg == "--cpu" && hasValue) cpu = atoi(argv[++i]);
+        else if (arg == "--output" && hasValue) outputPath = argv[++i];
+        else if (arg == "--check") check = true;
+        else { usage(argv[0]); return 1; }
+    }
+    if (rounds < 1) rounds = 1;
+    if (check) {
+        vKeyInit();
+        return checkTyping();
+    }
+
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0)
+            fprintf(stderr, "warning: can't pin to cpu %d\n", cpu);
+    }
+    string governor = readFirstLine(cpu >= 0 ?
+                                    ("/sys/devices/system/cpu/cpu" + to_string(cpu) + "/cpufreq/scaling_governor").c_str() :
+                                    "/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor");
+    if (governor != "performance")
+        fprintf(stderr, "warning: cpu governor is '%s', results may not be comparable (use 'performance')\n",
+                governor.empty() ? "unknown" : governor.c_str());
+
+    vKeyInit();
+    loadDefaultMacros();
+
+    string telex = _telexCorpus;
+    if (!inputPath.empty() && !loadStream(inputPath, telex)) {
+        fprintf(stderr, "can't read %s\n", inputPath.c_str());
+        return 1;
+    }
+    string vni = telexToVni(telex);
+    if (!inputVniPath.empty() && !loadStream(inputVniPath, vni)) {
+        fprintf(stderr, "can't read %s\n", inputVniPath.c_str());
+        return 1;
+    }
+    string simpleTelex = telexToSimpleTelex(telex);
+    string streams[4] = {
+        addTypingErrors(telex, errorPercent, 1),
+        addTypingErrors(vni, errorPercent, 1),
+        addTypingErrors(simpleTelex, errorPercent, 1),
+        addTypingErrors(simpleTelex, errorPercent, 1)
+    };
+
+    vector<BenchResult> results;
+    vector<BenchKey> keys;
+    for (int inputType = 0; inputType < 4; inputType++) {
+        makeKeys(streams[inputType], keys);
+        if (keys.empty())
+            continue;
+        for (int codeTable = 0; codeTable < 5; codeTable++)
+            results.push_back(runBench(inputType, codeTable, keys, rounds));
+    }
+
+    FILE* out = stdout;
+    if (!outputPath.empty() && (out = fopen(outputPath.c_str(), "w")) == NULL) {
+        fprintf(stderr, "can't write %s\n", outputPath.c_str());
+        return 1;
+    }
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"engine\",\n");
+    fprintf(out, "  \"commit\": \"%s\",\n", BENCH_COMMIT);
+    fprintf(out, "  \"rounds\": %d,\n", rounds);
+    fprintf(out, "  \"error_percent\": %d,\n", errorPercent);
+    fprintf(out, "  \"cpu\": %d,\n", cpu);
+    fprintf(out, "  \"cpu_governor\": \"%s\",\n", governor.c_str());
+    fprintf(out, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        fprintf(out, "    { \"input_type\": \"%s\", \"code_table\": \"%s\", \"keys\": %zu, \"keys_per_sec\": %.0f, "
+                     "\"p50_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f, \"max_ns\": %.0f, \"history_bytes\": %zu, "
+                     "\"backspaces\": %llu, \"new_chars\": %llu, \"saved_backspaces\": %llu, \"saved_chars\": %llu }%s\n",
+                _inputTypeName[r.inputType], _codeTableName[r.codeTable], r.keys, r.keysPerSec,
+                r.p50, r.p99, r.p999, r.max, r.historyBytes,
+                (unsigned long long)r.output.backspaceCount, (unsigned long long)r.output.newCharCount,
+                (unsigned long long)r.output.savedBackspaceCount, (unsigned long long)r.output.savedCharCount, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
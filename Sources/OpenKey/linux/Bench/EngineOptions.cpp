@@ -0,0 +1,29 @@
+//
+//  EngineOptions.cpp
+//  OpenKey
+//
+//  Engine options for the Linux tools, normally defined by the platform app.
+//
+
+int vLanguage = 1;
+int vInputType = 0;
+int vFreeMark = 0;
+int vCodeTable = 0;
+int vSwitchKeyStatus = 0;
+int vCheckSpelling = 1;
+int vUseModernOrthography = 1;
+int vQuickTelex = 0;
+int vRestoreIfWrongSpelling = 1;
+int vFixRecommendBrowser = 0;
+int vUseMacro = 1;
+int vUseMacroInEnglishMode = 1;
+int vAutoCapsMacro = 0;
+int vUseSmartSwitchKey = 0;
+int vUpperCaseFirstChar = 0;
+int vTempOffSpelling = 0;
+int vAllowConsonantZFWJ = 0;
+int vQuickStartConsonant = 0;
+int vQuickEndConsonant = 0;
+int vRememberCode = 0;
+int vOtherLanguage = 0;
+int vTempOffOpenKey = 0;
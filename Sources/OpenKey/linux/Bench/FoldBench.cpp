@@ -0,0 +1,96 @@
+//
+//  FoldBench.cpp
+//  OpenKey
+//
+//  Throughput of foldChunk (accent insensitive folding) in GB/s on mixed (mostly ASCII),
+//  Vietnamese (precomposed and compound) and ASCII documents, with and without case folding.
+//  convertUtil with convertToolRemoveMark (Unicode to Unicode) is measured as the baseline.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../../engine/Engine.h"
+#include "BenchUtil.h"
+
+using namespace std;
+
+#ifndef BENCH_COMMIT
+#define BENCH_COMMIT ""
+#endif
+
+enum FoldBenchCase {
+    FoldBenchFold = 0,
+    FoldBenchCaseFold,
+    FoldBenchConvertRemoveMark
+};
+
+static const char* _caseName[] = { "fold", "fold_case", "convert_remove_mark" };
+
+static size_t runCase(const int& foldCase, const string& source, vector<char>& output) {
+    if (foldCase == FoldBenchConvertRemoveMark)
+        return convertUtil(source).size();
+    vFoldState state;
+    beginFold(state, foldCase == FoldBenchCaseFold);
+    return foldChunk(state, source.data(), source.size(), output.data(), true);
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --size MB        size of each document (default 64)\n"
+            "  --rounds N       best of N rounds (default 5)\n",
+            name);
+}
+
+int main(int argc, char** argv) {
+    int sizeMb = 64, rounds = 5;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--size" && hasValue) sizeMb = atoi(argv[++i]);
+        else if (arg == "--rounds" && hasValue) rounds = atoi(argv[++i]);
+        else { usage(argv[0]); return 1; }
+    }
+    if (sizeMb <= 0 || rounds <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    vKeyInit();
+
+    vector<pair<string, string>> documents;
+    documents.push_back(make_pair(string("mixed"), makeDocument(MIXED_TEXT, (size_t)sizeMb << 20)));
+    documents.push_back(make_pair(string("vietnamese"), makeDocument(VIETNAMESE_TEXT, (size_t)sizeMb << 20)));
+    documents.push_back(make_pair(string("ascii"), makeDocument(ASCII_TEXT, (size_t)sizeMb << 20)));
+    convertToolFromCode = 0;
+    convertToolToCode = 3; //Unicode Compound
+    documents.push_back(make_pair(string("vietnamese_compound"), convertUtil(documents[1].second)));
+
+    printf("{\n");
+    printf("  \"benchmark\": \"fold\",\n");
+    printf("  \"commit\": \"%s\",\n", BENCH_COMMIT);
+    printf("  \"rounds\": %d,\n", rounds);
+    printf("  \"results\": [\n");
+    for (size_t d = 0; d < documents.size(); d++) {
+        const string& source = documents[d].second;
+        vector<char> output(FOLD_CAPACITY(source.size()));
+        for (int foldCase = FoldBenchFold; foldCase <= FoldBenchConvertRemoveMark; foldCase++) {
+            convertToolFromCode = convertToolToCode = 0;
+            convertToolRemoveMark = true;
+            double best = 1e18;
+            size_t outputSize = 0;
+            for (int r = 0; r < (foldCase == FoldBenchConvertRemoveMark ? 1 : rounds); r++) {
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                outputSize = runCase(foldCase, source, output);
+                best = min(best, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+            }
+            printf("    { \"document\": \"%s\", \"case\": \"%s\", \"bytes\": %zu, \"output_bytes\": %zu, \"ms\": %.2f, \"gb_per_sec\": %.2f }%s\n",
+                   documents[d].first.c_str(), _caseName[foldCase], source.size(), outputSize, best, source.size() / best / 1e6,
+                   d + 1 < documents.size() || foldCase < FoldBenchConvertRemoveMark ? "," : "");
+        }
+    }
+    printf("  ]\n}\n");
+    return 0;
+}
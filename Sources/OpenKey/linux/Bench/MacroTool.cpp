@@ -0,0 +1,504 @@
+//
+//  MacroTool.cpp
+//  OpenKey
+//
+//  Convert macro data to the macro library format (engine/MacroLibrary.h),
+//  and measure the startup time and memory of both formats, import/export of UniKey files
+//  and macro changes sent from another process (engine/MacroChange.h).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../../engine/Engine.h"
+#include "../../engine/Macro.h"
+#include "../../engine/MacroLibrary.h"
+#include "../../engine/MacroChange.h"
+#include "BenchUtil.h"
+
+using namespace std;
+
+static bool readFile(const string& path, vector<Byte>& data) {
+    ifstream file(path.c_str(), ios::binary);
+    if (!file.is_open())
+        return false;
+    stringstream buffer;
+    buffer << file.rdbuf();
+    string str = buffer.str();
+    data.assign(str.begin(), str.end());
+    return true;
+}
+
+static bool writeFile(const string& path, const vector<Byte>& data) {
+    ofstream file(path.c_str(), ios::binary);
+    if (!file.is_open())
+        return false;
+    file.write((const char*)data.data(), data.size());
+    return file.good();
+}
+
+static void printMemoryUsage(const char* name, const vMacroMemoryUsage& usage) {
+    printf("  \"%s\": { \"macros\": %zu, \"contents\": %zu, \"key_bytes\": %zu, \"text_bytes\": %zu, \"content_bytes\": %zu, "
+           "\"free_bytes\": %zu, \"macro_bytes\": %zu, \"trie_bytes\": %zu, \"cache_bytes\": %zu, \"library_bytes\": %zu, \"total_bytes\": %zu },\n",
+           name, usage.macroCount, usage.contentCount, usage.keyBytes, usage.textBytes, usage.contentBytes,
+           usage.freeBytes, usage.macroBytes, usage.trieBytes, usage.cacheBytes, usage.libraryBytes, usage.totalBytes);
+}
+
+/**
+ * Time of findMacro() for the key of each macro typed in Title case (auto caps),
+ * @hits: macros which are found with the content in Title case. The first round makes
+ * Title/UPPER content of each macro, @cachedUs is the time of the next rounds
+ */
+static double autoCapsLookupUs(const int& count, int& hits, double& cachedUs) {
+    const int rounds = 5;
+    vector<vector<Uint32>> keys(count);
+    vector<Uint32> key, caseNodes(count);
+    vector<Uint32> content;
+    string text;
+    for (int i = 0; i < count; i++) {
+        text = "M" + to_string(i);
+        for (size_t c = 0; c < text.size(); c++)
+            keys[i].push_back(_characterMap[(Uint8)text[c]]);
+        //the engine walks the key in lower case while typing, see matchMacroKey()
+        caseNodes[i] = MACRO_TRIE_ROOT;
+        for (size_t c = 0; c < keys[i].size(); c++)
+            caseNodes[i] = nextMacroNode(caseNodes[i], getKeyCodeCase(keys[i][c], MACRO_KEY_CODE_TABLE, false));
+    }
+    hits = 0;
+    double firstUs = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < count; i++) {
+            key = keys[i]; //findMacro changes the key to lower case
+            if (findMacro(key, MACRO_TRIE_DEAD, caseNodes[i], vCodeTable, true, content) && content.size() > 0 && (content[0] & CAPS_MASK) && r == 0)
+                hits++;
+        }
+        if (r == 0) {
+            firstUs = elapsedMs(start) * 1000.0 / count;
+            start = chrono::steady_clock::now();
+        }
+    }
+    cachedUs = elapsedMs(start) * 1000.0 / count / (rounds - 1);
+    return firstUs;
+}
+
+/**
+ * Saved data (initMacroMap format) of @count generated macros, return the number of macros
+ */
+static int makeMacroData(const int& count, vector<Byte>& data) {
+    vector<string> macroTexts, macroContents;
+    for (int i = 0; i < count; i++) {
+        macroTexts.push_back("m" + to_string(i));
+        macroContents.push_back("nội dung của macro số " + to_string(i));
+    }
+    Uint16 total = (Uint16)(count > 0xFFFF ? 0xFFFF : count); //the old format has 2 bytes count
+    data.push_back((Byte)total);
+    data.push_back((Byte)(total >> 8));
+    for (int i = 0; i < total; i++) {
+        data.push_back((Byte)macroTexts[i].size());
+        data.insert(data.end(), macroTexts[i].begin(), macroTexts[i].end());
+        data.push_back((Byte)macroContents[i].size());
+        data.push_back((Byte)(macroContents[i].size() >> 8));
+        data.insert(data.end(), macroContents[i].begin(), macroContents[i].end());
+    }
+    return total;
+}
+
+/**
+ * Startup time of initMacroMap() and initMacroLibrary() with @count generated macros,
+ * and auto caps lookups of both formats
+ */
+static int bench(const int& count) {
+    vector<Byte> data;
+    const int total = makeMacroData(count, data);
+
+    vector<Byte> library;
+    convertMacroDataToLibrary(data.data(), (int)data.size(), library);
+    const char* path = "macro_bench.okm";
+    if (!writeFile(path, library)) {
+        fprintf(stderr, "can't write %s\n", path);
+        return 1;
+    }
+
+    int mapHits, libraryHits;
+    double mapAutoCapsUs, libraryAutoCapsUs;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    initMacroMap(data.data(), (int)data.size());
+    double mapMs = elapsedMs(start);
+    vMacroMemoryUsage mapUsage, libraryUsage;
+    getMacroMemoryUsage(mapUsage);
+    double mapAutoCapsFirstUs = autoCapsLookupUs(total, mapHits, mapAutoCapsUs);
+
+    //switch to TCVN3 and back, like focus switches between apps with vRememberCode
+    const int switches = 10;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < switches; i++) {
+        vCodeTable = 1 - vCodeTable;
+        onTableCodeChange();
+    }
+    double tableSwitchMs = elapsedMs(start) / switches;
+    initMacroMap(NULL, 0); //don't count the time to free macroMap
+
+    start = chrono::steady_clock::now();
+    bool opened = initMacroLibrary(path);
+    double libraryMs = elapsedMs(start);
+
+    start = chrono::steady_clock::now();
+    bool found = hasMacro("m" + to_string(total - 1));
+    double lookupMs = elapsedMs(start);
+    double libraryAutoCapsFirstUs = autoCapsLookupUs(total, libraryHits, libraryAutoCapsUs);
+    getMacroMemoryUsage(libraryUsage);
+    remove(path);
+    bool ok = opened && found && mapHits == total && libraryHits == total;
+
+    printf("{\n");
+    printf("  \"macros\": %d,\n", total);
+    printf("  \"data_bytes\": %zu,\n", data.size());
+    printf("  \"library_bytes\": %zu,\n", library.size());
+    printf("  \"init_macro_map_ms\": %.3f,\n", mapMs);
+    printf("  \"init_macro_library_ms\": %.3f,\n", libraryMs);
+    printf("  \"first_lookup_ms\": %.3f,\n", lookupMs);
+    printMemoryUsage("memory_map", mapUsage);
+    printMemoryUsage("memory_library", libraryUsage); //after auto caps lookup of all macros
+    printf("  \"auto_caps_macro_map_first_us\": %.3f,\n", mapAutoCapsFirstUs);
+    printf("  \"auto_caps_macro_map_us\": %.3f,\n", mapAutoCapsUs);
+    printf("  \"table_switch_ms\": %.3f,\n", tableSwitchMs);
+    printf("  \"auto_caps_macro_library_first_us\": %.3f,\n", libraryAutoCapsFirstUs);
+    printf("  \"auto_caps_macro_library_us\": %.3f,\n", libraryAutoCapsUs);
+    printf("  \"ok\": %s\n", ok ? "true" : "false");
+    printf("}\n");
+    return ok ? 0 : 1;
+}
+
+static int info(const string& path) {
+    vMacroLibrary library;
+    if (!openMacroLibrary(library, path)) {
+        fprintf(stderr, "%s is not a macro library\n", path.c_str());
+        return 1;
+    }
+    const vMacroLibraryHeader& header = *library.header;
+    printf("version %d, platform %d, code table %d, flags %d\n", header.version, header.platform, header.codeTable, header.flags);
+    printf("%u macros, %u trie nodes, %u edge slots, %u bytes\n", header.macroCount, header.nodeCount, header.edgeSlotCount, header.fileSize);
+    string macroText, macroContent;
+    for (Uint32 i = 0; i < header.macroCount && i < 10; i++) {
+        if (getMacroLibraryText(library, i, macroText, macroContent))
+            printf("  %s:%s\n", macroText.c_str(), macroContent.c_str());
+    }
+    closeMacroLibrary(library);
+    return 0;
+}
+
+/**
+ * Import (readFromFile) and export (saveToFile) a UniKey macro file with @count macros,
+ * 1 of 10 lines repeats an earlier name. Per line import (hasMacro and addMacro), which
+ * readFromFile did before, is measured as the baseline
+ */
+static int benchImport(const int& count) {
+    vector<string> macroTexts, macroContents;
+    string text = ";Compatible OpenKey Macro Data file for UniKey*** version=1 ***\n";
+    for (int i = 0; i < count; i++) {
+        macroTexts.push_back("m" + to_string(i % 10 == 9 ? i / 2 : i));
+        macroContents.push_back("nội dung của macro số " + to_string(i));
+        text += macroTexts.back() + ":" + macroContents.back() + "\n";
+    }
+    const char* path = "macro_bench.txt";
+    const char* savePath = "macro_bench_save.txt";
+    if (!writeFile(path, vector<Byte>(text.begin(), text.end()))) {
+        fprintf(stderr, "can't write %s\n", path);
+        return 1;
+    }
+
+    initMacroMap(NULL, 0);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        if (!hasMacro(macroTexts[i]))
+            addMacro(macroTexts[i], macroContents[i]);
+    }
+    double perLineMs = elapsedMs(start);
+    vector<Byte> perLineData, data;
+    getMacroSaveData(perLineData);
+
+    initMacroMap(NULL, 0);
+    start = chrono::steady_clock::now();
+    readFromFile(path, false);
+    double importMs = elapsedMs(start);
+    getMacroSaveData(data);
+
+    start = chrono::steady_clock::now();
+    saveToFile(savePath);
+    double exportMs = elapsedMs(start);
+    vector<Byte> saved;
+    bool ok = readFile(savePath, saved) && data == perLineData;
+    remove(path);
+    remove(savePath);
+
+    printf("{\n");
+    printf("  \"lines\": %d,\n", count);
+    printf("  \"file_bytes\": %zu,\n", text.size());
+    printf("  \"per_line_import_ms\": %.3f,\n", perLineMs);
+    printf("  \"import_ms\": %.3f,\n", importMs);
+    printf("  \"export_ms\": %.3f,\n", exportMs);
+    printf("  \"export_bytes\": %zu,\n", saved.size());
+    printf("  \"ok\": %s\n", ok ? "true" : "false");
+    printf("}\n");
+    return ok ? 0 : 1;
+}
+
+static bool writeAll(const int& fd, const Byte* data, const size_t& size) {
+    for (size_t done = 0; done < size; ) {
+        ssize_t n = write(fd, data + done, size - done);
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+static bool readAll(const int& fd, Byte* data, const size_t& size) {
+    for (size_t done = 0; done < size; ) {
+        ssize_t n = read(fd, data + done, size - done);
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+/**
+ * Read one change data (getMacroChanges) from a stream, false at the end of stream
+ */
+static bool readMacroChangeData(const int& fd, vector<Byte>& data) {
+    data.resize(8);
+    if (!readAll(fd, data.data(), 8))
+        return false;
+    size_t size = getMacroChangeDataSize(data.data(), 8);
+    if (size == 0)
+        return false;
+    data.resize(size);
+    return readAll(fd, data.data() + 8, size - 8);
+}
+
+struct SyncReply {
+    Byte applied; //0: version mismatch, macro data is reloaded from the saved file
+    double us;
+};
+
+/**
+ * Save macro data and its version, like OpenKeyHelper::saveMacroData() saves them to the registry
+ */
+static void saveSyncData(const char* savePath, const char* versionPath) {
+    vector<Byte> saveData, versionData;
+    getMacroSaveData(saveData);
+    writeFile(savePath, saveData);
+    getMacroVersionData(saveData.data(), saveData.size(), versionData);
+    writeFile(versionPath, versionData);
+}
+
+/**
+ * Load macro data and its version, like OpenKeyHelper::loadMacroData()
+ */
+static void loadSyncData(const char* savePath, const char* versionPath) {
+    vector<Byte> data, versionData;
+    readFile(savePath, data);
+    initMacroMap(data.data(), (int)data.size());
+    if (readFile(versionPath, versionData))
+        setMacroVersionData(versionData.data(), versionData.size());
+}
+
+/**
+ * Engine side of benchSync: start with macro @data, apply changes from @fd, reload @savePath on
+ * version mismatch like the main process reloads the registry. All macro data is sent back at the end
+ */
+static int syncEngine(const int& fd, const char* savePath, const char* versionPath, vector<Byte> data) {
+    vector<Byte> change;
+    initMacroMap(data.data(), (int)data.size());
+    while (readMacroChangeData(fd, change)) {
+        SyncReply reply;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        reply.applied = applyMacroChanges(change.data(), change.size());
+        if (!reply.applied)
+            loadSyncData(savePath, versionPath);
+        reply.us = elapsedMs(start) * 1000.0;
+        if (!writeAll(fd, (const Byte*)&reply, sizeof(reply)))
+            return 1;
+    }
+    vector<Byte> saveData;
+    getMacroSaveData(saveData);
+    Uint32 size = (Uint32)saveData.size();
+    return writeAll(fd, (const Byte*)&size, sizeof(size)) && writeAll(fd, saveData.data(), size) ? 0 : 1;
+}
+
+/**
+ * Macro dialog and engine in two processes with @count macros, connected by a local socket:
+ * the dialog adds, edits and deletes @edits macros, saves all macro data and its version to files
+ * (the registry) and sends the changes; the engine applies them. Half way, the dialog is opened
+ * again: it loads the saved data and version, so its first change is applied too. At the end the
+ * dialog loads other macro data, so the next change makes the engine reload. Reloading all macro
+ * data for each change, which the engine did before, is measured as the baseline
+ */
+static int benchSync(const int& count, const int& edits) {
+    vector<Byte> data;
+    makeMacroData(count, data);
+    const char* savePath = "macro_sync.dat";
+    const char* versionPath = "macro_sync.ver";
+    if (!writeFile(savePath, data)) {
+        fprintf(stderr, "can't write %s\n", savePath);
+        return 1;
+    }
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        perror("socketpair");
+        return 1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        _exit(syncEngine(fds[1], savePath, versionPath, data));
+    }
+    close(fds[1]);
+    const int fd = fds[0];
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    initMacroMap(data.data(), (int)data.size());
+    double fullReloadMs = elapsedMs(start);
+
+    vector<double> applyUs;
+    vector<Byte> change;
+    vMacroVersion version;
+    SyncReply reply;
+    size_t changeBytes = 0;
+    int applied = 0, reloads = 0;
+    double roundTripUs = 0, mismatchReloadMs = 0;
+    bool ok = true;
+    for (int i = 0; i <= edits && ok; i++) {
+        if (i == edits / 2) { //new dialog session
+            loadSyncData(savePath, versionPath);
+        } else if (i == edits) { //other macro data, ex: the dialog imported a file
+            vector<Byte> other;
+            makeMacroData(count / 2, other);
+            initMacroMap(other.data(), (int)other.size());
+        }
+        getMacroVersion(version);
+        if (i % 3 == 0)
+            addMacro("n" + to_string(i), "macro mới " + to_string(i));
+        else if (i % 3 == 1)
+            addMacro("m" + to_string(i * 7 % count), "sửa macro " + to_string(i));
+        else
+            deleteMacro("m" + to_string(i * 13 % count));
+        saveSyncData(savePath, versionPath);
+
+        start = chrono::steady_clock::now();
+        ok = getMacroChanges(version.sequence, change) && writeAll(fd, change.data(), change.size()) &&
+             readAll(fd, (Byte*)&reply, sizeof(reply));
+        if (!ok)
+            break;
+        if (reply.applied) {
+            applied++;
+            applyUs.push_back(reply.us);
+            roundTripUs += elapsedMs(start) * 1000.0;
+            changeBytes += change.size();
+        } else {
+            reloads++;
+            mismatchReloadMs = reply.us / 1000.0;
+        }
+    }
+    shutdown(fd, SHUT_WR);
+    Uint32 size = 0;
+    vector<Byte> engineData;
+    ok = ok && readAll(fd, (Byte*)&size, sizeof(size));
+    engineData.resize(size);
+    ok = ok && readAll(fd, engineData.data(), size);
+    close(fd);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    vector<Byte> saveData;
+    getMacroSaveData(saveData);
+    ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0 && engineData == saveData &&
+         applied == edits && reloads == 1 && !applyUs.empty();
+    remove(savePath);
+    remove(versionPath);
+
+    sort(applyUs.begin(), applyUs.end());
+    double applyTotalUs = 0;
+    for (size_t i = 0; i < applyUs.size(); i++)
+        applyTotalUs += applyUs[i];
+    printf("{\n");
+    printf("  \"macros\": %d,\n", count);
+    printf("  \"edits\": %d,\n", applied);
+    printf("  \"change_bytes\": %.1f,\n", applied ? (double)changeBytes / applied : 0.0);
+    printf("  \"apply_us\": %.3f,\n", applied ? applyTotalUs / applied : 0.0);
+    printf("  \"apply_p50_us\": %.3f,\n", applyUs.empty() ? 0.0 : applyUs[applyUs.size() / 2]);
+    printf("  \"apply_max_us\": %.3f,\n", applyUs.empty() ? 0.0 : applyUs.back());
+    printf("  \"round_trip_us\": %.3f,\n", applied ? roundTripUs / applied : 0.0);
+    printf("  \"full_reload_ms\": %.3f,\n", fullReloadMs);
+    printf("  \"mismatch_reload_ms\": %.3f,\n", mismatchReloadMs);
+    printf("  \"reloads\": %d,\n", reloads);
+    printf("  \"ok\": %s\n", ok ? "true" : "false");
+    printf("}\n");
+    return ok ? 0 : 1;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s command\n"
+            "  unikey FILE OUTPUT   convert UniKey macro file (readFromFile format) to macro library\n"
+            "  data FILE OUTPUT     convert saved macro data (initMacroMap format) to macro library\n"
+            "  info FILE            show macro library header and first macros\n"
+            "  bench N              startup, memory, auto caps lookup and code table switch time with N macros\n"
+            "  import N             import and export time of a UniKey macro file with N lines\n"
+            "  sync N [EDITS]       time of macro changes sent to another process with N macros (default 200 edits)\n",
+            name);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+    string command = argv[1];
+    vKeyInit();
+    if (command == "bench")
+        return bench(atoi(argv[2]));
+    if (command == "import")
+        return benchImport(atoi(argv[2]));
+    if (command == "sync")
+        return benchSync(atoi(argv[2]), argc > 3 ? atoi(argv[3]) : 200);
+    if (command == "info")
+        return info(argv[2]);
+    if (argc < 4) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    vector<Byte> library;
+    if (command == "unikey") {
+        if (!convertMacroFileToLibrary(argv[2], library)) {
+            fprintf(stderr, "can't read %s\n", argv[2]);
+            return 1;
+        }
+    } else if (command == "data") {
+        vector<Byte> data;
+        if (!readFile(argv[2], data)) {
+            fprintf(stderr, "can't read %s\n", argv[2]);
+            return 1;
+        }
+        convertMacroDataToLibrary(data.data(), (int)data.size(), library);
+    } else {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!writeFile(argv[3], library)) {
+        fprintf(stderr, "can't write %s\n", argv[3]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+//
+//  NormalizeText.cpp
+//  OpenKey
+//
+//  Normalize tone mark placement of a UTF-8 file to the modern (oà, uý) or old
+//  (òa, úy) style, chunk by chunk with beginNormalizeOrthography/normalizeOrthographyChunk.
+//  With --threads, each chunk is normalized by normalizeOrthographyChunkParallel.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../../engine/Orthography.h"
+
+using namespace std;
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [options] INPUT OUTPUT     (- is stdin/stdout)\n"
+            "  --modern         oà, uý (default)\n"
+            "  --old            òa, úy\n"
+            "  --chunk N        bytes read each time (default 65536, 16MB with --threads)\n"
+            "  --threads N      normalize each chunk with N threads, 0: all cores (default 1)\n"
+            "  --stats          print size, changed words and time to stderr\n",
+            name);
+}
+
+int main(int argc, char** argv) {
+    size_t chunkSize = 0;
+    int threadCount = 1;
+    bool modern = true, stats = false;
+    vector<string> paths;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--modern") modern = true;
+        else if (arg == "--old") modern = false;
+        else if (arg == "--chunk" && hasValue) chunkSize = (size_t)atol(argv[++i]);
+        else if (arg == "--threads" && hasValue) threadCount = atoi(argv[++i]);
+        else if (arg == "--stats") stats = true;
+        else if (arg.size() > 1 && arg[0] == '-') { usage(argv[0]); return 1; }
+        else paths.push_back(arg);
+    }
+    if (chunkSize == 0)
+        chunkSize = threadCount == 1 ? 65536 : 16 << 20;
+    if (paths.size() != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    vKeyInit();
+
+    FILE* input = paths[0] == "-" ? stdin : fopen(paths[0].c_str(), "rb");
+    if (input == NULL) {
+        fprintf(stderr, "can't read %s\n", paths[0].c_str());
+        return 1;
+    }
+    FILE* output = paths[1] == "-" ? stdout : fopen(paths[1].c_str(), "wb");
+    if (output == NULL) {
+        fprintf(stderr, "can't write %s\n", paths[1].c_str());
+        return 1;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vOrthographyState state;
+    beginNormalizeOrthography(state, modern);
+    vector<char> buffer(chunkSize);
+    string normalized;
+    size_t inputSize = 0, size;
+    bool last = false;
+    while (!last) {
+        size = fread(buffer.data(), 1, chunkSize, input);
+        last = size < chunkSize;
+        if (threadCount == 1)
+            normalizeOrthographyChunk(state, buffer.data(), size, normalized, last);
+        else
+            normalizeOrthographyChunkParallel(state, buffer.data(), size, normalized, last, threadCount);
+        if (fwrite(normalized.data(), 1, normalized.size(), output) != normalized.size()) {
+            fprintf(stderr, "can't write %s\n", paths[1].c_str());
+            return 1;
+        }
+        inputSize += size;
+    }
+    bool ok = !ferror(input);
+    if (input != stdin)
+        fclose(input);
+    if (output != stdout)
+        ok = fclose(output) == 0 && ok;
+    else
+        ok = fflush(output) == 0 && ok;
+
+    if (stats) {
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        fprintf(stderr, "%zu bytes, %zu words changed in %.1f ms (%.0f MB/s)\n", inputSize, state.changedWordCount, ms, inputSize / ms / 1000.0);
+    }
+    return ok ? 0 : 1;
+}
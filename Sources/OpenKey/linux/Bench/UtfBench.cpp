@@ -0,0 +1,155 @@
+//
+//  UtfBench.cpp
+//  OpenKey
+//
+//  Compare engine/Utf.h with std::wstring_convert<codecvt_utf8_utf16>, which
+//  was used by utf8ToWideString/wideStringToUtf8 before, on large documents.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <codecvt>
+#include <fstream>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../../engine/Utf.h"
+#include "BenchUtil.h"
+
+using namespace std;
+
+#define CHUNK_SIZE 65536
+
+struct Result {
+    double oldDecodeMs = 1e18, oldEncodeMs = 1e18;
+    double newDecodeMs = 1e18, newEncodeMs = 1e18;
+    double streamDecodeMs = 1e18, streamEncodeMs = 1e18;
+    bool same = true;
+};
+
+static void measure(const string& document, const int& rounds, Result& result) {
+    wstring_convert<codecvt_utf8_utf16<wchar_t>> converter;
+    vector<Uint16> units(UTF8_DECODE_CAPACITY(document.size()));
+    vector<char> bytes(UTF16_ENCODE_CAPACITY(units.size()));
+    vector<Uint16> chunkUnits(UTF8_DECODE_CAPACITY(CHUNK_SIZE));
+    vector<char> chunkBytes(UTF16_ENCODE_CAPACITY(CHUNK_SIZE));
+    wstring oldWide;
+    string oldBytes;
+    size_t unitCount = 0, byteCount = 0, streamUnitCount = 0, streamByteCount = 0;
+
+    for (int r = 0; r < rounds; r++) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        oldWide = converter.from_bytes(document);
+        result.oldDecodeMs = min(result.oldDecodeMs, elapsedMs(start));
+
+        start = chrono::steady_clock::now();
+        oldBytes = converter.to_bytes(oldWide);
+        result.oldEncodeMs = min(result.oldEncodeMs, elapsedMs(start));
+
+        //caller buffers, no allocation
+        start = chrono::steady_clock::now();
+        unitCount = utf8ToUtf16(document.data(), document.size(), units.data());
+        result.newDecodeMs = min(result.newDecodeMs, elapsedMs(start));
+
+        start = chrono::steady_clock::now();
+        byteCount = utf16ToUtf8(units.data(), unitCount, bytes.data());
+        result.newEncodeMs = min(result.newEncodeMs, elapsedMs(start));
+
+        //chunks of CHUNK_SIZE, like reading a file
+        vUtf8Decoder decoder;
+        streamUnitCount = 0;
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < document.size(); i += CHUNK_SIZE) {
+            size_t size = min((size_t)CHUNK_SIZE, document.size() - i);
+            streamUnitCount += utf8ToUtf16(decoder, document.data() + i, size, chunkUnits.data(), i + size == document.size());
+        }
+        result.streamDecodeMs = min(result.streamDecodeMs, elapsedMs(start));
+
+        vUtf16Encoder encoder;
+        streamByteCount = 0;
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < unitCount; i += CHUNK_SIZE) {
+            size_t size = min((size_t)CHUNK_SIZE, unitCount - i);
+            streamByteCount += utf16ToUtf8(encoder, units.data() + i, size, chunkBytes.data(), i + size == unitCount);
+        }
+        result.streamEncodeMs = min(result.streamEncodeMs, elapsedMs(start));
+    }
+
+    //same result as wstring_convert
+    if (oldWide.size() != unitCount || streamUnitCount != unitCount || streamByteCount != byteCount)
+        result.same = false;
+    for (size_t i = 0; result.same && i < unitCount; i++)
+        result.same = (Uint16)oldWide[i] == units[i];
+    result.same = result.same && oldBytes == string(bytes.data(), byteCount) && oldBytes == document;
+}
+
+static double mbPerSec(const size_t& size, const double& ms) {
+    return size / ms / 1000.0;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --size MB        size of generated documents (default 32)\n"
+            "  --input FILE     use a UTF-8 file instead of generated documents\n"
+            "  --rounds N       best of N rounds (default 5)\n",
+            name);
+}
+
+int main(int argc, char** argv) {
+    int sizeMb = 32, rounds = 5;
+    string inputPath;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--size" && hasValue) sizeMb = atoi(argv[++i]);
+        else if (arg == "--input" && hasValue) inputPath = argv[++i];
+        else if (arg == "--rounds" && hasValue) rounds = atoi(argv[++i]);
+        else { usage(argv[0]); return 1; }
+    }
+
+    vector<pair<string, string>> documents;
+    if (!inputPath.empty()) {
+        ifstream file(inputPath.c_str(), ios::binary);
+        if (!file.is_open()) {
+            fprintf(stderr, "can't read %s\n", inputPath.c_str());
+            return 1;
+        }
+        stringstream buffer;
+        buffer << file.rdbuf();
+        documents.push_back(make_pair(string("input"), buffer.str()));
+    } else {
+        documents.push_back(make_pair(string("vietnamese"), makeDocument(VIETNAMESE_TEXT, (size_t)sizeMb << 20)));
+        documents.push_back(make_pair(string("ascii"), makeDocument(ASCII_TEXT, (size_t)sizeMb << 20)));
+    }
+
+    bool allSame = true;
+    printf("{\n");
+    printf("  \"benchmark\": \"utf\",\n");
+    printf("  \"commit\": \"%s\",\n", BENCH_COMMIT);
+    printf("  \"rounds\": %d,\n", rounds);
+    printf("  \"results\": [\n");
+    for (size_t i = 0; i < documents.size(); i++) {
+        const string& document = documents[i].second;
+        Result result;
+        try {
+            measure(document, rounds, result);
+        } catch (const range_error&) { //wstring_convert throws with invalid data
+            result.same = false;
+        }
+        allSame = allSame && result.same;
+        printf("    { \"document\": \"%s\", \"bytes\": %zu, "
+               "\"wstring_convert_decode_mb_per_sec\": %.0f, \"wstring_convert_encode_mb_per_sec\": %.0f, "
+               "\"decode_mb_per_sec\": %.0f, \"encode_mb_per_sec\": %.0f, "
+               "\"stream_decode_mb_per_sec\": %.0f, \"stream_encode_mb_per_sec\": %.0f, \"same\": %s }%s\n",
+               documents[i].first.c_str(), document.size(),
+               mbPerSec(document.size(), result.oldDecodeMs), mbPerSec(document.size(), result.oldEncodeMs),
+               mbPerSec(document.size(), result.newDecodeMs), mbPerSec(document.size(), result.newEncodeMs),
+               mbPerSec(document.size(), result.streamDecodeMs), mbPerSec(document.size(), result.streamEncodeMs),
+               result.same ? "true" : "false", i + 1 < documents.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+    return allSame ? 0 : 1;
+}
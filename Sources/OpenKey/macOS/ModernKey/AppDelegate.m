@@ -462,11 +462,13 @@ extern bool convertToolDontAlertWhenCompleted;
 }
 
 -(void)onQuickConvert {
-    if ([OpenKeyManager quickConvert]) {
-        if (!convertToolDontAlertWhenCompleted) {
+    if (![OpenKeyManager quickConvert:^(BOOL cancelled) {
+        if (cancelled) {
+            [OpenKeyManager showMessage: nil message:@"Đã huỷ chuyển mã!" subMsg:@"Clipboard không bị thay đổi."];
+        } else if (!convertToolDontAlertWhenCompleted) {
             [OpenKeyManager showMessage: nil message:@"Chuyển mã thành công!" subMsg:@"Kết quả đã được lưu trong clipboard."];
         }
-    } else {
+    }]) {
         [OpenKeyManager showMessage: nil message:@"Không có dữ liệu trong clipboard!" subMsg:@"Hãy sao chép một đoạn text để chuyển đổi!"];
     }
 }
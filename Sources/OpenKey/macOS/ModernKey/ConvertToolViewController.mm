@@ -173,11 +173,13 @@ extern AppDelegate* appDelegate;
 }
 
 - (IBAction)onConvertButton:(id)sender {
-    if ([OpenKeyManager quickConvert]) {
-        if (!convertToolDontAlertWhenCompleted) {
+    if (![OpenKeyManager quickConvert:^(BOOL cancelled) {
+        if (cancelled) {
+            [OpenKeyManager showMessage: self.view.window message:@"Đã huỷ chuyển mã!" subMsg:@"Clipboard không bị thay đổi."];
+        } else if (!convertToolDontAlertWhenCompleted) {
             [OpenKeyManager showMessage: self.view.window message:@"Chuyển mã thành công!" subMsg:@"Kết quả đã được lưu trong clipboard."];
         }
-    } else {
+    }]) {
         [OpenKeyManager showMessage: self.view.window message:@"Không có dữ liệu trong clipboard!" subMsg:@"Hãy sao chép một đoạn text để chuyển đổi!"];
     }
 }
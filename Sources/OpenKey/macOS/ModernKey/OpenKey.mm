@@ -47,6 +47,59 @@ extern int vSendKeyStepByStep;
 extern int vFixChromiumBrowser;
 extern int vPerformLayoutCompat;
 
+typedef void (^ConvertCompletion)(BOOL cancelled, NSString* html, NSData* rtf, NSString* str);
+
+struct ConvertContext {
+    NSString* html;
+    NSData* rtf;
+    NSString* str;
+    ConvertCompletion completion;
+};
+
+//quick convert job, only used on main thread
+static shared_ptr<vConvertJob> _convertJob;
+
+static void loadConvertJob(vConvertJob& job, void* context) {
+    //worker thread: UTF-8 copies of a big pasteboard aren't made by main thread
+    ConvertContext* convert = (ConvertContext*)context;
+    @autoreleasepool {
+        if (convert->html != nil)
+            addConvertJobDocument(job, [convert->html UTF8String], vMarkupHtml);
+        if (convert->rtf != nil)
+            addConvertJobDocument(job, string((const char*)[convert->rtf bytes], [convert->rtf length]), vMarkupRtf);
+        if (convert->str != nil)
+            addConvertJobDocument(job, [convert->str UTF8String], CONVERT_JOB_TEXT);
+    }
+}
+
+static void onConvertJobCompleted(vConvertJob& job, void* context) {
+    //worker thread: the pasteboard is written on main thread
+    ConvertContext* convert = (ConvertContext*)context;
+    ConvertCompletion completion = convert->completion;
+    delete convert;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        shared_ptr<vConvertJob> convertJob = _convertJob;
+        _convertJob = NULL;
+        if (convertJob->status == vConvertJobCancelled) {
+            completion(YES, nil, nil, nil);
+            return;
+        }
+        if (convertJob->status != vConvertJobCompleted)
+            return;
+        NSString* html = nil, *str = nil;
+        NSData* rtf = nil;
+        for (const vConvertJobDocument& document : convertJob->documents) {
+            if (document.format == vMarkupHtml)
+                html = [[NSString alloc] initWithBytes:document.output.data() length:document.output.size() encoding:NSUTF8StringEncoding];
+            else if (document.format == vMarkupRtf)
+                rtf = [NSData dataWithBytes:document.output.data() length:document.output.size()];
+            else
+                str = [[NSString alloc] initWithBytes:document.output.data() length:document.output.size() encoding:NSUTF8StringEncoding];
+        }
+        completion(NO, html, rtf, str);
+    });
+}
+
 extern "C" {
     //app which must sent special empty character
     NSArray* _niceSpaceApp = @[@"com.sublimetext.3",
@@ -165,6 +218,25 @@ extern "C" {
         return [NSString stringWithUTF8String:convertUtil([str UTF8String]).c_str()];
     }
     
+    /**
+     * Convert on a worker thread, @completion is called on main thread when it's done or
+     * cancelled (all results are nil). Return NO if another conversion is running
+     */
+    BOOL ConvertAsync(NSString* html, NSData* rtf, NSString* str, ConvertCompletion completion) {
+        if (_convertJob)
+            return NO;
+        _convertJob = createConvertJob();
+        startConvertJob(_convertJob, loadConvertJob, NULL, onConvertJobCompleted, new ConvertContext{ html, rtf, str, completion });
+        return YES;
+    }
+    
+    BOOL CancelConvertAsync() {
+        if (!_convertJob)
+            return NO;
+        cancelConvertJob(*_convertJob);
+        return YES;
+    }
+    
     BOOL containUnicodeCompoundApp(NSString* topApp) {
         if (topApp == nil) return false;
         for (_j = 0; _j < [_unicodeCompoundApp count]; _j++) {
@@ -23,7 +23,7 @@ typedef void (^CheckNewVersionCallback)(void);
 +(NSString*)getBuildDate;
 +(void)showMessage:(NSWindow*)window message:(NSString*)msg subMsg:(NSString*)subMsg;
 
-+(BOOL)quickConvert;
++(BOOL)quickConvert:(void (^)(BOOL cancelled))completion; //completion is called on main thread, also when the conversion is cancelled
 
 +(void)checkNewVersion:(NSWindow*)parent callbackFunc:(CheckNewVersionCallback) callback;
 @end
@@ -16,6 +16,8 @@ extern CGEventRef OpenKeyCallback(CGEventTapProxy proxy,
                                   void *refcon);
 
 extern NSString* ConvertUtil(NSString* str);
+extern BOOL ConvertAsync(NSString* html, NSData* rtf, NSString* str, void (^completion)(BOOL cancelled, NSString* html, NSData* rtf, NSString* str));
+extern BOOL CancelConvertAsync(void);
 
 @interface OpenKeyManager ()
 
@@ -111,29 +113,33 @@ static CFRunLoopSourceRef runLoopSource;
 }
 
 #pragma mark -Convert feature
-+(BOOL)quickConvert {
++(BOOL)quickConvert:(void (^)(BOOL cancelled))completion {
+    //hotkey or button is pressed again while converting a big clipboard: cancel it,
+    //the completion of that conversion reports it
+    if (CancelConvertAsync())
+        return YES;
     NSPasteboard *pasteboard = [NSPasteboard generalPasteboard];
     NSString *htmlString = [pasteboard stringForType:NSPasteboardTypeHTML];
+    NSData *rtfData = [pasteboard dataForType:NSPasteboardTypeRTF];
     NSString *rawString = [pasteboard stringForType:NSPasteboardTypeString];
-    bool converted = false;
-    if (htmlString != nil) {
-        htmlString = ConvertUtil(htmlString);
-        converted = true;
-    }
-    if (rawString != nil) {
-        rawString = ConvertUtil(rawString);
-        converted = true;
-    }
-    if (converted) {
+    if (htmlString == nil && rtfData == nil && rawString == nil)
+        return NO;
+    //converted on a worker thread, so the event tap isn't blocked by a big clipboard
+    ConvertAsync(htmlString, rtfData, rawString, ^(BOOL cancelled, NSString* html, NSData* rtf, NSString* str) {
+        if (cancelled) {
+            completion(YES);
+            return;
+        }
         [pasteboard clearContents];
-        if (htmlString != nil)
-            [pasteboard setString:htmlString forType:NSPasteboardTypeHTML];
-        if (rawString != nil)
-            [pasteboard setString:rawString forType:NSPasteboardTypeString];
-        
-        return YES;
-    }
-    return NO;
+        if (html != nil)
+            [pasteboard setString:html forType:NSPasteboardTypeHTML];
+        if (rtf != nil)
+            [pasteboard setData:rtf forType:NSPasteboardTypeRTF];
+        if (str != nil)
+            [pasteboard setString:str forType:NSPasteboardTypeString];
+        completion(NO);
+    });
+    return YES;
 }
 
 +(void)showMessage:(NSWindow*)window message:(NSString*)msg subMsg:(NSString*)subMsg {
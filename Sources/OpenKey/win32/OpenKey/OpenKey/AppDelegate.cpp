@@ -331,14 +331,31 @@ void AppDelegate::onConvertTool() {
 	}
 }
 
-void AppDelegate::onQuickConvert() {
-	if (OpenKeyHelper::quickConvert()) {
-		//alert when complete
-		if (!convertToolDontAlertWhenCompleted) {
-			TCHAR msg[256];
-			LoadString(hInstance, IDS_STRING_CONVERT_COMPLETED, msg, 256);
-			MessageBox(NULL, msg, _T("OpenKey"), MB_OK);
-		}
+static void onQuickConvertJobCompleted(vConvertJob& job, void* context) {
+	//worker thread: it writes the clipboard too, main thread only alerts
+	BOOL written = OpenKeyHelper::writeQuickConvertJob(job);
+	PostMessage(FindWindow(APP_CLASS, NULL), WM_USER + 105, written, 0);
+}
+
+void AppDelegate::onQuickConvert(HWND owner) {
+	//hotkey is pressed again while converting a big clipboard: cancel it
+	if (quickConvertJob) {
+		cancelConvertJob(*quickConvertJob);
+		return;
+	}
+	//clipboard is read and converted on a worker thread, so the keyboard hook never waits for it
+	quickConvertOwner = owner;
+	quickConvertJob = createConvertJob();
+	startConvertJob(quickConvertJob, OpenKeyHelper::readQuickConvertJob, NULL, onQuickConvertJobCompleted, NULL);
+}
+
+void AppDelegate::onQuickConvertCompleted(const bool& written) {
+	quickConvertJob = NULL;
+	//alert when complete
+	if (written && !convertToolDontAlertWhenCompleted) {
+		TCHAR msg[256];
+		LoadString(hInstance, IDS_STRING_CONVERT_COMPLETED, msg, 256);
+		MessageBox(IsWindow(quickConvertOwner) ? quickConvertOwner : NULL, msg, _T("OpenKey"), MB_OK);
 	}
 }
 
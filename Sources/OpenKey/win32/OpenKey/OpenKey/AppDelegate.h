@@ -28,6 +28,8 @@ private:
 	BaseDialog* mainDialog = NULL, *macroDialog = NULL, *convertDialog = NULL, *excludedAppsDialog = NULL;
 	AboutDialog* aboutDialog = NULL; // Sciter window - managed separately
 	std::vector<HANDLE> m_childProcesses;  // Track subprocess handles for cleanup
+	shared_ptr<vConvertJob> quickConvertJob; // Running quick convert, NULL if there isn't any
+	HWND quickConvertOwner = NULL;
 private:
 	bool isDialogMsg(MSG & msg) const;
 	void checkUpdate();
@@ -54,7 +56,8 @@ public: //event
 
 	void onMacroTable();
 	void onConvertTool();
-	void onQuickConvert();
+	void onQuickConvert(HWND owner=NULL);
+	void onQuickConvertCompleted(const bool& written);
 	void onManageExcludedApps();
 	void onSpawnExcludedAppsSciter();  // Spawn excluded apps Sciter subprocess (called via IPC)
 
@@ -236,12 +236,6 @@ void ConvertToolDialog::onSwitchButton() {
 }
 
 void ConvertToolDialog::onConvertButton() {
-	if (OpenKeyHelper::quickConvert()) {
-		//alert when complete
-		if (!convertToolDontAlertWhenCompleted) {
-			TCHAR msg[256];
-			LoadString(hInstance, IDS_STRING_CONVERT_COMPLETED, msg, 256);
-			MessageBox(this->hDlg, msg, _T("OpenKey"), MB_OK);
-		}
-	}
+	//converted on a worker thread, AppDelegate alerts when it's completed
+	AppDelegate::getInstance()->onQuickConvert(this->hDlg);
 }
\ No newline at end of file
@@ -124,9 +124,7 @@ void MacroDialog::fillData() {
 
 void MacroDialog::saveAndReload() {
 	//save
-	vector<Byte> macroData;
-	getMacroSaveData(macroData);
-	OpenKeyHelper::setRegBinary(_T("macroData"), macroData.data(), (int)macroData.size());
+	OpenKeyHelper::saveMacroData();
 
 	//reload data
 	fillData();
@@ -14,6 +14,7 @@ redistribute your new version, it MUST be open source.
 #include "MacroDialogSciter.h"
 #include "stdafx.h"
 #include "OpenKeyHelper.h"
+#include "../../../engine/MacroChange.h"
 #include <commdlg.h>
 #include <dwmapi.h>
 #include <CommCtrl.h>
@@ -27,10 +28,8 @@ extern void getAllMacro(std::vector<std::vector<Uint32>>& keys, std::vector<std:
 extern bool addMacro(const std::string& macroName, const std::string& macroContent);
 extern bool deleteMacro(const std::string& macroName);
 extern bool hasMacro(const std::string& macroName);
-extern void getMacroSaveData(std::vector<Byte>& data);
 extern void readFromFile(const std::string& path, const bool& append);
 extern void saveToFile(const std::string& path);
-extern void initMacroMap(const Byte* pData, const int& size);
 
 // Helper function to convert UTF-8 to wide string
 extern std::wstring utf8ToWideString(const std::string& utf8str);
@@ -64,13 +63,11 @@ MacroDialogSciter::MacroDialogSciter()
 	: sciter::window(SW_POPUP | SW_ALPHA | SW_ENABLE_DEBUG, RECT{ 0, 0, 400, 600 }) {
 	
 	// Load macro data from registry BEFORE loading HTML (subprocess needs to init)
-	// NOTE: getRegBinary returns a static pointer - DO NOT delete[] it
-	DWORD macroDataSize = 0;
-	BYTE* macroData = OpenKeyHelper::getRegBinary(_T("macroData"), macroDataSize);
-	if (macroData && macroDataSize > 0) {
-		initMacroMap(macroData, (int)macroDataSize);
-		// Do NOT delete[] macroData - it's managed by OpenKeyHelper
-	}
+	// with its saved version, which main process has too, so the first save sends only the changes
+	OpenKeyHelper::loadMacroData();
+	vMacroVersion version;
+	getMacroVersion(version);
+	sentMacroSequence = version.sequence;
 	
 	// Load HTML
 #ifdef NDEBUG
@@ -363,16 +360,25 @@ void MacroDialogSciter::fillMacroList() {
 void MacroDialogSciter::saveAndReload() {
 
 	
-	// Save macros to registry
-	std::vector<Byte> macroData;
-	getMacroSaveData(macroData);
-	OpenKeyHelper::setRegBinary(_T("macroData"), macroData.data(), (int)macroData.size());
+	// Save macros and their version to registry
+	OpenKeyHelper::saveMacroData();
 	
-	// Notify main process to reload macros from registry
+	// Send the changes since last save to main process, it applies them to its macros.
+	// After an import they aren't kept, an empty change with the new version makes it reload registry
+	vMacroVersion version;
+	getMacroVersion(version);
+	std::vector<Byte> changeData;
+	if (!getMacroChanges(sentMacroSequence, changeData))
+		getMacroChanges(version.sequence, changeData);
+	sentMacroSequence = version.sequence;
+
 	HWND mainWnd = FindWindow(_T("OpenKeyVietnameseInputMethod"), NULL);
 	if (mainWnd) {
-		PostMessage(mainWnd, WM_USER + 101, 0, 0);
-
+		COPYDATASTRUCT copyData;
+		copyData.dwData = APP_COPYDATA_MACRO_CHANGES;
+		copyData.cbData = (DWORD)changeData.size();
+		copyData.lpData = changeData.data();
+		SendMessage(mainWnd, WM_COPYDATA, (WPARAM)get_hwnd(), (LPARAM)&copyData);
 	}
 	
 	// Reload list
@@ -36,6 +36,7 @@ private:
 	std::vector<std::vector<unsigned int>> keys;
 	std::vector<std::string> macroText;
 	std::vector<std::string> macroContent;
+	unsigned int sentMacroSequence; // version of macro data which main process has
 	
 	// UI helpers
 	void fillMacroList();
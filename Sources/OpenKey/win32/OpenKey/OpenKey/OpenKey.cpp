@@ -226,9 +226,7 @@ void OpenKeyInit() {
 	if (GetKeyState(VK_SCROLL) < 0) _flag |= MASK_SCROLL;
 
 	//init and load macro data
-	DWORD macroDataSize;
-	BYTE* macroData = OpenKeyHelper::getRegBinary(_T("macroData"), macroDataSize);
-	initMacroMap((Byte*)macroData, (int)macroDataSize);
+	OpenKeyHelper::loadMacroData();
 
 	//init and load smart switch key data
 	DWORD smartSwitchKeySize;
@@ -761,9 +759,11 @@ LRESULT CALLBACK keyboardHookProcess(int nCode, WPARAM wParam, LPARAM lParam) {
 					// Only apply fix for non-Qt/Electron apps
 					if (vFixChromiumBrowser && 
 						std::find(_chromiumBrowser.begin(), _chromiumBrowser.end(), currentApp) != _chromiumBrowser.end()) {
-						SendCombineKey(KEY_LEFT_SHIFT, KEY_LEFT, 0, KEYEVENTF_EXTENDEDKEY);
-						if (pData->backspaceCount == 1)
-							pData->backspaceCount--;
+						if (pData->backspaceCount > 0) {
+							SendCombineKey(KEY_LEFT_SHIFT, KEY_LEFT, 0, KEYEVENTF_EXTENDEDKEY);
+							if (pData->backspaceCount == 1)
+								pData->backspaceCount--;
+						}
 					} else {
 						SendEmptyCharacter();
 						pData->backspaceCount++;
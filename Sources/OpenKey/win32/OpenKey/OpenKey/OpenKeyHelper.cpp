@@ -12,11 +12,15 @@ You can fork, modify, improve this program. If you
 redistribute your new version, it MUST be open source.
 -----------------------------------------------------------*/
 #include "OpenKeyHelper.h"
+#include "../../../engine/MacroChange.h"
 #include <stdarg.h>
 #include <Urlmon.h>
 #include <fstream>
 #include <sstream>
 
+extern void initMacroMap(const Byte* pData, const int& size);
+extern void getMacroSaveData(std::vector<Byte>& data);
+
 #pragma comment(lib, "version.lib")
 #pragma comment(lib, "Urlmon.lib")
 
@@ -100,6 +104,35 @@ BYTE * OpenKeyHelper::getRegBinary(LPCTSTR key, DWORD& outSize) {
 	return _regData;
 }
 
+void OpenKeyHelper::saveMacroData() {
+	//macroVersion is saved with macroData, so a process which loads them has the version of this process
+	//and they send macro changes to each other without reloading all macro data
+	vector<Byte> macroData, versionData;
+	getMacroSaveData(macroData);
+	setRegBinary(_T("macroData"), macroData.data(), (int)macroData.size());
+	getMacroVersionData(macroData.data(), macroData.size(), versionData);
+	setRegBinary(_T("macroVersion"), versionData.data(), (int)versionData.size());
+}
+
+void OpenKeyHelper::loadMacroData() {
+	//getRegBinary() deletes the data of the last call, initMacroMap() copies it
+	DWORD size = 0;
+	BYTE* data = getRegBinary(_T("macroData"), size);
+	initMacroMap(data, data != NULL ? (int)size : 0);
+	data = getRegBinary(_T("macroVersion"), size);
+	if (data != NULL)
+		setMacroVersionData(data, size);
+}
+
+bool OpenKeyHelper::isMacroDataLoaded() {
+	DWORD size = 0;
+	BYTE* data = getRegBinary(_T("macroVersion"), size);
+	vMacroVersion saved, version;
+	getMacroVersion(version);
+	return data != NULL && readMacroVersionData(data, size, saved) &&
+		saved.generation == version.generation && saved.sequence == version.sequence;
+}
+
 void OpenKeyHelper::registerRunOnStartup(const int& val) {
 	if (val) {
 		if (vRunAsAdmin) {
@@ -237,54 +270,70 @@ void OpenKeyHelper::setClipboardText(LPCTSTR data, const int & len, const int& t
 	CloseClipboard();
 }
 
-bool OpenKeyHelper::quickConvert() {
-	//read data from clipboard
+void OpenKeyHelper::readQuickConvertJob(vConvertJob& job, void* context) {
+	//read data from clipboard, on the worker thread of the job
 	//support Unicode raw string, Rich Text Format and HTML
 
 	if (!OpenClipboard(nullptr)) {
-		return false;
+		return;
 	}
 
-	string dataHTML, dataRTF;
-	wstring dataUnicode;
-
-	char* pHTML = 0, pRTF = 0;
-	wchar_t* pUnicode = 0;
-
-	//HTML
+	//HTML: only text runs are converted, tags and header are kept
 	HANDLE hData = GetClipboardData(CF_HTML);
 	if (hData) {
-		pHTML = static_cast<char*>(GlobalLock(hData));
+		char* pHTML = static_cast<char*>(GlobalLock(hData));
+		if (pHTML) {
+			addConvertJobDocument(job, pHTML, vMarkupClipboardHtml);
+		}
 		GlobalUnlock(hData);
 	}
-	if (pHTML) {
-		dataHTML = pHTML;
-		dataHTML = convertUtil(dataHTML);
+
+	//RTF
+	hData = GetClipboardData(CF_RTF);
+	if (hData) {
+		char* pRTF = static_cast<char*>(GlobalLock(hData));
+		if (pRTF) {
+			addConvertJobDocument(job, pRTF, vMarkupRtf);
+		}
+		GlobalUnlock(hData);
 	}
 
 	//UNICODE
 	hData = GetClipboardData(CF_UNICODETEXT);
 	if (hData) {
-		pUnicode = static_cast<wchar_t*>(GlobalLock(hData));
+		wchar_t* pUnicode = static_cast<wchar_t*>(GlobalLock(hData));
+		if (pUnicode) {
+			addConvertJobDocument(job, wideStringToUtf8(pUnicode), CONVERT_JOB_TEXT);
+		}
 		GlobalUnlock(hData);
 	}
-	if (pUnicode) {
-		dataUnicode = pUnicode;
-		dataUnicode = utf8ToWideString(convertUtil(wideStringToUtf8(dataUnicode)));
+
+	CloseClipboard();
+}
+
+bool OpenKeyHelper::writeQuickConvertJob(const vConvertJob& job) {
+	if (job.status != vConvertJobCompleted || job.documents.empty() || !OpenClipboard(nullptr)) {
+		return false;
 	}
 
-	OpenClipboard(0);
 	EmptyClipboard();
 
-	HGLOBAL hMem = GlobalAlloc(GMEM_MOVEABLE, (int)(dataHTML.size() + 1) * sizeof(char));
-	memcpy(GlobalLock(hMem), dataHTML.c_str(), (int)(dataHTML.size() + 1) * sizeof(char));
-	GlobalUnlock(hMem);
-	SetClipboardData(CF_HTML, hMem);
-
-	hMem = GlobalAlloc(GMEM_MOVEABLE, (int)(dataUnicode.size() + 1) * sizeof(wchar_t));
-	memcpy(GlobalLock(hMem), dataUnicode.c_str(), (int)(dataUnicode.size() + 1) * sizeof(wchar_t));
-	GlobalUnlock(hMem);
-	SetClipboardData(CF_UNICODETEXT, hMem);
+	HGLOBAL hMem;
+	wstring dataUnicode;
+	for (const vConvertJobDocument& document : job.documents) {
+		if (document.format == CONVERT_JOB_TEXT) {
+			dataUnicode = utf8ToWideString(document.output);
+			hMem = GlobalAlloc(GMEM_MOVEABLE, (int)(dataUnicode.size() + 1) * sizeof(wchar_t));
+			memcpy(GlobalLock(hMem), dataUnicode.c_str(), (int)(dataUnicode.size() + 1) * sizeof(wchar_t));
+			GlobalUnlock(hMem);
+			SetClipboardData(CF_UNICODETEXT, hMem);
+		} else {
+			hMem = GlobalAlloc(GMEM_MOVEABLE, (int)(document.output.size() + 1) * sizeof(char));
+			memcpy(GlobalLock(hMem), document.output.c_str(), (int)(document.output.size() + 1) * sizeof(char));
+			GlobalUnlock(hMem);
+			SetClipboardData(document.format == vMarkupRtf ? CF_RTF : CF_HTML, hMem);
+		}
+	}
 
 	CloseClipboard();
 	return true;
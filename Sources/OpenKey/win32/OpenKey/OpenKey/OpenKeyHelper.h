@@ -28,6 +28,10 @@ public:
 	static void setRegBinary(LPCTSTR key, const BYTE* pData, const int& size);
 	static BYTE* getRegBinary(LPCTSTR key, DWORD& outSize);
 
+	static void saveMacroData();
+	static void loadMacroData();
+	static bool isMacroDataLoaded();
+
 	static void registerRunOnStartup(const int& val);
 
 	static LPTSTR getExecutePath();
@@ -40,7 +44,8 @@ public:
 	static wstring getClipboardText(const int& type);
 	static void setClipboardText(LPCTSTR data, const int& len, const int& type);
 
-	static bool quickConvert();
+	static void readQuickConvertJob(vConvertJob& job, void* context);
+	static bool writeQuickConvertJob(const vConvertJob& job);
 
 	static DWORD getVersionNumber();
 	static wstring getVersionString();
@@ -14,13 +14,11 @@ redistribute your new version, it MUST be open source.
 #include "SystemTrayHelper.h"
 #include "AppDelegate.h"
 #include "OpenKeyManager.h"
+#include "../../../engine/MacroChange.h"
 #include <Wtsapi32.h>
 
 #pragma comment(lib, "Wtsapi32.lib")
 
-// Extern declaration for macro engine function
-extern void initMacroMap(const Byte* pData, const int& size);
-
 #define TIMER_REINSTALL_HOOKS 1001
 
 #define WM_TRAYMESSAGE (WM_USER + 1)
@@ -142,18 +140,9 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 		APP_GET_DATA(vFixChromiumBrowser, 0);
 		APP_GET_DATA(vSendKeyStepByStep, 1);  // Clipboard send keys
 		
-		// Reload macro data from registry
-		// NOTE: getRegBinary returns a static pointer - DO NOT delete[] it
-		{
-			DWORD macroDataSize = 0;
-			BYTE* macroData = OpenKeyHelper::getRegBinary(_T("macroData"), macroDataSize);
-			if (macroData && macroDataSize > 0) {
-				initMacroMap(macroData, (int)macroDataSize);
-				// Do NOT delete[] macroData - it's a static pointer managed by OpenKeyHelper
-			} else {
-				// Empty/deleted macro data - clear the macro map
-				initMacroMap(nullptr, 0);
-			}
+		// Macro changes are sent with WM_COPYDATA, reload macro data only if another version is saved
+		if (!OpenKeyHelper::isMacroDataLoaded()) {
+			OpenKeyHelper::loadMacroData();
 		}
 		
 		// Reload English-only apps data from registry
@@ -172,6 +161,22 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 		SystemTrayHelper::updateData();
 		break;
 	
+	// Handle macro changes from MacroDialogSciter subprocess, it saves all macro data to registry
+	// before sending them, so reload the registry if they are made from other macro data
+	case WM_COPYDATA: {
+		COPYDATASTRUCT* copyData = (COPYDATASTRUCT*)lParam;
+		if (copyData == NULL || copyData->dwData != APP_COPYDATA_MACRO_CHANGES)
+			return FALSE;
+		const Byte* changeData = (const Byte*)copyData->lpData;
+		if (!applyMacroChanges(changeData, copyData->cbData)) {
+			OpenKeyHelper::loadMacroData();
+			vMacroVersion version; //the version of the sender, if macroVersion isn't saved
+			if (getMacroChangeVersion(changeData, copyData->cbData, version))
+				setMacroVersion(version);
+		}
+		return TRUE;
+	}
+
 	// Handle macro table open request from SettingsDialog subprocess
 	case WM_USER+103:
 		AppDelegate::getInstance()->onMacroTable();
@@ -181,6 +186,11 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 	case WM_USER+104:
 		AppDelegate::getInstance()->onSpawnExcludedAppsSciter();
 		break;
+
+	// Quick convert job is done (posted from its worker thread)
+	case WM_USER+105:
+		AppDelegate::getInstance()->onQuickConvertCompleted(wParam != 0);
+		break;
 		
 	// Handle session change (lock/unlock)
 	case WM_WTSSESSION_CHANGE:
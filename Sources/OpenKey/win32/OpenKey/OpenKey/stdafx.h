@@ -57,6 +57,7 @@ extern wchar_t _logBuffer[1024];
 #define APP_GET_DATA(KEY, DEFAULT_VAL) KEY = OpenKeyHelper::getRegInt(_T(#KEY), DEFAULT_VAL)
 
 #define APP_CLASS _T("OpenKeyVietnameseInputMethod")
+#define APP_COPYDATA_MACRO_CHANGES 0x4F4B4D43 // WM_COPYDATA: macro change data (engine/MacroChange.h)
 
 extern void saveSmartSwitchKeyData();
 